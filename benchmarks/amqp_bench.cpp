@@ -0,0 +1,69 @@
+#include "amqp_client.hpp"
+#include "support/loopback_broker.hpp"
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <thread>
+
+namespace {
+// sender and receiver connected through the in-process broker, shared by the benchmarks
+struct Loopback {
+	LoopbackBroker broker;
+	proton::container container;
+	std::thread container_thread;
+	std::unique_ptr<sender> snd;
+	std::unique_ptr<receiver> rcv;
+
+	Loopback() {
+		broker.route("del-bench", "loc-bench");
+		broker.start();
+		container.auto_stop(false);
+		container_thread = std::thread([this]() { container.run(); });
+		snd				 = std::make_unique<sender>(container, broker.url(), "del-bench");
+		rcv				 = std::make_unique<receiver>(container, broker.url(), "loc-bench");
+	}
+	~Loopback() {
+		container.stop();
+		container_thread.join();
+		snd.reset();
+		rcv.reset();
+		broker.stop();
+	}
+};
+
+proton::message bodyOf(size_t size) {
+	proton::message m;
+	m.body(proton::binary(std::string(size, 'x')));
+	return m;
+}
+} // namespace
+
+// One message at a time from sender::send() to receiver::receive(), the round trip through both queues
+static void BM_AmqpHandoff(benchmark::State& state) {
+	Loopback loopback;
+	auto message = bodyOf(state.range(0));
+	for (auto _ : state) {
+		loopback.snd->send(message);
+		benchmark::DoNotOptimize(loopback.rcv->receive());
+	}
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AmqpHandoff)->Arg(128)->Arg(1024)->UseRealTime();
+
+// Batches sent while a thread receives, the throughput of the pipelined hand-off
+static void BM_AmqpBatchThroughput(benchmark::State& state) {
+	Loopback loopback;
+	size_t batch_size = static_cast<size_t>(state.range(0));
+	std::vector<std::shared_ptr<const proton::message>> batch(batch_size,
+															  std::make_shared<const proton::message>(bodyOf(256)));
+	for (auto _ : state) {
+		std::thread consumer([&]() {
+			for (size_t i = 0; i < batch_size; ++i) {
+				loopback.rcv->receive();
+			}
+		});
+		loopback.snd->send(batch);
+		consumer.join();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AmqpBatchThroughput)->Arg(16)->Arg(256)->UseRealTime();
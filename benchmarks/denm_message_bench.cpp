@@ -0,0 +1,77 @@
+#include "denm_message.hpp"
+#include <benchmark/benchmark.h>
+#include <chrono>
+
+namespace {
+// Payload shapes: 0 management container only, 1 with a situation container, 2 a termination of an event
+DenmMessage makeDenm(int shape) {
+	DenmMessage denm;
+	time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	denm.setStationId(1234567);
+	denm.setActionId(20);
+	denm.setDetectionTime(now);
+	denm.setReferenceTime(now);
+	denm.setEventPosition(57.779017, 12.774981, 190.0);
+	denm.setStationType(3);
+	if (shape >= 1) {
+		denm.setRelevanceDistance(RelevanceDistance_lessThan50m);
+		denm.setRelevanceTrafficDirection(RelevanceTrafficDirection_allTrafficDirections);
+		denm.setValidityDuration(std::chrono::seconds(600));
+		denm.setInformationQuality(3);
+		denm.setCauseCode(CauseCodeType_accident);
+		denm.setSubCauseCode(2);
+	}
+	if (shape == 2) {
+		denm.setTermination(Termination_isCancellation);
+	}
+	return denm;
+}
+
+void setShapeLabel(benchmark::State& state) {
+	static const char* const SHAPES[] = {"management", "situation", "termination"};
+	state.SetLabel(SHAPES[state.range(0)]);
+}
+} // namespace
+
+static void BM_DenmFromJson(benchmark::State& state) {
+	nlohmann::json j = makeDenm(state.range(0)).toJson();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(DenmMessage::fromJson(j));
+	}
+	setShapeLabel(state);
+}
+BENCHMARK(BM_DenmFromJson)->DenseRange(0, 2);
+
+static void BM_DenmToJson(benchmark::State& state) {
+	DenmMessage denm = makeDenm(state.range(0));
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(denm.toJson());
+	}
+	setShapeLabel(state);
+}
+BENCHMARK(BM_DenmToJson)->DenseRange(0, 2);
+
+static void BM_DenmGetUperEncoded(benchmark::State& state) {
+	DenmMessage denm = makeDenm(state.range(0));
+	size_t bytes	 = 0;
+	for (auto _ : state) {
+		auto uper = denm.getUperEncoded();
+		bytes += uper.size();
+		benchmark::DoNotOptimize(uper);
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(bytes));
+	setShapeLabel(state);
+}
+BENCHMARK(BM_DenmGetUperEncoded)->DenseRange(0, 2);
+
+static void BM_DenmFromUper(benchmark::State& state) {
+	auto uper = makeDenm(state.range(0)).getUperEncoded();
+	for (auto _ : state) {
+		DenmMessage denm;
+		denm.fromUper(uper);
+		benchmark::DoNotOptimize(denm);
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * uper.size()));
+	setShapeLabel(state);
+}
+BENCHMARK(BM_DenmFromUper)->DenseRange(0, 2);
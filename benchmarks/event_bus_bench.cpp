@@ -0,0 +1,29 @@
+#include "event_bus.hpp"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+// Publishing to 1..N subscribers, from 1..8 threads at once for the contention on the bus lock
+static void BM_EventBusPublish(benchmark::State& state) {
+	auto& bus = EventBus::getInstance();
+	static std::vector<EventBus::SubscriptionId> subscriptions;
+	if (state.thread_index() == 0) {
+		for (int64_t i = 0; i < state.range(0); ++i) {
+			subscriptions.push_back(
+			  bus.subscribe("bench.publish", [](const nlohmann::json& j) { benchmark::DoNotOptimize(&j); }));
+		}
+	}
+	nlohmann::json denm = {{"publisherId", "NO00001"}, {"latitude", 59.91}, {"longitude", 10.75}};
+
+	for (auto _ : state) {
+		bus.publish("bench.publish", denm);
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+
+	if (state.thread_index() == 0) {
+		for (auto id : subscriptions) {
+			bus.unsubscribe("bench.publish", id);
+		}
+		subscriptions.clear();
+	}
+}
+BENCHMARK(BM_EventBusPublish)->RangeMultiplier(4)->Range(1, 64)->ThreadRange(1, 8)->UseRealTime();
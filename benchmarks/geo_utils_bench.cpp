@@ -0,0 +1,15 @@
+#include "geo_utils.hpp"
+#include <benchmark/benchmark.h>
+
+static void BM_CalculateQuadTree(benchmark::State& state) {
+	int zoom   = static_cast<int>(state.range(0));
+	double lat = 57.779017;
+	double lon = 12.774981;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(calculateQuadTree(lat, lon, zoom));
+		// Vary the position a little so every call computes a different tile
+		lat += 1e-6;
+		lon += 1e-6;
+	}
+}
+BENCHMARK(BM_CalculateQuadTree)->Arg(1)->Arg(8)->Arg(12)->Arg(18)->Arg(23);
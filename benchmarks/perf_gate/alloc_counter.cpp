@@ -0,0 +1,102 @@
+#include "alloc_counter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<uint64_t> allocations{0};
+std::atomic<uint64_t> allocated_bytes{0};
+
+void* allocate(std::size_t size) noexcept {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	return std::malloc(size ? size : 1);
+}
+
+void* allocateAligned(std::size_t size, std::align_val_t alignment) noexcept {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	// aligned_alloc wants a multiple of the alignment
+	auto align = static_cast<std::size_t>(alignment);
+	return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+} // namespace
+
+AllocationCount allocationCount() {
+	return AllocationCount{allocations.load(std::memory_order_relaxed),
+						   allocated_bytes.load(std::memory_order_relaxed)};
+}
+
+void CountingMemoryManager::Start() {
+	start_ = allocationCount();
+}
+
+void CountingMemoryManager::Stop(Result& result) {
+	AllocationCount now			 = allocationCount();
+	result.num_allocs			 = static_cast<int64_t>(now.allocations - start_.allocations);
+	result.total_allocated_bytes = static_cast<int64_t>(now.bytes - start_.bytes);
+}
+
+void* operator new(std::size_t size) {
+	if (void* p = allocate(size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	if (void* p = allocate(size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	if (void* p = allocateAligned(size, alignment))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+	if (void* p = allocateAligned(size, alignment))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+	std::free(p);
+}
@@ -0,0 +1,30 @@
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+
+// Counts of the global operator new of the executable it is linked into.
+//
+// alloc_counter.cpp replaces the global operator new and delete with versions that count every allocation
+// before handing it to malloc. The counters are process-wide and relaxed, so they take allocations of every
+// thread, including the loopback broker and proton's threads, but not malloc calls made by C code such as the
+// asn1c encoders in Vanetza or proton-c.
+struct AllocationCount {
+	uint64_t allocations = 0;
+	uint64_t bytes		 = 0;
+};
+
+AllocationCount allocationCount();
+
+// Reports the allocations of every benchmark run to Google Benchmark as allocs_per_iter
+class CountingMemoryManager : public benchmark::MemoryManager {
+public:
+	void Start() override;
+	void Stop(Result& result) override;
+
+private:
+	AllocationCount start_;
+};
+
+#endif // ALLOC_COUNTER_HPP
@@ -0,0 +1,141 @@
+#include "loopback_scenario.hpp"
+#include "alloc_counter.hpp"
+#include "event_bus.hpp"
+#include "interchange_service.hpp"
+#include "support/loopback_broker.hpp"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+const char* const SEND_ADDRESS	  = "del-perf";
+const char* const RECEIVE_ADDRESS = "loc-perf";
+
+double percentileUs(const std::vector<int64_t>& sorted, double quantile) {
+	if (sorted.empty())
+		return 0;
+	size_t rank = static_cast<size_t>(std::ceil(quantile * sorted.size()));
+	return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1] / 1e3;
+}
+} // namespace
+
+LoopbackScenario::LoopbackScenario(const ScenarioOptions& options) :
+  options_(options) {
+	options_.messages = std::max<size_t>(options_.messages, 1);
+	options_.window	  = std::max<size_t>(options_.window, 1);
+}
+
+nlohmann::json LoopbackScenario::makeDenm(uint64_t i) {
+	uint32_t station = FIRST_STATION + static_cast<uint32_t>(i);
+	// Spread over a few kilometres, so the quadtree keys differ too
+	double latitude	 = 57.70 + (i % 100) * 0.001;
+	double longitude = 12.70 + (i / 100 % 100) * 0.001;
+
+	nlohmann::json data;
+	data["header"]	   = {{"protocolVersion", 2}, {"messageId", 1}, {"stationId", station}};
+	data["management"] = {{"actionId", station},
+						  {"sequenceNumber", i & 0xffff},
+						  {"stationType", 3},
+						  {"validityDuration", 600},
+						  {"eventPosition", {{"latitude", latitude}, {"longitude", longitude}, {"altitude", 190.0}}}};
+	data["situation"]  = {{"informationQuality", 3}, {"causeCode", 2}, {"subCauseCode", 0}};
+
+	return {{"publisherId", "SE00001"},
+			{"publicationId", "SE00001:PERF"},
+			{"originatingCountry", "SE"},
+			{"protocolVersion", "DENM:1.2.2"},
+			{"messageType", "DENM"},
+			{"latitude", latitude},
+			{"longitude", longitude},
+			{"data", std::move(data)}};
+}
+
+ScenarioResult LoopbackScenario::run() {
+	size_t total = options_.warmup + options_.messages;
+	std::vector<nlohmann::json> denms;
+	denms.reserve(total);
+	for (size_t i = 0; i < total; ++i) {
+		denms.push_back(makeDenm(i));
+	}
+
+	std::mutex lock;
+	std::condition_variable arrived;
+	std::vector<Clock::time_point> sent(total);
+	std::vector<int64_t> latencies_ns;
+	latencies_ns.reserve(options_.messages);
+	size_t received = 0;
+
+	LoopbackBroker broker;
+	broker.route(SEND_ADDRESS, RECEIVE_ADDRESS);
+	broker.start();
+
+	auto& bus		  = EventBus::getInstance();
+	auto subscription = bus.subscribe("denm.incoming", [&](const nlohmann::json& denm) {
+		auto now		 = Clock::now();
+		uint64_t station = denm["header"]["stationId"].get<uint64_t>();
+		if (station < FIRST_STATION || station - FIRST_STATION >= total)
+			return;
+		size_t i = station - FIRST_STATION;
+		std::lock_guard<std::mutex> l(lock);
+		if (i >= options_.warmup)
+			latencies_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - sent[i]).count());
+		++received;
+		arrived.notify_all();
+	});
+
+	// Wait until fewer than `in_flight` DENMs are on their way
+	auto waitFor = [&](std::unique_lock<std::mutex>& l, size_t sent_count, size_t in_flight) {
+		if (!arrived.wait_for(l, options_.timeout, [&]() { return sent_count - received < in_flight; }))
+			throw std::runtime_error("DENMs stopped coming back, " + std::to_string(received) + " of " +
+									 std::to_string(sent_count) + " received");
+	};
+
+	ScenarioResult result;
+	try {
+		InterchangeService interchange("perf", broker.url(), SEND_ADDRESS, RECEIVE_ADDRESS, "");
+		interchange.start();
+
+		AllocationCount allocations_before;
+		Clock::time_point start;
+		for (size_t i = 0; i < total; ++i) {
+			if (i == options_.warmup) {
+				std::unique_lock<std::mutex> l(lock);
+				waitFor(l, i, 1);
+				allocations_before = allocationCount();
+				start			   = Clock::now();
+			}
+			{
+				std::unique_lock<std::mutex> l(lock);
+				waitFor(l, i, options_.window);
+				sent[i] = Clock::now();
+			}
+			bus.publish("denm.outgoing", denms[i]);
+		}
+		{
+			std::unique_lock<std::mutex> l(lock);
+			waitFor(l, total, 1);
+		}
+		auto end			  = Clock::now();
+		AllocationCount after = allocationCount();
+
+		std::sort(latencies_ns.begin(), latencies_ns.end());
+		result.messages			  = options_.messages;
+		result.seconds			  = std::chrono::duration<double>(end - start).count();
+		result.throughput		  = result.seconds > 0 ? options_.messages / result.seconds : 0;
+		result.p50_us			  = percentileUs(latencies_ns, 0.50);
+		result.p99_us			  = percentileUs(latencies_ns, 0.99);
+		result.allocs_per_message = double(after.allocations - allocations_before.allocations) / options_.messages;
+	} catch (...) {
+		bus.unsubscribe("denm.incoming", subscription);
+		broker.stop();
+		throw;
+	}
+	bus.unsubscribe("denm.incoming", subscription);
+	broker.stop();
+	return result;
+}
@@ -0,0 +1,48 @@
+#ifndef LOOPBACK_SCENARIO_HPP
+#define LOOPBACK_SCENARIO_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+
+struct ScenarioOptions {
+	size_t warmup	= 200;	// DENMs sent before measuring, not recorded
+	size_t messages = 5000; // DENMs measured
+	size_t window	= 32;	// DENMs in flight at most (closed loop)
+	std::chrono::seconds timeout{10};
+};
+
+struct ScenarioResult {
+	size_t messages			  = 0;
+	double seconds			  = 0;
+	double throughput		  = 0; // DENMs per second
+	double p50_us			  = 0;
+	double p99_us			  = 0;
+	double allocs_per_message = 0;
+};
+
+// Outgoing DENMs through the interchange and the loopback broker back in as incoming DENMs.
+//
+// An InterchangeService is started against an in-process broker routing its send address to its receive
+// address. DENMs are published as "denm.outgoing" on the EventBus, at most `window` of them waiting to come
+// back as "denm.incoming" at any time, and every DENM is timed from publishing to its arrival. DENM i carries
+// stationId FIRST_STATION + i, which is unique, so neither the decode cache nor duplicate dropping shortcut
+// it. Allocations are those of the whole process over the measured DENMs, see alloc_counter.hpp.
+class LoopbackScenario {
+public:
+	static constexpr uint32_t FIRST_STATION = 2000000;
+
+	explicit LoopbackScenario(const ScenarioOptions& options);
+
+	// Throws std::runtime_error if DENMs stop coming back for the timeout
+	ScenarioResult run();
+
+	// The DENM with index i
+	static nlohmann::json makeDenm(uint64_t i);
+
+private:
+	ScenarioOptions options_;
+};
+
+#endif // LOOPBACK_SCENARIO_HPP
@@ -0,0 +1,181 @@
+#include "alloc_counter.hpp"
+#include "loopback_scenario.hpp"
+#include "perf_baseline.hpp"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <boost/program_options.hpp>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace {
+// Exit code of a run that was not gated, ctest's SKIP_RETURN_CODE of the perf_gate test
+const int NOT_GATED = 77;
+
+// Console output as usual, and the fastest repetition of every benchmark for the gate
+class CollectingReporter : public benchmark::ConsoleReporter {
+public:
+	void ReportRuns(const std::vector<Run>& runs) override {
+		ConsoleReporter::ReportRuns(runs);
+		for (const auto& run : runs) {
+			if (run.run_type != Run::RT_Iteration)
+				continue;
+			double ns	 = run.GetAdjustedRealTime() * 1e9 / benchmark::GetTimeUnitMultiplier(run.time_unit);
+			auto& result = results_[run.benchmark_name()];
+			result.ns	 = result.ns > 0 ? std::min(result.ns, ns) : ns;
+			// Only the runs measured with the memory manager carry allocations
+			if (run.memory_result)
+				result.allocs = run.allocs_per_iter;
+		}
+	}
+
+	void addMetrics(std::vector<Metric>& metrics) const {
+		for (const auto& result : results_) {
+			metrics.push_back(Metric{result.first + "/realTime", MetricKind::Time, result.second.ns, "ns"});
+			if (result.second.allocs >= 0) {
+				metrics.push_back(
+				  Metric{result.first + "/allocs", MetricKind::Allocations, result.second.allocs, "allocs"});
+			}
+		}
+	}
+
+private:
+	struct Result {
+		double ns	  = 0;
+		double allocs = -1;
+	};
+	std::map<std::string, Result> results_;
+};
+
+void printComparisons(const std::vector<Comparison>& comparisons) {
+	std::printf("%-48s %14s %14s %9s %9s  %s\n", "metric", "measured", "baseline", "change", "tolerance", "verdict");
+	for (const auto& c : comparisons) {
+		bool compared = c.verdict != Verdict::NoBaseline && c.verdict != Verdict::NotRun;
+		std::printf("%-48s %14s %14s %9s %9s  %s\n",
+					c.name.c_str(),
+					c.verdict == Verdict::NotRun ? "-" : fmt::format("{:.2f} {}", c.measured, c.unit).c_str(),
+					c.verdict == Verdict::NoBaseline ? "-" : fmt::format("{:.2f} {}", c.baseline, c.unit).c_str(),
+					compared ? fmt::format("{:+.1f}%", c.change * 100).c_str() : "-",
+					c.verdict == Verdict::NotRun ? "-" : fmt::format("{:.0f}%", c.tolerance * 100).c_str(),
+					toString(c.verdict));
+	}
+}
+} // namespace
+
+int main(int argc, char** argv) {
+	try {
+		namespace po = boost::program_options;
+
+		po::options_description desc("Allowed options, the --benchmark_* options of Google Benchmark are passed on");
+		desc.add_options()("help,h", "produce help message")(
+		  "baseline,b", po::value<std::string>()->required(), "baseline file to compare with")(
+		  "update-baseline", po::bool_switch(), "replace the baseline with the measured values instead")(
+		  "build-type",
+		  po::value<std::string>()->required(),
+		  "build type of this build, the baseline only gates builds of the type it was measured in")(
+		  "messages", po::value<size_t>()->default_value(5000), "DENMs measured in the loopback scenario")(
+		  "window", po::value<size_t>()->default_value(32), "DENMs in flight at most in the loopback scenario")(
+		  "skip-scenario", po::bool_switch(), "only run the micro-benchmarks")(
+		  "log-level,l", po::value<std::string>()->default_value("warn"), "logging level (debug, info, warn, error)");
+
+		po::variables_map vm;
+		auto parsed = po::command_line_parser(argc, argv).options(desc).allow_unregistered().run();
+		po::store(parsed, vm);
+		if (vm.count("help")) {
+			std::cout << desc << "\n";
+			return 0;
+		}
+		po::notify(vm);
+		spdlog::set_level(spdlog::level::from_str(vm["log-level"].as<std::string>()));
+
+		std::string baseline_path = vm["baseline"].as<std::string>();
+		std::string build_type	  = vm["build-type"].as<std::string>();
+		PerfBaseline baseline	  = PerfBaseline::load(baseline_path);
+		// An empty $<CONFIG> of a single-config build without CMAKE_BUILD_TYPE
+		if (build_type.empty())
+			throw std::runtime_error("--build-type is empty, configure with -DCMAKE_BUILD_TYPE=Release");
+
+		// Micro-benchmarks, with their allocations counted
+		auto unrecognized = po::collect_unrecognized(parsed.options, po::include_positional);
+		std::vector<char*> benchmark_argv{argv[0]};
+		for (auto& arg : unrecognized) {
+			benchmark_argv.push_back(arg.data());
+		}
+		int benchmark_argc = static_cast<int>(benchmark_argv.size());
+		benchmark::Initialize(&benchmark_argc, benchmark_argv.data());
+		if (benchmark::ReportUnrecognizedArguments(benchmark_argc, benchmark_argv.data()))
+			return 1;
+		CountingMemoryManager memory_manager;
+		benchmark::RegisterMemoryManager(&memory_manager);
+		CollectingReporter reporter;
+		benchmark::RunSpecifiedBenchmarks(&reporter);
+		benchmark::RegisterMemoryManager(nullptr);
+		benchmark::Shutdown();
+
+		std::vector<Metric> metrics;
+		reporter.addMetrics(metrics);
+
+		if (!vm["skip-scenario"].as<bool>()) {
+			ScenarioOptions options;
+			options.messages = vm["messages"].as<size_t>();
+			options.window	 = vm["window"].as<size_t>();
+			auto result		 = LoopbackScenario(options).run();
+			std::printf("\nLoopback: %zu DENMs in %.2f s, %.0f/s, p50 %.1f us, p99 %.1f us, %.1f allocs per DENM\n\n",
+						result.messages,
+						result.seconds,
+						result.throughput,
+						result.p50_us,
+						result.p99_us,
+						result.allocs_per_message);
+			metrics.push_back(Metric{"loopback/throughput", MetricKind::Throughput, result.throughput, "/s"});
+			metrics.push_back(Metric{"loopback/p50", MetricKind::Time, result.p50_us, "us"});
+			metrics.push_back(Metric{"loopback/p99", MetricKind::Time, result.p99_us, "us"});
+			metrics.push_back(
+			  Metric{"loopback/allocsPerDenm", MetricKind::Allocations, result.allocs_per_message, "allocs"});
+		}
+
+		if (vm["update-baseline"].as<bool>()) {
+			baseline.update(metrics, build_type);
+			baseline.save(baseline_path);
+			std::printf("Wrote %zu metrics to %s\n", metrics.size(), baseline_path.c_str());
+			return 0;
+		}
+
+		auto comparisons = baseline.compare(metrics);
+		printComparisons(comparisons);
+
+		auto count = [&comparisons](Verdict verdict) {
+			return std::count_if(
+			  comparisons.begin(), comparisons.end(), [verdict](const Comparison& c) { return c.verdict == verdict; });
+		};
+		size_t regressions = count(Verdict::Regressed);
+		size_t unmeasured  = count(Verdict::NoBaseline);
+		if (unmeasured > 0) {
+			std::printf("\n%zu metrics have no baseline yet, record them with --update-baseline\n", unmeasured);
+		}
+		if (unmeasured == metrics.size()) {
+			spdlog::error("{} has no values for any of the {} measured metrics, nothing was gated",
+						  baseline_path,
+						  metrics.size());
+			return 1;
+		}
+		// Timings of a Debug build say nothing about a Release baseline
+		if (baseline.buildType() != build_type) {
+			spdlog::warn("The baseline was measured in a {} build and this is a {} build, NOT GATED",
+						 baseline.buildType().empty() ? "unknown" : baseline.buildType(),
+						 build_type);
+			return NOT_GATED;
+		}
+		if (regressions > 0) {
+			spdlog::error("{} metrics regressed beyond their tolerance", regressions);
+			return 1;
+		}
+		return 0;
+	} catch (const std::exception& e) {
+		spdlog::error("Error: {}", e.what());
+		return 1;
+	}
+}
@@ -0,0 +1,128 @@
+#include "perf_baseline.hpp"
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+namespace {
+const char* const KIND_NAMES[]	  = {"time", "throughput", "allocations"};
+const char* const VERDICT_NAMES[] = {"ok", "REGRESSED", "improved", "no baseline", "not run"};
+// Tolerances of a baseline without its own
+const double DEFAULT_TOLERANCES[] = {0.25, 0.25, 0.05};
+// Allocation counts are averages over a few iterations that include some of the harness's own, so fewer than
+// half an allocation more is never a regression. A whole allocation more per iteration always is one
+const double ALLOCATION_SLACK = 0.5;
+} // namespace
+
+const char* toString(MetricKind kind) {
+	return KIND_NAMES[static_cast<size_t>(kind)];
+}
+
+const char* toString(Verdict verdict) {
+	return VERDICT_NAMES[static_cast<size_t>(verdict)];
+}
+
+PerfBaseline PerfBaseline::load(const std::string& path) {
+	std::ifstream in(path);
+	if (!in)
+		throw std::runtime_error("Failed to open baseline " + path);
+	PerfBaseline baseline;
+	try {
+		baseline.json_ = nlohmann::json::parse(in);
+	} catch (const nlohmann::json::exception& e) {
+		throw std::runtime_error("Failed to parse baseline " + path + ": " + e.what());
+	}
+	if (!baseline.json_.is_object())
+		throw std::runtime_error("Baseline " + path + " is not a JSON object");
+	return baseline;
+}
+
+void PerfBaseline::save(const std::string& path) const {
+	// Written aside and renamed, like the trace file
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream out(temporary, std::ios::trunc);
+		out << json_.dump(2) << "\n";
+		if (!out)
+			throw std::runtime_error("Failed to write baseline " + temporary);
+	}
+	if (std::rename(temporary.c_str(), path.c_str()) != 0)
+		throw std::runtime_error("Failed to replace baseline " + path);
+}
+
+std::string PerfBaseline::buildType() const {
+	return json_.value("buildType", "");
+}
+
+double PerfBaseline::tolerance(const std::string& name, MetricKind kind) const {
+	const nlohmann::json metrics = json_.value("metrics", nlohmann::json::object());
+	const nlohmann::json metric	 = metrics.value(name, nlohmann::json::object());
+	if (metric.contains("tolerance"))
+		return metric["tolerance"].get<double>();
+	const nlohmann::json defaults = json_.value("tolerance", nlohmann::json::object());
+	return defaults.value(toString(kind), DEFAULT_TOLERANCES[static_cast<size_t>(kind)]);
+}
+
+std::vector<Comparison> PerfBaseline::compare(const std::vector<Metric>& metrics) const {
+	const nlohmann::json baseline = json_.value("metrics", nlohmann::json::object());
+	std::vector<Comparison> comparisons;
+	std::set<std::string> measured;
+	for (const auto& metric : metrics) {
+		measured.insert(metric.name);
+		Comparison c;
+		c.name		= metric.name;
+		c.unit		= metric.unit;
+		c.measured	= metric.value;
+		c.tolerance = tolerance(metric.name, metric.kind);
+
+		auto entry = baseline.find(metric.name);
+		if (entry == baseline.end() || !entry->contains("value") || !(*entry)["value"].is_number()) {
+			c.verdict = Verdict::NoBaseline;
+			comparisons.push_back(c);
+			continue;
+		}
+		c.baseline = (*entry)["value"].get<double>();
+		c.change   = c.baseline != 0 ? (c.measured - c.baseline) / c.baseline : (c.measured > 0 ? 1 : 0);
+
+		// Positive when worse
+		double worse	= metric.kind == MetricKind::Throughput ? -c.change : c.change;
+		bool negligible = metric.kind == MetricKind::Allocations && c.measured - c.baseline < ALLOCATION_SLACK;
+		if (worse > c.tolerance && !negligible) {
+			c.verdict = Verdict::Regressed;
+		} else if (worse < -c.tolerance) {
+			c.verdict = Verdict::Improved;
+		}
+		comparisons.push_back(c);
+	}
+
+	for (const auto& entry : baseline.items()) {
+		if (measured.count(entry.key()))
+			continue;
+		Comparison c;
+		c.name	   = entry.key();
+		c.unit	   = entry.value().value("unit", "");
+		c.baseline = entry.value().value("value", 0.0);
+		c.verdict  = Verdict::NotRun;
+		comparisons.push_back(c);
+	}
+	return comparisons;
+}
+
+void PerfBaseline::update(const std::vector<Metric>& metrics, const std::string& build_type) {
+	// Metrics this run did not measure, e.g. the scenario with --skip-scenario, keep their entries
+	nlohmann::json updated = json_.value("metrics", nlohmann::json::object());
+	for (const auto& metric : metrics) {
+		nlohmann::json entry = {{"kind", toString(metric.kind)}, {"value", metric.value}, {"unit", metric.unit}};
+		auto old			 = updated.find(metric.name);
+		if (old != updated.end() && old->contains("tolerance"))
+			entry["tolerance"] = (*old)["tolerance"];
+		updated[metric.name] = std::move(entry);
+	}
+	json_["buildType"] = build_type;
+	if (!json_.contains("tolerance")) {
+		for (auto kind : {MetricKind::Time, MetricKind::Throughput, MetricKind::Allocations}) {
+			json_["tolerance"][toString(kind)] = DEFAULT_TOLERANCES[static_cast<size_t>(kind)];
+		}
+	}
+	json_["metrics"] = std::move(updated);
+}
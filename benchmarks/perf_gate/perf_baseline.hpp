@@ -0,0 +1,72 @@
+#ifndef PERF_BASELINE_HPP
+#define PERF_BASELINE_HPP
+
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+// What a metric measures, which decides whether higher is worse and its default tolerance
+enum class MetricKind {
+	Time,		 // Latency or time per iteration, a regression when higher
+	Throughput,	 // Items per second, a regression when lower
+	Allocations, // Allocations per iteration or message, a regression when higher
+};
+const char* toString(MetricKind kind);
+
+struct Metric {
+	std::string name;
+	MetricKind kind;
+	double value;
+	std::string unit;
+};
+
+enum class Verdict {
+	Pass,
+	Regressed,	// Worse than the baseline by more than the tolerance
+	Improved,	// Better than the baseline by more than the tolerance, time to update it
+	NoBaseline, // Measured, but not in the baseline yet
+	NotRun,		// In the baseline, but not measured in this run
+};
+const char* toString(Verdict verdict);
+
+struct Comparison {
+	std::string name;
+	std::string unit;
+	double measured	 = 0;
+	double baseline	 = 0;
+	double tolerance = 0;
+	double change	 = 0; // (measured - baseline) / baseline
+	Verdict verdict	 = Verdict::Pass;
+};
+
+// Committed values of the gated metrics and the tolerance bands they may move in.
+//
+// The file holds
+//   {"buildType": "Release",
+//    "tolerance": {"time": 0.25, "throughput": 0.25, "allocations": 0.05},
+//    "metrics": {"BM_DenmToJson/0/realTime": {"kind": "time", "value": 1830.2, "unit": "ns"}, ...}}
+// where a metric may carry its own "tolerance". Tolerances are fractions of the baseline value; a metric
+// regresses when it is worse than its value by more than that, and allocations only once they are at least
+// half an allocation more.
+class PerfBaseline {
+public:
+	// Throws std::runtime_error if the file cannot be read or parsed
+	static PerfBaseline load(const std::string& path);
+	// Replace `path` with the baseline. Throws std::runtime_error if the file cannot be written
+	void save(const std::string& path) const;
+
+	// Build type the values were measured in, empty if none was recorded
+	std::string buildType() const;
+	double tolerance(const std::string& name, MetricKind kind) const;
+
+	// One comparison per measured metric, followed by the baseline metrics that were not measured
+	std::vector<Comparison> compare(const std::vector<Metric>& metrics) const;
+	// Take `metrics` as the new values, keeping the tolerances of metrics already in the baseline. Metrics that
+	// were not measured are left as they are
+	void update(const std::vector<Metric>& metrics, const std::string& build_type);
+
+private:
+	nlohmann::json json_;
+};
+
+#endif // PERF_BASELINE_HPP
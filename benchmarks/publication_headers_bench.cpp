@@ -0,0 +1,62 @@
+#include "message_pool.hpp"
+#include "publication_headers.hpp"
+#include <benchmark/benchmark.h>
+#include <proton/duration.hpp>
+#include <vector>
+
+namespace {
+nlohmann::json request() {
+	return {{"messageType", "DENM"},
+			{"protocolVersion", "DENM:1.2.2"},
+			{"publisherId", "NO00001"},
+			{"publicationId", "NO00001:DENM-PUBLICATION-0001"},
+			{"originatingCountry", "NO"},
+			{"quadTree", ",12020330213302030,"}};
+}
+
+// The per message properties, set either way
+void putMessageProperties(const nlohmann::json& j, proton::message& msg) {
+	auto& props = msg.properties();
+	props.put("causeCode", 3);
+	props.put("quadTree", j["quadTree"].get<std::string>());
+}
+} // namespace
+
+// Headers and publication level properties built from the request for every message, as before the cache
+static void BM_PublicationHeadersPerMessage(benchmark::State& state) {
+	MessagePool pool;
+	auto j = request();
+	std::vector<char> encoded;
+	for (auto _ : state) {
+		auto msg = pool.acquire();
+		msg->durable(true);
+		msg->ttl(proton::duration(3600000));
+		msg->user("interchange-user");
+		msg->to("del-queue");
+		for (const char* key : PublicationHeaders::KEYS) {
+			msg->properties().put(key, j.at(key).get<std::string>());
+		}
+		putMessageProperties(j, *msg);
+		msg->encode(encoded);
+		benchmark::DoNotOptimize(encoded.data());
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PublicationHeadersPerMessage);
+
+// The same message with the headers and properties applied from the publication cache
+static void BM_PublicationHeadersCached(benchmark::State& state) {
+	MessagePool pool;
+	PublicationHeaderCache cache("interchange-user", "del-queue");
+	auto j = request();
+	std::vector<char> encoded;
+	for (auto _ : state) {
+		auto msg = pool.acquire();
+		cache.get(j)->applyTo(*msg);
+		putMessageProperties(j, *msg);
+		msg->encode(encoded);
+		benchmark::DoNotOptimize(encoded.data());
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PublicationHeadersCached);
@@ -40,6 +40,16 @@ FetchContent_Declare(
     GIT_TAG release-1.12.1
 )
 
+# Add Google Benchmark
+FetchContent_Declare(
+    googlebenchmark
+    GIT_REPOSITORY https://github.com/google/benchmark.git
+    GIT_TAG v1.8.3
+)
+# Only the library, not its own tests
+set(BENCHMARK_ENABLE_TESTING OFF CACHE BOOL "" FORCE)
+set(BENCHMARK_ENABLE_GTEST_TESTS OFF CACHE BOOL "" FORCE)
+
 # Include dependencies as subdirectories:
 
 # Set options for specific packages. See respective options file in cmake/xxxOptions.cmake
@@ -50,4 +60,5 @@ FetchContent_MakeAvailable(
 	crow
 	json
 	googletest
+	googlebenchmark
 )
@@ -1,14 +1,21 @@
 #ifndef AMQP_CLIENT_HPP
 #define AMQP_CLIENT_HPP
 
+#include "trace.hpp"
+#include <chrono>
 #include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <proton/connection.hpp>
 #include <proton/container.hpp>
 #include <proton/message.hpp>
 #include <proton/messaging_handler.hpp>
+#include <proton/tracker.hpp>
 #include <queue>
 #include <string>
+#include <vector>
 
 // Exception raised if a sender or receiver is closed when trying to send/receive
 class closed : public std::runtime_error {
@@ -17,7 +24,11 @@ public:
 	  std::runtime_error(msg) {}
 };
 
-// A thread-safe sending connection
+// Trace context of a message from its "traceparent" application property, unsampled without one
+TraceContext traceContextOf(const proton::message& m);
+
+// A thread-safe sending connection. If the connection fails for good, i.e. is not reconnected by the
+// container's reconnect options, sending throws `closed`
 class sender : private proton::messaging_handler {
 public:
 	sender(proton::container& cont,
@@ -25,11 +36,23 @@ public:
 		   const std::string& address,
 		   const std::string& name = "sender");
 	void send(const proton::message& m);
+	// Send several messages with as few hand-offs to the connection thread as the credit allows
+	void send(const std::vector<std::shared_ptr<const proton::message>>& batch);
+	// Wait up to `timeout` until the link has credit, returns the number of messages that can be sent
+	// without blocking (0 on timeout). Throws `closed` once the connection failed
+	size_t wait_credit(std::chrono::milliseconds timeout);
 	void close();
 	std::string reply_address() const {
 		return address_ + "-reply";
 	}
 
+	// Called on the connection thread with the string message-id of every sent message that has one, and the
+	// remote outcome: "accepted", "rejected" or "released". Set before sending
+	using outcome_handler = std::function<void(const std::string& message_id, const std::string& outcome)>;
+	void on_outcome(outcome_handler handler) {
+		outcome_handler_ = std::move(handler);
+	}
+
 private:
 	proton::sender sender_;
 	std::mutex lock_;
@@ -37,21 +60,43 @@ private:
 	std::condition_variable sender_ready_;
 	int queued_;
 	int credit_;
+	bool closed_;
 	std::string address_;
+	outcome_handler outcome_handler_;
+	// A delivery waiting for its outcome, reported by message-id, or timed until settled if it is traced
+	struct Unsettled {
+		std::string message_id;
+		TraceContext trace;
+		Tracer::Clock::time_point sent_at;
+	};
+	// Unsettled deliveries by delivery tag, only used on the connection thread
+	std::map<proton::binary, Unsettled> unsettled_;
 
 	// Handler methods
 	void on_connection_open(proton::connection& c) override;
 	void on_sender_open(proton::sender& s) override;
 	void on_sendable(proton::sender& s) override;
+	void on_tracker_accept(proton::tracker& t) override;
+	void on_tracker_reject(proton::tracker& t) override;
+	void on_tracker_release(proton::tracker& t) override;
+	void on_tracker_settle(proton::tracker& t) override;
 	void on_error(const proton::error_condition& e) override;
 	void on_transport_error(proton::transport& t) override;
 	void on_connection_error(proton::connection& c) override;
 
+	// Null if the connection failed before the link opened
 	proton::work_queue* work_queue();
+	// Wake everything waiting for credit, they throw `closed`
+	void fail(const std::string& what);
+	// Block until a message can be queued, with `l` holding lock_. Throws `closed` once the connection failed
+	void wait_for_credit(std::unique_lock<std::mutex>& l);
 	void do_send(const proton::message& m);
+	void do_send(const std::vector<std::shared_ptr<const proton::message>>& batch);
+	void track(const proton::tracker& t, const proton::message& m);
+	void report(const proton::tracker& t, const std::string& outcome);
 };
 
-// A thread-safe receiving connection
+// A thread-safe receiving connection. If the connection fails for good, receive() throws `closed`
 class receiver : private proton::messaging_handler {
 public:
 	receiver(proton::container& cont,
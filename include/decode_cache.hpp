@@ -0,0 +1,44 @@
+#ifndef DECODE_CACHE_HPP
+#define DECODE_CACHE_HPP
+
+#include "incoming_denm.hpp"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Bounded LRU cache of decoded incoming DENMs keyed by the hash of their UPER body.
+//
+// DENMs are repeated by the originator at a fixed interval, so the interchange delivers byte-identical
+// bodies many times. A hit returns the previously decoded and serialized message instead of decoding it again.
+class DecodeCache {
+public:
+	explicit DecodeCache(size_t capacity = 4096) :
+	  capacity_(capacity) {}
+
+	// Return the cached message with an identical body, or nullptr. The body is compared in full, so hash
+	// collisions never return the wrong message
+	std::shared_ptr<const IncomingDenm> find(uint64_t hash, const std::vector<unsigned char>& body);
+	void insert(const std::shared_ptr<const IncomingDenm>& denm);
+
+	size_t size() const;
+	uint64_t hits() const {
+		return hits_;
+	}
+	uint64_t misses() const {
+		return misses_;
+	}
+
+private:
+	using Entry = std::shared_ptr<const IncomingDenm>;
+
+	size_t capacity_;
+	mutable std::mutex lock_;
+	std::list<Entry> lru_; // Most recently used first
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+	std::atomic<uint64_t> hits_{0};
+	std::atomic<uint64_t> misses_{0};
+};
+
+#endif // DECODE_CACHE_HPP
@@ -0,0 +1,69 @@
+#ifndef DELIVERY_STATUS_HPP
+#define DELIVERY_STATUS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+// Where an asynchronously published DENM is on its way to the broker
+enum class DeliveryState {
+	Pending,	// Accepted by the HTTP API, waiting for the publishing pipeline
+	Queued,		// Encoded and waiting for AMQP credit
+	Delivered,	// Accepted by the broker
+	Rejected,	// Rejected by the broker
+	Released,	// Released by the broker without being delivered
+	Superseded, // Replaced in the queue by a newer DENM for the same actionID before it was sent
+	Failed		// Invalid, or could not be queued
+};
+
+const char* toString(DeliveryState state);
+// Throws std::invalid_argument for unknown names
+DeliveryState deliveryStateFromString(const std::string& name);
+
+// Bounded table of the delivery state of asynchronously published DENMs, keyed by a generated message ID.
+//
+// The oldest entries are evicted once the table is full, so a status can only be looked up for a while after
+// the message was published. The first final state (delivered, rejected, released, superseded, failed) is
+// kept: updates from different threads may arrive out of order, and repetitions settle the message again.
+class DeliveryStatusTable {
+public:
+	explicit DeliveryStatusTable(size_t capacity = 100000);
+
+	// Register a new message as pending and return its ID
+	std::string create(int64_t now_ms = nowMs());
+	// Move a message to `state`. Unknown or evicted IDs are ignored
+	void update(const std::string& id, DeliveryState state, const std::string& error = "", int64_t now_ms = nowMs());
+	// {"id", "status", "error", "createdAt", "updatedAt"} with times in ms since the epoch, or nothing if the ID
+	// is unknown
+	std::optional<nlohmann::json> lookup(const std::string& id) const;
+
+	size_t size() const;
+
+	static int64_t nowMs();
+
+private:
+	struct Entry {
+		DeliveryState state;
+		std::string error;
+		int64_t created_ms;
+		int64_t updated_ms;
+	};
+
+	static bool isFinal(DeliveryState state) {
+		return state != DeliveryState::Pending && state != DeliveryState::Queued;
+	}
+
+	size_t capacity_;
+	uint64_t salt_;
+	uint64_t next_ = 0;
+	mutable std::mutex lock_;
+	std::unordered_map<std::string, Entry> entries_;
+	std::deque<std::string> order_; // Oldest first
+};
+
+#endif // DELIVERY_STATUS_HPP
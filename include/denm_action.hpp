@@ -0,0 +1,28 @@
+#ifndef DENM_ACTION_HPP
+#define DENM_ACTION_HPP
+
+#include <cstdint>
+
+// Identity and lifecycle fields of a DENM management container (ETSI EN 302 637-3). An event is identified
+// by its actionID, i.e. (originatingStationID, sequenceNumber); updates carry a newer referenceTime and
+// the event ends with a termination or when detectionTime + validityDuration has passed.
+struct DenmActionInfo {
+	enum class Termination { None, Cancellation, Negation };
+
+	uint32_t originating_station_id = 0;
+	uint16_t sequence_number		= 0;
+	int64_t detection_time_ms		= 0; // Unix epoch milliseconds
+	int64_t reference_time_ms		= 0; // Unix epoch milliseconds
+	uint32_t validity_duration_s	= 600; // ASN.1 default
+	Termination termination			= Termination::None;
+
+	// Key unique per actionID, usable as a hash map key
+	uint64_t key() const {
+		return (static_cast<uint64_t>(originating_station_id) << 16) | sequence_number;
+	}
+	int64_t expiresAtMs() const {
+		return detection_time_ms + static_cast<int64_t>(validity_duration_s) * 1000;
+	}
+};
+
+#endif // DENM_ACTION_HPP
@@ -0,0 +1,57 @@
+#ifndef DENM_BATCH_HPP
+#define DENM_BATCH_HPP
+
+#include "outgoing_denm.hpp"
+#include "rate_limiter.hpp"
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+// The DENMs of a POST /denm/batch body and the outcome of every one of them.
+//
+// Items are numbered in the order they were submitted. Items that are not JSON objects, lack a publisherId
+// or exceed the rate limit of their publisher are rejected here; the rest are sent as one OutgoingDenmBatch
+// and take the outcome the interchange reports for them.
+class DenmBatch {
+public:
+	enum class Format {
+		Array,	// A JSON array of DENMs
+		Ndjson, // One DENM per line, blank lines are skipped
+	};
+
+	// Throws std::invalid_argument if an array body is not JSON. Parsing stops after `max_items` + 1 items,
+	// see tooLarge()
+	DenmBatch(const std::string& body, Format format, size_t max_items);
+
+	size_t size() const {
+		return errors_.size();
+	}
+	bool tooLarge() const {
+		return size() > max_items_;
+	}
+
+	// Charge one request per item to the buckets of its publisherId and `ip`, the items a bucket has no
+	// token for are rejected. Returns the seconds until the next token if any item was rejected
+	double limit(RateLimiter& limiter, const std::string& ip);
+
+	// The items not rejected so far, each reported as not sent unless a subscriber takes the batch
+	std::shared_ptr<OutgoingDenmBatch> outgoing() const;
+	// Take the outcome of the items of `sent`, as returned by outgoing()
+	void report(const OutgoingDenmBatch& sent);
+
+	// Items not rejected so far
+	size_t pending() const;
+	// {"accepted": n, "rejected": n, "results": [{"index": i, "status": "accepted" or "rejected", "error"}]}
+	nlohmann::json results() const;
+
+private:
+	void add(nlohmann::json item);
+
+	size_t max_items_;
+	std::vector<nlohmann::json> items_;
+	std::vector<size_t> submitted_;	 // Item number of every entry in items_
+	std::vector<std::string> errors_; // Per item number, empty unless rejected
+};
+
+#endif // DENM_BATCH_HPP
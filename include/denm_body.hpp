@@ -0,0 +1,38 @@
+#ifndef DENM_BODY_HPP
+#define DENM_BODY_HPP
+
+#include "outgoing_denm.hpp"
+#include <functional>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <string>
+
+// Encoding of a POST /denm body, chosen by its Content-Type
+enum class DenmBodyFormat {
+	Json,
+	MessagePack, // application/msgpack, application/x-msgpack or application/vnd.msgpack
+	Cbor,		 // application/cbor
+	Uper,		 // application/octet-stream, the AMQP properties travel in X-* headers
+};
+
+DenmBodyFormat denmBodyFormat(const std::string& content_type);
+
+// The DENM document of a JSON, MessagePack or CBOR body; the binary formats carry the same document as JSON,
+// just more compact. Throws std::invalid_argument if the body does not parse
+nlohmann::json parseDenmBody(DenmBodyFormat format, const std::string& body);
+
+// The first AMQP property a UPER encoded DENM must have that `properties` lacks, empty if complete
+std::string missingProperty(const nlohmann::json& properties);
+
+// A UPER encoded `body` with the AMQP properties of its X-* headers, where `header` returns the value of a
+// header or an empty string. Throws std::invalid_argument if a required header is missing, a numeric header
+// does not parse or the body is empty
+std::shared_ptr<OutgoingUperDenm> uperDenmOf(const std::function<std::string(const char*)>& header,
+											 const std::string& body);
+
+// A binary WebSocket publish frame: a big-endian 16-bit header length, a MessagePack map of the AMQP properties
+// and the "id" the client chose, and the UPER encoded DENM. The id is returned in `id` and removed from the
+// properties. Throws std::invalid_argument if the frame is malformed or a required property is missing
+std::shared_ptr<OutgoingUperDenm> uperDenmOfFrame(const std::string& frame, nlohmann::json& id);
+
+#endif // DENM_BODY_HPP
@@ -0,0 +1,104 @@
+#ifndef DENM_LIFECYCLE_HPP
+#define DENM_LIFECYCLE_HPP
+
+#include "denm_action.hpp"
+#include "timer_wheel.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+enum class DenmDirection { Incoming, Outgoing };
+
+enum class DenmTransition {
+	New,		  // First DENM of an actionID
+	Update,		  // Newer referenceTime for a known actionID
+	Repetition,	  // Same referenceTime as the known state, nothing changed
+	Stale,		  // Older than the known state, already expired when seen, or terminating no known event
+	Cancellation, // Terminated by the originator
+	Negation,	  // Terminated by another station
+	Expiry		  // validityDuration passed without termination
+};
+
+const char* toString(DenmTransition transition);
+const char* toString(DenmDirection direction);
+
+// Shared form of a "denm.lifecycle" event, without the DENM, for subscribers that only need to know which
+// event changed
+struct DenmLifecycleEvent {
+	DenmTransition transition;
+	DenmDirection direction;
+	DenmActionInfo info;
+};
+
+// Table of active DENM events keyed by direction and actionID.
+//
+// Every DENM sent or received is applied to the table, which classifies it as a lifecycle transition.
+// State changes (new, update, cancellation, negation, expiry) are published as JSON on the "denm.lifecycle"
+// event while it has subscribers, and as a DenmLifecycleEvent to the subscribeShared subscribers; repetitions
+// and stale messages are not. Expiry runs on a hierarchical timer wheel ticked by a background thread. The
+// table is sharded so concurrent senders and the receiver rarely contend.
+class DenmLifecycle {
+public:
+	explicit DenmLifecycle(std::chrono::milliseconds tick = std::chrono::milliseconds(100));
+	~DenmLifecycle();
+
+	void start();
+	void stop();
+
+	// Classify `info` and publish the transition if it changed the state. `denm` is the decoded message
+	// included in the published event
+	DenmTransition apply(DenmDirection direction,
+						 const DenmActionInfo& info,
+						 const nlohmann::json& denm,
+						 int64_t now_ms = nowMs());
+
+	// Expire every event whose validity ended before `now_ms`. Called by the background thread
+	void expire(int64_t now_ms);
+
+	size_t size() const;
+
+	static int64_t nowMs();
+
+private:
+	struct Entry {
+		DenmDirection direction;
+		DenmActionInfo info;
+		uint64_t deadline_tick;
+	};
+
+	struct Shard {
+		mutable std::mutex lock;
+		std::unordered_map<uint64_t, Entry> entries;
+	};
+
+	static constexpr size_t SHARDS = 16;
+
+	static uint64_t keyOf(DenmDirection direction, const DenmActionInfo& info);
+	Shard& shardOf(uint64_t key) {
+		return shards_[(key ^ (key >> 17)) % SHARDS];
+	}
+	uint64_t tickOf(int64_t ms) const;
+	void publish(DenmTransition transition,
+				 DenmDirection direction,
+				 const DenmActionInfo& info,
+				 const nlohmann::json& denm) const;
+
+	std::chrono::milliseconds tick_;
+	std::array<Shard, SHARDS> shards_;
+
+	std::mutex wheel_lock_;
+	TimerWheel wheel_;
+
+	std::atomic<bool> running_{false};
+	std::mutex expiry_lock_;
+	std::condition_variable expiry_cv_;
+	std::thread expiry_thread_;
+};
+
+#endif // DENM_LIFECYCLE_HPP
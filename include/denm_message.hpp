@@ -2,6 +2,7 @@
 #define DENM_MESSAGE_HPP
 
 #include "crow.h"
+#include "denm_action.hpp"
 #include <chrono>
 #include <memory>
 #include <nlohmann/json.hpp>
@@ -22,6 +23,9 @@ public:
 	nlohmann::json toJson() const;
 	static DenmMessage fromJson(const nlohmann::json& j);
 
+	// Identity and lifecycle fields of the management container
+	DenmActionInfo actionInfo() const;
+
 	// Direct access to DENM structure
 	std::unique_ptr<DENM_t> denm = std::make_unique<DENM_t>();
 
@@ -45,6 +49,17 @@ public:
 		denm->denm.management.eventPosition.altitude.altitudeValue = static_cast<int32_t>(altitude * 100);
 	}
 
+	void setSequenceNumber(uint16_t number) {
+		denm->denm.management.actionID.sequenceNumber = number;
+	}
+
+	void setTermination(Termination_t termination) {
+		if (!denm->denm.management.termination) {
+			denm->denm.management.termination = vanetza::asn1::allocate<Termination_t>();
+		}
+		*denm->denm.management.termination = termination;
+	}
+
 	void setRelevanceDistance(RelevanceDistance_t distance) {
 		if (!denm->denm.management.relevanceDistance) {
 			denm->denm.management.relevanceDistance = vanetza::asn1::allocate<RelevanceDistance_t>();
@@ -97,6 +112,7 @@ private:
 	// Helper functions for timestamp handling
 	static std::string formatToIso8601Timestamp(const TimestampIts_t& timestamp);
 	static TimestampIts_t createItsTimestamp(time_t unix_timestamp);
+	static int64_t itsTimestampToUnixMs(const TimestampIts_t& timestamp);
 	static time_t parseIsoTimestamp(const std::string& iso_timestamp);
 };
 
@@ -0,0 +1,80 @@
+#ifndef DENM_REPEATER_HPP
+#define DENM_REPEATER_HPP
+
+#include "outbound_queue.hpp"
+#include "timer_wheel.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <proton/message.hpp>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Re-sends active outgoing DENMs at their repetition interval until the repetition duration ends.
+//
+// A DENM is registered once with its fully built AMQP message, so a repetition costs neither JSON parsing nor
+// UPER encoding. Due repetitions are collected from a timer wheel and handed to the sender as one batch per
+// tick. Registrations are keyed by actionID, registering the same key again replaces the previous DENM
+// (an update or a termination of the event).
+class DenmRepeater {
+public:
+	using MessagePtr = std::shared_ptr<const proton::message>;
+	struct Repetition {
+		uint64_t key;
+		MessagePtr message;
+		OutboundRoute route;
+	};
+	using BatchSender = std::function<void(const std::vector<Repetition>&)>;
+
+	explicit DenmRepeater(BatchSender send, std::chrono::milliseconds tick = std::chrono::milliseconds(10));
+	~DenmRepeater();
+
+	void start();
+	void stop();
+
+	// Repeat `message` every `interval` for `duration`, starting one interval from `now_ms`. The outbound
+	// route is passed through to the sender with every repetition
+	void add(uint64_t key,
+			 MessagePtr message,
+			 std::chrono::milliseconds interval,
+			 std::chrono::milliseconds duration,
+			 const OutboundRoute& route = OutboundRoute(),
+			 int64_t now_ms				= nowMs());
+	// Stop repeating `key`. Returns false if it was not repeating
+	bool remove(uint64_t key);
+
+	// Send every repetition due at `now_ms`. Called by the background thread
+	void run(int64_t now_ms);
+
+	size_t size() const;
+
+	// Milliseconds on a monotonic clock
+	static int64_t nowMs();
+
+private:
+	struct Entry {
+		MessagePtr message;
+		OutboundRoute route;
+		uint64_t interval_ticks;
+		uint64_t end_tick;
+	};
+
+	uint64_t tickOf(int64_t ms) const;
+
+	BatchSender send_;
+	std::chrono::milliseconds tick_;
+
+	mutable std::mutex lock_;
+	TimerWheel wheel_;
+	std::unordered_map<uint64_t, Entry> entries_;
+
+	std::atomic<bool> running_{false};
+	std::condition_variable wakeup_;
+	std::thread thread_;
+};
+
+#endif // DENM_REPEATER_HPP
@@ -1,17 +1,62 @@
 #pragma once
 
+#include "delivery_status.hpp"
+#include "denm_lifecycle.hpp"
 #include "denm_message.hpp"
+#include "event_bus.hpp"
+#include "incoming_denm.hpp"
+#include "publish_window.hpp"
+#include "rate_limiter.hpp"
+#include "ws_fanout.hpp"
 #include <atomic>
+#include <condition_variable>
 #include <crow.h>
+#include <deque>
+#include <functional>
+#include <map>
 #include <memory>
 #include <nlohmann/json.hpp>
-#include <set>
+#include <optional>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Tuning options for the HTTP and WebSocket API
+struct DenmServiceOptions {
+	// Token-bucket limits for POST /denm, per publisherId and per client IP. Can be changed at runtime
+	// through PUT /limits
+	RateLimit publisher_limit;
+	RateLimit ip_limit;
+	// Bearer token PUT /limits requires. Empty rejects every change of the limits
+	std::string admin_token;
+	// Largest number of DENMs accepted by one POST /denm/batch
+	size_t max_batch_items = 1000;
+	// Asynchronous POST /denm requests waiting for the publishing pipeline, more are rejected with 503
+	size_t async_queue_limit = 10000;
+	// Delivery states kept for GET /denm/{id}/status, the oldest are dropped
+	size_t status_table_size = 100000;
+	// Crow I/O and worker threads of the HTTP server, 0 uses one per hardware thread
+	unsigned http_threads = 0;
+	// Threads of a separate WebSocket server on the WebSocket port, 0 serves WebSocket on the HTTP port
+	unsigned ws_threads = 0;
+	// CPUs the server threads are restricted to, as "0-3,6". Empty leaves scheduling to the OS
+	std::string cpus;
+	// Per-client queueing of the WebSocket broadcast
+	WsFanoutOptions ws_fanout;
+	// DENMs a WebSocket connection may publish before their acknowledgement
+	size_t ws_publish_window = 64;
+	// Delay before an EventSource asks GET /denm/stream for the next events
+	unsigned stream_retry_ms = 1000;
+};
 
 class DenmService {
 public:
-	DenmService(const std::string& http_host, int http_port, int ws_port);
+	DenmService(const std::string& http_host,
+				int http_port,
+				int ws_port,
+				const DenmServiceOptions& options = DenmServiceOptions());
 
 	~DenmService();
 
@@ -19,10 +64,53 @@ public:
 	void stop();
 
 private:
+	// A WebSocket connection, shared with the pipeline that acknowledges the DENMs it published
+	struct WsSession {
+		explicit WsSession(size_t window_size) :
+		  window(window_size) {}
+
+		WsFanout::ClientId client = 0;
+		std::mutex lock;
+		crow::websocket::connection* conn = nullptr; // Null once closed, guarded by lock
+		PublishWindow window;						 // Published DENMs not yet acknowledged, guarded by lock
+		WsFanout::ClientId lifecycle_client = 0;	 // Of lifecycle_fanout_ while enabled, guarded by lock
+	};
+
 	void handleDenmPost(const crow::request& req, crow::response& res);
+	// POST /denm with an application/octet-stream body, called by handleDenmPost
+	void handleUperPost(const crow::request& req, crow::response& res);
+	void handleDenmBatchPost(const crow::request& req, crow::response& res);
+	void handleStreamGet(const crow::request& req, crow::response& res);
+	// Hand `publish` to the pipeline thread and answer 202 with the status ID `id`
+	void acceptAsync(const std::string& id, std::function<void()> publish, crow::response& res);
+	// Hand `publish` to the pipeline thread, which calls `done` with an empty error once the DENM is queued.
+	// False if the pipeline is full
+	bool enqueuePublish(const std::string& id,
+						std::function<void()> publish,
+						std::function<void(const std::string& error)> done);
+	void runPipeline();
+	// Charge one request of the client IP before its body is parsed, or answer 429 and return false
+	bool checkIpLimit(const crow::request& req, crow::response& res);
+	// Charge one request of `publisher` once its DENM is validated, or answer 429 and return false
+	bool checkPublisherLimit(const std::string& publisher, crow::response& res);
 	void setupRoutes();
+	void setupWebSocketRoute(crow::App<>& app);
 
-	void broadcastMessage(const std::string& message);
+	std::shared_ptr<WsSession> sessionOf(crow::websocket::connection& conn);
+	// Subscription, encoding and publish requests of WebSocket clients
+	void handleWebSocketMessage(crow::websocket::connection& conn, const std::string& data, bool is_binary);
+	// Publish a {"type": "publish"} `message`, or the binary `frame` if `message` is null
+	void handleWebSocketPublish(const std::shared_ptr<WsSession>& session,
+								const nlohmann::json& message,
+								const std::string& frame);
+	// Returns the sequence number of the message
+	uint64_t broadcastMessage(const WsFanout::Message& message, const WsFanout::Attributes& attributes);
+	void broadcastIncoming(const std::shared_ptr<const IncomingDenm>& denm);
+	// Forget the last broadcast DENM of a received action that expired
+	void onLifecycle(const std::shared_ptr<const DenmLifecycleEvent>& event);
+	// Send a connection the "denm.lifecycle" events from now on, or stop. The service only subscribes to them
+	// while a connection wants them
+	void setLifecycle(const std::shared_ptr<WsSession>& session, bool enabled);
 	void runReceiverLoop();
 
 	void run_http_server();
@@ -34,10 +122,45 @@ private:
 
 	std::atomic<bool> running_{false};
 
-	crow::App<> app_; // Crow application instance
+	RateLimiter rate_limiter_;
+	std::string admin_token_;
+	size_t max_batch_items_;
+
+	// Asynchronous publishing, see acceptAsync()
+	DeliveryStatusTable statuses_;
+	EventBus::SubscriptionId status_subscription_;
+	size_t async_queue_limit_;
+	std::mutex pipeline_lock_;
+	std::condition_variable pipeline_ready_;
+	std::deque<std::function<void()>> pipeline_;
+	std::thread pipeline_thread_;
+
+	unsigned http_threads_;
+	unsigned ws_threads_;
+	std::vector<int> cpus_;
+
+	crow::App<> app_;	 // Crow application instance
+	crow::App<> ws_app_; // WebSocket server if it has its own port
+	size_t ws_publish_window_;
+	unsigned stream_retry_ms_;
+	// Cursor of a WebSocket connection being opened, from onaccept to onopen
+	static thread_local std::optional<uint64_t> pending_resume_;
+	WsFanout ws_fanout_;
+	EventBus::SubscriptionId incoming_subscription_;
+	// Lifecycle events for the connections that asked for them, queued apart from the DENM stream
+	WsFanout lifecycle_fanout_;
+	std::mutex lifecycle_mutex_;
+	size_t lifecycle_clients_ = 0; // Guarded by lifecycle_mutex_, like the subscription
+	EventBus::SubscriptionId lifecycle_subscription_ = 0;
+	// Last broadcast DENM and its sequence number per actionID, for deltas. Only kept while a client is in delta
+	// mode, entries are dropped when their action ends or expires
+	static constexpr size_t MAX_BROADCAST_ACTIONS = 100000;
+	std::mutex last_broadcast_mutex_;
+	std::unordered_map<uint64_t, std::pair<std::shared_ptr<const IncomingDenm>, uint64_t>> last_broadcast_;
+	EventBus::SubscriptionId expiry_subscription_;
 	std::mutex ws_connections_mutex_;
-	// Container of active websocket connections
-	std::set<crow::websocket::connection*> ws_connections_;
+	// Every active websocket connection
+	std::map<crow::websocket::connection*, std::shared_ptr<WsSession>> ws_connections_;
 
 	std::thread http_thread_;
 	std::thread ws_thread_;
@@ -1,40 +1,137 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <utility>
 #include <vector>
 
 class EventBus {
 public:
-	using JsonCallback = std::function<void(const nlohmann::json&)>;
+	using JsonCallback	 = std::function<void(const nlohmann::json&)>;
+	using SubscriptionId = uint64_t;
+	template <typename T>
+	using SharedCallback = std::function<void(const std::shared_ptr<const T>&)>;
 
 	static EventBus& getInstance() {
 		static EventBus instance;
 		return instance;
 	}
 
-	// Subscribe to an event
-	void subscribe(const std::string& event, JsonCallback callback) {
+	// Subscribe to an event. The returned id can be passed to unsubscribe()
+	SubscriptionId subscribe(const std::string& event, JsonCallback callback) {
 		std::lock_guard<std::mutex> lock(mutex_);
-		subscribers_[event].push_back(callback);
+		SubscriptionId id = ++last_id_;
+		addSubscriber(subscribers_, event, id, std::move(callback));
+		return id;
 	}
 
-	// Publish an event
-	void publish(const std::string& event, const nlohmann::json& data) {
+	// Subscribe to an event carrying an immutable, shared payload of type T instead of JSON. Used where the
+	// payload is expensive to copy or rebuild, e.g. decoded incoming DENMs with their serialized forms
+	template <typename T>
+	SubscriptionId subscribeShared(const std::string& event, SharedCallback<T> callback) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		SubscriptionId id = ++last_id_;
+		addSubscriber(shared_subscribers_, event, id, ErasedCallback([callback](const std::shared_ptr<const void>& data) {
+						  callback(std::static_pointer_cast<const T>(data));
+					  }));
+		return id;
+	}
+
+	// Remove a subscription, e.g. when the subscribing object is destroyed
+	void unsubscribe(const std::string& event, SubscriptionId id) {
 		std::lock_guard<std::mutex> lock(mutex_);
-		if (subscribers_.find(event) != subscribers_.end()) {
-			for (const auto& callback : subscribers_[event]) {
-				callback(data);
+		eraseSubscriber(subscribers_, event, id);
+		eraseSubscriber(shared_subscribers_, event, id);
+	}
+
+	// Whether publish() of an event reaches any subscriber, so publishers can skip building an unwanted payload
+	bool hasSubscribers(const std::string& event) {
+		auto subscribers = snapshot(subscribers_, event);
+		return subscribers && !subscribers->empty();
+	}
+
+	// Whether publishShared() of an event reaches any subscriber
+	bool hasSharedSubscribers(const std::string& event) {
+		auto subscribers = snapshot(shared_subscribers_, event);
+		return subscribers && !subscribers->empty();
+	}
+
+	// Publish an event. Callbacks run on the publishing thread without the bus lock held, so they may
+	// publish further events
+	void publish(const std::string& event, const nlohmann::json& data) {
+		auto subscribers = snapshot(subscribers_, event);
+		if (subscribers) {
+			for (const auto& subscriber : *subscribers) {
+				subscriber.second(data);
+			}
+		}
+	}
+
+	// Publish a shared payload to the subscribeShared<T> subscribers of an event. All subscribers of an event
+	// must agree on T
+	template <typename T>
+	void publishShared(const std::string& event, const std::shared_ptr<const T>& data) {
+		auto subscribers = snapshot(shared_subscribers_, event);
+		if (subscribers) {
+			std::shared_ptr<const void> erased = data;
+			for (const auto& subscriber : *subscribers) {
+				subscriber.second(erased);
 			}
 		}
 	}
 
 private:
+	using ErasedCallback = std::function<void(const std::shared_ptr<const void>&)>;
+
+	// Subscriber lists are copied on write, publishing only takes the lock to grab the current list
+	template <typename Callback>
+	using SubscriberList = std::vector<std::pair<SubscriptionId, Callback>>;
+	template <typename Callback>
+	using SubscriberMap = std::map<std::string, std::shared_ptr<const SubscriberList<Callback>>>;
+
+	template <typename Callback>
+	static void addSubscriber(SubscriberMap<Callback>& subscribers,
+							  const std::string& event,
+							  SubscriptionId id,
+							  Callback callback) {
+		auto& current = subscribers[event];
+		auto updated  = current ? std::make_shared<SubscriberList<Callback>>(*current)
+								: std::make_shared<SubscriberList<Callback>>();
+		updated->emplace_back(id, std::move(callback));
+		current = std::move(updated);
+	}
+
+	template <typename Callback>
+	static void eraseSubscriber(SubscriberMap<Callback>& subscribers, const std::string& event, SubscriptionId id) {
+		auto it = subscribers.find(event);
+		if (it == subscribers.end()) {
+			return;
+		}
+		auto updated = std::make_shared<SubscriberList<Callback>>(*it->second);
+		updated->erase(std::remove_if(updated->begin(),
+									  updated->end(),
+									  [id](const auto& subscriber) { return subscriber.first == id; }),
+					   updated->end());
+		it->second = std::move(updated);
+	}
+
+	template <typename Callback>
+	std::shared_ptr<const SubscriberList<Callback>> snapshot(const SubscriberMap<Callback>& subscribers,
+															  const std::string& event) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = subscribers.find(event);
+		return it == subscribers.end() ? nullptr : it->second;
+	}
+
 	EventBus() = default;
-	std::map<std::string, std::vector<JsonCallback>> subscribers_;
+	SubscriberMap<JsonCallback> subscribers_;
+	SubscriberMap<ErasedCallback> shared_subscribers_;
+	SubscriptionId last_id_ = 0;
 	std::mutex mutex_;
 };
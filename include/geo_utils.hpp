@@ -1,10 +1,16 @@
 #ifndef GEO_UTILS_HPP
 #define GEO_UTILS_HPP
 
+#include <cstdint>
 #include <string>
 
 // Calculate quadTree value for given lat/lon coordinates
 // Returns an 18-character quadTree string
 std::string calculateQuadTree(double lat, double lon, int zoom=18);
 
+// Tile of lat/lon at `zoom` in the tiling of calculateQuadTree, clamped to the map
+void latLonToTile(double lat, double lon, int zoom, uint32_t& x, uint32_t& y);
+// quadTree of tile x/y at `zoom`
+std::string tileToQuadTree(uint32_t x, uint32_t y, int zoom);
+
 #endif // GEO_UTILS_HPP
@@ -0,0 +1,15 @@
+#ifndef HASH_UTILS_HPP
+#define HASH_UTILS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 64-bit xxHash (XXH64) of a byte range. Fast, non-cryptographic; used to key caches by message content
+uint64_t xxhash64(const unsigned char* data, size_t size, uint64_t seed = 0);
+
+inline uint64_t xxhash64(const std::vector<unsigned char>& data, uint64_t seed = 0) {
+	return xxhash64(data.data(), data.size(), seed);
+}
+
+#endif // HASH_UTILS_HPP
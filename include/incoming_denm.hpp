@@ -0,0 +1,22 @@
+#ifndef INCOMING_DENM_HPP
+#define INCOMING_DENM_HPP
+
+#include "denm_action.hpp"
+#include "subscription_filter.hpp"
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+// A DENM received from the interchange, decoded once and shared read-only with every consumer of the
+// "denm.incoming" event (see EventBus::publishShared)
+struct IncomingDenm {
+	uint64_t hash = 0;			   // xxhash64 of the UPER body
+	std::vector<unsigned char> uper; // Body as received
+	nlohmann::json json;		   // DenmMessage::toJson() of the body
+	std::string serialized;		   // json.dump()
+	DenmActionInfo action;		   // actionID and lifecycle fields of the management container
+	DenmAttributes attributes;	   // Matched against WebSocket subscriptions
+};
+
+#endif // INCOMING_DENM_HPP
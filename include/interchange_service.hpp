@@ -1,29 +1,87 @@
 #pragma once
 
 #include "amqp_client.hpp"
+#include "decode_cache.hpp"
+#include "denm_lifecycle.hpp"
+#include "denm_repeater.hpp"
 #include "event_bus.hpp"
+#include "message_pool.hpp"
+#include "outbound_queue.hpp"
+#include "outgoing_denm.hpp"
+#include "priority_classes.hpp"
+#include "publication_headers.hpp"
+#include "shard_assigner.hpp"
 #include "ssl_utils.hpp"
+#include "worker_pool.hpp"
 #include <atomic>
 #include <memory>
 #include <nlohmann/json.hpp>
 #include <string>
 #include <thread>
 
+// Tuning options for the interchange connection
+struct InterchangeOptions {
+	// Number of decoded incoming DENMs kept for byte-identical repetitions, 0 disables the cache
+	size_t decode_cache_size = 4096;
+	// Drop incoming DENMs whose body is identical to one still in the decode cache instead of
+	// publishing them again on denm.incoming
+	bool drop_duplicates = false;
+	// Maximum number of distinct DENMs waiting for AMQP credit
+	size_t outbound_queue_limit = 10000;
+	// Priority class of outgoing DENMs by causeCode and stationType, one outbound lane per class
+	PriorityClassifier priority_classes;
+	LaneScheduling lane_scheduling = LaneScheduling::Weighted;
+	// Bytes each publisher may send per deficit round-robin round within a priority class
+	size_t fair_queue_quantum = 512;
+	// Assigns shardIds to outgoing DENMs without one, disabled by default
+	ShardAssigner shard_assigner;
+	// Threads validating and encoding a DENM batch, 0 uses one per hardware thread
+	size_t batch_threads = 0;
+};
+
 class InterchangeService {
 public:
 	InterchangeService(const std::string& username,
 					   const std::string& amqp_url,
 					   const std::string& amqp_send_address,
 					   const std::string& amqp_receive_address,
-					   const std::string& cert_dir);
+					   const std::string& cert_dir,
+					   const InterchangeOptions& options = InterchangeOptions());
+	~InterchangeService();
 
 	void start();
 	void stop();
 
 private:
-	void handleOutgoingDenm(const nlohmann::json& denm);
+	// An outgoing DENM validated and encoded, ready to be queued
+	struct PreparedDenm {
+		OutboundQueue::MessagePtr message;
+		OutboundRoute route;
+		DenmActionInfo action;
+		std::chrono::milliseconds repetition_interval{0};
+		std::chrono::milliseconds repetition_duration{0};
+		nlohmann::json decoded; // Data of a DENM submitted UPER encoded, null otherwise
+	};
+
+	// Batches are only split over the workers if every part gets at least this many DENMs
+	static constexpr size_t MIN_ITEMS_PER_WORKER = 16;
+
+	// `status_id` is the AMQP message-id of an asynchronously published DENM, empty otherwise
+	void handleOutgoingDenm(const nlohmann::json& denm, const std::string& status_id = "");
+	void handleOutgoingUper(const OutgoingUperDenm& uper);
+	void handleOutgoingBatch(const OutgoingDenmBatch& batch);
+	// Build the AMQP message of a DENM, from its "data" or from `uper` if given, with `status_id` as message-id
+	// if not empty. Throws if the DENM is invalid. Thread-safe
+	PreparedDenm prepareOutgoingDenm(const nlohmann::json& denm,
+									 const std::vector<unsigned char>* uper = nullptr,
+									 const std::string& status_id			= "");
+	// Track the lifecycle and repetition of a DENM once it is queued
+	void commitOutgoingDenm(const PreparedDenm& prepared, const nlohmann::json& denm);
+	void handleIncomingMessage(const proton::message& msg);
 	void setupAmqpReceiver();
 	void setupAmqpSender();
+	void runDispatcher();
+	nlohmann::json stats() const;
 	void setupContainerOptions();
 
 	std::string username_;
@@ -31,12 +89,28 @@ private:
 	std::string amqp_send_address_;
 	std::string amqp_receive_address_;
 	std::string cert_dir_;
+	InterchangeOptions options_;
+
+	MessagePool message_pool_;
+	PublicationHeaderCache publication_headers_;
+	DecodeCache decode_cache_;
+	DenmLifecycle lifecycle_;
+	OutboundQueue outbound_queue_;
+	WorkerPool batch_workers_; // Started once, shared by all batches
+	DenmRepeater repeater_;
+	std::atomic<uint64_t> duplicates_dropped_{0};
 
 	std::unique_ptr<proton::container> amqp_container_;
 	std::unique_ptr<sender> amqp_sender_;
 	std::unique_ptr<receiver> amqp_receiver_;
 
+	EventBus::SubscriptionId outgoing_subscription_;
+	EventBus::SubscriptionId tracked_subscription_;
+	EventBus::SubscriptionId uper_subscription_;
+	EventBus::SubscriptionId batch_subscription_;
+
 	std::thread container_thread_;
 	std::thread receiver_thread_;
+	std::thread dispatcher_thread_;
 	std::atomic<bool> running_{false};
 };
@@ -0,0 +1,48 @@
+#ifndef LOGGING_HPP
+#define LOGGING_HPP
+
+#include <cstddef>
+#include <spdlog/spdlog.h>
+
+// Logging on the per-message paths.
+//
+// LOG_TRACE, LOG_DEBUG and LOG_INFO take the arguments of spdlog::trace() etc. Levels below
+// SPDLOG_ACTIVE_LEVEL, set at build time with AZ_V2X_LOG_LEVEL, compile to nothing. The others only evaluate
+// their arguments and format once the level is enabled at runtime, so a DENM dumped at debug level costs one
+// level check when running at info. Expensive work done only for a log line goes under logEnabled().
+
+// Whether `level` is compiled in and enabled on the default logger
+inline bool logEnabled(spdlog::level::level_enum level) {
+	return level >= SPDLOG_ACTIVE_LEVEL && spdlog::default_logger_raw()->should_log(level);
+}
+
+#define AZ_LOG_LAZY(level, ...)                                                                                        \
+	do {                                                                                                               \
+		if (spdlog::default_logger_raw()->should_log(level))                                                          \
+			spdlog::default_logger_raw()->log(level, __VA_ARGS__);                                                     \
+	} while (false)
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE
+#define LOG_TRACE(...) AZ_LOG_LAZY(spdlog::level::trace, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) (void)0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) AZ_LOG_LAZY(spdlog::level::debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) (void)0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_INFO
+#define LOG_INFO(...) AZ_LOG_LAZY(spdlog::level::info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) (void)0
+#endif
+
+// Replace the default logger with one that formats and writes on a background thread. Log calls only
+// queue the message; once `queue_size` messages are waiting the oldest are dropped, a log call never blocks
+// on the console. Warnings and errors are flushed right away
+void initAsyncLogging(size_t queue_size = 8192);
+
+#endif // LOGGING_HPP
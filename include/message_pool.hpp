@@ -0,0 +1,35 @@
+#ifndef MESSAGE_POOL_HPP
+#define MESSAGE_POOL_HPP
+
+#include <memory>
+#include <mutex>
+#include <proton/message.hpp>
+#include <vector>
+
+// Pool of recycled proton::message objects to avoid allocating a new message for every send.
+// Acquired messages are cleared, so nothing of the previous send is carried over.
+class MessagePool {
+public:
+	struct Releaser {
+		MessagePool* pool;
+		void operator()(proton::message* m) const {
+			pool->release(m);
+		}
+	};
+	using Handle = std::unique_ptr<proton::message, Releaser>;
+
+	explicit MessagePool(size_t max_idle = 64) :
+	  max_idle_(max_idle) {}
+
+	// The returned message is returned to the pool when the handle goes out of scope
+	Handle acquire();
+
+private:
+	void release(proton::message* m);
+
+	size_t max_idle_;
+	std::mutex lock_;
+	std::vector<std::unique_ptr<proton::message>> idle_;
+};
+
+#endif // MESSAGE_POOL_HPP
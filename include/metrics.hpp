@@ -0,0 +1,188 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+
+// Counters and histograms are split in shards, each thread records into its own cache line
+constexpr size_t METRIC_SHARDS = 16;
+
+// Shard of the calling thread, threads are assigned round-robin on first use
+inline size_t metricShard() {
+	static std::atomic<size_t> next{0};
+	thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS;
+	return shard;
+}
+
+// Monotonic counter. add() is one uncontended relaxed atomic increment
+class MetricCounter {
+public:
+	void add(uint64_t n = 1) {
+		shards_[metricShard()].value.fetch_add(n, std::memory_order_relaxed);
+	}
+	uint64_t value() const;
+
+private:
+	struct alignas(64) Shard {
+		std::atomic<uint64_t> value{0};
+	};
+	std::array<Shard, METRIC_SHARDS> shards_;
+};
+
+// Current value of something, e.g. a queue depth
+class MetricGauge {
+public:
+	void set(int64_t value) {
+		value_.store(value, std::memory_order_relaxed);
+	}
+	int64_t value() const {
+		return value_.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<int64_t> value_{0};
+};
+
+// Histogram of durations with log-linear buckets in the style of HdrHistogram: every power of two of
+// nanoseconds is split in two, so a bucket is at most 50% wider than its lower bound. Durations from 1 ns to
+// about 18 minutes are told apart, longer ones share the last bucket. record() finds the bucket from the
+// position of the highest bit and adds to the bucket and the sum of the thread's shard. Histograms of the
+// registry are served on GET /metrics, the summary of any histogram can be reported as JSON
+class MetricHistogram {
+public:
+	static constexpr size_t MAX_BIT = 40;
+	static constexpr size_t BUCKETS = 2 * (MAX_BIT + 1);
+
+	void record(std::chrono::nanoseconds duration) {
+		uint64_t ns	 = duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0;
+		Shard& shard = shards_[metricShard()];
+		shard.buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+		shard.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+	}
+
+	static size_t bucketOf(uint64_t ns) {
+		if (ns < 2)
+			return ns;
+		size_t bit = 63 - static_cast<size_t>(__builtin_clzll(ns));
+		if (bit > MAX_BIT)
+			return BUCKETS - 1;
+		return 2 * bit + ((ns >> (bit - 1)) & 1);
+	}
+	// Exclusive upper bound of a bucket in nanoseconds
+	static uint64_t upperBoundNs(size_t bucket) {
+		if (bucket < 2)
+			return bucket + 1;
+		size_t bit = bucket / 2;
+		return (uint64_t(3) + bucket % 2) << (bit - 1);
+	}
+
+	struct Snapshot {
+		std::array<uint64_t, BUCKETS> buckets{};
+		uint64_t count	= 0;
+		uint64_t sum_ns = 0;
+
+		// Estimated duration at `quantile` (0..1) as the upper bound of its bucket, 0 if nothing was recorded
+		uint64_t percentileNs(double quantile) const;
+		// {"count", "meanUs", "p50Us", "p90Us", "p99Us"}, rounded up to whole microseconds
+		nlohmann::json toJson() const;
+	};
+	// Sum of the shards. Concurrent records may or may not be included
+	Snapshot snapshot() const;
+
+private:
+	struct alignas(64) Shard {
+		std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+		std::atomic<uint64_t> sum_ns{0};
+	};
+	std::array<Shard, METRIC_SHARDS> shards_;
+};
+
+// Records the time from construction to destruction
+class ScopedTimer {
+public:
+	explicit ScopedTimer(MetricHistogram& histogram) :
+	  histogram_(histogram),
+	  start_(std::chrono::steady_clock::now()) {}
+	~ScopedTimer() {
+		histogram_.record(std::chrono::steady_clock::now() - start_);
+	}
+	ScopedTimer(const ScopedTimer&)			   = delete;
+	ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+	MetricHistogram& histogram_;
+	std::chrono::steady_clock::time_point start_;
+};
+
+// Call `f`, record how long it took and return its result
+template <typename F>
+auto timed(MetricHistogram& histogram, F&& f) -> decltype(f()) {
+	ScopedTimer timer(histogram);
+	return f();
+}
+
+// Registry of the metrics served on GET /metrics.
+//
+// Metrics are registered once by name and live as long as the process, so callers keep the returned
+// reference and record without any lookup or lock. Registering a name again returns the same metric.
+class Metrics {
+public:
+	static Metrics& getInstance() {
+		static Metrics instance;
+		return instance;
+	}
+
+	// Throw std::logic_error if `name` is registered as another type
+	MetricCounter& counter(const std::string& name, const std::string& help);
+	MetricGauge& gauge(const std::string& name, const std::string& help);
+	MetricHistogram& histogram(const std::string& name, const std::string& help);
+
+	// Every metric in the Prometheus text exposition format 0.0.4. Histograms are in seconds, with the
+	// bucket bounds from 1 us to 34 s
+	std::string render() const;
+
+private:
+	Metrics() = default;
+
+	struct Family {
+		std::string type;
+		std::string help;
+		std::unique_ptr<MetricCounter> counter;
+		std::unique_ptr<MetricGauge> gauge;
+		std::unique_ptr<MetricHistogram> histogram;
+	};
+	Family& family(const std::string& name, const std::string& type, const std::string& help);
+
+	std::map<std::string, Family> families_;
+	mutable std::mutex mutex_;
+};
+
+// The instrumented stages of the DENM pipeline
+struct PipelineMetrics {
+	// Outgoing DENMs
+	MetricHistogram& http_parse;  // Body of POST /denm to JSON
+	MetricHistogram& validation;  // Whole preparation of an outgoing DENM, including the three below
+	MetricHistogram& from_json;	  // DenmMessage::fromJson
+	MetricHistogram& uper_encode; // DenmMessage::getUperEncoded
+	MetricHistogram& quadtree;	  // calculateQuadTree
+	MetricHistogram& credit_wait; // Blocked on AMQP link credit before sending
+	MetricCounter& published;	  // Outgoing DENMs handed to the outbound queue
+
+	// Incoming DENMs
+	MetricGauge& receiver_buffered;	  // Received messages waiting for the receiver thread
+	MetricHistogram& uper_decode;	  // DenmMessage::fromUper and toJson, decode cache misses only
+	MetricHistogram& event_dispatch;  // EventBus subscribers of "denm.incoming"
+	MetricHistogram& ws_fanout;		  // From WsFanout::publish() to the send to a client
+	MetricCounter& received;		  // Incoming DENMs
+
+	static PipelineMetrics& get();
+};
+
+#endif // METRICS_HPP
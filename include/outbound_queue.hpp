@@ -0,0 +1,153 @@
+#ifndef OUTBOUND_QUEUE_HPP
+#define OUTBOUND_QUEUE_HPP
+
+#include "metrics.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <proton/message.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// How pop() shares the link credit between lanes
+enum class LaneScheduling {
+	Strict,	 // Always drain the most urgent non-empty lane first
+	Weighted // Smooth weighted round-robin, every non-empty lane gets credit in proportion to its weight
+};
+
+// Where a message is queued
+struct OutboundRoute {
+	size_t lane = 0;	// Priority lane, 0 is the most urgent
+	std::string flow;	// Fair queuing flow within the lane, e.g. the publisherId
+	size_t cost = 1;	// Fair queuing cost, e.g. the body size in bytes
+	TraceContext trace;	// Of a sampled DENM, its wait in the queue is recorded as "outbound.queue"
+};
+
+// Conflating, multi-lane queue of outgoing AMQP messages waiting for link credit.
+//
+// Messages are keyed by the actionID of their DENM. While a message waits, a newer message with the same key
+// replaces it in place and the older version is counted as conflated, so a congested link only carries the
+// latest state of every event and the backlog is bounded by the number of distinct events.
+//
+// Every priority class has its own lane, lane 0 being the most urgent. Within a lane every flow (publisher)
+// has its own FIFO and the flows are served by deficit round-robin, so one publisher flooding the service
+// cannot take the credit of the others. The time each message spent in its lane is recorded in a per-lane
+// latency histogram.
+class OutboundQueue {
+public:
+	using MessagePtr = std::shared_ptr<const proton::message>;
+
+	// A message to queue with push(batch)
+	struct Pending {
+		uint64_t key;
+		MessagePtr message;
+		OutboundRoute route;
+	};
+
+	explicit OutboundQueue(size_t limit = 10000,
+						   const std::vector<unsigned>& lane_weights = {1},
+						   LaneScheduling scheduling = LaneScheduling::Weighted,
+						   size_t quantum = 512);
+
+	// Queue `message` as routed, replacing a pending message with the same key. Throws std::runtime_error if
+	// the queue is closed, or full of distinct keys, and std::out_of_range for an unknown lane
+	void push(uint64_t key, MessagePtr message, const OutboundRoute& route = OutboundRoute());
+	// Queue a batch in order under a single lock acquisition. Returns for every message whether it was
+	// queued, messages with new keys are rejected once the queue is full. Throws like push() otherwise
+	std::vector<bool> push(const std::vector<Pending>& batch);
+
+	// Wait up to `timeout` for pending messages and return at most `max` of them, picking lanes according to
+	// the scheduling policy. Returns an empty batch on timeout or once the queue is closed
+	std::vector<MessagePtr> pop(size_t max, std::chrono::milliseconds timeout);
+
+	// Wake up waiting consumers and reject further messages
+	void close();
+
+	// Called with every pending message that a newer message with the same key replaced, outside the queue
+	// lock. Set before messages are pushed
+	void onConflated(std::function<void(const MessagePtr& replaced)> callback) {
+		on_conflated_ = std::move(callback);
+	}
+
+	size_t size() const;
+	size_t size(size_t lane) const;
+	size_t lanes() const {
+		return lanes_.size();
+	}
+	uint64_t conflated() const {
+		return conflated_;
+	}
+	const MetricHistogram& latency(size_t lane) const {
+		return lanes_.at(lane).latency;
+	}
+	// Messages handed out per flow, the share of the link each publisher received
+	std::map<std::string, uint64_t> sentByFlow() const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Item {
+		uint64_t key;
+		MessagePtr message;
+		size_t cost;
+		Clock::time_point queued_at;
+		TraceContext trace;
+	};
+
+	struct Flow {
+		std::string name;
+		std::list<Item> items;
+		int64_t deficit = 0;
+		bool visited	= false; // Received its quantum in the current round
+	};
+
+	struct Lane {
+		std::unordered_map<std::string, Flow> flows;
+		std::deque<Flow*> active; // Round-robin order of the non-empty flows
+		size_t size		= 0;
+		int64_t weight	= 1;
+		int64_t current = 0; // Smooth weighted round-robin state
+		MetricHistogram latency;
+	};
+
+	struct Location {
+		size_t lane;
+		Flow* flow;
+		std::list<Item>::iterator item;
+	};
+
+	static constexpr size_t MAX_FLOW_COUNTERS = 10000;
+
+	// Queue or conflate with the lock held, false if the queue is full. A replaced message is appended to
+	// `replaced`
+	bool insert(uint64_t key, MessagePtr message, const OutboundRoute& route, std::vector<MessagePtr>& replaced);
+	void notifyConflated(const std::vector<MessagePtr>& replaced) const;
+	Lane* nextLane();
+	Item take(Lane& lane);
+	void append(uint64_t key, MessagePtr message, const OutboundRoute& route);
+	void erase(const Location& location);
+
+	size_t limit_;
+	LaneScheduling scheduling_;
+	int64_t quantum_;
+	mutable std::mutex lock_;
+	std::condition_variable ready_;
+	std::vector<Lane> lanes_;
+	std::unordered_map<uint64_t, Location> index_;
+	size_t size_ = 0;
+	bool closed_ = false;
+	std::atomic<uint64_t> conflated_{0};
+	std::unordered_map<std::string, uint64_t> sent_by_flow_;
+	std::function<void(const MessagePtr&)> on_conflated_;
+};
+
+#endif // OUTBOUND_QUEUE_HPP
@@ -0,0 +1,33 @@
+#ifndef OUTGOING_DENM_HPP
+#define OUTGOING_DENM_HPP
+
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+// A DENM submitted already UPER encoded, published as a "denm.outgoing.uper" event (see
+// EventBus::publishShared). `properties` holds the fields of a JSON DENM except "data", which is decoded
+// from `uper` instead. The body is forwarded byte for byte
+struct OutgoingUperDenm {
+	nlohmann::json properties;
+	std::vector<unsigned char> uper;
+	std::string status_id; // Set for asynchronous publishing, see TrackedDenm
+};
+
+// A JSON DENM published asynchronously, as a "denm.outgoing.tracked" event. `status_id` is the ID of its
+// delivery status, sent as AMQP message-id so the broker settlement can be matched to it. Status IDs are
+// assigned by the service and carried next to the DENM, never taken from the document a client sent
+struct TrackedDenm {
+	nlohmann::json denm;
+	std::string status_id;
+};
+
+// DENMs submitted together through POST /denm/batch, published as one "denm.outgoing.batch" event. The
+// subscriber that sends the batch reports the outcome of every item in `errors`, which is why it is mutable:
+// an empty string means the item was queued for sending
+struct OutgoingDenmBatch {
+	std::vector<nlohmann::json> items;
+	mutable std::vector<std::string> errors;
+};
+
+#endif // OUTGOING_DENM_HPP
@@ -0,0 +1,47 @@
+#ifndef PRIORITY_CLASSES_HPP
+#define PRIORITY_CLASSES_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// An outbound priority class. Each class has its own lane in the outbound queue
+struct PriorityClass {
+	std::string name;
+	uint8_t amqp_priority; // AMQP header priority, 0-9
+	unsigned weight;	   // Share of the link credit under weighted scheduling
+};
+
+// Maps the causeCode and stationType of an outgoing DENM to a priority class.
+//
+// Classes are ordered from most to least urgent; the last class is the default for unmatched DENMs.
+// Rules are matched most specific first: causeCode and stationType, causeCode only, stationType only.
+class PriorityClassifier {
+public:
+	// critical (collision risk, dangerous situation, emergency vehicle), high (stationary or broken down
+	// vehicles, obstacles and people on the road) and normal for everything else
+	PriorityClassifier();
+
+	// Classes as "name:amqpPriority:weight,..." and rules as "causeCode[/stationType]=class,...", where
+	// either code may be "*". Throws std::invalid_argument on malformed input or unknown class names
+	PriorityClassifier(const std::string& classes, const std::string& rules);
+
+	size_t classify(int cause_code, int station_type) const;
+
+	const std::vector<PriorityClass>& classes() const {
+		return classes_;
+	}
+
+	static const std::string DEFAULT_CLASSES;
+	static const std::string DEFAULT_RULES;
+
+private:
+	static constexpr int ANY = -1;
+
+	std::vector<PriorityClass> classes_;
+	std::map<std::pair<int, int>, size_t> rules_; // (causeCode, stationType) -> class
+};
+
+#endif // PRIORITY_CLASSES_HPP
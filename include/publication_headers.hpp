@@ -0,0 +1,57 @@
+#ifndef PUBLICATION_HEADERS_HPP
+#define PUBLICATION_HEADERS_HPP
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <proton/message.hpp>
+#include <proton/scalar.hpp>
+#include <string>
+#include <unordered_map>
+
+// AMQP headers and publication level application properties shared by every message of a publicationId.
+//
+// Built once and never changed afterwards, so any number of threads may apply the same instance. Only plain
+// values are kept: copying a proton::message or proton::map encodes its source, which is not safe to share.
+struct PublicationHeaders {
+	// The publication level application properties, in this order in `values`
+	static constexpr std::array<const char*, 5> KEYS = {
+	  "messageType", "protocolVersion", "publisherId", "publicationId", "originatingCountry"};
+
+	std::string user;
+	std::string to;
+	std::array<std::string, KEYS.size()> values;
+	std::map<std::string, proton::scalar> properties; // The same values, ready to put
+
+	// Set the headers and properties on a message, leaving its other properties alone
+	void applyTo(proton::message& msg) const;
+	// Whether a publication request carries the same publication level properties
+	bool matches(const nlohmann::json& j) const;
+};
+
+// PublicationHeaders keyed by publicationId. An entry is rebuilt when a request of its publication carries
+// different publication level properties, and all of them are forgotten once max_publications is exceeded.
+class PublicationHeaderCache {
+public:
+	PublicationHeaderCache(std::string user, std::string to, size_t max_publications = 4096);
+
+	// The headers for the publication of request `j`. Throws if a publication level property is missing or
+	// not a string
+	std::shared_ptr<const PublicationHeaders> get(const nlohmann::json& j);
+
+	size_t size() const;
+
+private:
+	std::shared_ptr<const PublicationHeaders> build(const nlohmann::json& j) const;
+
+	std::string user_;
+	std::string to_;
+	size_t max_publications_;
+
+	mutable std::mutex lock_;
+	std::unordered_map<std::string, std::shared_ptr<const PublicationHeaders>> publications_;
+};
+
+#endif // PUBLICATION_HEADERS_HPP
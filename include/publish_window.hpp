@@ -0,0 +1,30 @@
+#ifndef PUBLISH_WINDOW_HPP
+#define PUBLISH_WINDOW_HPP
+
+#include <cstddef>
+
+// Flow control of the DENMs a WebSocket connection publishes: at most `size` DENMs await their
+// acknowledgement, and every acknowledgement tells the client its remaining credit. Not thread-safe
+class PublishWindow {
+public:
+	explicit PublishWindow(size_t size);
+
+	// Take a DENM into the window, false if the window is full
+	bool acquire();
+	// An acknowledged DENM leaves the window
+	void release();
+
+	size_t inFlight() const {
+		return in_flight_;
+	}
+	// DENMs the client may still publish before it is acknowledged
+	size_t credit() const {
+		return size_ - in_flight_;
+	}
+
+private:
+	size_t size_;
+	size_t in_flight_ = 0;
+};
+
+#endif // PUBLISH_WINDOW_HPP
@@ -0,0 +1,98 @@
+#ifndef RATE_LIMITER_HPP
+#define RATE_LIMITER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unordered_map>
+
+// Sustained rate and burst size of a token bucket. A rate of 0 disables the limit
+struct RateLimit {
+	double rate	 = 0; // Requests per second
+	double burst = 0; // Bucket size, at least one request. 0 means one second worth of requests
+};
+
+// Token-bucket rate limits per publisherId and per client IP address.
+//
+// The IP bucket is charged before a POST body is parsed, the publisher bucket once the DENM is validated, so it
+// is the one the DENM is published under.
+// Limits can be changed at runtime; a publisher may have an override of the default publisher limit.
+class RateLimiter {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// At most `max_buckets` buckets are kept per kind; the least recently used one makes room for a new one
+	RateLimiter(RateLimit publisher_limit = RateLimit(), RateLimit ip_limit = RateLimit(), size_t max_buckets = 100000);
+
+	// Take one token from the buckets of `publisher` and `ip`. Returns false, and the seconds until a token is
+	// available in `retry_after`, if either is empty. Empty names are not limited
+	bool allow(const std::string& publisher,
+			   const std::string& ip,
+			   double& retry_after,
+			   Clock::time_point now = Clock::now());
+	// Take one token from the bucket of `ip` alone, before the request is parsed. Only a rejection is counted,
+	// an accepted request is counted when its publisher is charged
+	bool allowIp(const std::string& ip, double& retry_after, Clock::time_point now = Clock::now());
+	// Take up to `count` tokens from both buckets, as many as both hold. Returns the number taken, and the
+	// seconds until the next token is available in `retry_after` if that is less than `count`
+	size_t allowUpTo(const std::string& publisher,
+					 const std::string& ip,
+					 size_t count,
+					 double& retry_after,
+					 Clock::time_point now = Clock::now());
+
+	// Replace the limits from JSON of the form returned by config(). Throws std::invalid_argument on
+	// malformed input
+	void configure(const nlohmann::json& config);
+	// {"publisher": {"rate", "burst"}, "ip": {...}, "publishers": {"<publisherId>": {...}}}
+	nlohmann::json config() const;
+	// Accepted and rejected requests, in total and per publisher
+	nlohmann::json stats() const;
+
+private:
+	struct Bucket {
+		std::string name;
+		double tokens;
+		Clock::time_point updated;
+	};
+
+	// Buckets in least recently used order. The bucket evicted for a new one is the one most likely to have
+	// refilled completely, which makes it equivalent to a new bucket
+	struct BucketTable {
+		std::list<Bucket> lru; // Most recently used first
+		std::unordered_map<std::string, std::list<Bucket>::iterator> index;
+
+		void clear() {
+			lru.clear();
+			index.clear();
+		}
+	};
+
+	struct Counters {
+		uint64_t accepted = 0;
+		uint64_t rejected = 0;
+	};
+
+	// Refill the bucket of `name` and return it, or nullptr if `name` is not limited
+	Bucket* refill(BucketTable& buckets, const std::string& name, const RateLimit& limit, Clock::time_point now);
+	const RateLimit& publisherLimit(const std::string& publisher) const;
+
+	mutable std::mutex lock_;
+	RateLimit publisher_limit_;
+	RateLimit ip_limit_;
+	std::map<std::string, RateLimit> publisher_overrides_;
+
+	size_t max_buckets_;
+	BucketTable publisher_buckets_;
+	BucketTable ip_buckets_;
+
+	Counters total_;
+	uint64_t rejected_by_ip_ = 0;
+	std::map<std::string, Counters> per_publisher_;
+};
+
+#endif // RATE_LIMITER_HPP
@@ -0,0 +1,48 @@
+#ifndef REPLAY_RING_HPP
+#define REPLAY_RING_HPP
+
+#include "subscription_filter.hpp"
+#include "ws_encoding.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Fixed-size ring of the most recent broadcast messages, numbered by a sequence starting at 1.
+//
+// Clients that reconnect catch up from here with the last sequence number they received. Entries hold the
+// shared, already encoded message, nothing is copied or decoded again. There is a single writer. Readers do not
+// hold a ring-wide lock: each slot is read with std::atomic_load, which in libstdc++ briefly takes one of a
+// small pool of locks chosen by the slot's address. A slot overwritten while they read is skipped.
+class ReplayRing {
+public:
+	struct Entry {
+		uint64_t seq;
+		std::shared_ptr<const WsMessage> message;
+		std::shared_ptr<const DenmAttributes> attributes;
+	};
+	using EntryPtr = std::shared_ptr<const Entry>;
+
+	explicit ReplayRing(size_t capacity = 4096);
+
+	// Append a message and return its sequence number. Not thread-safe, callers serialize appends
+	uint64_t append(std::shared_ptr<const WsMessage> message, std::shared_ptr<const DenmAttributes> attributes);
+
+	// Up to the newest `max` entries after `since`, oldest first. `truncated` is set if entries after `since`
+	// are no longer (or were never) in the ring, e.g. after a restart. Thread-safe
+	std::vector<EntryPtr> since(uint64_t since, bool& truncated, size_t max = SIZE_MAX) const;
+
+	uint64_t lastSeq() const {
+		return last_.load(std::memory_order_acquire);
+	}
+	size_t capacity() const {
+		return slots_.size();
+	}
+
+private:
+	// Only accessed through std::atomic_load and std::atomic_store, which are lock-based, not lock-free
+	std::vector<EntryPtr> slots_;
+	std::atomic<uint64_t> last_{0};
+};
+
+#endif // REPLAY_RING_HPP
@@ -0,0 +1,40 @@
+#ifndef SHARD_ASSIGNER_HPP
+#define SHARD_ASSIGNER_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Derives the interchange shardId of an outgoing message from its quadkey.
+//
+// An explicit table maps quadkey prefixes to shards, the longest matching prefix wins. Everything else is
+// spread by consistent hashing: the quadkey is cut to `level` digits, i.e. a Morton range of tiles, and the
+// hash of the range picks a shard with jump consistent hashing. Messages from the same area therefore stay on
+// the same shard, areas are spread evenly, and adding a shard only moves the areas that go to the new shard.
+class ShardAssigner {
+public:
+	// `shard_count` 0 disables assignment. `prefix_table` is "quadkeyPrefix=shardId,...". Throws
+	// std::invalid_argument on malformed input
+	explicit ShardAssigner(unsigned shard_count = 0, const std::string& prefix_table = "", int level = 8);
+
+	bool enabled() const {
+		return shard_count_ > 0;
+	}
+	unsigned shardCount() const {
+		return shard_count_;
+	}
+
+	// 1-based shardId for a quadkey of digits 0-3
+	unsigned assign(const std::string& quadkey) const;
+
+private:
+	static uint64_t mortonPrefix(const std::string& quadkey, int level);
+	static unsigned jumpHash(uint64_t key, unsigned buckets);
+
+	unsigned shard_count_;
+	int level_;
+	size_t longest_prefix_ = 0;
+	std::map<std::string, unsigned> prefixes_;
+};
+
+#endif // SHARD_ASSIGNER_HPP
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+
+// Registry of runtime statistics served on GET /stats.
+//
+// Components register a provider under a name; collect() calls every provider and returns one JSON object
+// keyed by those names. Providers run on the HTTP thread and must be thread-safe.
+class StatsRegistry {
+public:
+	using Provider = std::function<nlohmann::json()>;
+
+	static StatsRegistry& getInstance() {
+		static StatsRegistry instance;
+		return instance;
+	}
+
+	void add(const std::string& name, Provider provider) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		providers_[name] = std::move(provider);
+	}
+
+	void remove(const std::string& name) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		providers_.erase(name);
+	}
+
+	nlohmann::json collect() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		nlohmann::json stats = nlohmann::json::object();
+		for (const auto& provider : providers_) {
+			stats[provider.first] = provider.second();
+		}
+		return stats;
+	}
+
+private:
+	StatsRegistry() = default;
+	std::map<std::string, Provider> providers_;
+	mutable std::mutex mutex_;
+};
@@ -0,0 +1,94 @@
+#ifndef SUBSCRIPTION_FILTER_HPP
+#define SUBSCRIPTION_FILTER_HPP
+
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Attributes of an incoming DENM that subscriptions are matched against, extracted once when it is decoded
+struct DenmAttributes {
+	double latitude	 = 0;
+	double longitude = 0;
+	std::string quadkey;			// Of the event position at zoom 18
+	int cause_code			= -1; // -1 without a situation container
+	int station_type		= -1;
+	int information_quality = -1; // -1 without a situation container
+
+	// From DenmMessage::toJson()
+	static DenmAttributes fromJson(const nlohmann::json& denm);
+};
+
+// What a WebSocket client wants to receive. Every field that is set must match, an empty filter matches
+// every DENM
+struct SubscriptionFilter {
+	// Event position within the box
+	bool has_box		 = false;
+	double min_latitude	 = 0;
+	double min_longitude = 0;
+	double max_latitude	 = 0;
+	double max_longitude = 0;
+	// Event position within one of these tiles
+	std::vector<std::string> quadkeys;
+	std::set<int> cause_codes;
+	std::set<int> station_types;
+	int min_information_quality = -1; // DENMs without a situation container have -1
+
+	// {"boundingBox": {"minLatitude", "minLongitude", "maxLatitude", "maxLongitude"}, "quadkeys": [...],
+	// "causeCodes": [...], "stationTypes": [...], "minInformationQuality": n}, all optional. Throws
+	// std::invalid_argument on malformed filters
+	static SubscriptionFilter fromJson(const nlohmann::json& j);
+
+	bool empty() const;
+	bool matches(const DenmAttributes& denm) const;
+};
+
+// Finds the subscribers whose filter matches a DENM without testing every subscriber.
+//
+// Subscribers with a geographic filter are indexed by quadkey prefix: their quadkeys, or the few tiles
+// covering their bounding box. A DENM only looks up the prefixes of its own quadkey. Subscribers without a
+// geographic filter are indexed by causeCode, only those filtering on neither are candidates for every DENM.
+// Candidates are then checked against their full filter, subscribers with an empty filter always match.
+class SubscriptionIndex {
+public:
+	using SubscriberId = uint64_t;
+
+	// Add a subscriber or replace its filter
+	void set(SubscriberId id, const SubscriptionFilter& filter);
+	void remove(SubscriberId id);
+
+	// Replaces `out` with the matching subscribers, in no particular order
+	void match(const DenmAttributes& denm, std::vector<SubscriberId>& out) const;
+
+	size_t size() const {
+		return filters_.size();
+	}
+	// Subscribers with a non-empty filter
+	size_t filtered() const {
+		return filters_.size() - unfiltered_.size();
+	}
+
+	// Bounding boxes are covered by at most this many tiles, at the deepest zoom level that allows it
+	static constexpr size_t MAX_COVER_TILES = 16;
+
+private:
+	struct Entry {
+		SubscriptionFilter filter;
+		std::vector<std::string> tiles; // Keys in by_tile_
+		bool by_cause = false;			// Listed in by_cause_ under every cause code of the filter
+	};
+
+	static std::vector<std::string> coverBox(const SubscriptionFilter& filter);
+	static void erase(std::vector<SubscriberId>& ids, SubscriberId id);
+
+	std::unordered_map<SubscriberId, Entry> filters_;
+	std::unordered_map<std::string, std::vector<SubscriberId>> by_tile_;
+	std::unordered_map<int, std::vector<SubscriberId>> by_cause_;
+	std::vector<SubscriberId> unindexed_;  // Filtered on neither position nor causeCode
+	std::vector<SubscriberId> unfiltered_; // Empty filter
+	size_t longest_tile_ = 0;
+};
+
+#endif // SUBSCRIPTION_FILTER_HPP
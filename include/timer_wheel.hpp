@@ -0,0 +1,63 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+
+// Hierarchical timer wheel with O(1) schedule and cancel.
+//
+// Time is measured in integer ticks chosen by the owner (e.g. 100 ms). Four levels of 64 slots cover
+// 64^4 ticks; timers further out are parked in the last level and re-placed when it cascades. A timer is
+// identified by a caller chosen 64-bit id, scheduling an id that is already pending moves it.
+// Not thread-safe, the owner serializes access.
+class TimerWheel {
+public:
+	using TimerId = uint64_t;
+
+	explicit TimerWheel(uint64_t start_tick = 0) :
+	  now_(start_tick) {}
+
+	// Fire `id` at the first advance() reaching `deadline_tick`. Deadlines in the past fire on the next tick
+	void schedule(TimerId id, uint64_t deadline_tick);
+	// Returns false if the timer was not pending
+	bool cancel(TimerId id);
+	bool pending(TimerId id) const {
+		return timers_.count(id) != 0;
+	}
+
+	// Advance the wheel to `tick`, calling `expired` for every timer whose deadline has been reached
+	void advance(uint64_t tick, const std::function<void(TimerId)>& expired);
+
+	uint64_t now() const {
+		return now_;
+	}
+	size_t size() const {
+		return timers_.size();
+	}
+
+private:
+	static constexpr int LEVELS		= 4;
+	static constexpr int SLOT_BITS	= 6;
+	static constexpr uint64_t SLOTS = 1u << SLOT_BITS;
+	static constexpr uint64_t MASK	= SLOTS - 1;
+
+	using Slot = std::list<TimerId>;
+
+	struct Timer {
+		uint64_t deadline;
+		Slot* slot;
+		Slot::iterator position;
+	};
+
+	void place(TimerId id, Timer& timer);
+	void cascade(int level, uint64_t tick);
+
+	uint64_t now_;
+	std::array<std::array<Slot, SLOTS>, LEVELS> wheels_;
+	std::unordered_map<TimerId, Timer> timers_;
+};
+
+#endif // TIMER_WHEEL_HPP
@@ -0,0 +1,172 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Identifies the trace of one sampled DENM through the pipeline, all zero if the DENM is not sampled.
+//
+// The context of the DENM being handled is current on its thread (see TraceScope), so EventBus subscribers,
+// which run on the publishing thread, pick it up without it being part of the event. Where a DENM changes
+// threads the context is handed over explicitly, and over AMQP it travels as a W3C "traceparent" application
+// property.
+struct TraceContext {
+	uint64_t trace_hi = 0; // 128-bit trace-id
+	uint64_t trace_lo = 0;
+	uint64_t span_id  = 0; // parent-id sent on to the interchange
+
+	bool sampled() const {
+		return trace_hi != 0 || trace_lo != 0;
+	}
+	// "00-<trace-id>-<parent-id>-01"
+	std::string traceparent() const;
+	// Context of a sampled traceparent, unsampled if it is malformed or not sampled
+	static TraceContext fromTraceparent(const std::string& traceparent);
+
+	// Context of the calling thread
+	static const TraceContext& current();
+};
+
+// Makes a context current on the calling thread for its lifetime
+class TraceScope {
+public:
+	explicit TraceScope(const TraceContext& trace);
+	~TraceScope();
+	TraceScope(const TraceScope&)			 = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	TraceContext previous_;
+};
+
+// A timed stage of a traced DENM
+struct Span {
+	const char* name  = nullptr; // String literal
+	uint64_t trace_hi = 0;
+	uint64_t trace_lo = 0;
+	int64_t start_ns  = 0; // steady_clock
+	int64_t end_ns	  = 0;
+	uint32_t thread	  = 0; // Numbered in order of first use
+};
+
+// Fixed-size ring of the most recent spans, written by any number of threads without a lock.
+//
+// A writer claims the next slot with one atomic increment and guards it with a sequence number, odd while it
+// writes. Readers copy a slot and keep it if its sequence number was the expected one before and after. A
+// writer that finds its slot still being written, by a writer a whole ring earlier, drops its span.
+class SpanRing {
+public:
+	explicit SpanRing(size_t capacity);
+
+	void push(const Span& span);
+	// Up to capacity of the newest spans, oldest first. Spans overwritten while reading are skipped
+	std::vector<Span> snapshot() const;
+
+	size_t capacity() const {
+		return capacity_;
+	}
+	uint64_t dropped() const {
+		return dropped_.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct alignas(64) Slot {
+		std::atomic<uint64_t> seq{0}; // 2n + 1 while span n is written, 2n + 2 once it is complete
+		std::atomic<const char*> name{nullptr};
+		std::atomic<uint64_t> trace_hi{0};
+		std::atomic<uint64_t> trace_lo{0};
+		std::atomic<int64_t> start_ns{0};
+		std::atomic<int64_t> end_ns{0};
+		std::atomic<uint32_t> thread{0};
+	};
+
+	size_t capacity_;
+	std::unique_ptr<Slot[]> slots_;
+	std::atomic<uint64_t> next_{0};
+	std::atomic<uint64_t> dropped_{0};
+};
+
+// Samples DENMs for tracing and collects the spans of their stages.
+//
+// Tracing is off until configure() is called with a positive sample rate. Unsampled DENMs cost a check of
+// the current context per stage; sampled ones an entry in the span ring. The ring is exported in the Chrome
+// trace event format, every DENM on its own track, which chrome://tracing and Perfetto open.
+class Tracer {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	static Tracer& getInstance() {
+		static Tracer instance;
+		return instance;
+	}
+
+	// Trace about `sample_rate` (0 to 1) of the DENMs, keeping the newest `capacity` spans. Call before
+	// DENMs are handled
+	void configure(double sample_rate, size_t capacity = 65536);
+	bool enabled() const {
+		return sample_period_.load(std::memory_order_relaxed) > 0;
+	}
+
+	// Context of a DENM entering the service. Every sample period DENMs one is sampled, continuing `parent`
+	// (e.g. from an incoming traceparent) if it is sampled or starting a new trace otherwise. A sampled parent
+	// never makes a DENM sampled by itself. Unsampled when disabled
+	TraceContext start(const TraceContext& parent = TraceContext());
+	// Record a stage of a sampled trace, does nothing for an unsampled one. `name` must be a string literal
+	void record(const TraceContext& trace, const char* name, Clock::time_point start, Clock::time_point end);
+
+	std::vector<Span> spans() const;
+	// {"traceEvents": [...]} with a complete event per span, timestamps in microseconds
+	nlohmann::json exportChromeTrace() const;
+	// Replace `path` with the exported spans. Throws std::runtime_error if the file cannot be written
+	void writeFile(const std::string& path) const;
+
+	// Write the file every `interval` on a background thread until stopExport(), which writes it once more
+	void startExport(const std::string& path, std::chrono::seconds interval);
+	void stopExport();
+
+private:
+	Tracer() = default;
+	~Tracer();
+
+	std::atomic<uint64_t> sample_period_{0};
+	std::atomic<uint64_t> started_{0};
+	std::unique_ptr<SpanRing> ring_;
+
+	std::string export_path_;
+	std::mutex export_lock_;
+	std::condition_variable export_wakeup_;
+	bool exporting_ = false;
+	std::thread export_thread_;
+};
+
+// Records the time from construction to destruction as a span of the current trace
+class ScopedSpan {
+public:
+	explicit ScopedSpan(const char* name, const TraceContext& trace = TraceContext::current()) :
+	  trace_(trace),
+	  name_(name) {
+		if (trace_.sampled())
+			start_ = Tracer::Clock::now();
+	}
+	~ScopedSpan() {
+		if (trace_.sampled())
+			Tracer::getInstance().record(trace_, name_, start_, Tracer::Clock::now());
+	}
+	ScopedSpan(const ScopedSpan&)			 = delete;
+	ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+private:
+	TraceContext trace_;
+	const char* name_;
+	Tracer::Clock::time_point start_;
+};
+
+#endif // TRACE_HPP
@@ -0,0 +1,42 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads for splitting work into parallel parts.
+//
+// The threads are started once by the owner instead of per request, so concurrent requests share them and
+// a burst of requests cannot start more threads than the pool has. The caller of forEach() works on the
+// parts too, a pool without threads runs everything on the caller.
+class WorkerPool {
+public:
+	explicit WorkerPool(size_t threads);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&)			 = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	size_t size() const {
+		return threads_.size();
+	}
+
+	// Call `part` for every index below `parts` and return once all calls are done. `part` must not throw
+	void forEach(size_t parts, const std::function<void(size_t)>& part);
+
+private:
+	void run();
+
+	std::mutex lock_;
+	std::condition_variable ready_;
+	std::deque<std::function<void()>> tasks_;
+	bool stopping_ = false;
+	std::vector<std::thread> threads_;
+};
+
+#endif // WORKER_POOL_HPP
@@ -0,0 +1,91 @@
+#ifndef WS_ENCODING_HPP
+#define WS_ENCODING_HPP
+
+#include "incoming_denm.hpp"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Encoding of the DENMs a WebSocket client receives, chosen by the client
+enum class WsEncoding {
+	Json,		 // Text frames with DenmMessage::toJson()
+	Uper,		 // Binary frames with a property header and the UPER body as received
+	MessagePack, // Binary frames with the JSON form as MessagePack
+	JsonDeflate	 // Binary frames with the JSON text compressed as a raw deflate stream
+};
+
+constexpr size_t WS_ENCODING_COUNT = 4;
+
+const char* toString(WsEncoding encoding);
+// Throws std::invalid_argument for unknown names
+WsEncoding wsEncodingFromString(const std::string& name);
+
+inline bool isBinary(WsEncoding encoding) {
+	return encoding != WsEncoding::Json;
+}
+
+// Place of a message in the sequence of messages of one actionID, for clients that only want what changed
+struct WsDelta {
+	uint64_t action_key	  = 0;
+	uint64_t previous_seq = 0;	   // Sequence number of the previous message of the action, 0 if none
+	bool final			  = false; // Terminates the action, nothing follows
+	// The JSON text relative to the previous message, given the sequence number of this one
+	std::function<std::string(uint64_t seq)> encode;
+};
+
+// One message in every encoding a client may choose.
+//
+// The JSON text is given, other encodings are produced by `encode` when the first client needs them and then
+// shared by every client that chose the same encoding. frame() is thread-safe.
+class WsMessage {
+public:
+	using Encode = std::function<std::string(WsEncoding encoding)>;
+
+	explicit WsMessage(std::shared_ptr<const std::string> json, Encode encode = nullptr, WsDelta delta = WsDelta()) :
+	  json_(std::move(json)),
+	  encode_(std::move(encode)),
+	  delta_(std::move(delta)) {}
+
+	// Throws std::logic_error if the message cannot be encoded as `encoding`
+	const std::string& frame(WsEncoding encoding) const;
+	// The frame with its sequence number for clients that resume the stream: {"seq": N, "denm": ...} as
+	// text, or the big-endian 64-bit sequence number before a binary frame. A message is only ever given one
+	// sequence number
+	const std::string& sequencedFrame(WsEncoding encoding, uint64_t seq) const;
+
+	// action_key is 0 for messages that are not DENMs
+	const WsDelta& delta() const {
+		return delta_;
+	}
+	// The JSON text relative to the message delta().previous_seq, for clients that received it
+	const std::string& deltaFrame(uint64_t seq) const;
+
+private:
+	std::shared_ptr<const std::string> json_;
+	Encode encode_;
+	WsDelta delta_;
+	mutable std::once_flag delta_once_;
+	mutable std::string delta_frame_;
+	mutable std::once_flag once_[WS_ENCODING_COUNT];
+	mutable std::string frames_[WS_ENCODING_COUNT];
+	mutable std::once_flag sequenced_once_[WS_ENCODING_COUNT];
+	mutable std::string sequenced_frames_[WS_ENCODING_COUNT];
+};
+
+// Encoder of a WsMessage for a received DENM. The UPER frame is a big-endian 16-bit header length, a
+// MessagePack map of stationId, sequenceNumber, referenceTime, causeCode and quadkey, and the UPER body
+std::string encodeIncomingDenm(const IncomingDenm& denm, WsEncoding encoding);
+
+// Delta of an incoming DENM to the previous one with the same actionID: {"type": "active", ...} for an
+// identical repetition, else {"type": "patch", ..., "patch": <JSON Merge Patch>}. Both carry the
+// "actionId" and "sequenceNumber" that identify the DENM and the stream sequence number "seq"
+std::string encodeDenmDelta(const IncomingDenm& previous, const IncomingDenm& denm, uint64_t seq);
+
+// JSON Merge Patch (RFC 7396) that turns `from` into `to`
+nlohmann::json mergePatchOf(const nlohmann::json& from, const nlohmann::json& to);
+
+// Raw deflate stream (RFC 1951) of `data`, as inflated by zlib with windowBits -15 or pako.inflateRaw
+std::string deflateRaw(const std::string& data);
+
+#endif // WS_ENCODING_HPP
@@ -0,0 +1,189 @@
+#ifndef WS_FANOUT_HPP
+#define WS_FANOUT_HPP
+
+#include "metrics.hpp"
+#include "replay_ring.hpp"
+#include "subscription_filter.hpp"
+#include "trace.hpp"
+#include "ws_encoding.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct WsFanoutOptions {
+	// Messages waiting for one client. When full, the client is downgraded: its oldest messages are dropped
+	size_t queue_limit = 256;
+	// A client whose oldest waiting message is older than this is disconnected
+	std::chrono::milliseconds max_lag{5000};
+	// Threads sending to clients, a slow client blocks at most one of them
+	size_t send_threads = 2;
+	// Published messages waiting for the fan-out thread, the oldest are dropped beyond this
+	size_t inbound_limit = 10000;
+	// Recent messages kept for clients that resume the stream
+	size_t replay_size = 4096;
+	// Bytes a client may have been handed beyond what it is assumed to have read, see min_client_rate
+	size_t send_buffer = 4 << 20;
+	// Bytes per second a client is assumed to read at least. Crow buffers the frames it is handed without
+	// limit and does not tell what it has written, so what a client has not read yet is estimated from this
+	// rate. A client whose estimate exceeds send_buffer gets no frames until it has drained, meanwhile its
+	// queue fills up and queue_limit and max_lag apply. 0 hands every frame to Crow at once
+	size_t min_client_rate = 512 << 10;
+};
+
+// Fan-out of encoded messages to WebSocket clients, decoupled from the publisher.
+//
+// publish() only appends the shared buffer to an inbound queue, so the AMQP receiver never waits for a
+// client. A fan-out thread appends every message to a bounded queue per client, and a small pool drains the
+// client queues through their send functions. Clients that chose the same encoding share the same buffer, a
+// message is never copied or encoded per client. Clients that cannot keep up first lose their oldest messages, and are
+// disconnected through their close function once they lag more than max_lag, counting the messages handed to
+// Crow that they are not assumed to have read yet (see WsFanoutOptions::min_client_rate). A client that stops
+// reading entirely is only noticed once the service publishes faster than min_client_rate, below that Crow's
+// buffer of the client grows at the publish rate until the connection times out. Clients may subscribe with a
+// filter, matched on the fan-out thread through a SubscriptionIndex. Every message is numbered and kept in a
+// ReplayRing, a client that resumes from a sequence number first receives what it missed.
+class WsFanout {
+public:
+	using Message	 = std::shared_ptr<const WsMessage>;
+	using Attributes = std::shared_ptr<const DenmAttributes>;
+	using Send		 = std::function<void(const std::string& frame, bool binary)>;
+	using Close		 = std::function<void(const std::string& reason)>;
+	using ClientId	 = SubscriptionIndex::SubscriberId;
+
+	explicit WsFanout(const WsFanoutOptions& options = WsFanoutOptions());
+	~WsFanout();
+
+	void start();
+	void stop();
+
+	// Register a client. `send` runs on a fan-out thread, `close` is called with the fan-out lock held and
+	// must only initiate the close. Either may be called until remove() returns. A client that resumes after
+	// sequence number `resume_from` is first sent the messages after it still in the replay ring, and gets
+	// sequenced frames (see WsMessage::sequencedFrame), without gaps or duplicates between replay and live
+	// messages. Only the newest queue_limit messages are replayed
+	ClientId add(Send send, Close close, std::optional<uint64_t> resume_from = std::nullopt);
+	// Unregister a client, waits for a send to it that is in progress
+	void remove(ClientId id);
+	// Replace the filter of a client, which receives every message until it subscribes
+	void subscribe(ClientId id, const SubscriptionFilter& filter);
+	// Encoding of the messages sent to a client from now on, JSON by default
+	void setEncoding(ClientId id, WsEncoding encoding);
+
+	// Send a client with the JSON encoding only what changed since the message of the same actionID it
+	// received last (see WsDelta), off by default
+	void setDelta(ClientId id, bool enabled);
+	// Clients in delta mode, so a publisher can skip the bookkeeping deltas need while there are none
+	size_t deltaClients() const {
+		return delta_clients_;
+	}
+	// Queue a message for every client whose filter matches `attributes`, or for every client without
+	// attributes. Never blocks on clients. Returns the sequence number of the message. The message keeps the
+	// current trace context
+	uint64_t publish(Message message, Attributes attributes = nullptr);
+
+	// Actions a client in delta mode remembers, it gets full messages again when exceeded
+	static constexpr size_t MAX_CLIENT_ACTIONS = 10000;
+	size_t clients() const;
+	// Thread-safe for readers
+	const ReplayRing& replay() const {
+		return replay_;
+	}
+	// Connected clients, dropped and evicted counters and the latency from publish() to send, which is
+	// recorded as ws_fanout_seconds of the PipelineMetrics
+	nlohmann::json stats() const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Pending {
+		Message message;
+		Clock::time_point published_at;
+		Attributes attributes;
+		uint64_t seq;
+		// Of the publishing thread. Only the copy queued for the first client carries it, so the send of a
+		// sampled DENM to that client is its one "ws.fanout" span
+		TraceContext trace;
+	};
+
+	struct Client {
+		ClientId id;
+		Send send;
+		Close close;
+		WsEncoding encoding = WsEncoding::Json;
+		bool sequenced		= false; // Resumed, frames carry their sequence number
+		uint64_t next_seq	= 0;	 // Older messages were replayed
+		bool delta			= false;
+		// Sequence number of the last message sent per actionID in delta mode, only used by the send thread
+		// that owns the client
+		std::unordered_map<uint64_t, uint64_t> last_seq_by_action;
+		std::deque<Pending> queue;
+		bool scheduled	= false; // Waiting for or owned by a send thread, or throttled
+		bool sending	= false; // A send thread is outside the lock sending to it
+		Clock::time_point in_flight_since; // Publish time of the oldest message being sent while `sending`
+		// Estimate of the bytes handed to Crow that the client has not read yet, as of `unwritten_at`. Only
+		// used by the send thread that owns the client
+		double unwritten = 0;
+		Clock::time_point unwritten_at;
+		Clock::time_point throttled_until; // When a throttled client is scheduled again
+		bool downgraded = false; // Dropped messages since it last caught up
+		bool closed		= false;
+		uint64_t sent	 = 0;
+		uint64_t dropped = 0;
+	};
+	using ClientPtr = std::shared_ptr<Client>;
+
+	void runFanout();
+	void runSender();
+	// False if the client does not take the message
+	bool enqueue(const ClientPtr& client, const Pending& pending);
+	// Count `count` messages dropped from the oldest of a client
+	void drop(Client& client, size_t count);
+	// Drain the unwritten estimate of a client to `now`, whether it may be sent more
+	bool hasSendRoom(Client& client, Clock::time_point now) const;
+	// Schedule the throttled clients that are due again, the time the next one is due if any remain
+	std::optional<Clock::time_point> resumeThrottled(Clock::time_point now);
+	// Whether the delta of a message is sent to a client in delta mode, and remembers that it got the message
+	bool sendsDelta(Client& client, const Pending& pending);
+	void evict(Client& client, const std::string& reason);
+
+	WsFanoutOptions options_;
+
+	mutable std::mutex lock_;
+	std::condition_variable inbound_ready_;
+	std::condition_variable clients_ready_;
+	std::condition_variable idle_;
+	std::deque<Pending> inbound_;
+	std::unordered_map<ClientId, ClientPtr> clients_;
+	std::deque<ClientPtr> ready_;		// Clients with messages and no send thread
+	std::vector<ClientPtr> throttled_;	// Clients over their send buffer, scheduled again by the fan-out thread
+	SubscriptionIndex subscriptions_;
+	ReplayRing replay_; // Appended under lock_
+	ClientId last_id_ = 0;
+
+	uint64_t inbound_dropped_ = 0;
+	uint64_t dropped_		  = 0;
+	uint64_t evicted_		  = 0;
+	uint64_t filtered_out_	  = 0; // Deliveries saved by filters
+	uint64_t resumed_		  = 0;
+	uint64_t deltas_		  = 0; // Delta frames sent instead of full messages
+	uint64_t throttles_		  = 0; // Times a client exceeded its send buffer
+	std::atomic<size_t> delta_clients_{0}; // Changed under lock_
+	MetricHistogram& latency_; // ws_fanout_seconds of the PipelineMetrics
+
+	std::atomic<bool> running_{false};
+	std::thread fanout_thread_;
+	std::vector<std::thread> send_threads_;
+};
+
+#endif // WS_FANOUT_HPP
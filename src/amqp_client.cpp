@@ -1,9 +1,13 @@
 #include "amqp_client.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
 #include "ssl_utils.hpp"
+#include <algorithm>
 #include <iostream>
 #include <proton/connection_options.hpp>
 #include <proton/container.hpp>
 #include <proton/receiver_options.hpp>
+#include <proton/scalar.hpp>
 #include <proton/sender_options.hpp>
 #include <proton/source_options.hpp>
 #include <proton/target.hpp>
@@ -12,19 +16,22 @@
 #include <proton/work_queue.hpp>
 #include <spdlog/spdlog.h>
 
-// Lock output from threads to avoid scrambling
-std::mutex out_lock;
-#define OUT(x)                                                                                                         \
-	do {                                                                                                               \
-		std::lock_guard<std::mutex> l(out_lock);                                                                       \
-		x;                                                                                                             \
-	} while (false)
+TraceContext traceContextOf(const proton::message& m) {
+	const auto& props = m.properties();
+	if (!props.exists("traceparent"))
+		return TraceContext();
+	proton::scalar traceparent = props.get("traceparent");
+	if (traceparent.type() != proton::STRING)
+		return TraceContext();
+	return TraceContext::fromTraceparent(proton::get<std::string>(traceparent));
+}
 
 // Sender implementation
 sender::sender(proton::container& cont, const std::string& url, const std::string& address, const std::string& name) :
   work_queue_(0),
   queued_(0),
   credit_(0),
+  closed_(false),
   address_(address) {
 	proton::sender_options so;
 	so.target(proton::target_options().address(address))
@@ -35,24 +42,75 @@ sender::sender(proton::container& cont, const std::string& url, const std::strin
 }
 
 void sender::send(const proton::message& m) {
+	proton::work_queue* wq;
 	{
 		std::unique_lock<std::mutex> l(lock_);
-		while (!work_queue_ || queued_ >= credit_)
-			sender_ready_.wait(l);
+		wait_for_credit(l);
 		++queued_;
+		wq = work_queue_;
+	}
+	wq->add([=]() { this->do_send(m); });
+}
+
+void sender::send(const std::vector<std::shared_ptr<const proton::message>>& batch) {
+	auto next = batch.begin();
+	while (next != batch.end()) {
+		size_t count;
+		proton::work_queue* wq;
+		{
+			std::unique_lock<std::mutex> l(lock_);
+			wait_for_credit(l);
+			count = std::min<size_t>(credit_ - queued_, batch.end() - next);
+			queued_ += count;
+			wq = work_queue_;
+		}
+		std::vector<std::shared_ptr<const proton::message>> chunk(next, next + count);
+		next += count;
+		wq->add([this, chunk]() { this->do_send(chunk); });
+	}
+}
+
+size_t sender::wait_credit(std::chrono::milliseconds timeout) {
+	std::unique_lock<std::mutex> l(lock_);
+	if (!closed_ && (!work_queue_ || queued_ >= credit_)) {
+		ScopedTimer timer(PipelineMetrics::get().credit_wait);
+		sender_ready_.wait_for(l, timeout, [this]() { return closed_ || (work_queue_ && queued_ < credit_); });
 	}
-	work_queue_->add([=]() { this->do_send(m); });
+	if (closed_)
+		throw closed("sender closed");
+	return work_queue_ && queued_ < credit_ ? credit_ - queued_ : 0;
+}
+
+void sender::wait_for_credit(std::unique_lock<std::mutex>& l) {
+	// Only timed when it actually blocks, sending with credit costs nothing extra
+	if (!closed_ && (!work_queue_ || queued_ >= credit_)) {
+		ScopedTimer timer(PipelineMetrics::get().credit_wait);
+		while (!closed_ && (!work_queue_ || queued_ >= credit_))
+			sender_ready_.wait(l);
+	}
+	if (closed_)
+		throw closed("sender closed");
 }
 
 void sender::close() {
-	work_queue()->add([=]() { sender_.connection().close(); });
+	proton::work_queue* wq = work_queue();
+	if (wq)
+		wq->add([=]() { sender_.connection().close(); });
 }
 
 proton::work_queue* sender::work_queue() {
 	std::unique_lock<std::mutex> l(lock_);
-	while (!work_queue_)
+	while (!work_queue_ && !closed_)
 		sender_ready_.wait(l);
-	return work_queue_;
+	// The work queue of a failed connection is gone with it
+	return closed_ ? nullptr : work_queue_;
+}
+
+void sender::fail(const std::string& what) {
+	spdlog::error("AMQP sender to {} failed: {}", address_, what);
+	std::lock_guard<std::mutex> l(lock_);
+	closed_ = true;
+	sender_ready_.notify_all();
 }
 
 void sender::on_connection_open(proton::connection& c) {
@@ -76,25 +134,80 @@ void sender::on_sendable(proton::sender& s) {
 	sender_ready_.notify_all();
 }
 
+void sender::track(const proton::tracker& t, const proton::message& m) {
+	Unsettled unsettled;
+	if (outcome_handler_ && m.id().type() == proton::STRING) {
+		unsettled.message_id = proton::get<std::string>(m.id());
+	}
+	// Only traced messages pay for looking up the property
+	if (Tracer::getInstance().enabled()) {
+		unsettled.trace = traceContextOf(m);
+	}
+	if (!unsettled.message_id.empty() || unsettled.trace.sampled()) {
+		unsettled.sent_at	= Tracer::Clock::now();
+		unsettled_[t.tag()] = std::move(unsettled);
+	}
+}
+
+void sender::report(const proton::tracker& t, const std::string& outcome) {
+	auto it = unsettled_.find(t.tag());
+	if (it != unsettled_.end() && !it->second.message_id.empty()) {
+		outcome_handler_(it->second.message_id, outcome);
+	}
+}
+
+void sender::on_tracker_accept(proton::tracker& t) {
+	report(t, "accepted");
+}
+
+void sender::on_tracker_reject(proton::tracker& t) {
+	report(t, "rejected");
+}
+
+void sender::on_tracker_release(proton::tracker& t) {
+	report(t, "released");
+}
+
+void sender::on_tracker_settle(proton::tracker& t) {
+	auto it = unsettled_.find(t.tag());
+	if (it == unsettled_.end())
+		return;
+	// From the hand-off to the link to the settlement by the broker
+	if (it->second.trace.sampled())
+		Tracer::getInstance().record(it->second.trace, "amqp.settle", it->second.sent_at, Tracer::Clock::now());
+	unsettled_.erase(it);
+}
+
 void sender::do_send(const proton::message& m) {
-	sender_.send(m);
+	track(sender_.send(m), m);
 	std::lock_guard<std::mutex> l(lock_);
 	--queued_;
 	credit_ = sender_.credit();
 	sender_ready_.notify_all();
 }
 
+void sender::do_send(const std::vector<std::shared_ptr<const proton::message>>& batch) {
+	for (const auto& m : batch) {
+		track(sender_.send(*m), *m);
+	}
+	std::lock_guard<std::mutex> l(lock_);
+	queued_ -= batch.size();
+	credit_ = sender_.credit();
+	sender_ready_.notify_all();
+}
+
+// Only called once the connection is lost for good, disconnects the reconnect options recover from are not
+// reported
 void sender::on_error(const proton::error_condition& e) {
-	spdlog::error("Unexpected error: {}", e.what());
-	throw std::runtime_error(e.what());
+	fail(e.what());
 }
 
 void sender::on_transport_error(proton::transport& t) {
-	spdlog::error("Transport error: {}", t.error().what());
+	fail("transport error: " + t.error().what());
 }
 
 void sender::on_connection_error(proton::connection& c) {
-	spdlog::error("Connection error: {}", c.error().what());
+	fail("connection error: " + c.error().what());
 }
 
 // Receiver implementation
@@ -118,23 +231,18 @@ receiver::receiver(proton::container& cont,
 
 proton::message receiver::receive() {
 	std::unique_lock<std::mutex> l(lock_);
-	spdlog::debug("Waiting for message...");
-
 	while (!closed_ && (!work_queue_ || buffer_.empty())) {
 		can_receive_.wait(l);
-		spdlog::debug("Woke up from wait! closed_: {}, work_queue_: {}, buffer size: {}",
-					  closed_,
-					  (work_queue_ != nullptr),
-					  buffer_.size());
+		LOG_TRACE("Receiver woke up, closed: {}, buffer size: {}", closed_, buffer_.size());
 	}
 	if (closed_)
 		throw closed("receiver closed");
 	if (buffer_.empty()) {
-		spdlog::debug("Buffer is empty after wait!");
 		throw std::runtime_error("No message available");
 	}
 	proton::message m = std::move(buffer_.front());
 	buffer_.pop();
+	PipelineMetrics::get().receiver_buffered.set(static_cast<int64_t>(buffer_.size()));
 	work_queue_->add([=]() { this->receive_done(); });
 	return m;
 }
@@ -163,9 +271,9 @@ void receiver::on_message(proton::delivery& d, proton::message& m) {
 	{
 		std::lock_guard<std::mutex> l(lock_);
 		buffer_.push(m);
-		spdlog::debug("Message pushed to buffer. New buffer size: {}", buffer_.size());
+		PipelineMetrics::get().receiver_buffered.set(static_cast<int64_t>(buffer_.size()));
+		LOG_TRACE("Message pushed to buffer. New buffer size: {}", buffer_.size());
 		can_receive_.notify_all();
-		spdlog::debug("Notified waiting threads");
 	}
 }
 
@@ -173,7 +281,10 @@ void receiver::receive_done() {
 	receiver_.add_credit(1);
 }
 
+// Connection and transport errors end up here too, only once the connection is lost for good
 void receiver::on_error(const proton::error_condition& e) {
-	spdlog::error("Unexpected error: {}", e.what());
-	exit(1);
+	spdlog::error("AMQP receiver from {} failed: {}", address_, e.what());
+	std::lock_guard<std::mutex> l(lock_);
+	closed_ = true;
+	can_receive_.notify_all();
 }
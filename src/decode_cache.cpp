@@ -0,0 +1,39 @@
+#include "decode_cache.hpp"
+
+std::shared_ptr<const IncomingDenm> DecodeCache::find(uint64_t hash, const std::vector<unsigned char>& body) {
+	std::lock_guard<std::mutex> l(lock_);
+	auto it = index_.find(hash);
+	if (it == index_.end() || (*it->second)->uper != body) {
+		++misses_;
+		return nullptr;
+	}
+	lru_.splice(lru_.begin(), lru_, it->second);
+	++hits_;
+	return *it->second;
+}
+
+void DecodeCache::insert(const std::shared_ptr<const IncomingDenm>& denm) {
+	if (capacity_ == 0)
+		return;
+
+	std::lock_guard<std::mutex> l(lock_);
+	auto it = index_.find(denm->hash);
+	if (it != index_.end()) {
+		// Same hash, different body (or a concurrent insert): keep the newest
+		*it->second = denm;
+		lru_.splice(lru_.begin(), lru_, it->second);
+		return;
+	}
+
+	if (lru_.size() >= capacity_) {
+		index_.erase(lru_.back()->hash);
+		lru_.pop_back();
+	}
+	lru_.push_front(denm);
+	index_[denm->hash] = lru_.begin();
+}
+
+size_t DecodeCache::size() const {
+	std::lock_guard<std::mutex> l(lock_);
+	return lru_.size();
+}
@@ -0,0 +1,87 @@
+#include "delivery_status.hpp"
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+
+namespace {
+const char* const STATE_NAMES[] = {"pending", "queued", "delivered", "rejected", "released", "superseded", "failed"};
+} // namespace
+
+const char* toString(DeliveryState state) {
+	return STATE_NAMES[static_cast<size_t>(state)];
+}
+
+DeliveryState deliveryStateFromString(const std::string& name) {
+	for (size_t i = 0; i < sizeof(STATE_NAMES) / sizeof(STATE_NAMES[0]); ++i) {
+		if (name == STATE_NAMES[i])
+			return static_cast<DeliveryState>(i);
+	}
+	throw std::invalid_argument("Unknown delivery state: " + name);
+}
+
+DeliveryStatusTable::DeliveryStatusTable(size_t capacity) :
+  capacity_(capacity > 0 ? capacity : 1),
+  // IDs of different runs must not collide, a client may still poll an ID from before a restart
+  salt_(std::random_device()()) {}
+
+int64_t DeliveryStatusTable::nowMs() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+	  .count();
+}
+
+std::string DeliveryStatusTable::create(int64_t now_ms) {
+	std::lock_guard<std::mutex> l(lock_);
+	char id[24];
+	std::snprintf(id,
+				  sizeof(id),
+				  "%08x%012llx",
+				  static_cast<unsigned>(salt_),
+				  static_cast<unsigned long long>(++next_));
+
+	if (order_.size() >= capacity_) {
+		entries_.erase(order_.front());
+		order_.pop_front();
+	}
+	entries_.emplace(id, Entry{DeliveryState::Pending, "", now_ms, now_ms});
+	order_.emplace_back(id);
+	return id;
+}
+
+void DeliveryStatusTable::update(const std::string& id, DeliveryState state, const std::string& error, int64_t now_ms) {
+	std::lock_guard<std::mutex> l(lock_);
+	auto it = entries_.find(id);
+	if (it == entries_.end())
+		return;
+
+	// Repetitions of a DENM are sent with its message-id and settled again, the first outcome is the one
+	// of the publication
+	Entry& entry = it->second;
+	if (isFinal(entry.state))
+		return;
+	entry.state		 = state;
+	entry.error		 = error;
+	entry.updated_ms = now_ms;
+}
+
+std::optional<nlohmann::json> DeliveryStatusTable::lookup(const std::string& id) const {
+	std::lock_guard<std::mutex> l(lock_);
+	auto it = entries_.find(id);
+	if (it == entries_.end())
+		return std::nullopt;
+
+	const Entry& entry = it->second;
+	nlohmann::json j;
+	j["id"]		= id;
+	j["status"] = toString(entry.state);
+	if (!entry.error.empty()) {
+		j["error"] = entry.error;
+	}
+	j["createdAt"] = entry.created_ms;
+	j["updatedAt"] = entry.updated_ms;
+	return j;
+}
+
+size_t DeliveryStatusTable::size() const {
+	std::lock_guard<std::mutex> l(lock_);
+	return entries_.size();
+}
@@ -0,0 +1,112 @@
+#include "denm_batch.hpp"
+#include <map>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+const char* const NOT_SENT = "No interchange connection to send to";
+} // namespace
+
+DenmBatch::DenmBatch(const std::string& body, Format format, size_t max_items) :
+  max_items_(max_items) {
+	if (format == Format::Ndjson) {
+		size_t begin = 0;
+		while (begin < body.size() && !tooLarge()) {
+			size_t end = std::min(body.find('\n', begin), body.size());
+			std::string_view line(body.data() + begin, end - begin);
+			begin = end + 1;
+			if (line.find_first_not_of(" \t\r") == std::string::npos)
+				continue;
+			add(nlohmann::json::parse(line.begin(), line.end(), nullptr, false));
+		}
+	} else {
+		auto items = nlohmann::json::parse(body, nullptr, false);
+		if (items.is_discarded())
+			throw std::invalid_argument("Invalid JSON");
+		if (!items.is_array())
+			throw std::invalid_argument("Expected a JSON array");
+		for (auto& item : items) {
+			if (tooLarge())
+				break;
+			add(std::move(item));
+		}
+	}
+}
+
+void DenmBatch::add(nlohmann::json item) {
+	if (item.is_object()) {
+		submitted_.push_back(errors_.size());
+		items_.push_back(std::move(item));
+		errors_.emplace_back();
+	} else {
+		errors_.emplace_back(item.is_discarded() ? "Invalid JSON" : "Item is not a JSON object");
+	}
+}
+
+double DenmBatch::limit(RateLimiter& limiter, const std::string& ip) {
+	// Items of a publisher in submission order, so the first ones get the tokens
+	std::map<std::string, std::vector<size_t>> by_publisher;
+	for (size_t n = 0; n < items_.size(); ++n) {
+		auto publisher = items_[n].find("publisherId");
+		if (publisher == items_[n].end() || !publisher->is_string()) {
+			errors_[submitted_[n]] = "Missing field publisherId";
+			continue;
+		}
+		by_publisher[publisher->get<std::string>()].push_back(submitted_[n]);
+	}
+
+	double retry_after = 0;
+	for (const auto& publisher : by_publisher) {
+		const auto& numbers = publisher.second;
+		double wait			= 0;
+		size_t allowed		= limiter.allowUpTo(publisher.first, ip, numbers.size(), wait);
+		for (size_t k = allowed; k < numbers.size(); ++k) {
+			errors_[numbers[k]] = "Rate limit exceeded";
+		}
+		retry_after = std::max(retry_after, wait);
+	}
+	return retry_after;
+}
+
+std::shared_ptr<OutgoingDenmBatch> DenmBatch::outgoing() const {
+	auto batch = std::make_shared<OutgoingDenmBatch>();
+	for (size_t n = 0; n < items_.size(); ++n) {
+		if (errors_[submitted_[n]].empty())
+			batch->items.push_back(items_[n]);
+	}
+	batch->errors.assign(batch->items.size(), NOT_SENT);
+	return batch;
+}
+
+void DenmBatch::report(const OutgoingDenmBatch& sent) {
+	size_t k = 0;
+	for (size_t n = 0; n < items_.size() && k < sent.items.size(); ++n) {
+		std::string& error = errors_[submitted_[n]];
+		if (!error.empty())
+			continue;
+		error = k < sent.errors.size() ? sent.errors[k] : NOT_SENT;
+		++k;
+	}
+}
+
+size_t DenmBatch::pending() const {
+	size_t pending = 0;
+	for (const auto& error : errors_) {
+		pending += error.empty();
+	}
+	return pending;
+}
+
+nlohmann::json DenmBatch::results() const {
+	nlohmann::json results = nlohmann::json::array();
+	size_t accepted		   = 0;
+	for (size_t i = 0; i < errors_.size(); ++i) {
+		if (errors_[i].empty()) {
+			++accepted;
+			results.push_back({{"index", i}, {"status", "accepted"}});
+		} else {
+			results.push_back({{"index", i}, {"status", "rejected"}, {"error", errors_[i]}});
+		}
+	}
+	return {{"accepted", accepted}, {"rejected", errors_.size() - accepted}, {"results", std::move(results)}};
+}
@@ -0,0 +1,146 @@
+#include "denm_body.hpp"
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+// The AMQP properties of a UPER body, by the header they travel in
+const std::vector<std::pair<const char*, const char*>> STRING_HEADERS = {
+  {"X-Publisher-Id", "publisherId"},
+  {"X-Publication-Id", "publicationId"},
+  {"X-Originating-Country", "originatingCountry"},
+  {"X-Protocol-Version", "protocolVersion"},
+  {"X-Message-Type", "messageType"},
+  {"X-Quad-Tree", "quadTree"},
+  {"X-Timestamp", "timestamp"},
+  {"X-Relation", "relation"},
+};
+const std::vector<std::pair<const char*, const char*>> NUMBER_HEADERS = {
+  {"X-Latitude", "latitude"},
+  {"X-Longitude", "longitude"},
+};
+const std::vector<std::pair<const char*, const char*>> INTEGER_HEADERS = {
+  {"X-Shard-Id", "shardId"},
+  {"X-Shard-Count", "shardCount"},
+};
+
+// The whole of `value` as a number, std::stod and std::stoll alone accept trailing garbage
+template <typename Number>
+Number parseNumber(const char* header, const std::string& value) {
+	size_t parsed = 0;
+	Number number = 0;
+	try {
+		if constexpr (std::is_floating_point<Number>::value) {
+			number = std::stod(value, &parsed);
+		} else {
+			number = std::stoll(value, &parsed);
+		}
+	} catch (const std::exception&) {
+		parsed = 0;
+	}
+	if (parsed == 0 || parsed != value.size())
+		throw std::invalid_argument(std::string("Invalid ") + header + " header");
+	return number;
+}
+} // namespace
+
+DenmBodyFormat denmBodyFormat(const std::string& content_type) {
+	if (content_type.find("application/octet-stream") != std::string::npos)
+		return DenmBodyFormat::Uper;
+	if (content_type.find("msgpack") != std::string::npos)
+		return DenmBodyFormat::MessagePack;
+	if (content_type.find("application/cbor") != std::string::npos)
+		return DenmBodyFormat::Cbor;
+	return DenmBodyFormat::Json;
+}
+
+nlohmann::json parseDenmBody(DenmBodyFormat format, const std::string& body) {
+	nlohmann::json denm;
+	switch (format) {
+	case DenmBodyFormat::MessagePack:
+		denm = nlohmann::json::from_msgpack(body, true, false);
+		if (denm.is_discarded())
+			throw std::invalid_argument("Invalid MessagePack");
+		break;
+	case DenmBodyFormat::Cbor:
+		denm = nlohmann::json::from_cbor(body, true, false);
+		if (denm.is_discarded())
+			throw std::invalid_argument("Invalid CBOR");
+		break;
+	case DenmBodyFormat::Json:
+		denm = nlohmann::json::parse(body, nullptr, false);
+		if (denm.is_discarded())
+			throw std::invalid_argument("Invalid JSON");
+		break;
+	case DenmBodyFormat::Uper:
+		throw std::invalid_argument("A UPER body is not a JSON document");
+	}
+	return denm;
+}
+
+std::string missingProperty(const nlohmann::json& properties) {
+	for (const char* required : {"publisherId", "publicationId", "originatingCountry", "protocolVersion"}) {
+		if (!properties.contains(required))
+			return required;
+	}
+	return "";
+}
+
+std::shared_ptr<OutgoingUperDenm> uperDenmOf(const std::function<std::string(const char*)>& header,
+											 const std::string& body) {
+	auto denm		 = std::make_shared<OutgoingUperDenm>();
+	auto& properties = denm->properties;
+	properties		 = {{"messageType", "DENM"}};
+	for (const auto& property : STRING_HEADERS) {
+		std::string value = header(property.first);
+		if (!value.empty())
+			properties[property.second] = value;
+	}
+	for (const auto& property : NUMBER_HEADERS) {
+		std::string value = header(property.first);
+		if (!value.empty())
+			properties[property.second] = parseNumber<double>(property.first, value);
+	}
+	for (const auto& property : INTEGER_HEADERS) {
+		std::string value = header(property.first);
+		if (!value.empty())
+			properties[property.second] = parseNumber<long long>(property.first, value);
+	}
+	std::string missing = missingProperty(properties);
+	if (!missing.empty())
+		throw std::invalid_argument("Missing header for " + missing);
+	std::string interval = header("X-Repetition-Interval-Ms");
+	if (!interval.empty()) {
+		properties["repetition"]["intervalMs"] = parseNumber<long long>("X-Repetition-Interval-Ms", interval);
+		std::string duration				   = header("X-Repetition-Duration-Ms");
+		if (!duration.empty())
+			properties["repetition"]["durationMs"] = parseNumber<long long>("X-Repetition-Duration-Ms", duration);
+	}
+	if (body.empty())
+		throw std::invalid_argument("Empty UPER body");
+	denm->uper.assign(body.begin(), body.end());
+	return denm;
+}
+
+std::shared_ptr<OutgoingUperDenm> uperDenmOfFrame(const std::string& frame, nlohmann::json& id) {
+	size_t header_size = 0;
+	if (frame.size() >= 2)
+		header_size = (static_cast<unsigned char>(frame[0]) << 8) | static_cast<unsigned char>(frame[1]);
+	if (header_size == 0 || frame.size() <= 2 + header_size)
+		throw std::invalid_argument("Expected a property header and a UPER body");
+
+	auto denm		 = std::make_shared<OutgoingUperDenm>();
+	auto& properties = denm->properties;
+	properties		 = nlohmann::json::from_msgpack(frame.substr(2, header_size), true, false);
+	if (properties.is_discarded() || !properties.is_object())
+		throw std::invalid_argument("Property header is not a MessagePack map");
+	id = properties.value("id", nlohmann::json());
+	properties.erase("id");
+	properties.emplace("messageType", "DENM");
+	std::string missing = missingProperty(properties);
+	if (!missing.empty())
+		throw std::invalid_argument("Missing property " + missing);
+	denm->uper.assign(frame.begin() + 2 + header_size, frame.end());
+	return denm;
+}
@@ -0,0 +1,187 @@
+#include "denm_lifecycle.hpp"
+#include "event_bus.hpp"
+#include "logging.hpp"
+#include <spdlog/spdlog.h>
+#include <vector>
+
+const char* toString(DenmTransition transition) {
+	switch (transition) {
+	case DenmTransition::New:
+		return "new";
+	case DenmTransition::Update:
+		return "update";
+	case DenmTransition::Repetition:
+		return "repetition";
+	case DenmTransition::Stale:
+		return "stale";
+	case DenmTransition::Cancellation:
+		return "cancellation";
+	case DenmTransition::Negation:
+		return "negation";
+	case DenmTransition::Expiry:
+		return "expiry";
+	}
+	return "unknown";
+}
+
+const char* toString(DenmDirection direction) {
+	return direction == DenmDirection::Incoming ? "incoming" : "outgoing";
+}
+
+DenmLifecycle::DenmLifecycle(std::chrono::milliseconds tick) :
+  tick_(tick.count() > 0 ? tick : std::chrono::milliseconds(1)),
+  wheel_(tickOf(nowMs())) {}
+
+DenmLifecycle::~DenmLifecycle() {
+	stop();
+}
+
+void DenmLifecycle::start() {
+	if (running_.exchange(true))
+		return;
+
+	expiry_thread_ = std::thread([this]() {
+		std::unique_lock<std::mutex> l(expiry_lock_);
+		while (running_) {
+			expiry_cv_.wait_for(l, tick_);
+			l.unlock();
+			expire(nowMs());
+			l.lock();
+		}
+	});
+}
+
+void DenmLifecycle::stop() {
+	{
+		std::lock_guard<std::mutex> l(expiry_lock_);
+		if (!running_.exchange(false))
+			return;
+	}
+	expiry_cv_.notify_all();
+	if (expiry_thread_.joinable())
+		expiry_thread_.join();
+}
+
+int64_t DenmLifecycle::nowMs() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+	  .count();
+}
+
+uint64_t DenmLifecycle::keyOf(DenmDirection direction, const DenmActionInfo& info) {
+	return info.key() | (direction == DenmDirection::Outgoing ? (uint64_t(1) << 48) : 0);
+}
+
+uint64_t DenmLifecycle::tickOf(int64_t ms) const {
+	// Round up so an event never expires before its deadline
+	return ms <= 0 ? 0 : static_cast<uint64_t>((ms + tick_.count() - 1) / tick_.count());
+}
+
+DenmTransition DenmLifecycle::apply(DenmDirection direction,
+									const DenmActionInfo& info,
+									const nlohmann::json& denm,
+									int64_t now_ms) {
+	uint64_t key		  = keyOf(direction, info);
+	int64_t expires_at	  = info.expiresAtMs();
+	Shard& shard		  = shardOf(key);
+	DenmTransition result = DenmTransition::Stale;
+
+	{
+		std::lock_guard<std::mutex> l(shard.lock);
+		auto it = shard.entries.find(key);
+
+		if (info.termination != DenmActionInfo::Termination::None) {
+			// Only the termination that ends a known event is a transition; repeated terminations, and those of
+			// unknown or already terminated events, are stale
+			if (it != shard.entries.end()) {
+				result = info.termination == DenmActionInfo::Termination::Cancellation ? DenmTransition::Cancellation
+																						: DenmTransition::Negation;
+				shard.entries.erase(it);
+				std::lock_guard<std::mutex> wl(wheel_lock_);
+				wheel_.cancel(key);
+			}
+		} else if (it != shard.entries.end() && info.reference_time_ms <= it->second.info.reference_time_ms) {
+			result = info.reference_time_ms == it->second.info.reference_time_ms ? DenmTransition::Repetition
+																				 : DenmTransition::Stale;
+		} else if (expires_at <= now_ms) {
+			// Already past its validity, a late copy of an event that should be gone
+			result = DenmTransition::Stale;
+		} else {
+			result			 = it == shard.entries.end() ? DenmTransition::New : DenmTransition::Update;
+			uint64_t deadline = tickOf(expires_at);
+			shard.entries[key] = Entry{direction, info, deadline};
+			std::lock_guard<std::mutex> wl(wheel_lock_);
+			wheel_.schedule(key, deadline);
+		}
+	}
+
+	if (result != DenmTransition::Repetition && result != DenmTransition::Stale) {
+		publish(result, direction, info, denm);
+	}
+	return result;
+}
+
+void DenmLifecycle::expire(int64_t now_ms) {
+	uint64_t now_tick = tickOf(now_ms);
+	std::vector<uint64_t> fired;
+	{
+		std::lock_guard<std::mutex> wl(wheel_lock_);
+		if (now_tick <= wheel_.now())
+			return;
+		wheel_.advance(now_tick, [&fired](TimerWheel::TimerId id) { fired.push_back(id); });
+	}
+
+	for (uint64_t key : fired) {
+		Shard& shard = shardOf(key);
+		Entry expired;
+		{
+			std::lock_guard<std::mutex> l(shard.lock);
+			auto it = shard.entries.find(key);
+			// An update may have rescheduled the event after the wheel fired
+			if (it == shard.entries.end() || it->second.deadline_tick > now_tick)
+				continue;
+			expired = it->second;
+			shard.entries.erase(it);
+		}
+		publish(DenmTransition::Expiry, expired.direction, expired.info, nullptr);
+	}
+}
+
+size_t DenmLifecycle::size() const {
+	size_t total = 0;
+	for (const auto& shard : shards_) {
+		std::lock_guard<std::mutex> l(shard.lock);
+		total += shard.entries.size();
+	}
+	return total;
+}
+
+void DenmLifecycle::publish(DenmTransition transition,
+							DenmDirection direction,
+							const DenmActionInfo& info,
+							const nlohmann::json& denm) const {
+	LOG_DEBUG("DENM {} {}:{} {}",
+			  toString(direction),
+			  info.originating_station_id,
+			  info.sequence_number,
+			  toString(transition));
+	// Every sent and received DENM gets here, the events are only built for someone
+	auto& bus = EventBus::getInstance();
+	if (bus.hasSharedSubscribers("denm.lifecycle")) {
+		bus.publishShared("denm.lifecycle",
+						  std::make_shared<const DenmLifecycleEvent>(DenmLifecycleEvent{transition, direction, info}));
+	}
+	if (!bus.hasSubscribers("denm.lifecycle"))
+		return;
+
+	nlohmann::json event;
+	event["transition"]			  = toString(transition);
+	event["direction"]			  = toString(direction);
+	event["originatingStationId"] = info.originating_station_id;
+	event["sequenceNumber"]		  = info.sequence_number;
+	event["referenceTime"]		  = info.reference_time_ms;
+	event["expiresAt"]			  = info.expiresAtMs();
+	if (!denm.is_null()) {
+		event["denm"] = denm;
+	}
+	bus.publish("denm.lifecycle", event);
+}
@@ -1,5 +1,6 @@
 #include "denm_message.hpp"
 #include "crow.h"
+#include "logging.hpp"
 #include <iomanip>
 #include <spdlog/spdlog.h>
 #include <sstream>
@@ -101,6 +102,32 @@ TimestampIts_t DenmMessage::createItsTimestamp(time_t unix_timestamp) {
 	return timestamp;
 }
 
+int64_t DenmMessage::itsTimestampToUnixMs(const TimestampIts_t& timestamp) {
+	long msec_since_2004;
+	if (asn_INTEGER2long(&timestamp, &msec_since_2004) != 0) {
+		throw std::runtime_error("Failed to decode ITS timestamp");
+	}
+	return static_cast<int64_t>(UTC_2004) * 1000 + msec_since_2004;
+}
+
+DenmActionInfo DenmMessage::actionInfo() const {
+	const auto& mgmt = denm->denm.management;
+
+	DenmActionInfo info;
+	info.originating_station_id = static_cast<uint32_t>(mgmt.actionID.originatingStationID);
+	info.sequence_number		= static_cast<uint16_t>(mgmt.actionID.sequenceNumber);
+	info.detection_time_ms		= itsTimestampToUnixMs(mgmt.detectionTime);
+	info.reference_time_ms		= itsTimestampToUnixMs(mgmt.referenceTime);
+	if (mgmt.validityDuration) {
+		info.validity_duration_s = static_cast<uint32_t>(*mgmt.validityDuration);
+	}
+	if (mgmt.termination) {
+		info.termination = *mgmt.termination == Termination_isNegation ? DenmActionInfo::Termination::Negation
+																	   : DenmActionInfo::Termination::Cancellation;
+	}
+	return info;
+}
+
 void DenmMessage::fromUper(const std::vector<unsigned char>& data) {
 	void* decoded = nullptr;
 	asn_dec_rval_t rval;
@@ -134,12 +161,19 @@ nlohmann::json DenmMessage::toJson() const {
 	// Management Container
 	auto& mgmt									  = denm->denm.management;
 	j["management"]["actionId"]					  = mgmt.actionID.originatingStationID;
+	j["management"]["sequenceNumber"]			  = mgmt.actionID.sequenceNumber;
 	j["management"]["detectionTime"]			  = formatToIso8601Timestamp(mgmt.detectionTime);
 	j["management"]["referenceTime"]			  = formatToIso8601Timestamp(mgmt.referenceTime);
 	j["management"]["stationType"]				  = mgmt.stationType;
 	j["management"]["eventPosition"]["latitude"]  = mgmt.eventPosition.latitude / 10000000.0;
 	j["management"]["eventPosition"]["longitude"] = mgmt.eventPosition.longitude / 10000000.0;
 	j["management"]["eventPosition"]["altitude"]  = mgmt.eventPosition.altitude.altitudeValue / 100.0;
+	if (mgmt.validityDuration) {
+		j["management"]["validityDuration"] = *mgmt.validityDuration;
+	}
+	if (mgmt.termination) {
+		j["management"]["termination"] = *mgmt.termination;
+	}
 
 	// Situation Container (if present)
 	if (denm->denm.situation) {
@@ -188,7 +222,10 @@ DenmMessage DenmMessage::fromJson(const nlohmann::json& j) {
 	// Management Container
 	auto& mgmt						   = msg.denm->denm.management;
 	mgmt.actionID.originatingStationID = j["management"]["actionId"];
-	
+	if (j["management"].contains("sequenceNumber")) {
+		mgmt.actionID.sequenceNumber = j["management"]["sequenceNumber"];
+	}
+
 	// Handle detection and reference times
 	if (j["management"].contains("detectionTime")) {
 		mgmt.detectionTime = createItsTimestamp(
@@ -208,6 +245,14 @@ DenmMessage DenmMessage::fromJson(const nlohmann::json& j) {
 
 	mgmt.stationType				   = j["management"]["stationType"];
 
+	// Optional lifecycle fields
+	if (j["management"].contains("validityDuration")) {
+		msg.setValidityDuration(std::chrono::seconds(j["management"]["validityDuration"].get<int>()));
+	}
+	if (j["management"].contains("termination")) {
+		msg.setTermination(j["management"]["termination"].get<int>());
+	}
+
 	// Event Position
 	mgmt.eventPosition.latitude =
 	  static_cast<int32_t>(j["management"]["eventPosition"]["latitude"].get<double>() * 10000000.0);
@@ -255,24 +300,16 @@ std::vector<unsigned char> DenmMessage::getUperEncoded() const {
 	size_t buffer_size = 1024; // 1KB should be enough for most DENM messages
 	buffer.resize(buffer_size);
 
-	spdlog::debug("Attempting UPER encoding of DENM message");
-
 	// Debug print the key fields before encoding
-	spdlog::debug("DENM Header - Protocol Version: {}, Message ID: {}, Station ID: {}",
-				  denm->header.protocolVersion,
-				  denm->header.messageID,
-				  denm->header.stationID);
-
-	spdlog::debug("Management Container - Station Type: {}, Action ID: {}, Traces: {}",
-				  denm->denm.management.stationType,
-				  denm->denm.management.actionID.sequenceNumber,
-				  denm->denm.location ? "present" : "nullptr");
-
-	// Additional debug for mandatory fields
-	spdlog::debug("Event Position - Lat: {}, Lon: {}, Alt: {}",
-				  denm->denm.management.eventPosition.latitude,
-				  denm->denm.management.eventPosition.longitude,
-				  denm->denm.management.eventPosition.altitude.altitudeValue);
+	LOG_DEBUG("Encoding DENM - Station ID: {}, Station Type: {}, Action ID: {}, Lat: {}, Lon: {}, Alt: {}, "
+			  "Location: {}",
+			  denm->header.stationID,
+			  denm->denm.management.stationType,
+			  denm->denm.management.actionID.sequenceNumber,
+			  denm->denm.management.eventPosition.latitude,
+			  denm->denm.management.eventPosition.longitude,
+			  denm->denm.management.eventPosition.altitude.altitudeValue,
+			  denm->denm.location ? "present" : "nullptr");
 
 	// Attempt to encode directly to the buffer
 	ec = uper_encode_to_buffer(&asn_DEF_DENM, nullptr, denm.get(), buffer.data(), buffer_size);
@@ -289,17 +326,17 @@ std::vector<unsigned char> DenmMessage::getUperEncoded() const {
 	// Calculate the actual size in bytes (rounding up to nearest byte)
 	size_t actual_size = (ec.encoded + 7) / 8;
 
-	spdlog::debug("Successfully encoded DENM message - {} bits ({} bytes)", ec.encoded, actual_size);
-
 	// Resize the buffer to the actual encoded size
 	buffer.resize(actual_size);
 
-	// Debug print the encoded data
-	std::stringstream hex_output;
-	for (size_t i = 0; i < actual_size; i++) {
-		hex_output << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(buffer[i]) << " ";
+	// Debug print the encoded data, only built if it is logged
+	if (logEnabled(spdlog::level::trace)) {
+		std::stringstream hex_output;
+		for (size_t i = 0; i < actual_size; i++) {
+			hex_output << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(buffer[i]) << " ";
+		}
+		LOG_TRACE("UPER encoded data ({} bits): {}", ec.encoded, hex_output.str());
 	}
-	spdlog::debug("UPER encoded data: {}", hex_output.str());
 
 	return buffer;
 }
@@ -0,0 +1,135 @@
+#include "denm_repeater.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <utility>
+
+DenmRepeater::DenmRepeater(BatchSender send, std::chrono::milliseconds tick) :
+  send_(std::move(send)),
+  tick_(tick.count() > 0 ? tick : std::chrono::milliseconds(1)),
+  wheel_(tickOf(nowMs())) {}
+
+DenmRepeater::~DenmRepeater() {
+	stop();
+}
+
+void DenmRepeater::start() {
+	if (running_.exchange(true))
+		return;
+
+	thread_ = std::thread([this]() {
+		std::unique_lock<std::mutex> l(lock_);
+		while (running_) {
+			// Nothing to repeat, sleep until a DENM is registered
+			if (entries_.empty()) {
+				wakeup_.wait(l);
+			} else {
+				wakeup_.wait_for(l, tick_);
+			}
+			l.unlock();
+			try {
+				run(nowMs());
+			} catch (const std::exception& e) {
+				spdlog::error("Failed to send DENM repetitions: {}", e.what());
+			}
+			l.lock();
+		}
+	});
+}
+
+void DenmRepeater::stop() {
+	{
+		std::lock_guard<std::mutex> l(lock_);
+		if (!running_.exchange(false))
+			return;
+	}
+	wakeup_.notify_all();
+	if (thread_.joinable())
+		thread_.join();
+}
+
+int64_t DenmRepeater::nowMs() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+	  .count();
+}
+
+uint64_t DenmRepeater::tickOf(int64_t ms) const {
+	return ms <= 0 ? 0 : static_cast<uint64_t>(ms / tick_.count());
+}
+
+void DenmRepeater::add(uint64_t key,
+					   MessagePtr message,
+					   std::chrono::milliseconds interval,
+					   std::chrono::milliseconds duration,
+					   const OutboundRoute& route,
+					   int64_t now_ms) {
+	if (interval.count() <= 0) {
+		throw std::invalid_argument("Repetition interval must be positive");
+	}
+
+	{
+		std::lock_guard<std::mutex> l(lock_);
+		// Intervals shorter than a tick are repeated every tick
+		uint64_t interval_ticks = std::max<uint64_t>(1, interval.count() / tick_.count());
+		uint64_t end_tick		= tickOf(now_ms + duration.count());
+		uint64_t first_tick		= tickOf(now_ms) + interval_ticks;
+		if (first_tick > end_tick) {
+			// Too short to repeat, but still replaces a previous registration
+			entries_.erase(key);
+			wheel_.cancel(key);
+			return;
+		}
+		entries_[key] = Entry{std::move(message), route, interval_ticks, end_tick};
+		wheel_.schedule(key, first_tick);
+	}
+	wakeup_.notify_all();
+}
+
+bool DenmRepeater::remove(uint64_t key) {
+	std::lock_guard<std::mutex> l(lock_);
+	wheel_.cancel(key);
+	return entries_.erase(key) != 0;
+}
+
+void DenmRepeater::run(int64_t now_ms) {
+	uint64_t now_tick = tickOf(now_ms);
+	std::vector<Repetition> batch;
+	{
+		std::lock_guard<std::mutex> l(lock_);
+		if (now_tick <= wheel_.now())
+			return;
+
+		std::vector<std::pair<uint64_t, uint64_t>> fired;
+		wheel_.advance(now_tick, [this, &fired](TimerWheel::TimerId key) { fired.emplace_back(key, wheel_.now()); });
+
+		for (const auto& timer : fired) {
+			auto it = entries_.find(timer.first);
+			if (it == entries_.end())
+				continue;
+			Entry& entry = it->second;
+			batch.push_back(Repetition{timer.first, entry.message, entry.route});
+
+			// Keep the cadence of the original deadline, but skip repetitions missed while stalled
+			uint64_t next = timer.second + entry.interval_ticks;
+			if (next <= now_tick) {
+				next = now_tick + entry.interval_ticks;
+			}
+			if (next > entry.end_tick) {
+				entries_.erase(it);
+			} else {
+				wheel_.schedule(timer.first, next);
+			}
+		}
+	}
+
+	if (!batch.empty()) {
+		LOG_DEBUG("Repeating {} DENM(s)", batch.size());
+		send_(batch);
+	}
+}
+
+size_t DenmRepeater::size() const {
+	std::lock_guard<std::mutex> l(lock_);
+	return entries_.size();
+}
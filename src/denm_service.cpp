@@ -1,20 +1,202 @@
 #include "denm_service.hpp"
+#include "denm_batch.hpp"
+#include "denm_body.hpp"
 #include "event_bus.hpp"
 #include "geo_utils.hpp"
+#include "incoming_denm.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "outgoing_denm.hpp"
+#include "stats_registry.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
 #include <spdlog/spdlog.h>
+#include <sstream>
+#include <thread>
 
-DenmService::DenmService(const std::string& http_host, int http_port, int ws_port) :
+namespace {
+// The publisherId a validated DENM is published under, which is what its rate limit is charged to
+std::string publisherOf(const nlohmann::json& denm) {
+	const auto& publisher = denm.at("publisherId");
+	if (!publisher.is_string())
+		throw std::invalid_argument("publisherId must be a string");
+	return publisher.get<std::string>();
+}
+
+// Compare secrets in time independent of where they differ
+bool equalSecrets(const std::string& a, const std::string& b) {
+	unsigned char difference = a.size() != b.size();
+	for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+		difference |= static_cast<unsigned char>(a[i] ^ b[i]);
+	}
+	return difference == 0;
+}
+
+// Newline-delimited JSON unless the body is a JSON array. Clients may also say so with the Content-Type
+bool isNdjson(const crow::request& req) {
+	if (req.get_header_value("Content-Type").find("ndjson") != std::string::npos)
+		return true;
+	size_t first = req.body.find_first_not_of(" \t\r\n");
+	return first == std::string::npos || req.body[first] != '[';
+}
+
+// CPU numbers of this machine are below this, and so are those a cpu_set_t can hold
+int cpuLimit() {
+#ifdef __linux__
+	long configured = sysconf(_SC_NPROCESSORS_CONF);
+	return configured > 0 ? static_cast<int>(std::min<long>(configured, CPU_SETSIZE)) : CPU_SETSIZE;
+#else
+	unsigned count = std::thread::hardware_concurrency();
+	return count > 0 ? static_cast<int>(count) : 1024;
+#endif
+}
+
+// "0-3,6" as {0, 1, 2, 3, 6}. Throws std::invalid_argument for CPUs this machine does not have
+std::vector<int> parseCpuList(const std::string& list) {
+	const int limit = cpuLimit();
+	std::vector<int> cpus;
+	std::stringstream ranges(list);
+	std::string range;
+	while (std::getline(ranges, range, ',')) {
+		if (range.empty())
+			continue;
+		try {
+			size_t dash = range.find('-');
+			int first	= std::stoi(range.substr(0, dash));
+			int last	= dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+			if (first < 0 || last < first || last >= limit)
+				throw std::invalid_argument(range);
+			for (int cpu = first; cpu <= last; ++cpu) {
+				cpus.push_back(cpu);
+			}
+		} catch (const std::exception&) {
+			throw std::invalid_argument("Invalid CPU list: " + list + ", CPUs are numbered 0 to " +
+										std::to_string(limit - 1));
+		}
+	}
+	return cpus;
+}
+
+// Restrict the calling thread to `cpus`. Threads it starts afterwards inherit the affinity, which is how the
+// Crow worker threads are pinned
+void pinCurrentThread(const std::vector<int>& cpus) {
+	if (cpus.empty())
+		return;
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu : cpus) {
+		CPU_SET(cpu, &set);
+	}
+	int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (error != 0) {
+		spdlog::warn("Failed to pin HTTP threads to CPUs: {}", std::strerror(error));
+	}
+#else
+	spdlog::warn("CPU pinning is not supported on this platform");
+#endif
+}
+
+// Asynchronous publishing is asked for with "Prefer: respond-async" (RFC 7240) or ?async=true
+bool isAsync(const crow::request& req) {
+	const char* async = req.url_params.get("async");
+	return req.get_header_value("Prefer").find("respond-async") != std::string::npos ||
+		   (async && std::string(async) != "false" && std::string(async) != "0");
+}
+
+// The lifecycle fan-out sees a fraction of the DENM traffic and nothing is resumed from it
+WsFanoutOptions lifecycleFanoutOptions(WsFanoutOptions options) {
+	options.send_threads = 1;
+	options.replay_size	 = 1;
+	return options;
+}
+
+// Answer 429 with the seconds until the bucket that ran out has a token again
+void rejectRateLimited(double retry_after, crow::response& res) {
+	res.code = 429;
+	res.set_header("Retry-After", std::to_string(static_cast<int>(std::ceil(retry_after))));
+	res.write("{\"error\":\"Rate limit exceeded\"}");
+}
+
+// The first top-level field a DENM must have that `denm` lacks, empty if complete. Checked before an
+// asynchronous request is accepted, everything else is validated when the DENM is encoded
+std::string missingField(const nlohmann::json& denm) {
+	if (!denm.is_object())
+		return "publisherId";
+	for (const char* field : {"publisherId", "publicationId", "originatingCountry", "protocolVersion", "data"}) {
+		if (!denm.contains(field))
+			return field;
+	}
+	if (!denm.contains("quadTree") && !(denm.contains("latitude") && denm.contains("longitude")))
+		return "latitude";
+	return "";
+}
+} // namespace
+
+thread_local std::optional<uint64_t> DenmService::pending_resume_;
+
+DenmService::DenmService(const std::string& http_host, int http_port, int ws_port, const DenmServiceOptions& options) :
   http_host_(http_host),
   http_port_(http_port),
   ws_port_(ws_port),
-  running_(false) {
+  running_(false),
+  rate_limiter_(options.publisher_limit, options.ip_limit),
+  admin_token_(options.admin_token),
+  max_batch_items_(options.max_batch_items),
+  statuses_(options.status_table_size),
+  async_queue_limit_(options.async_queue_limit),
+  http_threads_(options.http_threads > 0 ? options.http_threads : std::max(1u, std::thread::hardware_concurrency())),
+  ws_threads_(options.ws_threads),
+  cpus_(parseCpuList(options.cpus)),
+  ws_publish_window_(std::max<size_t>(options.ws_publish_window, 1)),
+  stream_retry_ms_(options.stream_retry_ms),
+  ws_fanout_(options.ws_fanout),
+  lifecycle_fanout_(lifecycleFanoutOptions(options.ws_fanout)) {
 	// Setup HTTP routes (including WebSocket)
 	setupRoutes();
-	EventBus::getInstance().subscribe("denm.incoming",
-									  [this](const nlohmann::json& denm) { this->broadcastMessage(denm.dump()); });
+	if (ws_threads_ > 0) {
+		setupWebSocketRoute(ws_app_);
+	}
+	// Incoming DENMs arrive already serialized, repetitions are served from the interchange decode cache
+	incoming_subscription_ = EventBus::getInstance().subscribeShared<IncomingDenm>(
+	  "denm.incoming",
+	  [this](const std::shared_ptr<const IncomingDenm>& denm) { this->broadcastIncoming(denm); });
+	expiry_subscription_ = EventBus::getInstance().subscribeShared<DenmLifecycleEvent>(
+	  "denm.lifecycle",
+	  [this](const std::shared_ptr<const DenmLifecycleEvent>& event) { this->onLifecycle(event); });
+	StatsRegistry::getInstance().add("webSocket", [this]() { return ws_fanout_.stats(); });
+	// Progress of asynchronously published DENMs, reported by the interchange
+	status_subscription_ = EventBus::getInstance().subscribe("denm.status", [this](const nlohmann::json& status) {
+		statuses_.update(status["id"].get<std::string>(),
+						 deliveryStateFromString(status["status"].get<std::string>()),
+						 status.value("error", ""));
+	});
+	StatsRegistry::getInstance().add("rateLimiter", [this]() { return rate_limiter_.stats(); });
+	StatsRegistry::getInstance().add("asyncPublishing", [this]() {
+		std::lock_guard<std::mutex> l(pipeline_lock_);
+		return nlohmann::json{{"pending", pipeline_.size()}, {"statuses", statuses_.size()}};
+	});
 }
 
 DenmService::~DenmService() {
+	EventBus::getInstance().unsubscribe("denm.incoming", incoming_subscription_);
+	EventBus::getInstance().unsubscribe("denm.lifecycle", expiry_subscription_);
+	{
+		std::lock_guard<std::mutex> l(lifecycle_mutex_);
+		if (lifecycle_clients_ > 0)
+			EventBus::getInstance().unsubscribe("denm.lifecycle", lifecycle_subscription_);
+	}
+	EventBus::getInstance().unsubscribe("denm.status", status_subscription_);
+	StatsRegistry::getInstance().remove("rateLimiter");
+	StatsRegistry::getInstance().remove("asyncPublishing");
+	StatsRegistry::getInstance().remove("webSocket");
 	stop();
 }
 
@@ -116,6 +298,15 @@ void DenmService::setupRoutes() {
 		properties["shardCount"]["default"] = 1;
 		properties["shardCount"]["example"] = 1;
 
+		properties["repetition"]["type"] = "object";
+		properties["repetition"]["description"] = "Repeat the DENM until durationMs or the end of its validity";
+		properties["repetition"]["required"] = crow::json::wvalue::list{"intervalMs"};
+		properties["repetition"]["properties"]["intervalMs"]["type"] = "integer";
+		properties["repetition"]["properties"]["intervalMs"]["description"] = "Repetition interval in milliseconds";
+		properties["repetition"]["properties"]["intervalMs"]["example"] = 1000;
+		properties["repetition"]["properties"]["durationMs"]["type"] = "integer";
+		properties["repetition"]["properties"]["durationMs"]["description"] = "Repetition duration in milliseconds";
+
 		// Data object (nested structure)
 		auto& data_props = properties["data"];
 		data_props["type"] = "object";
@@ -174,16 +365,67 @@ void DenmService::setupRoutes() {
 		sit_props["properties"]["subCauseCode"]["description"] = "Sub cause code";
 		sit_props["properties"]["subCauseCode"]["default"] = 0;
 
+		// The same document as MessagePack or CBOR, or the UPER encoded DENM with the properties in X- headers
+		req_body["content"]["application/msgpack"]["schema"]["type"] = "object";
+		req_body["content"]["application/cbor"]["schema"]["type"] = "object";
+		req_body["content"]["application/octet-stream"]["schema"]["type"] = "string";
+		req_body["content"]["application/octet-stream"]["schema"]["format"] = "binary";
+
 		// Responses
 		auto& responses = denm_path["responses"];
 		responses["200"]["description"] = "DENM message sent successfully";
 		responses["200"]["content"]["application/json"]["schema"]["type"] = "object";
 		responses["200"]["content"]["application/json"]["schema"]["properties"]["status"]["type"] = "string";
 
+		responses["202"]["description"] = "Accepted for asynchronous publishing (Prefer: respond-async or ?async=true)";
+		responses["202"]["content"]["application/json"]["schema"]["properties"]["id"]["type"] = "string";
+
 		responses["400"]["description"] = "Invalid request";
 		responses["400"]["content"]["application/json"]["schema"]["type"] = "object";
 		responses["400"]["content"]["application/json"]["schema"]["properties"]["error"]["type"] = "string";
 
+		// Delivery state of an asynchronously published DENM
+		auto& status_path = swagger["paths"]["/denm/{id}/status"]["get"];
+		status_path["summary"] = "Delivery state of an asynchronously published DENM";
+		status_path["parameters"][0]["name"] = "id";
+		status_path["parameters"][0]["in"] = "path";
+		status_path["parameters"][0]["required"] = true;
+		status_path["parameters"][0]["schema"]["type"] = "string";
+		status_path["responses"]["200"]["description"] =
+		  "pending, queued, delivered, rejected, released, superseded or failed";
+		status_path["responses"]["404"]["description"] = "Unknown or expired message ID";
+
+		// Batch endpoint, every item has the schema of POST /denm
+		auto& batch_path = swagger["paths"]["/denm/batch"]["post"];
+		batch_path["summary"] = "Send many DENM messages";
+		batch_path["description"] =
+		  "Send DENM messages as a JSON array or newline-delimited JSON, with a result for every item";
+		batch_path["requestBody"]["required"] = true;
+		batch_path["requestBody"]["content"]["application/json"]["schema"]["type"] = "array";
+		batch_path["requestBody"]["content"]["application/json"]["schema"]["items"]["type"] = "object";
+		batch_path["requestBody"]["content"]["application/x-ndjson"]["schema"]["type"] = "string";
+		auto& batch_responses = batch_path["responses"];
+		batch_responses["200"]["description"] = "Result of every item, in submission order";
+		auto& batch_result = batch_responses["200"]["content"]["application/json"]["schema"];
+		batch_result["type"] = "object";
+		batch_result["properties"]["accepted"]["type"] = "integer";
+		batch_result["properties"]["rejected"]["type"] = "integer";
+		batch_result["properties"]["results"]["type"] = "array";
+		batch_result["properties"]["results"]["items"]["type"] = "object";
+		batch_responses["400"]["description"] = "Invalid or empty batch";
+		batch_responses["413"]["description"] = "Too many items";
+
+		// Replay of recently received DENMs
+		auto& stream_path = swagger["paths"]["/denm/stream"]["get"];
+		stream_path["summary"] = "Recently received DENMs as Server-Sent Events";
+		stream_path["parameters"][0]["name"] = "since";
+		stream_path["parameters"][0]["in"] = "query";
+		stream_path["parameters"][0]["description"] = "Sequence number of the last event seen, or Last-Event-ID";
+		stream_path["parameters"][0]["schema"]["type"] = "integer";
+		stream_path["responses"]["200"]["description"] = "Retained events after the cursor, id is the sequence number";
+		stream_path["responses"]["200"]["content"]["text/event-stream"]["schema"]["type"] = "string";
+		stream_path["responses"]["400"]["description"] = "Invalid cursor";
+
 		return crow::response(200, swagger);
 	});
 
@@ -194,44 +436,398 @@ void DenmService::setupRoutes() {
 		return res;
 	});
 
+	// Delivery state of an asynchronously published DENM
+	CROW_ROUTE(app_, "/denm/<string>/status")
+	([this](const std::string& id) {
+		crow::response res;
+		res.set_header("Content-Type", "application/json");
+		auto status = statuses_.lookup(id);
+		if (status) {
+			res.code = 200;
+			res.body = status->dump();
+		} else {
+			res.code = 404;
+			res.body = "{\"error\":\"Unknown message ID\"}";
+		}
+		return res;
+	});
+
+	// Recently received DENMs as Server-Sent Events, from the replay ring
+	CROW_ROUTE(app_, "/denm/stream")
+	([this](const crow::request& req) {
+		crow::response res;
+		this->handleStreamGet(req, res);
+		return res;
+	});
+
+	// Many DENMs in one request, as a JSON array or newline-delimited JSON
+	CROW_ROUTE(app_, "/denm/batch").methods("POST"_method)([this](const crow::request& req) {
+		crow::response res;
+		this->handleDenmBatchPost(req, res);
+		return res;
+	});
+
+	// Runtime statistics of the registered components
+	CROW_ROUTE(app_, "/stats")
+	([](const crow::request&) {
+		crow::response res;
+		res.code = 200;
+		res.set_header("Content-Type", "application/json");
+		res.body = StatsRegistry::getInstance().collect().dump();
+		return res;
+	});
+
+	// Counters and latency histograms of the pipeline stages for Prometheus
+	CROW_ROUTE(app_, "/metrics")
+	([](const crow::request&) {
+		crow::response res;
+		res.code = 200;
+		res.set_header("Content-Type", "text/plain; version=0.0.4");
+		res.body = Metrics::getInstance().render();
+		return res;
+	});
+
+	// Rate limits of POST /denm, replaced as a whole by PUT with the admin token as bearer token
+	CROW_ROUTE(app_, "/limits")
+	  .methods("GET"_method, "PUT"_method)([this](const crow::request& req) {
+		  crow::response res;
+		  res.set_header("Content-Type", "application/json");
+		  try {
+			  if (req.method == "PUT"_method) {
+				  if (admin_token_.empty()) {
+					  res.code = 403;
+					  res.body = "{\"error\":\"Changing the limits requires --admin-token\"}";
+					  return res;
+				  }
+				  if (!equalSecrets(req.get_header_value("Authorization"), "Bearer " + admin_token_)) {
+					  spdlog::warn("Rejected unauthorized change of the rate limits from {}", req.remote_ip_address);
+					  res.code = 401;
+					  res.set_header("WWW-Authenticate", "Bearer");
+					  res.body = "{\"error\":\"Unauthorized\"}";
+					  return res;
+				  }
+				  rate_limiter_.configure(nlohmann::json::parse(req.body));
+				  spdlog::info("Rate limits changed: {}", req.body);
+			  }
+			  res.code = 200;
+			  res.body = rate_limiter_.config().dump();
+		  } catch (const std::exception& e) {
+			  res.code = 400;
+			  res.body = nlohmann::json{{"error", e.what()}}.dump();
+		  }
+		  return res;
+	  });
+
+	// WebSocket on the HTTP port unless it has its own server
+	if (ws_threads_ == 0) {
+		setupWebSocketRoute(app_);
+	}
+}
+
+void DenmService::setupWebSocketRoute(crow::App<>& app) {
 	// New WebSocket endpoint for relaying AMQP messages to the Vue.js client
-	CROW_ROUTE(app_, "/denm")
+	CROW_ROUTE(app, "/denm")
 	  .websocket()
+	  .onaccept([](const crow::request& req) {
+		  // ?since=<seq> resumes the stream. Crow calls onopen right after onaccept on the same thread
+		  const char* since = req.url_params.get("since");
+		  pending_resume_.reset();
+		  try {
+			  if (since)
+				  pending_resume_ = std::stoull(since);
+		  } catch (const std::exception&) {
+			  spdlog::warn("Refused WebSocket connection with invalid cursor {}", since);
+			  return false;
+		  }
+		  return true;
+	  })
 	  .onopen([this](crow::websocket::connection& conn) {
+		  // Crow's send_text and close only queue work on the connection's I/O thread, as the fan-out requires
+		  auto id = ws_fanout_.add(
+			[&conn](const std::string& frame, bool binary) {
+				if (binary) {
+					conn.send_binary(frame);
+				} else {
+					conn.send_text(frame);
+				}
+			},
+			[&conn](const std::string& reason) { conn.close(reason); },
+			pending_resume_);
+		  pending_resume_.reset();
+		  auto session	  = std::make_shared<WsSession>(ws_publish_window_);
+		  session->conn	  = &conn;
+		  session->client = id;
 		  {
 			  std::lock_guard<std::mutex> lock(ws_connections_mutex_);
-			  ws_connections_.insert(&conn);
+			  ws_connections_[&conn] = session;
 		  }
 		  spdlog::info("WebSocket connection opened.");
 	  })
 	  .onclose([this](crow::websocket::connection& conn, const std::string& reason) {
-		  {
-			  std::lock_guard<std::mutex> lock(ws_connections_mutex_);
-			  ws_connections_.erase(&conn);
+		  auto session = sessionOf(conn);
+		  if (session) {
+			  {
+				  std::lock_guard<std::mutex> lock(ws_connections_mutex_);
+				  ws_connections_.erase(&conn);
+			  }
+			  // Acknowledgements of DENMs still in the pipeline are dropped from now on
+			  {
+				  std::lock_guard<std::mutex> lock(session->lock);
+				  session->conn = nullptr;
+			  }
+			  // Returns once no send to the connection is in progress, the connection is destroyed after this
+			  ws_fanout_.remove(session->client);
+			  setLifecycle(session, false);
 		  }
 		  spdlog::info("WebSocket connection closed: {}", reason);
 	  })
-	  .onmessage([](crow::websocket::connection& conn, const std::string& data, bool is_binary) {
-		  // Optionally react to messages from the frontend
-		  spdlog::debug("Received WS message: {}", data);
+	  .onmessage([this](crow::websocket::connection& conn, const std::string& data, bool is_binary) {
+		  LOG_DEBUG("Received WS message: {}", is_binary ? "(binary)" : data);
+		  this->handleWebSocketMessage(conn, data, is_binary);
 	  });
 }
 
+// The stream is resumed after the last event the client saw, from ?since=<seq> or the Last-Event-ID header
+// EventSource sends on reconnect. Crow cannot stream a response, so every request returns what is in the
+// replay ring and ends, and the retry field makes EventSource reconnect for the next events
+void DenmService::handleStreamGet(const crow::request& req, crow::response& res) {
+	uint64_t since = 0;
+	try {
+		const char* param = req.url_params.get("since");
+		std::string last  = req.get_header_value("Last-Event-ID");
+		if (param) {
+			since = std::stoull(param);
+		} else if (!last.empty()) {
+			since = std::stoull(last);
+		}
+	} catch (const std::exception&) {
+		res.code = 400;
+		res.set_header("Content-Type", "application/json");
+		res.write("{\"error\":\"Invalid event ID\"}");
+		return;
+	}
+
+	bool truncated = false;
+	auto entries   = ws_fanout_.replay().since(since, truncated);
+
+	std::string body = "retry: " + std::to_string(stream_retry_ms_) + "\n\n";
+	for (const auto& entry : entries) {
+		const std::string& json = entry->message->frame(WsEncoding::Json);
+		body.reserve(body.size() + json.size() + 32);
+		body += "id: ";
+		body += std::to_string(entry->seq);
+		body += "\ndata: ";
+		body += json;
+		body += "\n\n";
+	}
+	res.code = 200;
+	res.set_header("Content-Type", "text/event-stream");
+	res.set_header("Cache-Control", "no-cache");
+	if (truncated) {
+		res.set_header("X-Stream-Truncated", "true");
+	}
+	res.body = std::move(body);
+}
+
+std::shared_ptr<DenmService::WsSession> DenmService::sessionOf(crow::websocket::connection& conn) {
+	std::lock_guard<std::mutex> lock(ws_connections_mutex_);
+	auto it = ws_connections_.find(&conn);
+	return it != ws_connections_.end() ? it->second : nullptr;
+}
+
+// {"type": "subscribe", "filter": {...}} replaces the filter of the client, see SubscriptionFilter::fromJson.
+// An empty filter subscribes to every DENM again. {"type": "encoding", "encoding": "uper"} changes the
+// encoding of the DENMs sent to the client, see WsEncoding. {"type": "delta", "enabled": true} sends JSON
+// clients deltas of updated and repeated DENMs, see WsFanout::setDelta(). {"type": "lifecycle", "enabled":
+// true} also sends the "denm.lifecycle" events, see setLifecycle(). {"type": "publish", "id": ..., "denm":
+// {...}} and binary frames publish a DENM, see handleWebSocketPublish()
+void DenmService::handleWebSocketMessage(crow::websocket::connection& conn, const std::string& data, bool is_binary) {
+	auto session = sessionOf(conn);
+	if (!session)
+		return;
+	if (is_binary) {
+		handleWebSocketPublish(session, nlohmann::json(), data);
+		return;
+	}
+
+	nlohmann::json reply;
+	try {
+		auto j			 = nlohmann::json::parse(data);
+		std::string type = j.is_object() ? j.value("type", "") : "";
+
+		if (type == "publish") {
+			handleWebSocketPublish(session, j, "");
+			return;
+		} else if (type == "subscribe") {
+			ws_fanout_.subscribe(session->client,
+								 SubscriptionFilter::fromJson(j.value("filter", nlohmann::json::object())));
+			reply["type"] = "subscribed";
+		} else if (type == "encoding") {
+			auto encoding = wsEncodingFromString(j.value("encoding", ""));
+			ws_fanout_.setEncoding(session->client, encoding);
+			reply["type"]	  = "encoding";
+			reply["encoding"] = toString(encoding);
+		} else if (type == "delta") {
+			bool enabled = j.value("enabled", true);
+			ws_fanout_.setDelta(session->client, enabled);
+			reply["type"]	 = "delta";
+			reply["enabled"] = enabled;
+		} else if (type == "lifecycle") {
+			bool enabled = j.value("enabled", true);
+			setLifecycle(session, enabled);
+			reply["type"]	 = "lifecycle";
+			reply["enabled"] = enabled;
+		} else {
+			throw std::invalid_argument("Unknown message type");
+		}
+	} catch (const std::exception& e) {
+		spdlog::warn("Rejected WebSocket message: {}", e.what());
+		reply["type"]  = "error";
+		reply["error"] = e.what();
+	}
+	conn.send_text(reply.dump());
+}
+
+// Publish a DENM sent over a WebSocket, either a {"type": "publish"} message or a binary frame of a big-endian
+// 16-bit header length, a MessagePack map of the AMQP properties and "id", and the UPER encoded DENM. The
+// client is acknowledged with {"type": "ack", "id": ..., "messageId": ..., "status": "queued" or "failed"}
+// once the DENM is queued for the interchange, many DENMs may be in flight at once. At most
+// ws_publish_window DENMs of a connection are unacknowledged, every acknowledgement reports the remaining
+// "credit"
+void DenmService::handleWebSocketPublish(const std::shared_ptr<WsSession>& session,
+										 const nlohmann::json& message,
+										 const std::string& frame) {
+	TraceScope trace(Tracer::getInstance().start());
+	nlohmann::json id; // Chosen by the client, returned in the acknowledgement
+	try {
+		nlohmann::json denm;
+		std::shared_ptr<OutgoingUperDenm> uper;
+		if (message.is_object()) {
+			id					= message.value("id", nlohmann::json());
+			denm				= message.value("denm", nlohmann::json());
+			std::string missing = missingField(denm);
+			if (!missing.empty())
+				throw std::invalid_argument("Missing field " + missing);
+		} else {
+			uper = uperDenmOfFrame(frame, id);
+		}
+
+		// Only the publisher limit applies, the connection is not a request per DENM
+		double retry_after	  = 0;
+		const auto& publisher = uper ? uper->properties["publisherId"] : denm["publisherId"];
+		if (!rate_limiter_.allow(publisher.is_string() ? publisher.get<std::string>() : "", "", retry_after))
+			throw std::runtime_error("Rate limit exceeded");
+
+		{
+			std::lock_guard<std::mutex> lock(session->lock);
+			if (!session->window.acquire())
+				throw std::runtime_error("Publishing window is full");
+		}
+
+		std::string message_id = statuses_.create();
+		std::function<void()> publish;
+		if (uper) {
+			uper->status_id = message_id;
+			publish			= [uper]() {
+				  EventBus::getInstance().publishShared<OutgoingUperDenm>("denm.outgoing.uper", uper);
+			};
+		} else {
+			auto tracked = std::make_shared<TrackedDenm>(TrackedDenm{std::move(denm), message_id});
+			publish		 = [tracked]() {
+				 EventBus::getInstance().publishShared<TrackedDenm>("denm.outgoing.tracked", tracked);
+			};
+		}
+
+		bool queued = enqueuePublish(message_id, publish, [this, session, id, message_id](const std::string& error) {
+			nlohmann::json ack = {{"type", "ack"}, {"id", id}, {"messageId", message_id}};
+			ack["status"]	   = toString(error.empty() ? DeliveryState::Queued : DeliveryState::Failed);
+			if (!error.empty())
+				ack["error"] = error;
+
+			std::lock_guard<std::mutex> lock(session->lock);
+			session->window.release();
+			ack["credit"] = session->window.credit();
+			if (session->conn)
+				session->conn->send_text(ack.dump());
+		});
+		if (!queued) {
+			{
+				std::lock_guard<std::mutex> lock(session->lock);
+				session->window.release();
+			}
+			throw std::runtime_error("Publishing queue is full");
+		}
+	} catch (const std::exception& e) {
+		spdlog::warn("Rejected DENM published over WebSocket: {}", e.what());
+		nlohmann::json ack = {{"type", "ack"}, {"id", id}, {"status", toString(DeliveryState::Failed)}};
+		ack["error"]	   = e.what();
+		std::lock_guard<std::mutex> lock(session->lock);
+		ack["credit"] = session->window.credit();
+		if (session->conn)
+			session->conn->send_text(ack.dump());
+	}
+}
+
+bool DenmService::checkIpLimit(const crow::request& req, crow::response& res) {
+	double retry_after = 0;
+	if (rate_limiter_.allowIp(req.remote_ip_address, retry_after)) {
+		return true;
+	}
+	rejectRateLimited(retry_after, res);
+	return false;
+}
+
+bool DenmService::checkPublisherLimit(const std::string& publisher, crow::response& res) {
+	double retry_after = 0;
+	if (rate_limiter_.allow(publisher, "", retry_after)) {
+		return true;
+	}
+	rejectRateLimited(retry_after, res);
+	return false;
+}
+
 void DenmService::handleDenmPost(const crow::request& req, crow::response& res) {
+	TraceScope trace(Tracer::getInstance().start());
+
+	// Before parsing, so a client flooding malformed bodies is limited too
+	if (!checkIpLimit(req, res)) {
+		return;
+	}
+
 	try {
-		// Parse the JSON request
-		auto j = crow::json::load(req.body);
-		if (!j) {
-			res.code = 400;
-			res.write("{\"error\":\"Invalid JSON\"}");
+		auto format = denmBodyFormat(req.get_header_value("Content-Type"));
+		if (format == DenmBodyFormat::Uper) {
+			handleUperPost(req, res);
 			return;
 		}
 
-		// Convert crow::json to nlohmann::json for EventBus
-		nlohmann::json denm_json = nlohmann::json::parse(req.body);
+		auto parse_start		 = std::chrono::steady_clock::now();
+		nlohmann::json denm_json = parseDenmBody(format, req.body);
+		auto parse_end = std::chrono::steady_clock::now();
+		PipelineMetrics::get().http_parse.record(parse_end - parse_start);
+		Tracer::getInstance().record(TraceContext::current(), "http.parse", parse_start, parse_end);
 
 		// Debug log the parsed JSON
-		spdlog::debug("Parsed DENM JSON: {}", denm_json.dump(2));
+		LOG_DEBUG("Parsed DENM JSON: {}", denm_json.dump(2));
+
+		std::string missing = missingField(denm_json);
+		if (!missing.empty()) {
+			throw std::invalid_argument("Missing field " + missing);
+		}
+		// Charged to the publisherId the DENM is published under, not to anything the client merely claims
+		if (!checkPublisherLimit(publisherOf(denm_json), res)) {
+			return;
+		}
+
+		if (isAsync(req)) {
+			std::string id = statuses_.create();
+			auto tracked   = std::make_shared<TrackedDenm>(TrackedDenm{std::move(denm_json), id});
+			auto publish   = [tracked]() {
+				  EventBus::getInstance().publishShared<TrackedDenm>("denm.outgoing.tracked", tracked);
+			};
+			acceptAsync(id, publish, res);
+			return;
+		}
 
 		// Publish the DENM message to the event bus
 		EventBus::getInstance().publish("denm.outgoing", denm_json);
@@ -245,17 +841,157 @@ void DenmService::handleDenmPost(const crow::request& req, crow::response& res)
 	}
 }
 
+void DenmService::handleUperPost(const crow::request& req, crow::response& res) {
+	// The AMQP properties travel in headers, the body is the UPER encoded DENM
+	auto denm = uperDenmOf([&req](const char* header) { return req.get_header_value(header); }, req.body);
+	if (!checkPublisherLimit(publisherOf(denm->properties), res)) {
+		return;
+	}
+
+	// Decoded once by the interchange for validation and routing, then forwarded unchanged
+	auto publish = [denm]() { EventBus::getInstance().publishShared<OutgoingUperDenm>("denm.outgoing.uper", denm); };
+	if (isAsync(req)) {
+		std::string id	= statuses_.create();
+		denm->status_id	= id;
+		acceptAsync(id, publish, res);
+		return;
+	}
+	publish();
+
+	res.code = 200;
+	res.write("{\"status\":\"success\"}");
+}
+
+void DenmService::acceptAsync(const std::string& id, std::function<void()> publish, crow::response& res) {
+	if (!enqueuePublish(id, std::move(publish), nullptr)) {
+		res.code = 503;
+		res.set_header("Retry-After", "1");
+		res.write("{\"error\":\"Publishing queue is full\"}");
+		return;
+	}
+
+	res.code = 202;
+	res.set_header("Location", "/denm/" + id + "/status");
+	res.write(nlohmann::json{{"id", id}, {"status", toString(DeliveryState::Pending)}}.dump());
+}
+
+bool DenmService::enqueuePublish(const std::string& id,
+								 std::function<void()> publish,
+								 std::function<void(const std::string& error)> done) {
+	// The trace of the DENM continues on the pipeline thread
+	TraceContext trace = TraceContext::current();
+	auto queued_at	   = trace.sampled() ? Tracer::Clock::now() : Tracer::Clock::time_point();
+	{
+		std::lock_guard<std::mutex> l(pipeline_lock_);
+		if (pipeline_.size() >= async_queue_limit_) {
+			statuses_.update(id, DeliveryState::Failed, "Publishing queue is full");
+			return false;
+		}
+		pipeline_.push_back([this, id, publish = std::move(publish), done = std::move(done), trace, queued_at]() {
+			TraceScope scope(trace);
+			if (trace.sampled())
+				Tracer::getInstance().record(trace, "pipeline.queue", queued_at, Tracer::Clock::now());
+			std::string error;
+			try {
+				publish();
+				statuses_.update(id, DeliveryState::Queued);
+			} catch (const std::exception& e) {
+				spdlog::error("Error publishing DENM {}: {}", id, e.what());
+				error = e.what();
+				statuses_.update(id, DeliveryState::Failed, error);
+			}
+			if (done)
+				done(error);
+		});
+	}
+	pipeline_ready_.notify_one();
+	return true;
+}
+
+void DenmService::runPipeline() {
+	std::unique_lock<std::mutex> l(pipeline_lock_);
+	while (running_) {
+		pipeline_ready_.wait(l, [this]() { return !running_ || !pipeline_.empty(); });
+		while (running_ && !pipeline_.empty()) {
+			auto task = std::move(pipeline_.front());
+			pipeline_.pop_front();
+			l.unlock();
+			task();
+			l.lock();
+		}
+	}
+}
+
+void DenmService::handleDenmBatchPost(const crow::request& req, crow::response& res) {
+	res.set_header("Content-Type", "application/json");
+	TraceScope trace(Tracer::getInstance().start());
+
+	std::unique_ptr<DenmBatch> batch;
+	try {
+		batch = std::make_unique<DenmBatch>(
+		  req.body, isNdjson(req) ? DenmBatch::Format::Ndjson : DenmBatch::Format::Array, max_batch_items_);
+	} catch (const std::exception& e) {
+		res.code = 400;
+		res.write(nlohmann::json{{"error", e.what()}}.dump());
+		return;
+	}
+	if (batch->size() == 0) {
+		res.code = 400;
+		res.write("{\"error\":\"Empty batch\"}");
+		return;
+	}
+	if (batch->tooLarge()) {
+		res.code = 413;
+		res.write("{\"error\":\"Batch exceeds " + std::to_string(max_batch_items_) + " items\"}");
+		return;
+	}
+
+	// Every item is a request of its publisher, a batch only saves the HTTP round trips
+	double retry_after = batch->limit(rate_limiter_, req.remote_ip_address);
+	if (batch->pending() == 0 && retry_after > 0) {
+		res.code = 429;
+		res.set_header("Retry-After", std::to_string(static_cast<int>(std::ceil(retry_after))));
+		res.write("{\"error\":\"Rate limit exceeded\"}");
+		return;
+	}
+
+	if (batch->pending() > 0) {
+		auto outgoing = batch->outgoing();
+		EventBus::getInstance().publishShared<OutgoingDenmBatch>("denm.outgoing.batch", outgoing);
+		batch->report(*outgoing);
+	}
+
+	nlohmann::json results = batch->results();
+	LOG_DEBUG("Accepted {} of {} batched DENMs", results["accepted"].get<size_t>(), batch->size());
+	res.code = 200;
+	res.write(results.dump());
+}
+
 void DenmService::start() {
 	if (running_)
 		return;
 
 	running_ = true;
 
+	pipeline_thread_ = std::thread([this]() { this->runPipeline(); });
+	ws_fanout_.start();
+	lifecycle_fanout_.start();
+
 	// Start HTTP server (with WebSocket support) in a separate thread
 	http_thread_ = std::thread([this]() {
-		spdlog::info("Starting HTTP server on {}:{}", http_host_, http_port_);
-		app_.bindaddr("0.0.0.0").port(http_port_).run();
+		pinCurrentThread(cpus_);
+		spdlog::info("Starting HTTP server on {}:{} with {} threads", http_host_, http_port_, http_threads_);
+		app_.bindaddr(http_host_).port(http_port_).concurrency(http_threads_).run();
 	});
+
+	// Separate WebSocket server, so slow WebSocket clients do not hold up HTTP workers
+	if (ws_threads_ > 0) {
+		ws_thread_ = std::thread([this]() {
+			pinCurrentThread(cpus_);
+			spdlog::info("Starting WebSocket server on {}:{} with {} threads", http_host_, ws_port_, ws_threads_);
+			ws_app_.bindaddr(http_host_).port(ws_port_).concurrency(ws_threads_).run();
+		});
+	}
 }
 
 void DenmService::stop() {
@@ -270,13 +1006,114 @@ void DenmService::stop() {
 	if (http_thread_.joinable()) {
 		http_thread_.join();
 	}
+	if (ws_threads_ > 0) {
+		ws_app_.stop();
+	}
+	if (ws_thread_.joinable()) {
+		ws_thread_.join();
+	}
+
+	ws_fanout_.stop();
+	lifecycle_fanout_.stop();
+
+	{
+		std::lock_guard<std::mutex> l(pipeline_lock_);
+		pipeline_.clear();
+	}
+	pipeline_ready_.notify_all();
+	if (pipeline_thread_.joinable()) {
+		pipeline_thread_.join();
+	}
 }
 
-// New helper method to broadcast a message to all connected WebSocket clients.
-void DenmService::broadcastMessage(const std::string& message) {
-	spdlog::debug("Broadcasting message to WebSocket clients: {}", message);
-	std::lock_guard<std::mutex> lock(ws_connections_mutex_);
-	for (auto* conn : ws_connections_) {
-		conn->send_text(message);
+// Hand a message to the WebSocket fan-out, which sends it to every subscribed client on its own threads
+uint64_t DenmService::broadcastMessage(const WsFanout::Message& message, const WsFanout::Attributes& attributes) {
+	LOG_DEBUG("Broadcasting message to WebSocket clients: {}", message->frame(WsEncoding::Json));
+	return ws_fanout_.publish(message, attributes);
+}
+
+void DenmService::setLifecycle(const std::shared_ptr<WsSession>& session, bool enabled) {
+	std::lock_guard<std::mutex> l(lifecycle_mutex_);
+	crow::websocket::connection* conn;
+	WsFanout::ClientId client;
+	{
+		std::lock_guard<std::mutex> lock(session->lock);
+		conn   = session->conn;
+		client = session->lifecycle_client;
+	}
+
+	if (enabled && client == 0 && conn) {
+		// Removed in onclose before the connection is destroyed, like the DENM stream client
+		client = lifecycle_fanout_.add([conn](const std::string& frame, bool) { conn->send_text(frame); },
+									   [conn](const std::string& reason) { conn->close(reason); });
+		if (lifecycle_clients_++ == 0) {
+			lifecycle_subscription_ =
+			  EventBus::getInstance().subscribe("denm.lifecycle", [this](const nlohmann::json& event) {
+				  // Serialized once for every connection, without copying the event
+				  auto frame = std::make_shared<const std::string>("{\"type\":\"lifecycle\",\"event\":" +
+																	 event.dump() + "}");
+				  lifecycle_fanout_.publish(std::make_shared<const WsMessage>(std::move(frame)));
+			  });
+		}
+	} else if (!enabled && client != 0) {
+		lifecycle_fanout_.remove(client);
+		client = 0;
+		if (--lifecycle_clients_ == 0)
+			EventBus::getInstance().unsubscribe("denm.lifecycle", lifecycle_subscription_);
+	}
+
+	std::lock_guard<std::mutex> lock(session->lock);
+	session->lifecycle_client = client;
+}
+
+// Broadcast a received DENM. The message shares the serialized form and attributes of the decoded DENM, binary
+// encodings are produced once if a client chose them. Updates and repetitions of an actionID carry a delta to
+// the last broadcast DENM of the action, computed once for every client in delta mode
+void DenmService::broadcastIncoming(const std::shared_ptr<const IncomingDenm>& denm) {
+	uint64_t key = denm->action.key();
+	bool final	 = denm->action.termination != DenmActionInfo::Termination::None;
+	auto frame	 = std::shared_ptr<const std::string>(denm, &denm->serialized);
+	auto encode	 = [denm](WsEncoding encoding) { return encodeIncomingDenm(*denm, encoding); };
+
+	std::unique_lock<std::mutex> l(last_broadcast_mutex_);
+	if (ws_fanout_.deltaClients() == 0) {
+		// Nobody wants deltas, keep no DENMs for them. A client that enables delta mode gets full messages until
+		// its actions are updated
+		last_broadcast_.clear();
+		l.unlock();
+		broadcastMessage(std::make_shared<const WsMessage>(std::move(frame), std::move(encode)),
+						 WsFanout::Attributes(denm, &denm->attributes));
+		return;
+	}
+
+	WsDelta delta;
+	delta.action_key = key;
+	delta.final		 = final;
+	auto previous	 = last_broadcast_.find(key);
+	if (previous != last_broadcast_.end()) {
+		auto from		   = previous->second.first;
+		delta.previous_seq = previous->second.second;
+		delta.encode	   = [from, denm](uint64_t seq) { return encodeDenmDelta(*from, *denm, seq); };
+	}
+	auto message = std::make_shared<const WsMessage>(std::move(frame), std::move(encode), std::move(delta));
+	uint64_t seq = broadcastMessage(message, WsFanout::Attributes(denm, &denm->attributes));
+
+	if (final) {
+		if (previous != last_broadcast_.end())
+			last_broadcast_.erase(previous);
+	} else if (previous != last_broadcast_.end()) {
+		previous->second = {denm, seq};
+	} else {
+		// Actions normally end with a termination or expire; forget them all rather than grow without bound
+		if (last_broadcast_.size() >= MAX_BROADCAST_ACTIONS)
+			last_broadcast_.clear();
+		last_broadcast_.emplace(key, std::make_pair(denm, seq));
 	}
 }
+
+void DenmService::onLifecycle(const std::shared_ptr<const DenmLifecycleEvent>& event) {
+	if (event->transition != DenmTransition::Expiry || event->direction != DenmDirection::Incoming)
+		return;
+	std::lock_guard<std::mutex> l(last_broadcast_mutex_);
+	last_broadcast_.erase(event->info.key());
+}
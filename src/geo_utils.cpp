@@ -1,4 +1,5 @@
 #include "geo_utils.hpp"
+#include <algorithm>
 #include <cmath>
 
 std::string calculateQuadTree(double lat, double lon, int zoom) {
@@ -32,3 +33,24 @@ std::string calculateQuadTree(double lat, double lon, int zoom) {
 	
 	return quadTree;
 }
+
+void latLonToTile(double lat, double lon, int zoom, uint32_t& x, uint32_t& y) {
+	// Web Mercator is undefined at the poles
+	lat			  = std::max(-85.05112878, std::min(85.05112878, lat));
+	double sinlat = std::sin(lat * M_PI / 180.0);
+	double tiles  = std::pow(2, zoom);
+	double fx	  = std::floor(tiles * (0.5 + lon / 360.0));
+	double fy	  = std::floor(tiles * (0.5 - std::log((1.0 + sinlat) / (1.0 - sinlat)) / (4 * M_PI)));
+	x			  = static_cast<uint32_t>(std::max(0.0, std::min(tiles - 1, fx)));
+	y			  = static_cast<uint32_t>(std::max(0.0, std::min(tiles - 1, fy)));
+}
+
+std::string tileToQuadTree(uint32_t x, uint32_t y, int zoom) {
+	std::string quadTree(zoom, '0');
+	for (int i = zoom - 1; i >= 0; --i) {
+		quadTree[i] = static_cast<char>('0' + ((x & 1) | ((y & 1) << 1)));
+		x >>= 1;
+		y >>= 1;
+	}
+	return quadTree;
+}
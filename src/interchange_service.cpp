@@ -1,28 +1,101 @@
 #include "interchange_service.hpp"
+#include "delivery_status.hpp"
 #include "denm_message.hpp"
 #include "geo_utils.hpp"
+#include "hash_utils.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "stats_registry.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <proton/connection_options.hpp>
 #include <proton/reconnect_options.hpp>
 #include <spdlog/spdlog.h>
 
+namespace {
+std::vector<unsigned> laneWeights(const PriorityClassifier& classifier) {
+	std::vector<unsigned> weights;
+	for (const auto& priority_class : classifier.classes()) {
+		weights.push_back(priority_class.weight);
+	}
+	return weights;
+}
+
+// Workers of a pool for `batch_threads` threads in all, the thread handling a batch works on it too
+size_t batchWorkers(size_t batch_threads) {
+	size_t threads = batch_threads > 0 ? batch_threads : std::thread::hardware_concurrency();
+	return std::max<size_t>(threads, 1) - 1;
+}
+
+// Report the delivery state of an asynchronously published DENM, identified by its AMQP message-id
+void publishStatus(const std::string& message_id, DeliveryState state) {
+	EventBus::getInstance().publish("denm.status", {{"id", message_id}, {"status", toString(state)}});
+}
+} // namespace
+
 InterchangeService::InterchangeService(const std::string& username,
 									   const std::string& amqp_url,
 									   const std::string& amqp_send_address,
 									   const std::string& amqp_receive_address,
-									   const std::string& cert_dir) :
+									   const std::string& cert_dir,
+									   const InterchangeOptions& options) :
   username_(username),
   amqp_url_(amqp_url),
   amqp_send_address_(amqp_send_address),
   amqp_receive_address_(amqp_receive_address),
   cert_dir_(cert_dir),
+  options_(options),
+  publication_headers_(username, amqp_send_address),
+  decode_cache_(options.decode_cache_size),
+  outbound_queue_(options.outbound_queue_limit,
+				  laneWeights(options.priority_classes),
+				  options.lane_scheduling,
+				  options.fair_queue_quantum),
+  batch_workers_(batchWorkers(options.batch_threads)),
+  repeater_([this](const std::vector<DenmRepeater::Repetition>& batch) {
+	  for (const auto& repetition : batch) {
+		  outbound_queue_.push(repetition.key, repetition.message, repetition.route);
+	  }
+  }),
   amqp_container_(std::make_unique<proton::container>()) {
 
 	// Configure container settings
 	setupContainerOptions();
 
+	outbound_queue_.onConflated([](const OutboundQueue::MessagePtr& replaced) {
+		if (replaced->id().type() == proton::STRING) {
+			publishStatus(proton::get<std::string>(replaced->id()), DeliveryState::Superseded);
+		}
+	});
+
 	// Subscribe to outgoing DENM events
-	EventBus::getInstance().subscribe("denm.outgoing",
-									  [this](const nlohmann::json& denm) { this->handleOutgoingDenm(denm); });
+	auto& bus = EventBus::getInstance();
+	outgoing_subscription_ =
+	  bus.subscribe("denm.outgoing", [this](const nlohmann::json& denm) { this->handleOutgoingDenm(denm); });
+	tracked_subscription_ = bus.subscribeShared<TrackedDenm>(
+	  "denm.outgoing.tracked",
+	  [this](const std::shared_ptr<const TrackedDenm>& tracked) {
+		  this->handleOutgoingDenm(tracked->denm, tracked->status_id);
+	  });
+	// DENMs submitted UPER encoded, forwarded byte for byte
+	uper_subscription_ = bus.subscribeShared<OutgoingUperDenm>(
+	  "denm.outgoing.uper",
+	  [this](const std::shared_ptr<const OutgoingUperDenm>& uper) { this->handleOutgoingUper(*uper); });
+	// Batches from POST /denm/batch, the outcome of every item is reported back in the batch
+	batch_subscription_ = bus.subscribeShared<OutgoingDenmBatch>(
+	  "denm.outgoing.batch",
+	  [this](const std::shared_ptr<const OutgoingDenmBatch>& batch) { this->handleOutgoingBatch(*batch); });
+
+	StatsRegistry::getInstance().add("interchange", [this]() { return this->stats(); });
+}
+
+InterchangeService::~InterchangeService() {
+	EventBus::getInstance().unsubscribe("denm.outgoing", outgoing_subscription_);
+	EventBus::getInstance().unsubscribe("denm.outgoing.tracked", tracked_subscription_);
+	EventBus::getInstance().unsubscribe("denm.outgoing.uper", uper_subscription_);
+	EventBus::getInstance().unsubscribe("denm.outgoing.batch", batch_subscription_);
+	StatsRegistry::getInstance().remove("interchange");
+	stop();
 }
 
 void InterchangeService::setupContainerOptions() {
@@ -42,10 +115,11 @@ void InterchangeService::setupContainerOptions() {
 		}
 	}
 
-	// Match Java client configuration
+	// Match Java client configuration. Without SSL there is no client certificate to authenticate with, so
+	// also allow ANONYMOUS for unsecured development brokers (local Artemis, the loopback test broker)
 	conn_opts.user(username_)
 	  .sasl_enabled(true)
-	  .sasl_allowed_mechs("EXTERNAL PLAIN")
+	  .sasl_allowed_mechs(cert_dir_.empty() ? "EXTERNAL PLAIN ANONYMOUS" : "EXTERNAL PLAIN")
 	  .container_id(username_ + "-az-client");
 
 	// Add retry mechanism
@@ -62,6 +136,8 @@ void InterchangeService::start() {
 		return;
 	running_ = true;
 
+	lifecycle_.start();
+
 	// Start AMQP container
 	container_thread_ = std::thread([this]() {
 		try {
@@ -74,6 +150,8 @@ void InterchangeService::start() {
 	// Setup sender
 	if (!amqp_send_address_.empty()) {
 		setupAmqpSender();
+		dispatcher_thread_ = std::thread([this]() { this->runDispatcher(); });
+		repeater_.start();
 	}
 	// Setup receiver
 	if (!amqp_receive_address_.empty()) {
@@ -100,6 +178,40 @@ void InterchangeService::setupAmqpSender() {
 	if (!amqp_sender_) {
 		throw std::runtime_error("Failed to create sender after max retries");
 	}
+
+	// Settlement by the broker completes the status of asynchronously published DENMs
+	amqp_sender_->on_outcome([](const std::string& message_id, const std::string& outcome) {
+		DeliveryState state = outcome == "accepted" ? DeliveryState::Delivered
+							  : outcome == "rejected" ? DeliveryState::Rejected
+													  : DeliveryState::Released;
+		publishStatus(message_id, state);
+	});
+}
+
+void InterchangeService::runDispatcher() {
+	// Only take messages off the queue when the link can send them, so updates for an actionID that arrive
+	// while the link is short on credit are conflated in the queue
+	while (running_) {
+		try {
+			size_t credit = amqp_sender_->wait_credit(std::chrono::milliseconds(100));
+			if (credit == 0)
+				continue;
+			auto batch = outbound_queue_.pop(credit, std::chrono::milliseconds(100));
+			if (!batch.empty()) {
+				amqp_sender_->send(batch);
+			}
+		} catch (const closed& e) {
+			// Only once the reconnect options gave up, the DENMs left stay queued
+			if (running_)
+				spdlog::error("AMQP connection lost, no more DENMs are sent: {}", e.what());
+			return;
+		} catch (const std::exception& e) {
+			if (running_) {
+				spdlog::error("AMQP dispatcher error: {}", e.what());
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			}
+		}
+	}
 }
 
 void InterchangeService::setupAmqpReceiver() {
@@ -110,16 +222,12 @@ void InterchangeService::setupAmqpReceiver() {
 		while (running_) {
 			try {
 				proton::message msg = amqp_receiver_->receive();
-				spdlog::debug("Received DENM message");
-				if (msg.body().type() == proton::BINARY) {
-					auto data = proton::get<proton::binary>(msg.body());
-					DenmMessage denm;
-					denm.fromUper(data);
-					// Publish received DENM to event bus
-					EventBus::getInstance().publish("denm.incoming", denm.toJson());
-				} else {
-					spdlog::error("Received non-binary message");
-				}
+				LOG_DEBUG("Received DENM message");
+				handleIncomingMessage(msg);
+			} catch (const closed& e) {
+				if (running_)
+					spdlog::error("AMQP connection lost, no more DENMs are received: {}", e.what());
+				return;
 			} catch (const std::exception& e) {
 				if (running_) {
 					spdlog::error("AMQP receiver error: {}", e.what());
@@ -130,62 +238,195 @@ void InterchangeService::setupAmqpReceiver() {
 	});
 }
 
-void InterchangeService::handleOutgoingDenm(const nlohmann::json& j) {
-	try {
+void InterchangeService::handleIncomingMessage(const proton::message& msg) {
+	if (msg.body().type() != proton::BINARY) {
+		spdlog::error("Received non-binary message");
+		return;
+	}
+	// Continue the trace of a sampled sender, or sample the DENM here
+	auto& tracer = Tracer::getInstance();
+	TraceScope trace(tracer.start(tracer.enabled() ? traceContextOf(msg) : TraceContext()));
+
+	auto& metrics = PipelineMetrics::get();
+	auto data	  = proton::get<proton::binary>(msg.body());
+	uint64_t hash = xxhash64(data);
+	metrics.received.add();
+
+	std::shared_ptr<const IncomingDenm> incoming = decode_cache_.find(hash, data);
+	if (incoming) {
+		if (options_.drop_duplicates) {
+			++duplicates_dropped_;
+			LOG_DEBUG("Dropped duplicate DENM (hash {:016x})", hash);
+			return;
+		}
+	} else {
+		ScopedTimer timer(metrics.uper_decode);
+		ScopedSpan span("denm.uperDecode");
+		DenmMessage denm;
+		denm.fromUper(data);
 
-		proton::message amqp_msg;
-		// Set AMQP headers
-		amqp_msg.durable(true);
-		amqp_msg.ttl(proton::duration(3600000)); // 1 hour TTL
-		amqp_msg.priority(1);
-		amqp_msg.user(username_);
-		amqp_msg.to(amqp_send_address_);
+		auto decoded		= std::make_shared<IncomingDenm>();
+		decoded->hash		= hash;
+		decoded->uper		= std::move(data);
+		decoded->json		= denm.toJson();
+		decoded->serialized = decoded->json.dump();
+		decoded->action		= denm.actionInfo();
+		decoded->attributes = DenmAttributes::fromJson(decoded->json);
+		incoming			= decoded;
+		decode_cache_.insert(incoming);
+	}
+
+	lifecycle_.apply(DenmDirection::Incoming, incoming->action, incoming->json);
 
-		auto& props = amqp_msg.properties();
+	// Publish received DENM to event bus
+	ScopedTimer timer(metrics.event_dispatch);
+	ScopedSpan span("denm.dispatch");
+	auto& bus = EventBus::getInstance();
+	bus.publishShared<IncomingDenm>("denm.incoming", incoming);
+	bus.publish("denm.incoming", incoming->json);
+}
 
-		// Set mandatory properties
-		props.put("messageType", j["messageType"].get<std::string>());
-		props.put("protocolVersion", j["protocolVersion"].get<std::string>());
-		props.put("publisherId", j["publisherId"].get<std::string>());
-		props.put("publicationId", j["publicationId"].get<std::string>());
-		props.put("originatingCountry", j["originatingCountry"].get<std::string>());
-		props.put("causeCode", j["data"]["situation"]["causeCode"].get<int>());
+InterchangeService::PreparedDenm InterchangeService::prepareOutgoingDenm(const nlohmann::json& j,
+																		 const std::vector<unsigned char>* uper,
+																		 const std::string& status_id) {
+	auto& metrics = PipelineMetrics::get();
+	ScopedTimer timer(metrics.validation);
+	ScopedSpan span("denm.prepare");
+	PreparedDenm prepared;
 
-		// Calculate quadTree unless it is already present
-		if (j.contains("quadTree")) {
-			props.put("quadTree", j["quadTree"].get<std::string>());
+	// A UPER body is only decoded, for validation and the fields routing needs, and then sent as it is.
+	// Otherwise the DENM is built from JSON and encoded
+	DenmMessage denm = uper ? DenmMessage() : timed(metrics.from_json, [&j]() {
+		ScopedSpan span("denm.fromJson");
+		return DenmMessage::fromJson(j["data"]);
+	});
+	if (uper) {
+		denm.fromUper(*uper);
+		prepared.decoded = denm.toJson();
+	}
+	const nlohmann::json& data = uper ? prepared.decoded : j["data"];
 
-		} else {
-			std::string quadTree = calculateQuadTree(j["latitude"].get<double>(), j["longitude"].get<double>());
-			auto formattedQuadTree = "," + quadTree + ",";
-			spdlog::debug("Calculated quad tree: {}", formattedQuadTree);
-			props.put("quadTree", formattedQuadTree);
+	// Optional repetition, validated before anything is sent
+	if (j.contains("repetition")) {
+		const auto& repetition		 = j["repetition"];
+		prepared.repetition_interval = std::chrono::milliseconds(repetition.at("intervalMs").get<int64_t>());
+		if (prepared.repetition_interval.count() <= 0) {
+			throw std::invalid_argument("repetition.intervalMs must be positive");
+		}
+		if (repetition.contains("durationMs")) {
+			prepared.repetition_duration = std::chrono::milliseconds(repetition["durationMs"].get<int64_t>());
 		}
+	}
+
+	auto amqp_msg = message_pool_.acquire();
+	// Headers and mandatory properties are built once per publication
+	publication_headers_.get(j)->applyTo(*amqp_msg);
+	auto& props = amqp_msg->properties();
+
+	// Asynchronously published DENMs carry their status ID as message-id to match the broker settlement
+	if (!status_id.empty()) {
+		amqp_msg->id(status_id);
+	}
+
+	// The priority class decides the outbound lane and the AMQP priority header
+	int cause_code		  = data.contains("situation") ? data["situation"]["causeCode"].get<int>() : 0;
+	int station_type	  = data["management"].value("stationType", 0);
+	size_t priority_class = options_.priority_classes.classify(cause_code, station_type);
+	amqp_msg->priority(options_.priority_classes.classes()[priority_class].amqp_priority);
+
+	props.put("causeCode", cause_code);
 
-		// Set optional properties if present
-		if (j.contains("shardId")) {
-			props.put("shardId", j["shardId"].get<int>());
+	// Calculate quadTree unless it is already present
+	std::string quadTree;
+	if (j.contains("quadTree")) {
+		quadTree = j["quadTree"].get<std::string>();
+		props.put("quadTree", quadTree);
+
+	} else {
+		// Binary submissions may leave the position to the event position of the DENM
+		const auto& pos = uper && !j.contains("latitude") ? data["management"]["eventPosition"] : j;
+		{
+			ScopedTimer quadtree_timer(metrics.quadtree);
+			ScopedSpan quadtree_span("denm.quadtree");
+			quadTree = calculateQuadTree(pos["latitude"].get<double>(), pos["longitude"].get<double>());
 		}
+		auto formattedQuadTree = "," + quadTree + ",";
+		LOG_DEBUG("Calculated quad tree: {}", formattedQuadTree);
+		props.put("quadTree", formattedQuadTree);
+	}
+
+	// Sharding properties from the client take precedence, otherwise they are derived from the quadkey. A
+	// shardCount without its shardId is ignored, it must not disagree with the assigned shard
+	if (j.contains("shardId")) {
+		props.put("shardId", j["shardId"].get<int>());
 		if (j.contains("shardCount")) {
 			props.put("shardCount", j["shardCount"].get<int>());
 		}
-		if (j.contains("timestamp")) {
-			props.put("timestamp", j["timestamp"].get<std::string>());
-		}
-		if (j.contains("relation")) {
-			props.put("relation", j["relation"].get<std::string>());
-		}
+	} else if (options_.shard_assigner.enabled()) {
+		// A client supplied quadTree may list several tiles (",0123,0132,"), the first one decides
+		size_t begin = quadTree.find_first_not_of(',');
+		size_t end	 = quadTree.find(',', begin);
+		unsigned shard_id =
+		  options_.shard_assigner.assign(begin == std::string::npos ? "" : quadTree.substr(begin, end - begin));
+		props.put("shardId", static_cast<int>(shard_id));
+		props.put("shardCount", static_cast<int>(options_.shard_assigner.shardCount()));
+	}
+	if (j.contains("timestamp")) {
+		props.put("timestamp", j["timestamp"].get<std::string>());
+	}
+	if (j.contains("relation")) {
+		props.put("relation", j["relation"].get<std::string>());
+	}
+	// A sampled DENM carries its trace on to the interchange
+	const TraceContext& trace = TraceContext::current();
+	if (trace.sampled()) {
+		props.put("traceparent", trace.traceparent());
+	}
+
+	auto raw_body = uper ? *uper : timed(metrics.uper_encode, [&denm]() {
+		ScopedSpan span("denm.uperEncode");
+		return denm.getUperEncoded();
+	});
+
+	// Convert std::vector<unsigned char> to proton::binary
+	proton::binary body(raw_body.begin(), raw_body.end());
+	amqp_msg->body(body);
 
-		// Create binary message
-		DenmMessage denm = DenmMessage::fromJson(j["data"]);
-		auto raw_body	 = denm.getUperEncoded();
+	// The message is shared read-only by the queue and the repeater from here on, and returns to the
+	// pool once both are done with it
+	// Publishers are fair-queued within the priority class by the size of their messages
+	prepared.route	 = OutboundRoute{priority_class, j["publisherId"].get<std::string>(), raw_body.size(), trace};
+	prepared.action	 = denm.actionInfo();
+	prepared.message = OutboundQueue::MessagePtr(std::move(amqp_msg));
+	return prepared;
+}
+
+void InterchangeService::commitOutgoingDenm(const PreparedDenm& prepared, const nlohmann::json& j) {
+	PipelineMetrics::get().published.add();
+	const nlohmann::json& data = prepared.decoded.is_null() ? j["data"] : prepared.decoded;
+	lifecycle_.apply(DenmDirection::Outgoing, prepared.action, data);
+
+	// A new DENM for the actionID replaces any repetition of the previous one
+	if (prepared.repetition_interval.count() > 0) {
+		// Repeat until durationMs, but never past the validity of the event
+		auto duration  = prepared.repetition_duration;
+		auto remaining = std::chrono::milliseconds(prepared.action.expiresAtMs() - DenmLifecycle::nowMs());
+		if (duration.count() <= 0 || duration > remaining) {
+			duration = remaining;
+		}
+		repeater_.add(prepared.action.key(), prepared.message, prepared.repetition_interval, duration, prepared.route);
+	} else {
+		repeater_.remove(prepared.action.key());
+	}
+}
 
-		// Convert std::vector<unsigned char> to proton::binary
-		proton::binary body(raw_body.begin(), raw_body.end());
-		amqp_msg.body(body);
-		amqp_sender_->send(amqp_msg);
+void InterchangeService::handleOutgoingDenm(const nlohmann::json& j, const std::string& status_id) {
+	try {
+		PreparedDenm prepared = prepareOutgoingDenm(j, nullptr, status_id);
+		outbound_queue_.push(prepared.action.key(), prepared.message, prepared.route);
+		commitOutgoingDenm(prepared, j);
 
-		spdlog::debug("Successfully sent DENM message");
+		LOG_DEBUG("Queued DENM message");
 
 	} catch (const nlohmann::json::exception& e) {
 		spdlog::error("JSON error while processing DENM: {}", e.what());
@@ -196,11 +437,86 @@ void InterchangeService::handleOutgoingDenm(const nlohmann::json& j) {
 	}
 }
 
+void InterchangeService::handleOutgoingUper(const OutgoingUperDenm& uper) {
+	try {
+		PreparedDenm prepared = prepareOutgoingDenm(uper.properties, &uper.uper, uper.status_id);
+		outbound_queue_.push(prepared.action.key(), prepared.message, prepared.route);
+		commitOutgoingDenm(prepared, uper.properties);
+
+		LOG_DEBUG("Queued UPER encoded DENM message");
+
+	} catch (const std::exception& e) {
+		spdlog::error("Failed to send UPER encoded DENM: {}", e.what());
+		throw;
+	}
+}
+
+void InterchangeService::handleOutgoingBatch(const OutgoingDenmBatch& batch) {
+	const auto& items = batch.items;
+	batch.errors.assign(items.size(), "");
+	std::vector<PreparedDenm> prepared(items.size());
+
+	// Validation and UPER encoding are independent per item and dominate the cost of a batch, so they are
+	// spread over the batch workers. Small batches are not worth splitting
+	const TraceContext& trace = TraceContext::current();
+	// One part for the calling thread and every worker at most
+	size_t parts = std::min(batch_workers_.size() + 1, std::max<size_t>(1, items.size() / MIN_ITEMS_PER_WORKER));
+	size_t chunk = (items.size() + parts - 1) / parts;
+	batch_workers_.forEach(parts, [&](size_t part) {
+		// The items share the trace of the batch
+		TraceScope scope(trace);
+		for (size_t i = part * chunk; i < std::min(items.size(), (part + 1) * chunk); ++i) {
+			try {
+				prepared[i] = prepareOutgoingDenm(items[i]);
+			} catch (const std::exception& e) {
+				batch.errors[i] = e.what();
+			}
+		}
+	});
+
+	// Queue everything that encoded in one go, in submission order so later updates of an actionID win
+	std::vector<size_t> indices;
+	std::vector<OutboundQueue::Pending> pending;
+	for (size_t i = 0; i < items.size(); ++i) {
+		if (batch.errors[i].empty()) {
+			indices.push_back(i);
+			pending.push_back({prepared[i].action.key(), prepared[i].message, prepared[i].route});
+		}
+	}
+
+	std::vector<bool> queued;
+	try {
+		queued = outbound_queue_.push(pending);
+	} catch (const std::exception& e) {
+		spdlog::error("Failed to queue DENM batch: {}", e.what());
+		for (size_t i : indices) {
+			batch.errors[i] = e.what();
+		}
+		return;
+	}
+
+	size_t accepted = 0;
+	for (size_t n = 0; n < indices.size(); ++n) {
+		size_t i = indices[n];
+		if (!queued[n]) {
+			batch.errors[i] = "Outbound queue is full";
+			continue;
+		}
+		commitOutgoingDenm(prepared[i], items[i]);
+		++accepted;
+	}
+	LOG_DEBUG("Queued {} of {} batched DENM messages", accepted, items.size());
+}
+
 void InterchangeService::stop() {
 	if (!running_)
 		return;
 	running_ = false;
 
+	repeater_.stop();
+	outbound_queue_.close();
+	if (dispatcher_thread_.joinable())
+		dispatcher_thread_.join();
 	amqp_container_->stop();
 
 	if (amqp_sender_)
@@ -212,4 +528,32 @@ void InterchangeService::stop() {
 		receiver_thread_.join();
 	if (container_thread_.joinable())
 		container_thread_.join();
+
+	lifecycle_.stop();
+}
+
+nlohmann::json InterchangeService::stats() const {
+	nlohmann::json j;
+	j["outbound"]["queued"]	   = outbound_queue_.size();
+	j["outbound"]["conflated"] = outbound_queue_.conflated();
+	j["outbound"]["repeating"] = repeater_.size();
+
+	auto& lanes = j["outbound"]["lanes"] = nlohmann::json::array();
+	for (size_t i = 0; i < outbound_queue_.lanes(); ++i) {
+		nlohmann::json lane;
+		lane["class"]	= options_.priority_classes.classes()[i].name;
+		lane["queued"]	= outbound_queue_.size(i);
+		lane["latency"] = outbound_queue_.latency(i).snapshot().toJson();
+		lanes.push_back(lane);
+	}
+
+	j["outbound"]["sentByPublisher"] = outbound_queue_.sentByFlow();
+	j["outbound"]["publications"]	 = publication_headers_.size();
+
+	j["incoming"]["decodeCacheSize"]   = decode_cache_.size();
+	j["incoming"]["decodeCacheHits"]   = decode_cache_.hits();
+	j["incoming"]["decodeCacheMisses"] = decode_cache_.misses();
+	j["incoming"]["duplicatesDropped"] = duplicates_dropped_.load();
+	j["activeEvents"]				   = lifecycle_.size();
+	return j;
 }
@@ -0,0 +1,11 @@
+#include "logging.hpp"
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+void initAsyncLogging(size_t queue_size) {
+	// One thread writes every message, so the output keeps the order of the queue
+	spdlog::init_thread_pool(queue_size, 1);
+	auto logger = spdlog::create_async_nb<spdlog::sinks::stdout_color_sink_mt>("az-v2x");
+	logger->flush_on(spdlog::level::warn);
+	spdlog::set_default_logger(logger);
+}
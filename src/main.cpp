@@ -1,6 +1,8 @@
 #include "denm_service.hpp"
 #include "interchange_service.hpp"
+#include "logging.hpp"
 #include "ssl_utils.hpp"
+#include "trace.hpp"
 #include <boost/program_options.hpp>
 #include <condition_variable>
 #include <csignal>
@@ -28,7 +30,10 @@ int main(int argc, char** argv) {
 		  "directory containing SSL certificates")(
 		  "log-level,l",
 		  po::value<std::string>()->default_value(getenv("LOG_LEVEL") ? getenv("LOG_LEVEL") : "info"),
-		  "logging level (debug, info, warn, error)")(
+		  "logging level (trace, debug, info, warn, error)")(
+		  "log-queue-size",
+		  po::value<size_t>()->default_value(getenv("LOG_QUEUE_SIZE") ? std::stoul(getenv("LOG_QUEUE_SIZE")) : 8192),
+		  "log messages waiting for the logging thread, the oldest are dropped beyond this")(
 		  "username,u",
 		  po::value<std::string>()->default_value(getenv("USERNAME") ? getenv("USERNAME") : "Astazero"),
 		  "Organization/User-name")(
@@ -47,7 +52,115 @@ int main(int argc, char** argv) {
 		  po::value<int>()->default_value(getenv("HTTP_PORT") ? std::stoi(getenv("HTTP_PORT")) : 8080),
 		  "HTTP server port")("ws-port",
 							  po::value<int>()->default_value(getenv("WS_PORT") ? std::stoi(getenv("WS_PORT")) : 8081),
-							  "WebSocket server port");
+							  "WebSocket server port")(
+		  "decode-cache-size",
+		  po::value<size_t>()->default_value(getenv("DECODE_CACHE_SIZE") ? std::stoul(getenv("DECODE_CACHE_SIZE"))
+																		 : 4096),
+		  "number of decoded incoming DENMs cached for repetitions (0 disables)")(
+		  "drop-duplicates",
+		  po::bool_switch()->default_value(getenv("DROP_DUPLICATES") != nullptr),
+		  "drop incoming DENMs identical to a recently received one")(
+		  "outbound-queue-limit",
+		  po::value<size_t>()->default_value(getenv("OUTBOUND_QUEUE_LIMIT") ? std::stoul(getenv("OUTBOUND_QUEUE_LIMIT"))
+																			: 10000),
+		  "number of distinct DENMs that may wait for AMQP credit")(
+		  "priority-classes",
+		  po::value<std::string>()->default_value(getenv("PRIORITY_CLASSES") ? getenv("PRIORITY_CLASSES")
+																			 : PriorityClassifier::DEFAULT_CLASSES),
+		  "outbound priority classes, most urgent first, as name:amqpPriority:weight,...")(
+		  "priority-rules",
+		  po::value<std::string>()->default_value(getenv("PRIORITY_RULES") ? getenv("PRIORITY_RULES")
+																		   : PriorityClassifier::DEFAULT_RULES),
+		  "priority class of outgoing DENMs as causeCode[/stationType]=class,... (either code may be *)")(
+		  "priority-scheduling",
+		  po::value<std::string>()->default_value(getenv("PRIORITY_SCHEDULING") ? getenv("PRIORITY_SCHEDULING")
+																				: "weighted"),
+		  "sharing of AMQP credit between priority classes (strict, weighted)")(
+		  "fair-queue-quantum",
+		  po::value<size_t>()->default_value(getenv("FAIR_QUEUE_QUANTUM") ? std::stoul(getenv("FAIR_QUEUE_QUANTUM"))
+																		  : 512),
+		  "bytes each publisher may send per fair queuing round")(
+		  "shard-count",
+		  po::value<unsigned>()->default_value(getenv("SHARD_COUNT") ? std::stoul(getenv("SHARD_COUNT")) : 0),
+		  "assign outgoing DENMs without shardId to this many interchange shards by quadkey (0 disables)")(
+		  "shard-prefixes",
+		  po::value<std::string>()->default_value(getenv("SHARD_PREFIXES") ? getenv("SHARD_PREFIXES") : ""),
+		  "explicit shard assignments as quadkeyPrefix=shardId,...")(
+		  "batch-threads",
+		  po::value<size_t>()->default_value(getenv("BATCH_THREADS") ? std::stoul(getenv("BATCH_THREADS")) : 0),
+		  "threads encoding a POST /denm/batch (0 uses one per hardware thread)")(
+		  "max-batch-items",
+		  po::value<size_t>()->default_value(getenv("MAX_BATCH_ITEMS") ? std::stoul(getenv("MAX_BATCH_ITEMS")) : 1000),
+		  "largest number of DENMs in one POST /denm/batch")(
+		  "async-queue-limit",
+		  po::value<size_t>()->default_value(getenv("ASYNC_QUEUE_LIMIT") ? std::stoul(getenv("ASYNC_QUEUE_LIMIT"))
+																		  : 10000),
+		  "asynchronous POST /denm requests that may wait for publishing")(
+		  "status-table-size",
+		  po::value<size_t>()->default_value(getenv("STATUS_TABLE_SIZE") ? std::stoul(getenv("STATUS_TABLE_SIZE"))
+																		  : 100000),
+		  "delivery states kept for GET /denm/{id}/status")(
+		  "http-threads",
+		  po::value<unsigned>()->default_value(getenv("HTTP_THREADS") ? std::stoul(getenv("HTTP_THREADS")) : 0),
+		  "HTTP server threads (0 uses one per hardware thread)")(
+		  "ws-threads",
+		  po::value<unsigned>()->default_value(getenv("WS_THREADS") ? std::stoul(getenv("WS_THREADS")) : 0),
+		  "threads of a separate WebSocket server on --ws-port (0 serves WebSocket on the HTTP port)")(
+		  "http-cpus",
+		  po::value<std::string>()->default_value(getenv("HTTP_CPUS") ? getenv("HTTP_CPUS") : ""),
+		  "CPUs the HTTP and WebSocket threads are pinned to, e.g. 0-3,6")(
+		  "ws-queue-limit",
+		  po::value<size_t>()->default_value(getenv("WS_QUEUE_LIMIT") ? std::stoul(getenv("WS_QUEUE_LIMIT")) : 256),
+		  "DENMs waiting for one WebSocket client before its oldest are dropped")(
+		  "ws-max-lag-ms",
+		  po::value<long>()->default_value(getenv("WS_MAX_LAG_MS") ? std::stol(getenv("WS_MAX_LAG_MS")) : 5000),
+		  "disconnect WebSocket clients lagging more than this many milliseconds")(
+		  "ws-send-buffer",
+		  po::value<size_t>()->default_value(getenv("WS_SEND_BUFFER") ? std::stoul(getenv("WS_SEND_BUFFER"))
+																	  : 4 << 20),
+		  "bytes a WebSocket client may be sent beyond what it is assumed to have read")(
+		  "ws-min-client-rate",
+		  po::value<size_t>()->default_value(getenv("WS_MIN_CLIENT_RATE") ? std::stoul(getenv("WS_MIN_CLIENT_RATE"))
+																		  : 512 << 10),
+		  "bytes per second a WebSocket client is assumed to read at least (0 sends without limit)")(
+		  "ws-send-threads",
+		  po::value<size_t>()->default_value(getenv("WS_SEND_THREADS") ? std::stoul(getenv("WS_SEND_THREADS")) : 2),
+		  "threads sending DENMs to WebSocket clients")(
+		  "ws-publish-window",
+		  po::value<size_t>()->default_value(getenv("WS_PUBLISH_WINDOW") ? std::stoul(getenv("WS_PUBLISH_WINDOW"))
+																		  : 64),
+		  "DENMs a WebSocket connection may publish before they are acknowledged")(
+		  "replay-size",
+		  po::value<size_t>()->default_value(getenv("REPLAY_SIZE") ? std::stoul(getenv("REPLAY_SIZE")) : 4096),
+		  "recent DENMs kept for resuming WebSocket clients and GET /denm/stream")(
+		  "stream-retry-ms",
+		  po::value<unsigned>()->default_value(getenv("STREAM_RETRY_MS") ? std::stoul(getenv("STREAM_RETRY_MS"))
+																		  : 1000),
+		  "delay before an EventSource polls GET /denm/stream again")(
+		  "publisher-rate",
+		  po::value<double>()->default_value(getenv("PUBLISHER_RATE") ? std::stod(getenv("PUBLISHER_RATE")) : 0),
+		  "POST /denm requests per second per publisherId (0 disables)")(
+		  "publisher-burst",
+		  po::value<double>()->default_value(getenv("PUBLISHER_BURST") ? std::stod(getenv("PUBLISHER_BURST")) : 0),
+		  "POST /denm burst size per publisherId (default: one second of requests)")(
+		  "ip-rate",
+		  po::value<double>()->default_value(getenv("IP_RATE") ? std::stod(getenv("IP_RATE")) : 0),
+		  "POST /denm requests per second per client IP (0 disables)")(
+		  "ip-burst",
+		  po::value<double>()->default_value(getenv("IP_BURST") ? std::stod(getenv("IP_BURST")) : 0),
+		  "POST /denm burst size per client IP (default: one second of requests)")(
+		  "admin-token",
+		  po::value<std::string>()->default_value(getenv("ADMIN_TOKEN") ? getenv("ADMIN_TOKEN") : ""),
+		  "bearer token required to change the rate limits with PUT /limits (empty rejects changes)")(
+		  "trace-sample-rate",
+		  po::value<double>()->default_value(getenv("TRACE_SAMPLE_RATE") ? std::stod(getenv("TRACE_SAMPLE_RATE")) : 0),
+		  "fraction of DENMs traced through the pipeline, 0 to 1 (0 disables)")(
+		  "trace-buffer",
+		  po::value<size_t>()->default_value(getenv("TRACE_BUFFER") ? std::stoul(getenv("TRACE_BUFFER")) : 65536),
+		  "most recent trace spans kept")(
+		  "trace-file",
+		  po::value<std::string>()->default_value(getenv("TRACE_FILE") ? getenv("TRACE_FILE") : "denm-trace.json"),
+		  "Chrome trace file the spans are written to every 10 seconds");
 
 		po::variables_map vm;
 		po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -58,9 +171,14 @@ int main(int argc, char** argv) {
 			return 0;
 		}
 
+		// Log from a background thread, the level applies to the new logger
+		initAsyncLogging(vm["log-queue-size"].as<size_t>());
+
 		// Set log level
 		std::string log_level = vm["log-level"].as<std::string>();
-		if (log_level == "debug") {
+		if (log_level == "trace") {
+			spdlog::set_level(spdlog::level::trace);
+		} else if (log_level == "debug") {
 			spdlog::set_level(spdlog::level::debug);
 		} else if (log_level == "info") {
 			spdlog::set_level(spdlog::level::info);
@@ -81,18 +199,72 @@ int main(int argc, char** argv) {
 			if (service) {
 				service->stop();
 			}
-			exit(0); // Ensure we exit if stop() hangs
+			Tracer::getInstance().stopExport();
+			spdlog::shutdown(); // Write out the queued log messages
+			exit(0);			// Ensure we exit if stop() hangs
 		});
 
+		// Sampled DENMs are traced before any service handles them
+		double trace_sample_rate = vm["trace-sample-rate"].as<double>();
+		if (trace_sample_rate > 0) {
+			Tracer::getInstance().configure(trace_sample_rate, vm["trace-buffer"].as<size_t>());
+			Tracer::getInstance().startExport(vm["trace-file"].as<std::string>(), std::chrono::seconds(10));
+			spdlog::info("Tracing {}% of DENMs to {}", trace_sample_rate * 100, vm["trace-file"].as<std::string>());
+		}
+
 		// Create services
+		InterchangeOptions interchange_options;
+		interchange_options.decode_cache_size	 = vm["decode-cache-size"].as<size_t>();
+		interchange_options.drop_duplicates		 = vm["drop-duplicates"].as<bool>();
+		interchange_options.outbound_queue_limit = vm["outbound-queue-limit"].as<size_t>();
+		interchange_options.fair_queue_quantum	 = vm["fair-queue-quantum"].as<size_t>();
+		interchange_options.batch_threads		 = vm["batch-threads"].as<size_t>();
+		interchange_options.priority_classes =
+		  PriorityClassifier(vm["priority-classes"].as<std::string>(), vm["priority-rules"].as<std::string>());
+		interchange_options.shard_assigner =
+		  ShardAssigner(vm["shard-count"].as<unsigned>(), vm["shard-prefixes"].as<std::string>());
+
+		std::string scheduling = vm["priority-scheduling"].as<std::string>();
+		if (scheduling == "strict") {
+			interchange_options.lane_scheduling = LaneScheduling::Strict;
+		} else if (scheduling == "weighted") {
+			interchange_options.lane_scheduling = LaneScheduling::Weighted;
+		} else {
+			throw std::runtime_error("Invalid priority scheduling: " + scheduling);
+		}
+
 		auto interchange = std::make_unique<InterchangeService>(vm["username"].as<std::string>(),
 																vm["amqp-url"].as<std::string>(),
 																vm["amqp-send"].as<std::string>(),
 																vm["amqp-receive"].as<std::string>(),
-																vm["cert-dir"].as<std::string>());
+																vm["cert-dir"].as<std::string>(),
+																interchange_options);
+
+		DenmServiceOptions service_options;
+		service_options.publisher_limit.rate	  = vm["publisher-rate"].as<double>();
+		service_options.publisher_limit.burst	  = vm["publisher-burst"].as<double>();
+		service_options.ip_limit.rate			  = vm["ip-rate"].as<double>();
+		service_options.ip_limit.burst			  = vm["ip-burst"].as<double>();
+		service_options.admin_token				  = vm["admin-token"].as<std::string>();
+		service_options.max_batch_items			  = vm["max-batch-items"].as<size_t>();
+		service_options.async_queue_limit		  = vm["async-queue-limit"].as<size_t>();
+		service_options.status_table_size		  = vm["status-table-size"].as<size_t>();
+		service_options.http_threads			  = vm["http-threads"].as<unsigned>();
+		service_options.ws_threads				  = vm["ws-threads"].as<unsigned>();
+		service_options.cpus					  = vm["http-cpus"].as<std::string>();
+		service_options.ws_fanout.queue_limit	  = vm["ws-queue-limit"].as<size_t>();
+		service_options.ws_fanout.max_lag		  = std::chrono::milliseconds(vm["ws-max-lag-ms"].as<long>());
+		service_options.ws_fanout.send_threads	  = vm["ws-send-threads"].as<size_t>();
+		service_options.ws_fanout.send_buffer	  = vm["ws-send-buffer"].as<size_t>();
+		service_options.ws_fanout.min_client_rate = vm["ws-min-client-rate"].as<size_t>();
+		service_options.ws_publish_window		  = vm["ws-publish-window"].as<size_t>();
+		service_options.ws_fanout.replay_size	  = vm["replay-size"].as<size_t>();
+		service_options.stream_retry_ms			  = vm["stream-retry-ms"].as<unsigned>();
 
-		service = std::make_unique<DenmService>(
-		  vm["http-host"].as<std::string>(), vm["http-port"].as<int>(), vm["ws-port"].as<int>());
+		service = std::make_unique<DenmService>(vm["http-host"].as<std::string>(),
+												vm["http-port"].as<int>(),
+												vm["ws-port"].as<int>(),
+												service_options);
 
 		// Start services
 		interchange->start();
@@ -104,6 +276,7 @@ int main(int argc, char** argv) {
 		return 0;
 	} catch (const std::exception& e) {
 		spdlog::error("Error: {}", e.what());
+		spdlog::shutdown();
 		return 1;
 	}
 }
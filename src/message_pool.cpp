@@ -0,0 +1,26 @@
+#include "message_pool.hpp"
+
+MessagePool::Handle MessagePool::acquire() {
+	std::unique_ptr<proton::message> m;
+	{
+		std::lock_guard<std::mutex> l(lock_);
+		if (!idle_.empty()) {
+			m = std::move(idle_.back());
+			idle_.pop_back();
+		}
+	}
+	if (m) {
+		m->clear();
+	} else {
+		m = std::make_unique<proton::message>();
+	}
+	return Handle(m.release(), Releaser{this});
+}
+
+void MessagePool::release(proton::message* m) {
+	std::unique_ptr<proton::message> owned(m);
+	std::lock_guard<std::mutex> l(lock_);
+	if (idle_.size() < max_idle_) {
+		idle_.push_back(std::move(owned));
+	}
+}
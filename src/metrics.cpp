@@ -0,0 +1,150 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+uint64_t MetricCounter::value() const {
+	uint64_t total = 0;
+	for (const auto& shard : shards_) {
+		total += shard.value.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+MetricHistogram::Snapshot MetricHistogram::snapshot() const {
+	Snapshot snapshot;
+	for (const auto& shard : shards_) {
+		for (size_t i = 0; i < BUCKETS; ++i) {
+			uint64_t count = shard.buckets[i].load(std::memory_order_relaxed);
+			snapshot.buckets[i] += count;
+			snapshot.count += count;
+		}
+		snapshot.sum_ns += shard.sum_ns.load(std::memory_order_relaxed);
+	}
+	return snapshot;
+}
+
+uint64_t MetricHistogram::Snapshot::percentileNs(double quantile) const {
+	if (count == 0)
+		return 0;
+	uint64_t rank = static_cast<uint64_t>(quantile * count);
+	rank		  = std::min(std::max<uint64_t>(rank, 1), count);
+	uint64_t seen = 0;
+	for (size_t i = 0; i < BUCKETS; ++i) {
+		seen += buckets[i];
+		if (seen >= rank)
+			return upperBoundNs(i);
+	}
+	return upperBoundNs(BUCKETS - 1);
+}
+
+nlohmann::json MetricHistogram::Snapshot::toJson() const {
+	auto us = [](uint64_t ns) { return (ns + 999) / 1000; };
+	nlohmann::json j;
+	j["count"]	= count;
+	j["meanUs"] = count ? us(sum_ns / count) : 0;
+	j["p50Us"]	= us(percentileNs(0.50));
+	j["p90Us"]	= us(percentileNs(0.90));
+	j["p99Us"]	= us(percentileNs(0.99));
+	return j;
+}
+
+Metrics::Family& Metrics::family(const std::string& name, const std::string& type, const std::string& help) {
+	auto it = families_.find(name);
+	if (it != families_.end()) {
+		if (it->second.type != type)
+			throw std::logic_error("Metric " + name + " is a " + it->second.type);
+		return it->second;
+	}
+	Family& family = families_[name];
+	family.type	   = type;
+	family.help	   = help;
+	return family;
+}
+
+MetricCounter& Metrics::counter(const std::string& name, const std::string& help) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	Family& f = family(name, "counter", help);
+	if (!f.counter)
+		f.counter = std::make_unique<MetricCounter>();
+	return *f.counter;
+}
+
+MetricGauge& Metrics::gauge(const std::string& name, const std::string& help) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	Family& f = family(name, "gauge", help);
+	if (!f.gauge)
+		f.gauge = std::make_unique<MetricGauge>();
+	return *f.gauge;
+}
+
+MetricHistogram& Metrics::histogram(const std::string& name, const std::string& help) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	Family& f = family(name, "histogram", help);
+	if (!f.histogram)
+		f.histogram = std::make_unique<MetricHistogram>();
+	return *f.histogram;
+}
+
+namespace {
+std::string seconds(uint64_t ns) {
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%.9g", static_cast<double>(ns) / 1e9);
+	return buffer;
+}
+} // namespace
+
+std::string Metrics::render() const {
+	// Bounds of the exposed buckets, finer ones are summed into them
+	constexpr uint64_t MIN_BOUND_NS = 1000;
+	constexpr uint64_t MAX_BOUND_NS = uint64_t(1) << 35;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::string out;
+	for (const auto& entry : families_) {
+		const std::string& name = entry.first;
+		const Family& f			= entry.second;
+		out += "# HELP " + name + " " + f.help + "\n";
+		out += "# TYPE " + name + " " + f.type + "\n";
+		if (f.counter) {
+			out += name + " " + std::to_string(f.counter->value()) + "\n";
+		} else if (f.gauge) {
+			out += name + " " + std::to_string(f.gauge->value()) + "\n";
+		} else if (f.histogram) {
+			auto snapshot	= f.histogram->snapshot();
+			uint64_t counts = 0;
+			for (size_t i = 0; i < MetricHistogram::BUCKETS - 1; ++i) {
+				counts += snapshot.buckets[i];
+				// Buckets hold [lower, upper) in whole nanoseconds, i.e. up to and including upper - 1
+				uint64_t bound = MetricHistogram::upperBoundNs(i);
+				if (bound >= MIN_BOUND_NS && bound <= MAX_BOUND_NS) {
+					out += name + "_bucket{le=\"" + seconds(bound) + "\"} " + std::to_string(counts) + "\n";
+				}
+			}
+			out += name + "_bucket{le=\"+Inf\"} " + std::to_string(snapshot.count) + "\n";
+			out += name + "_sum " + seconds(snapshot.sum_ns) + "\n";
+			out += name + "_count " + std::to_string(snapshot.count) + "\n";
+		}
+	}
+	return out;
+}
+
+PipelineMetrics& PipelineMetrics::get() {
+	static PipelineMetrics metrics = [] {
+		auto& m = Metrics::getInstance();
+		return PipelineMetrics{
+		  m.histogram("denm_http_parse_seconds", "Parsing the body of POST /denm"),
+		  m.histogram("denm_validation_seconds", "Validating and building an outgoing DENM"),
+		  m.histogram("denm_from_json_seconds", "Building the ASN.1 DENM from JSON"),
+		  m.histogram("denm_uper_encode_seconds", "UPER encoding of an outgoing DENM"),
+		  m.histogram("denm_quadtree_seconds", "Quadtree of the position of an outgoing DENM"),
+		  m.histogram("amqp_credit_wait_seconds", "Time blocked waiting for AMQP link credit"),
+		  m.counter("denm_published_total", "Outgoing DENMs handed to the outbound queue"),
+		  m.gauge("amqp_receiver_buffered", "Received AMQP messages waiting for the receiver thread"),
+		  m.histogram("denm_uper_decode_seconds", "Decoding a received DENM from UPER to JSON"),
+		  m.histogram("denm_event_dispatch_seconds", "Dispatching a received DENM to its subscribers"),
+		  m.histogram("ws_fanout_seconds", "Time from WebSocket fan-out queue to the send to a client"),
+		  m.counter("denm_received_total", "Incoming DENMs")};
+	}();
+	return metrics;
+}
@@ -0,0 +1,239 @@
+#include "outbound_queue.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+OutboundQueue::OutboundQueue(size_t limit,
+							 const std::vector<unsigned>& lane_weights,
+							 LaneScheduling scheduling,
+							 size_t quantum) :
+  limit_(limit),
+  scheduling_(scheduling),
+  quantum_(quantum > 0 ? static_cast<int64_t>(quantum) : 1),
+  lanes_(lane_weights.empty() ? 1 : lane_weights.size()) {
+	for (size_t i = 0; i < lane_weights.size(); ++i) {
+		lanes_[i].weight = lane_weights[i] > 0 ? lane_weights[i] : 1;
+	}
+}
+
+void OutboundQueue::append(uint64_t key, MessagePtr message, const OutboundRoute& route) {
+	Lane& lane = lanes_[route.lane];
+	auto it	   = lane.flows.find(route.flow);
+	if (it == lane.flows.end()) {
+		it				 = lane.flows.emplace(route.flow, Flow()).first;
+		it->second.name	 = route.flow;
+		lane.active.push_back(&it->second);
+	}
+
+	Flow& flow = it->second;
+	auto item  =
+	  flow.items.insert(flow.items.end(), Item{key, std::move(message), route.cost, Clock::now(), route.trace});
+	++lane.size;
+	index_[key] = Location{route.lane, &flow, item};
+}
+
+void OutboundQueue::erase(const Location& location) {
+	Lane& lane = lanes_[location.lane];
+	location.flow->items.erase(location.item);
+	--lane.size;
+	if (location.flow->items.empty()) {
+		lane.active.erase(std::find(lane.active.begin(), lane.active.end(), location.flow));
+		std::string name = location.flow->name;
+		lane.flows.erase(name);
+	}
+}
+
+bool OutboundQueue::insert(uint64_t key,
+						   MessagePtr message,
+						   const OutboundRoute& route,
+						   std::vector<MessagePtr>& replaced) {
+	auto it = index_.find(key);
+	if (it != index_.end()) {
+		++conflated_;
+		Location& location = it->second;
+		// A repetition pushing the pending message again replaces nothing
+		if (on_conflated_ && location.item->message != message) {
+			replaced.push_back(location.item->message);
+		}
+		if (location.lane == route.lane && location.flow->name == route.flow) {
+			// Keep the queue position of the pending version, only the latest state is sent
+			location.item->message	 = std::move(message);
+			location.item->cost		 = route.cost;
+			location.item->queued_at = Clock::now();
+			location.item->trace	 = route.trace;
+			return true;
+		}
+		// The update changed priority class or publisher, it moves to the back of its new flow
+		erase(location);
+		append(key, std::move(message), route);
+		return true;
+	}
+
+	if (size_ >= limit_) {
+		return false;
+	}
+	append(key, std::move(message), route);
+	++size_;
+	return true;
+}
+
+void OutboundQueue::notifyConflated(const std::vector<MessagePtr>& replaced) const {
+	for (const auto& message : replaced) {
+		on_conflated_(message);
+	}
+}
+
+void OutboundQueue::push(uint64_t key, MessagePtr message, const OutboundRoute& route) {
+	if (route.lane >= lanes_.size()) {
+		throw std::out_of_range("Unknown outbound lane " + std::to_string(route.lane));
+	}
+
+	std::vector<MessagePtr> replaced;
+	{
+		std::lock_guard<std::mutex> l(lock_);
+		if (closed_) {
+			throw std::runtime_error("Outbound queue is closed");
+		}
+		if (!insert(key, std::move(message), route, replaced)) {
+			throw std::runtime_error("Outbound queue is full");
+		}
+	}
+	ready_.notify_one();
+	notifyConflated(replaced);
+}
+
+std::vector<bool> OutboundQueue::push(const std::vector<Pending>& batch) {
+	for (const auto& pending : batch) {
+		if (pending.route.lane >= lanes_.size()) {
+			throw std::out_of_range("Unknown outbound lane " + std::to_string(pending.route.lane));
+		}
+	}
+
+	std::vector<bool> queued;
+	std::vector<MessagePtr> replaced;
+	queued.reserve(batch.size());
+	{
+		std::lock_guard<std::mutex> l(lock_);
+		if (closed_) {
+			throw std::runtime_error("Outbound queue is closed");
+		}
+		for (const auto& pending : batch) {
+			queued.push_back(insert(pending.key, pending.message, pending.route, replaced));
+		}
+	}
+	ready_.notify_all();
+	notifyConflated(replaced);
+	return queued;
+}
+
+OutboundQueue::Lane* OutboundQueue::nextLane() {
+	if (scheduling_ == LaneScheduling::Strict) {
+		for (auto& lane : lanes_) {
+			if (lane.size > 0)
+				return &lane;
+		}
+		return nullptr;
+	}
+
+	// Smooth weighted round-robin over the non-empty lanes: the chosen lane pays back the total weight, so
+	// lanes are interleaved instead of served in bursts
+	Lane* best	  = nullptr;
+	int64_t total = 0;
+	for (auto& lane : lanes_) {
+		if (lane.size == 0)
+			continue;
+		lane.current += lane.weight;
+		total += lane.weight;
+		if (!best || lane.current > best->current) {
+			best = &lane;
+		}
+	}
+	if (best) {
+		best->current -= total;
+	}
+	return best;
+}
+
+OutboundQueue::Item OutboundQueue::take(Lane& lane) {
+	// Deficit round-robin: a flow gets one quantum per round and sends while its deficit covers the cost of
+	// its next message. Terminates because every visit without a send adds a quantum
+	while (true) {
+		Flow* flow = lane.active.front();
+		if (!flow->visited) {
+			flow->deficit += quantum_;
+			flow->visited = true;
+		}
+
+		Item& head = flow->items.front();
+		if (static_cast<int64_t>(head.cost) <= flow->deficit) {
+			flow->deficit -= head.cost;
+			auto sent = sent_by_flow_.find(flow->name);
+			if (sent != sent_by_flow_.end()) {
+				++sent->second;
+			} else if (sent_by_flow_.size() < MAX_FLOW_COUNTERS) {
+				sent_by_flow_.emplace(flow->name, 1);
+			}
+
+			Item item = std::move(head);
+			flow->items.pop_front();
+			--lane.size;
+			if (flow->items.empty()) {
+				// An idle flow does not bank its deficit
+				lane.active.pop_front();
+				std::string name = flow->name;
+				lane.flows.erase(name);
+			}
+			return item;
+		}
+
+		flow->visited = false;
+		lane.active.pop_front();
+		lane.active.push_back(flow);
+	}
+}
+
+std::vector<OutboundQueue::MessagePtr> OutboundQueue::pop(size_t max, std::chrono::milliseconds timeout) {
+	std::vector<MessagePtr> batch;
+	std::unique_lock<std::mutex> l(lock_);
+	ready_.wait_for(l, timeout, [this]() { return closed_ || size_ > 0; });
+	if (closed_)
+		return batch;
+
+	auto now = Clock::now();
+	while (batch.size() < max) {
+		Lane* lane = nextLane();
+		if (!lane)
+			break;
+		Item item = take(*lane);
+		lane->latency.record(now - item.queued_at);
+		if (item.trace.sampled())
+			Tracer::getInstance().record(item.trace, "outbound.queue", item.queued_at, now);
+		index_.erase(item.key);
+		--size_;
+		batch.push_back(std::move(item.message));
+	}
+	return batch;
+}
+
+void OutboundQueue::close() {
+	{
+		std::lock_guard<std::mutex> l(lock_);
+		closed_ = true;
+	}
+	ready_.notify_all();
+}
+
+size_t OutboundQueue::size() const {
+	std::lock_guard<std::mutex> l(lock_);
+	return size_;
+}
+
+size_t OutboundQueue::size(size_t lane) const {
+	std::lock_guard<std::mutex> l(lock_);
+	return lanes_.at(lane).size;
+}
+
+std::map<std::string, uint64_t> OutboundQueue::sentByFlow() const {
+	std::lock_guard<std::mutex> l(lock_);
+	return std::map<std::string, uint64_t>(sent_by_flow_.begin(), sent_by_flow_.end());
+}
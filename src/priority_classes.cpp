@@ -0,0 +1,93 @@
+#include "priority_classes.hpp"
+#include <sstream>
+#include <stdexcept>
+
+const std::string PriorityClassifier::DEFAULT_CLASSES = "critical:9:8,high:5:4,normal:1:1";
+// 95 emergencyVehicleApproaching, 97 collisionRisk, 99 dangerousSituation, 91 vehicleBreakdown, 92 accident,
+// 93 humanProblem, 94 stationaryVehicle, 10 obstacleOnTheRoad, 12 humanPresenceOnTheRoad
+const std::string PriorityClassifier::DEFAULT_RULES =
+  "95=critical,97=critical,99=critical,91=high,92=high,93=high,94=high,10=high,12=high";
+
+namespace {
+std::vector<std::string> split(const std::string& s, char delimiter) {
+	std::vector<std::string> parts;
+	std::stringstream ss(s);
+	std::string part;
+	while (std::getline(ss, part, delimiter)) {
+		if (!part.empty()) {
+			parts.push_back(part);
+		}
+	}
+	return parts;
+}
+
+int parseInt(const std::string& s, int min, int max) {
+	size_t end = 0;
+	int value  = 0;
+	try {
+		value = std::stoi(s, &end);
+	} catch (const std::exception&) {
+		end = 0;
+	}
+	if (end == 0 || end != s.size() || value < min || value > max) {
+		throw std::invalid_argument("Invalid number in priority configuration: " + s);
+	}
+	return value;
+}
+
+int parseCode(const std::string& s) {
+	return s == "*" ? -1 : parseInt(s, 0, 255);
+}
+} // namespace
+
+PriorityClassifier::PriorityClassifier() :
+  PriorityClassifier(DEFAULT_CLASSES, DEFAULT_RULES) {}
+
+PriorityClassifier::PriorityClassifier(const std::string& classes, const std::string& rules) {
+	for (const auto& spec : split(classes, ',')) {
+		auto fields = split(spec, ':');
+		if (fields.size() != 3) {
+			throw std::invalid_argument("Expected name:amqpPriority:weight, got " + spec);
+		}
+		int priority = parseInt(fields[1], 0, 9);
+		int weight	 = parseInt(fields[2], 1, 1000);
+		classes_.push_back(PriorityClass{fields[0], static_cast<uint8_t>(priority), static_cast<unsigned>(weight)});
+	}
+	if (classes_.empty()) {
+		throw std::invalid_argument("At least one priority class is required");
+	}
+
+	for (const auto& spec : split(rules, ',')) {
+		auto rule = split(spec, '=');
+		if (rule.size() != 2) {
+			throw std::invalid_argument("Expected causeCode[/stationType]=class, got " + spec);
+		}
+		auto codes = split(rule[0], '/');
+		if (codes.empty() || codes.size() > 2) {
+			throw std::invalid_argument("Expected causeCode[/stationType]=class, got " + spec);
+		}
+		int cause_code	 = parseCode(codes[0]);
+		int station_type = codes.size() == 2 ? parseCode(codes[1]) : ANY;
+
+		size_t index = 0;
+		while (index < classes_.size() && classes_[index].name != rule[1]) {
+			++index;
+		}
+		if (index == classes_.size()) {
+			throw std::invalid_argument("Unknown priority class: " + rule[1]);
+		}
+		rules_[{cause_code, station_type}] = index;
+	}
+}
+
+size_t PriorityClassifier::classify(int cause_code, int station_type) const {
+	for (const auto& key : {std::make_pair(cause_code, station_type),
+							std::make_pair(cause_code, ANY),
+							std::make_pair(static_cast<int>(ANY), station_type)}) {
+		auto it = rules_.find(key);
+		if (it != rules_.end()) {
+			return it->second;
+		}
+	}
+	return classes_.size() - 1;
+}
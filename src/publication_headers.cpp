@@ -0,0 +1,63 @@
+#include "publication_headers.hpp"
+#include <algorithm>
+#include <proton/duration.hpp>
+
+void PublicationHeaders::applyTo(proton::message& msg) const {
+	msg.durable(true);
+	msg.ttl(proton::duration(3600000)); // 1 hour TTL
+	msg.user(user);
+	msg.to(to);
+
+	auto& props = msg.properties();
+	for (const auto& property : properties) {
+		props.put(property.first, property.second);
+	}
+}
+
+bool PublicationHeaders::matches(const nlohmann::json& j) const {
+	for (size_t i = 0; i < KEYS.size(); ++i) {
+		auto it = j.find(KEYS[i]);
+		if (it == j.end() || !it->is_string() || it->get_ref<const std::string&>() != values[i])
+			return false;
+	}
+	return true;
+}
+
+PublicationHeaderCache::PublicationHeaderCache(std::string user, std::string to, size_t max_publications) :
+  user_(std::move(user)),
+  to_(std::move(to)),
+  max_publications_(std::max<size_t>(max_publications, 1)) {}
+
+std::shared_ptr<const PublicationHeaders> PublicationHeaderCache::get(const nlohmann::json& j) {
+	const auto& publication_id = j.at("publicationId").get_ref<const std::string&>();
+	{
+		std::lock_guard<std::mutex> l(lock_);
+		auto it = publications_.find(publication_id);
+		if (it != publications_.end() && it->second->matches(j))
+			return it->second;
+	}
+
+	auto headers = build(j);
+	std::lock_guard<std::mutex> l(lock_);
+	// Publications are long-lived and few, forget them all rather than track their use
+	if (publications_.size() >= max_publications_ && publications_.count(publication_id) == 0)
+		publications_.clear();
+	publications_[publication_id] = headers;
+	return headers;
+}
+
+size_t PublicationHeaderCache::size() const {
+	std::lock_guard<std::mutex> l(lock_);
+	return publications_.size();
+}
+
+std::shared_ptr<const PublicationHeaders> PublicationHeaderCache::build(const nlohmann::json& j) const {
+	auto headers  = std::make_shared<PublicationHeaders>();
+	headers->user = user_;
+	headers->to	  = to_;
+	for (size_t i = 0; i < PublicationHeaders::KEYS.size(); ++i) {
+		headers->values[i] = j.at(PublicationHeaders::KEYS[i]).get<std::string>();
+		headers->properties.emplace(PublicationHeaders::KEYS[i], proton::scalar(headers->values[i]));
+	}
+	return headers;
+}
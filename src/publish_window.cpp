@@ -0,0 +1,16 @@
+#include "publish_window.hpp"
+
+PublishWindow::PublishWindow(size_t size) :
+  size_(size) {}
+
+bool PublishWindow::acquire() {
+	if (in_flight_ >= size_)
+		return false;
+	++in_flight_;
+	return true;
+}
+
+void PublishWindow::release() {
+	if (in_flight_ > 0)
+		--in_flight_;
+}
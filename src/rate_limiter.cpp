@@ -0,0 +1,177 @@
+#include "rate_limiter.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+RateLimit limitFromJson(const nlohmann::json& j) {
+	RateLimit limit;
+	limit.rate	= j.value("rate", 0.0);
+	limit.burst = j.value("burst", 0.0);
+	if (limit.rate < 0 || limit.burst < 0) {
+		throw std::invalid_argument("Rate limits must not be negative");
+	}
+	return limit;
+}
+
+nlohmann::json limitToJson(const RateLimit& limit) {
+	return {{"rate", limit.rate}, {"burst", limit.burst}};
+}
+} // namespace
+
+RateLimiter::RateLimiter(RateLimit publisher_limit, RateLimit ip_limit, size_t max_buckets) :
+  publisher_limit_(publisher_limit),
+  ip_limit_(ip_limit),
+  max_buckets_(std::max<size_t>(max_buckets, 1)) {}
+
+const RateLimit& RateLimiter::publisherLimit(const std::string& publisher) const {
+	auto it = publisher_overrides_.find(publisher);
+	return it == publisher_overrides_.end() ? publisher_limit_ : it->second;
+}
+
+RateLimiter::Bucket* RateLimiter::refill(BucketTable& buckets,
+										 const std::string& name,
+										 const RateLimit& limit,
+										 Clock::time_point now) {
+	if (name.empty() || limit.rate <= 0)
+		return nullptr;
+
+	double burst = std::max(limit.burst > 0 ? limit.burst : limit.rate, 1.0);
+	auto it		 = buckets.index.find(name);
+	if (it != buckets.index.end()) {
+		buckets.lru.splice(buckets.lru.begin(), buckets.lru, it->second);
+	} else {
+		if (buckets.index.size() >= max_buckets_) {
+			buckets.index.erase(buckets.lru.back().name);
+			buckets.lru.pop_back();
+		}
+		buckets.lru.push_front(Bucket{name, burst, now});
+		buckets.index.emplace(name, buckets.lru.begin());
+	}
+
+	Bucket& bucket = buckets.lru.front();
+	double elapsed = std::chrono::duration<double>(now - bucket.updated).count();
+	bucket.tokens  = std::min(burst, bucket.tokens + std::max(elapsed, 0.0) * limit.rate);
+	bucket.updated = now;
+	return &bucket;
+}
+
+bool RateLimiter::allow(const std::string& publisher,
+						const std::string& ip,
+						double& retry_after,
+						Clock::time_point now) {
+	return allowUpTo(publisher, ip, 1, retry_after, now) == 1;
+}
+
+bool RateLimiter::allowIp(const std::string& ip, double& retry_after, Clock::time_point now) {
+	std::lock_guard<std::mutex> l(lock_);
+	retry_after	   = 0;
+	Bucket* bucket = refill(ip_buckets_, ip, ip_limit_, now);
+	if (!bucket)
+		return true;
+	if (bucket->tokens >= 1) {
+		bucket->tokens -= 1;
+		return true;
+	}
+	retry_after = (1.0 - bucket->tokens) / ip_limit_.rate;
+	++total_.rejected;
+	++rejected_by_ip_;
+	return false;
+}
+
+size_t RateLimiter::allowUpTo(const std::string& publisher,
+							  const std::string& ip,
+							  size_t count,
+							  double& retry_after,
+							  Clock::time_point now) {
+	std::lock_guard<std::mutex> l(lock_);
+	const RateLimit& publisher_limit = publisherLimit(publisher);
+
+	// Check both buckets before taking tokens from either, a rejected request costs nothing
+	retry_after				 = 0;
+	Bucket* publisher_bucket = refill(publisher_buckets_, publisher, publisher_limit, now);
+	Bucket* ip_bucket		 = refill(ip_buckets_, ip, ip_limit_, now);
+	auto available			 = [count](const Bucket* bucket) {
+		  return bucket ? std::min(count, static_cast<size_t>(std::max(bucket->tokens, 0.0))) : count;
+	};
+	size_t publisher_tokens = available(publisher_bucket);
+	size_t ip_tokens		= available(ip_bucket);
+	size_t allowed			= std::min(publisher_tokens, ip_tokens);
+
+	if (publisher_bucket)
+		publisher_bucket->tokens -= allowed;
+	if (ip_bucket)
+		ip_bucket->tokens -= allowed;
+	// Until the bucket that ran out has a token again
+	if (allowed < count && publisher_tokens == allowed)
+		retry_after = std::max(retry_after, (1.0 - publisher_bucket->tokens) / publisher_limit.rate);
+	if (allowed < count && ip_tokens == allowed)
+		retry_after = std::max(retry_after, (1.0 - ip_bucket->tokens) / ip_limit_.rate);
+
+	Counters* counters = nullptr;
+	if (!publisher.empty()) {
+		auto it = per_publisher_.find(publisher);
+		if (it != per_publisher_.end()) {
+			counters = &it->second;
+		} else if (per_publisher_.size() < max_buckets_) {
+			counters = &per_publisher_[publisher];
+		}
+	}
+	size_t rejected = count - allowed;
+	total_.accepted += allowed;
+	total_.rejected += rejected;
+	if (ip_tokens == allowed)
+		rejected_by_ip_ += rejected;
+	if (counters) {
+		counters->accepted += allowed;
+		counters->rejected += rejected;
+	}
+	return allowed;
+}
+
+void RateLimiter::configure(const nlohmann::json& config) {
+	if (!config.is_object()) {
+		throw std::invalid_argument("Rate limit configuration must be an object");
+	}
+
+	RateLimit publisher_limit = config.contains("publisher") ? limitFromJson(config["publisher"]) : RateLimit();
+	RateLimit ip_limit		  = config.contains("ip") ? limitFromJson(config["ip"]) : RateLimit();
+	std::map<std::string, RateLimit> overrides;
+	if (config.contains("publishers")) {
+		for (const auto& entry : config["publishers"].items()) {
+			overrides[entry.key()] = limitFromJson(entry.value());
+		}
+	}
+
+	std::lock_guard<std::mutex> l(lock_);
+	publisher_limit_	 = publisher_limit;
+	ip_limit_			 = ip_limit;
+	publisher_overrides_ = std::move(overrides);
+	// Start over with full buckets under the new limits
+	publisher_buckets_.clear();
+	ip_buckets_.clear();
+}
+
+nlohmann::json RateLimiter::config() const {
+	std::lock_guard<std::mutex> l(lock_);
+	nlohmann::json j;
+	j["publisher"]	= limitToJson(publisher_limit_);
+	j["ip"]			= limitToJson(ip_limit_);
+	j["publishers"] = nlohmann::json::object();
+	for (const auto& entry : publisher_overrides_) {
+		j["publishers"][entry.first] = limitToJson(entry.second);
+	}
+	return j;
+}
+
+nlohmann::json RateLimiter::stats() const {
+	std::lock_guard<std::mutex> l(lock_);
+	nlohmann::json j;
+	j["accepted"]	  = total_.accepted;
+	j["rejected"]	  = total_.rejected;
+	j["rejectedByIp"] = rejected_by_ip_;
+	j["publishers"]	  = nlohmann::json::object();
+	for (const auto& entry : per_publisher_) {
+		j["publishers"][entry.first] = {{"accepted", entry.second.accepted}, {"rejected", entry.second.rejected}};
+	}
+	return j;
+}
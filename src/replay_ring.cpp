@@ -0,0 +1,44 @@
+#include "replay_ring.hpp"
+#include <algorithm>
+
+ReplayRing::ReplayRing(size_t capacity) :
+  slots_(std::max<size_t>(capacity, 1)) {}
+
+uint64_t ReplayRing::append(std::shared_ptr<const WsMessage> message,
+							std::shared_ptr<const DenmAttributes> attributes) {
+	uint64_t seq = last_.load(std::memory_order_relaxed) + 1;
+	auto entry	 = std::make_shared<const Entry>(Entry{seq, std::move(message), std::move(attributes)});
+	std::atomic_store(&slots_[seq % slots_.size()], std::move(entry));
+	// Published after the slot, a reader that sees `seq` finds the entry
+	last_.store(seq, std::memory_order_release);
+	return seq;
+}
+
+std::vector<ReplayRing::EntryPtr> ReplayRing::since(uint64_t since, bool& truncated, size_t max) const {
+	std::vector<EntryPtr> entries;
+	uint64_t last = lastSeq();
+
+	// A cursor from before a restart, everything retained is new to the client
+	bool restarted = since > last;
+	if (restarted) {
+		since = 0;
+	}
+	uint64_t oldest = last >= slots_.size() ? last - slots_.size() + 1 : 1;
+	uint64_t first	= std::max(since + 1, oldest);
+	if (max < last + 1 - first) {
+		first = last + 1 - max;
+	}
+	truncated = restarted || first > since + 1;
+
+	entries.reserve(last >= first ? last - first + 1 : 0);
+	for (uint64_t seq = first; seq <= last; ++seq) {
+		EntryPtr entry = std::atomic_load(&slots_[seq % slots_.size()]);
+		// Overwritten by a newer entry since `last` was read
+		if (!entry || entry->seq != seq) {
+			truncated = true;
+			continue;
+		}
+		entries.push_back(std::move(entry));
+	}
+	return entries;
+}
@@ -0,0 +1,74 @@
+#include "shard_assigner.hpp"
+#include "hash_utils.hpp"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+ShardAssigner::ShardAssigner(unsigned shard_count, const std::string& prefix_table, int level) :
+  shard_count_(shard_count),
+  level_(std::min(std::max(level, 1), 29)) {
+	std::stringstream table(prefix_table);
+	std::string entry;
+	while (std::getline(table, entry, ',')) {
+		if (entry.empty())
+			continue;
+		size_t eq = entry.find('=');
+		if (eq == std::string::npos || eq == 0) {
+			throw std::invalid_argument("Expected quadkeyPrefix=shardId, got " + entry);
+		}
+		std::string prefix = entry.substr(0, eq);
+		if (prefix.find_first_not_of("0123") != std::string::npos) {
+			throw std::invalid_argument("Invalid quadkey prefix: " + prefix);
+		}
+		unsigned long shard = 0;
+		try {
+			shard = std::stoul(entry.substr(eq + 1));
+		} catch (const std::exception&) {
+		}
+		if (shard < 1 || shard > shard_count_) {
+			throw std::invalid_argument("Invalid shardId in " + entry + ", shards are 1-" +
+										std::to_string(shard_count_));
+		}
+		prefixes_[prefix] = static_cast<unsigned>(shard);
+		longest_prefix_	  = std::max(longest_prefix_, prefix.size());
+	}
+}
+
+uint64_t ShardAssigner::mortonPrefix(const std::string& quadkey, int level) {
+	// Every quadkey digit is two interleaved bits of the tile coordinates, so the digits read as a base-4
+	// number are the Morton code of the tile. Shorter keys are padded, i.e. cover a larger range
+	uint64_t code = 0;
+	for (int i = 0; i < level; ++i) {
+		unsigned digit = i < static_cast<int>(quadkey.size()) ? quadkey[i] - '0' : 0;
+		code		   = (code << 2) | (digit & 3);
+	}
+	// Keep the level in the hash input, a range at one level differs from the same code at another
+	return (code << 5) | static_cast<uint64_t>(level);
+}
+
+unsigned ShardAssigner::assign(const std::string& quadkey) const {
+	if (!enabled())
+		return 1;
+
+	for (size_t length = std::min(longest_prefix_, quadkey.size()); length > 0; --length) {
+		auto it = prefixes_.find(quadkey.substr(0, length));
+		if (it != prefixes_.end()) {
+			return it->second;
+		}
+	}
+
+	uint64_t range = mortonPrefix(quadkey, level_);
+	return jumpHash(xxhash64(reinterpret_cast<const unsigned char*>(&range), sizeof(range)), shard_count_) + 1;
+}
+
+unsigned ShardAssigner::jumpHash(uint64_t key, unsigned buckets) {
+	// Jump consistent hash (Lamping and Veach), even spread without a ring and no memory per shard
+	int64_t b = -1;
+	int64_t j = 0;
+	while (j < static_cast<int64_t>(buckets)) {
+		b	= j;
+		key = key * 2862933555777941757ULL + 1;
+		j	= static_cast<int64_t>((b + 1) * (static_cast<double>(1LL << 31) / static_cast<double>((key >> 33) + 1)));
+	}
+	return static_cast<unsigned>(b);
+}
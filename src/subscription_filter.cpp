@@ -0,0 +1,209 @@
+#include "subscription_filter.hpp"
+#include "geo_utils.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+DenmAttributes DenmAttributes::fromJson(const nlohmann::json& denm) {
+	DenmAttributes attributes;
+	const auto& management	= denm.at("management");
+	attributes.latitude		= management.at("eventPosition").at("latitude").get<double>();
+	attributes.longitude	= management.at("eventPosition").at("longitude").get<double>();
+	attributes.quadkey		= calculateQuadTree(attributes.latitude, attributes.longitude);
+	attributes.station_type	= management.value("stationType", -1);
+	if (denm.contains("situation")) {
+		attributes.cause_code		   = denm["situation"].value("causeCode", -1);
+		attributes.information_quality = denm["situation"].value("informationQuality", -1);
+	}
+	return attributes;
+}
+
+namespace {
+std::set<int> intSet(const nlohmann::json& j, const char* field) {
+	std::set<int> values;
+	if (!j.contains(field))
+		return values;
+	if (!j[field].is_array())
+		throw std::invalid_argument(std::string(field) + " must be an array");
+	for (const auto& value : j[field]) {
+		if (!value.is_number_integer())
+			throw std::invalid_argument(std::string(field) + " must contain integers");
+		values.insert(value.get<int>());
+	}
+	return values;
+}
+} // namespace
+
+SubscriptionFilter SubscriptionFilter::fromJson(const nlohmann::json& j) {
+	if (!j.is_object())
+		throw std::invalid_argument("Filter must be an object");
+
+	SubscriptionFilter filter;
+	try {
+		if (j.contains("boundingBox")) {
+			const auto& box		 = j["boundingBox"];
+			filter.has_box		 = true;
+			filter.min_latitude	 = box.at("minLatitude").get<double>();
+			filter.min_longitude = box.at("minLongitude").get<double>();
+			filter.max_latitude	 = box.at("maxLatitude").get<double>();
+			filter.max_longitude = box.at("maxLongitude").get<double>();
+		}
+		if (j.contains("minInformationQuality")) {
+			filter.min_information_quality = j["minInformationQuality"].get<int>();
+		}
+	} catch (const nlohmann::json::exception& e) {
+		throw std::invalid_argument(std::string("Invalid filter: ") + e.what());
+	}
+	if (filter.has_box &&
+		(filter.min_latitude > filter.max_latitude || filter.min_longitude > filter.max_longitude ||
+		 filter.min_latitude < -90 || filter.max_latitude > 90 || filter.min_longitude < -180 ||
+		 filter.max_longitude > 180)) {
+		throw std::invalid_argument("Invalid boundingBox");
+	}
+
+	if (j.contains("quadkeys")) {
+		if (!j["quadkeys"].is_array())
+			throw std::invalid_argument("quadkeys must be an array");
+		for (const auto& value : j["quadkeys"]) {
+			std::string quadkey = value.is_string() ? value.get<std::string>() : "";
+			if (quadkey.empty() || quadkey.size() > 18 || quadkey.find_first_not_of("0123") != std::string::npos)
+				throw std::invalid_argument("Invalid quadkey: " + value.dump());
+			filter.quadkeys.push_back(quadkey);
+		}
+	}
+	filter.cause_codes	 = intSet(j, "causeCodes");
+	filter.station_types = intSet(j, "stationTypes");
+	return filter;
+}
+
+bool SubscriptionFilter::empty() const {
+	return !has_box && quadkeys.empty() && cause_codes.empty() && station_types.empty() &&
+		   min_information_quality <= -1;
+}
+
+bool SubscriptionFilter::matches(const DenmAttributes& denm) const {
+	if (has_box && (denm.latitude < min_latitude || denm.latitude > max_latitude || denm.longitude < min_longitude ||
+					denm.longitude > max_longitude)) {
+		return false;
+	}
+	if (!quadkeys.empty() && std::none_of(quadkeys.begin(), quadkeys.end(), [&denm](const std::string& quadkey) {
+			return denm.quadkey.compare(0, quadkey.size(), quadkey) == 0;
+		})) {
+		return false;
+	}
+	if (!cause_codes.empty() && cause_codes.count(denm.cause_code) == 0)
+		return false;
+	if (!station_types.empty() && station_types.count(denm.station_type) == 0)
+		return false;
+	return denm.information_quality >= min_information_quality;
+}
+
+std::vector<std::string> SubscriptionIndex::coverBox(const SubscriptionFilter& filter) {
+	for (int zoom = 18; zoom > 0; --zoom) {
+		uint32_t min_x, min_y, max_x, max_y;
+		// Tile rows count from the north
+		latLonToTile(filter.max_latitude, filter.min_longitude, zoom, min_x, min_y);
+		latLonToTile(filter.min_latitude, filter.max_longitude, zoom, max_x, max_y);
+		if (static_cast<size_t>(max_x - min_x + 1) * (max_y - min_y + 1) > MAX_COVER_TILES)
+			continue;
+		std::vector<std::string> tiles;
+		for (uint32_t x = min_x; x <= max_x; ++x) {
+			for (uint32_t y = min_y; y <= max_y; ++y) {
+				tiles.push_back(tileToQuadTree(x, y, zoom));
+			}
+		}
+		return tiles;
+	}
+	// Larger than a quarter of the map, checked by the filter alone
+	return {};
+}
+
+void SubscriptionIndex::erase(std::vector<SubscriberId>& ids, SubscriberId id) {
+	auto it = std::find(ids.begin(), ids.end(), id);
+	if (it != ids.end()) {
+		*it = ids.back();
+		ids.pop_back();
+	}
+}
+
+void SubscriptionIndex::set(SubscriberId id, const SubscriptionFilter& filter) {
+	remove(id);
+
+	Entry entry;
+	entry.filter = filter;
+	entry.tiles	 = filter.quadkeys.empty() && filter.has_box ? coverBox(filter) : filter.quadkeys;
+	std::sort(entry.tiles.begin(), entry.tiles.end());
+	entry.tiles.erase(std::unique(entry.tiles.begin(), entry.tiles.end()), entry.tiles.end());
+
+	if (!entry.tiles.empty()) {
+		for (const auto& tile : entry.tiles) {
+			by_tile_[tile].push_back(id);
+			longest_tile_ = std::max(longest_tile_, tile.size());
+		}
+	} else if (!filter.cause_codes.empty()) {
+		entry.by_cause = true;
+		for (int cause_code : filter.cause_codes) {
+			by_cause_[cause_code].push_back(id);
+		}
+	} else if (!filter.empty()) {
+		unindexed_.push_back(id);
+	} else {
+		unfiltered_.push_back(id);
+	}
+	filters_.emplace(id, std::move(entry));
+}
+
+void SubscriptionIndex::remove(SubscriberId id) {
+	auto it = filters_.find(id);
+	if (it == filters_.end())
+		return;
+	const Entry& entry = it->second;
+	if (!entry.tiles.empty()) {
+		for (const auto& tile : entry.tiles) {
+			auto ids = by_tile_.find(tile);
+			erase(ids->second, id);
+			if (ids->second.empty())
+				by_tile_.erase(ids);
+		}
+	} else if (entry.by_cause) {
+		for (int cause_code : entry.filter.cause_codes) {
+			auto ids = by_cause_.find(cause_code);
+			erase(ids->second, id);
+			if (ids->second.empty())
+				by_cause_.erase(ids);
+		}
+	} else if (!entry.filter.empty()) {
+		erase(unindexed_, id);
+	} else {
+		erase(unfiltered_, id);
+	}
+	filters_.erase(it);
+}
+
+void SubscriptionIndex::match(const DenmAttributes& denm, std::vector<SubscriberId>& out) const {
+	out.clear();
+	auto check = [this, &denm, &out](SubscriberId id) {
+		if (filters_.at(id).filter.matches(denm))
+			out.push_back(id);
+	};
+
+	if (!by_tile_.empty()) {
+		std::string prefix;
+		size_t length = std::min(denm.quadkey.size(), longest_tile_);
+		for (size_t i = 0; i < length; ++i) {
+			prefix.push_back(denm.quadkey[i]);
+			auto ids = by_tile_.find(prefix);
+			if (ids != by_tile_.end()) {
+				std::for_each(ids->second.begin(), ids->second.end(), check);
+			}
+		}
+		// A subscriber with nested quadkeys is found under more than one prefix
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+	}
+	auto ids = by_cause_.find(denm.cause_code);
+	if (ids != by_cause_.end()) {
+		std::for_each(ids->second.begin(), ids->second.end(), check);
+	}
+	std::for_each(unindexed_.begin(), unindexed_.end(), check);
+	out.insert(out.end(), unfiltered_.begin(), unfiltered_.end());
+}
@@ -0,0 +1,78 @@
+#include "timer_wheel.hpp"
+#include <vector>
+
+void TimerWheel::schedule(TimerId id, uint64_t deadline_tick) {
+	cancel(id);
+	// The current tick has already been processed
+	Timer timer{deadline_tick > now_ ? deadline_tick : now_ + 1, nullptr, {}};
+	place(id, timers_.emplace(id, timer).first->second);
+}
+
+bool TimerWheel::cancel(TimerId id) {
+	auto it = timers_.find(id);
+	if (it == timers_.end())
+		return false;
+	it->second.slot->erase(it->second.position);
+	timers_.erase(it);
+	return true;
+}
+
+void TimerWheel::place(TimerId id, Timer& timer) {
+	// Pick the lowest level whose range covers the remaining time. The slot is visited by cascade() (or
+	// fired, for level 0) before the deadline and no earlier than one full rotation of the level below
+	uint64_t slot_tick = timer.deadline > now_ ? timer.deadline : now_;
+	uint64_t delta	   = slot_tick - now_;
+	int level		   = 0;
+	while (level < LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+		++level;
+	}
+	const uint64_t span = uint64_t(1) << (SLOT_BITS * LEVELS);
+	if (delta >= span) {
+		// Beyond the wheel, park it in the furthest slot and re-place it when that slot cascades
+		slot_tick = now_ + span - 1;
+	}
+
+	Slot& slot		= wheels_[level][(slot_tick >> (SLOT_BITS * level)) & MASK];
+	timer.slot		= &slot;
+	timer.position	= slot.insert(slot.end(), id);
+}
+
+void TimerWheel::cascade(int level, uint64_t tick) {
+	Slot pending;
+	pending.swap(wheels_[level][(tick >> (SLOT_BITS * level)) & MASK]);
+	for (TimerId id : pending) {
+		place(id, timers_.at(id));
+	}
+}
+
+void TimerWheel::advance(uint64_t tick, const std::function<void(TimerId)>& expired) {
+	std::vector<TimerId> fired;
+	while (now_ < tick) {
+		if (timers_.empty()) {
+			now_ = tick;
+			break;
+		}
+		uint64_t t = ++now_;
+
+		// Move timers down from every level whose lower digits wrapped, highest level first
+		for (int level = LEVELS - 1; level > 0; --level) {
+			if ((t & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) == 0) {
+				cascade(level, t);
+			}
+		}
+
+		Slot& slot = wheels_[0][t & MASK];
+		if (slot.empty())
+			continue;
+
+		// Unlink the whole slot before running callbacks, they may schedule or cancel timers
+		fired.assign(slot.begin(), slot.end());
+		slot.clear();
+		for (TimerId id : fired) {
+			timers_.erase(id);
+		}
+		for (TimerId id : fired) {
+			expired(id);
+		}
+	}
+}
@@ -0,0 +1,233 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <spdlog/spdlog.h>
+
+namespace {
+thread_local TraceContext current_trace;
+
+uint32_t traceThread() {
+	static std::atomic<uint32_t> next{0};
+	thread_local uint32_t thread = next.fetch_add(1, std::memory_order_relaxed) + 1;
+	return thread;
+}
+
+// Non-zero random id
+uint64_t randomId() {
+	thread_local std::mt19937_64 random(std::random_device{}() ^ (uint64_t(traceThread()) << 32));
+	uint64_t id;
+	do {
+		id = random();
+	} while (id == 0);
+	return id;
+}
+
+std::string hex(uint64_t value) {
+	char buffer[17];
+	std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+	return buffer;
+}
+
+bool parseHex(const std::string& text, size_t pos, size_t digits, uint64_t& value) {
+	value = 0;
+	for (size_t i = pos; i < pos + digits; ++i) {
+		char c = text[i];
+		int digit;
+		if (c >= '0' && c <= '9') {
+			digit = c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			digit = c - 'a' + 10;
+		} else {
+			return false;
+		}
+		value = value << 4 | digit;
+	}
+	return true;
+}
+
+int64_t nanoseconds(Tracer::Clock::time_point time) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+} // namespace
+
+std::string TraceContext::traceparent() const {
+	return "00-" + hex(trace_hi) + hex(trace_lo) + "-" + hex(span_id) + "-01";
+}
+
+TraceContext TraceContext::fromTraceparent(const std::string& traceparent) {
+	// version "00", 32 hex digits of trace-id, 16 of parent-id and the flags, of which bit 0 is "sampled"
+	TraceContext trace;
+	uint64_t flags;
+	if (traceparent.size() != 55 || traceparent.compare(0, 3, "00-") != 0 || traceparent[35] != '-' ||
+		traceparent[52] != '-')
+		return TraceContext();
+	if (!parseHex(traceparent, 3, 16, trace.trace_hi) || !parseHex(traceparent, 19, 16, trace.trace_lo) ||
+		!parseHex(traceparent, 36, 16, trace.span_id) || !parseHex(traceparent, 53, 2, flags))
+		return TraceContext();
+	if (!(flags & 1) || trace.span_id == 0)
+		return TraceContext();
+	return trace;
+}
+
+const TraceContext& TraceContext::current() {
+	return current_trace;
+}
+
+TraceScope::TraceScope(const TraceContext& trace) :
+  previous_(current_trace) {
+	current_trace = trace;
+}
+
+TraceScope::~TraceScope() {
+	current_trace = previous_;
+}
+
+SpanRing::SpanRing(size_t capacity) :
+  capacity_(std::max<size_t>(capacity, 1)),
+  slots_(new Slot[capacity_]) {}
+
+void SpanRing::push(const Span& span) {
+	uint64_t n	 = next_.fetch_add(1, std::memory_order_relaxed);
+	Slot& slot	 = slots_[n % capacity_];
+	uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+	if ((seq & 1) || !slot.seq.compare_exchange_strong(seq, 2 * n + 1, std::memory_order_relaxed)) {
+		dropped_.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.name.store(span.name, std::memory_order_relaxed);
+	slot.trace_hi.store(span.trace_hi, std::memory_order_relaxed);
+	slot.trace_lo.store(span.trace_lo, std::memory_order_relaxed);
+	slot.start_ns.store(span.start_ns, std::memory_order_relaxed);
+	slot.end_ns.store(span.end_ns, std::memory_order_relaxed);
+	slot.thread.store(span.thread, std::memory_order_relaxed);
+	slot.seq.store(2 * n + 2, std::memory_order_release);
+}
+
+std::vector<Span> SpanRing::snapshot() const {
+	std::vector<Span> spans;
+	uint64_t end   = next_.load(std::memory_order_acquire);
+	uint64_t begin = end > capacity_ ? end - capacity_ : 0;
+	spans.reserve(end - begin);
+	for (uint64_t n = begin; n < end; ++n) {
+		const Slot& slot = slots_[n % capacity_];
+		uint64_t seq	 = slot.seq.load(std::memory_order_acquire);
+		if (seq != 2 * n + 2)
+			continue;
+		Span span;
+		span.name	  = slot.name.load(std::memory_order_relaxed);
+		span.trace_hi = slot.trace_hi.load(std::memory_order_relaxed);
+		span.trace_lo = slot.trace_lo.load(std::memory_order_relaxed);
+		span.start_ns = slot.start_ns.load(std::memory_order_relaxed);
+		span.end_ns	  = slot.end_ns.load(std::memory_order_relaxed);
+		span.thread	  = slot.thread.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.seq.load(std::memory_order_relaxed) == seq)
+			spans.push_back(span);
+	}
+	return spans;
+}
+
+Tracer::~Tracer() {
+	stopExport();
+}
+
+void Tracer::configure(double sample_rate, size_t capacity) {
+	if (sample_rate <= 0) {
+		sample_period_ = 0;
+		return;
+	}
+	ring_		   = std::make_unique<SpanRing>(capacity);
+	sample_period_ = std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(1 / std::min(sample_rate, 1.0))));
+}
+
+TraceContext Tracer::start(const TraceContext& parent) {
+	uint64_t period = sample_period_.load(std::memory_order_relaxed);
+	if (period == 0)
+		return TraceContext();
+	// A sampled parent only decides which trace a DENM joins, senders do not choose how much is traced
+	if (started_.fetch_add(1, std::memory_order_relaxed) % period != 0)
+		return TraceContext();
+	if (parent.sampled()) {
+		TraceContext trace = parent;
+		trace.span_id	   = randomId();
+		return trace;
+	}
+	return TraceContext{randomId(), randomId(), randomId()};
+}
+
+void Tracer::record(const TraceContext& trace, const char* name, Clock::time_point start, Clock::time_point end) {
+	if (!trace.sampled() || !ring_)
+		return;
+	ring_->push(Span{name, trace.trace_hi, trace.trace_lo, nanoseconds(start), nanoseconds(end), traceThread()});
+}
+
+std::vector<Span> Tracer::spans() const {
+	return ring_ ? ring_->snapshot() : std::vector<Span>();
+}
+
+nlohmann::json Tracer::exportChromeTrace() const {
+	auto spans = this->spans();
+	std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) { return a.start_ns < b.start_ns; });
+
+	nlohmann::json events = nlohmann::json::array();
+	for (const auto& span : spans) {
+		// Every trace gets its own track, tids only need to tell the sampled traces apart
+		events.push_back({{"name", span.name},
+						  {"cat", "denm"},
+						  {"ph", "X"},
+						  {"ts", span.start_ns / 1000.0},
+						  {"dur", (span.end_ns - span.start_ns) / 1000.0},
+						  {"pid", 1},
+						  {"tid", span.trace_lo & 0x7fffffff},
+						  {"args", {{"traceId", hex(span.trace_hi) + hex(span.trace_lo)}, {"thread", span.thread}}}});
+	}
+	return {{"traceEvents", std::move(events)},
+			{"displayTimeUnit", "ms"},
+			{"otherData", {{"droppedSpans", ring_ ? ring_->dropped() : 0}}}};
+}
+
+void Tracer::writeFile(const std::string& path) const {
+	// Written aside and renamed, a reader never sees a partial file
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream out(temporary, std::ios::trunc);
+		out << exportChromeTrace().dump();
+		if (!out)
+			throw std::runtime_error("Failed to write trace file " + temporary);
+	}
+	if (std::rename(temporary.c_str(), path.c_str()) != 0)
+		throw std::runtime_error("Failed to replace trace file " + path);
+}
+
+void Tracer::startExport(const std::string& path, std::chrono::seconds interval) {
+	stopExport();
+	std::lock_guard<std::mutex> l(export_lock_);
+	export_path_   = path;
+	exporting_	   = true;
+	export_thread_ = std::thread([this, interval]() {
+		std::unique_lock<std::mutex> l(export_lock_);
+		while (exporting_) {
+			export_wakeup_.wait_for(l, interval, [this]() { return !exporting_; });
+			try {
+				writeFile(export_path_);
+			} catch (const std::exception& e) {
+				spdlog::warn("Trace export failed: {}", e.what());
+			}
+		}
+	});
+}
+
+void Tracer::stopExport() {
+	{
+		std::lock_guard<std::mutex> l(export_lock_);
+		exporting_ = false;
+	}
+	export_wakeup_.notify_all();
+	if (export_thread_.joinable())
+		export_thread_.join();
+}
@@ -0,0 +1,79 @@
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+WorkerPool::WorkerPool(size_t threads) {
+	threads_.reserve(threads);
+	for (size_t i = 0; i < threads; ++i) {
+		threads_.emplace_back([this]() { this->run(); });
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> l(lock_);
+		stopping_ = true;
+	}
+	ready_.notify_all();
+	for (auto& thread : threads_) {
+		thread.join();
+	}
+}
+
+void WorkerPool::forEach(size_t parts, const std::function<void(size_t)>& part) {
+	if (parts == 0)
+		return;
+
+	// Parts are claimed from a shared counter by the caller and the helping threads alike. A helper that
+	// starts after the caller took every part just finds nothing left
+	struct State {
+		std::atomic<size_t> next{0};
+		size_t done = 0;
+		std::mutex lock;
+		std::condition_variable finished;
+	};
+	auto state = std::make_shared<State>();
+	auto work  = [state, parts, &part]() {
+		  size_t claimed = 0;
+		  for (size_t i = state->next++; i < parts; i = state->next++) {
+			  part(i);
+			  ++claimed;
+		  }
+		  if (claimed > 0) {
+			  std::lock_guard<std::mutex> l(state->lock);
+			  state->done += claimed;
+			  if (state->done == parts)
+				  state->finished.notify_all();
+		  }
+	};
+
+	size_t helpers = std::min(threads_.size(), parts - 1);
+	if (helpers > 0) {
+		{
+			std::lock_guard<std::mutex> l(lock_);
+			for (size_t i = 0; i < helpers; ++i) {
+				tasks_.push_back(work);
+			}
+		}
+		ready_.notify_all();
+	}
+	work();
+
+	std::unique_lock<std::mutex> l(state->lock);
+	state->finished.wait(l, [&state, parts]() { return state->done == parts; });
+}
+
+void WorkerPool::run() {
+	std::unique_lock<std::mutex> l(lock_);
+	while (true) {
+		ready_.wait(l, [this]() { return stopping_ || !tasks_.empty(); });
+		if (tasks_.empty())
+			return;
+		auto task = std::move(tasks_.front());
+		tasks_.pop_front();
+		l.unlock();
+		task();
+		l.lock();
+	}
+}
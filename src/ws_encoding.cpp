@@ -0,0 +1,140 @@
+#include "ws_encoding.hpp"
+#include <stdexcept>
+#include <zlib.h>
+
+namespace {
+const char* const ENCODING_NAMES[] = {"json", "uper", "msgpack", "json+deflate"};
+} // namespace
+
+const char* toString(WsEncoding encoding) {
+	return ENCODING_NAMES[static_cast<size_t>(encoding)];
+}
+
+WsEncoding wsEncodingFromString(const std::string& name) {
+	for (size_t i = 0; i < WS_ENCODING_COUNT; ++i) {
+		if (name == ENCODING_NAMES[i])
+			return static_cast<WsEncoding>(i);
+	}
+	throw std::invalid_argument("Unknown encoding: " + name);
+}
+
+const std::string& WsMessage::frame(WsEncoding encoding) const {
+	if (encoding == WsEncoding::Json)
+		return *json_;
+	if (!encode_)
+		throw std::logic_error(std::string("Message has no ") + toString(encoding) + " encoding");
+
+	size_t i = static_cast<size_t>(encoding);
+	std::call_once(once_[i], [this, encoding, i]() { frames_[i] = encode_(encoding); });
+	return frames_[i];
+}
+
+const std::string& WsMessage::sequencedFrame(WsEncoding encoding, uint64_t seq) const {
+	size_t i = static_cast<size_t>(encoding);
+	std::call_once(sequenced_once_[i], [this, encoding, seq, i]() {
+		const std::string& plain = frame(encoding);
+		std::string& sequenced	 = sequenced_frames_[i];
+		if (isBinary(encoding)) {
+			sequenced.reserve(8 + plain.size());
+			for (int shift = 56; shift >= 0; shift -= 8) {
+				sequenced.push_back(static_cast<char>((seq >> shift) & 0xff));
+			}
+			sequenced.append(plain);
+		} else {
+			sequenced = "{\"seq\":" + std::to_string(seq) + ",\"denm\":" + plain + "}";
+		}
+	});
+	return sequenced_frames_[i];
+}
+
+const std::string& WsMessage::deltaFrame(uint64_t seq) const {
+	if (!delta_.encode)
+		throw std::logic_error("Message has no delta");
+	std::call_once(delta_once_, [this, seq]() { delta_frame_ = delta_.encode(seq); });
+	return delta_frame_;
+}
+
+std::string encodeIncomingDenm(const IncomingDenm& denm, WsEncoding encoding) {
+	switch (encoding) {
+	case WsEncoding::Json:
+		return denm.serialized;
+	case WsEncoding::MessagePack: {
+		auto packed = nlohmann::json::to_msgpack(denm.json);
+		return std::string(packed.begin(), packed.end());
+	}
+	case WsEncoding::JsonDeflate:
+		return deflateRaw(denm.serialized);
+	case WsEncoding::Uper: {
+		nlohmann::json properties = {{"stationId", denm.action.originating_station_id},
+									 {"sequenceNumber", denm.action.sequence_number},
+									 {"referenceTime", denm.action.reference_time_ms},
+									 {"causeCode", denm.attributes.cause_code},
+									 {"quadkey", denm.attributes.quadkey}};
+		auto header = nlohmann::json::to_msgpack(properties);
+
+		std::string frame;
+		frame.reserve(2 + header.size() + denm.uper.size());
+		frame.push_back(static_cast<char>(header.size() >> 8));
+		frame.push_back(static_cast<char>(header.size() & 0xff));
+		frame.append(header.begin(), header.end());
+		frame.append(denm.uper.begin(), denm.uper.end());
+		return frame;
+	}
+	}
+	throw std::logic_error("Unknown encoding");
+}
+
+std::string deflateRaw(const std::string& data) {
+	z_stream stream{};
+	// Negative window bits: no zlib header and trailer
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		throw std::runtime_error("deflateInit2 failed");
+
+	std::string out(deflateBound(&stream, data.size()), '\0');
+	stream.next_in	 = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+	stream.avail_in	 = static_cast<uInt>(data.size());
+	stream.next_out	 = reinterpret_cast<Bytef*>(&out[0]);
+	stream.avail_out = static_cast<uInt>(out.size());
+	int result		 = deflate(&stream, Z_FINISH);
+	out.resize(stream.total_out);
+	deflateEnd(&stream);
+	if (result != Z_STREAM_END)
+		throw std::runtime_error("deflate failed");
+	return out;
+}
+
+nlohmann::json mergePatchOf(const nlohmann::json& from, const nlohmann::json& to) {
+	if (!from.is_object() || !to.is_object())
+		return to;
+
+	nlohmann::json patch = nlohmann::json::object();
+	for (auto it = from.begin(); it != from.end(); ++it) {
+		if (!to.contains(it.key()))
+			patch[it.key()] = nullptr;
+	}
+	for (auto it = to.begin(); it != to.end(); ++it) {
+		auto previous = from.find(it.key());
+		if (previous == from.end()) {
+			patch[it.key()] = it.value();
+		} else if (*previous != it.value()) {
+			// Arrays and values are replaced as a whole, objects are patched
+			patch[it.key()] = previous->is_object() && it->is_object() ? mergePatchOf(*previous, *it) : *it;
+		}
+	}
+	return patch;
+}
+
+std::string encodeDenmDelta(const IncomingDenm& previous, const IncomingDenm& denm, uint64_t seq) {
+	nlohmann::json patch = mergePatchOf(previous.json, denm.json);
+	nlohmann::json delta = {{"seq", seq},
+							{"actionId", denm.action.originating_station_id},
+							{"sequenceNumber", denm.action.sequence_number}};
+	// Repetitions by the originator are identical
+	if (patch.empty()) {
+		delta["type"] = "active";
+	} else {
+		delta["type"]  = "patch";
+		delta["patch"] = std::move(patch);
+	}
+	return delta.dump();
+}
@@ -0,0 +1,389 @@
+#include "ws_fanout.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+WsFanout::WsFanout(const WsFanoutOptions& options) :
+  options_(options),
+  replay_(options.replay_size),
+  latency_(PipelineMetrics::get().ws_fanout) {
+	options_.queue_limit   = std::max<size_t>(options_.queue_limit, 1);
+	options_.send_threads  = std::max<size_t>(options_.send_threads, 1);
+	options_.inbound_limit = std::max<size_t>(options_.inbound_limit, 1);
+}
+
+WsFanout::~WsFanout() {
+	stop();
+}
+
+void WsFanout::start() {
+	if (running_.exchange(true))
+		return;
+	fanout_thread_ = std::thread([this]() { this->runFanout(); });
+	for (size_t i = 0; i < options_.send_threads; ++i) {
+		send_threads_.emplace_back([this]() { this->runSender(); });
+	}
+}
+
+void WsFanout::stop() {
+	{
+		std::lock_guard<std::mutex> l(lock_);
+		if (!running_.exchange(false))
+			return;
+	}
+	inbound_ready_.notify_all();
+	clients_ready_.notify_all();
+	if (fanout_thread_.joinable())
+		fanout_thread_.join();
+	for (auto& thread : send_threads_) {
+		thread.join();
+	}
+	send_threads_.clear();
+}
+
+WsFanout::ClientId WsFanout::add(Send send, Close close, std::optional<uint64_t> resume_from) {
+	std::lock_guard<std::mutex> l(lock_);
+	auto client			 = std::make_shared<Client>();
+	client->id			 = ++last_id_;
+	client->send		 = std::move(send);
+	client->close		 = std::move(close);
+	client->unwritten_at = Clock::now();
+	clients_.emplace(client->id, client);
+	subscriptions_.set(client->id, SubscriptionFilter());
+
+	if (resume_from) {
+		bool truncated	  = false;
+		auto missed		  = replay_.since(*resume_from, truncated, options_.queue_limit);
+		client->sequenced = true;
+		auto now		  = Clock::now();
+		for (const auto& entry : missed) {
+			enqueue(client, Pending{entry->message, now, entry->attributes, entry->seq});
+		}
+		// Everything up to here is in the ring, newer messages are still to be fanned out. Messages still in
+		// inbound_ were replayed and are skipped
+		client->next_seq = replay_.lastSeq() + 1;
+		++resumed_;
+		if (truncated) {
+			spdlog::info("WebSocket client {} resumed after {}, older messages are no longer available",
+						 client->id,
+						 *resume_from);
+		}
+	}
+	return client->id;
+}
+
+void WsFanout::remove(ClientId id) {
+	std::unique_lock<std::mutex> l(lock_);
+	auto it = clients_.find(id);
+	if (it == clients_.end())
+		return;
+	ClientPtr client = it->second;
+	clients_.erase(it);
+	if (client->delta)
+		--delta_clients_;
+	subscriptions_.remove(id);
+	client->closed = true;
+	client->queue.clear();
+	// The connection may be destroyed once we return, so no send to it may still be running
+	idle_.wait(l, [&client]() { return !client->sending; });
+}
+
+void WsFanout::subscribe(ClientId id, const SubscriptionFilter& filter) {
+	std::lock_guard<std::mutex> l(lock_);
+	if (clients_.count(id) > 0) {
+		subscriptions_.set(id, filter);
+	}
+}
+
+void WsFanout::setEncoding(ClientId id, WsEncoding encoding) {
+	std::lock_guard<std::mutex> l(lock_);
+	auto it = clients_.find(id);
+	if (it != clients_.end()) {
+		it->second->encoding = encoding;
+	}
+}
+
+void WsFanout::setDelta(ClientId id, bool enabled) {
+	std::lock_guard<std::mutex> l(lock_);
+	auto it = clients_.find(id);
+	if (it != clients_.end() && it->second->delta != enabled) {
+		it->second->delta = enabled;
+		enabled ? ++delta_clients_ : --delta_clients_;
+	}
+}
+
+uint64_t WsFanout::publish(Message message, Attributes attributes) {
+	uint64_t seq;
+	{
+		std::lock_guard<std::mutex> l(lock_);
+		if (inbound_.size() >= options_.inbound_limit) {
+			inbound_.pop_front();
+			++inbound_dropped_;
+		}
+		seq = replay_.append(message, attributes);
+		inbound_.push_back(
+		  Pending{std::move(message), Clock::now(), std::move(attributes), seq, TraceContext::current()});
+	}
+	inbound_ready_.notify_one();
+	return seq;
+}
+
+void WsFanout::evict(Client& client, const std::string& reason) {
+	spdlog::warn("Disconnecting WebSocket client {}: {}", client.id, reason);
+	client.closed = true;
+	client.queue.clear();
+	++evicted_;
+	try {
+		client.close(reason);
+	} catch (const std::exception& e) {
+		spdlog::error("Error closing WebSocket client {}: {}", client.id, e.what());
+	}
+}
+
+void WsFanout::drop(Client& client, size_t count) {
+	if (count == 0)
+		return;
+	client.dropped += count;
+	dropped_ += count;
+	if (!client.downgraded) {
+		client.downgraded = true;
+		spdlog::warn("WebSocket client {} is too slow, dropping its oldest messages", client.id);
+	}
+}
+
+bool WsFanout::enqueue(const ClientPtr& client, const Pending& pending) {
+	if (client->closed || pending.seq < client->next_seq)
+		return false;
+
+	// The messages a send thread is sending are waiting too
+	if (client->sending || !client->queue.empty()) {
+		auto oldest = client->sending ? client->in_flight_since : client->queue.front().published_at;
+		if (pending.published_at - oldest > options_.max_lag) {
+			evict(*client, "Too slow");
+			return false;
+		}
+	}
+	if (client->queue.size() >= options_.queue_limit) {
+		client->queue.pop_front();
+		drop(*client, 1);
+	}
+	client->queue.push_back(pending);
+
+	if (!client->scheduled) {
+		client->scheduled = true;
+		ready_.push_back(client);
+		clients_ready_.notify_one();
+	}
+	return true;
+}
+
+void WsFanout::runFanout() {
+	std::deque<Pending> batch;
+	std::vector<ClientId> matched;
+	std::optional<Clock::time_point> next_resume;
+	std::unique_lock<std::mutex> l(lock_);
+	while (running_) {
+		auto woken = [this]() { return !running_ || !inbound_.empty(); };
+		if (next_resume) {
+			inbound_ready_.wait_until(l, *next_resume, woken);
+		} else {
+			inbound_ready_.wait(l, woken);
+		}
+		next_resume = resumeThrottled(Clock::now());
+		batch.swap(inbound_);
+		for (const auto& pending : batch) {
+			// One span per sampled DENM rather than one per client
+			Pending untraced	= pending;
+			untraced.trace		= TraceContext();
+			const Pending* next	= &pending;
+			if (!pending.attributes) {
+				for (const auto& client : clients_) {
+					if (enqueue(client.second, *next))
+						next = &untraced;
+				}
+				continue;
+			}
+			subscriptions_.match(*pending.attributes, matched);
+			for (ClientId id : matched) {
+				if (enqueue(clients_.at(id), *next))
+					next = &untraced;
+			}
+			filtered_out_ += clients_.size() - matched.size();
+		}
+		batch.clear();
+	}
+}
+
+bool WsFanout::hasSendRoom(Client& client, Clock::time_point now) const {
+	if (options_.min_client_rate == 0)
+		return true;
+	double elapsed		= std::chrono::duration<double>(now - client.unwritten_at).count();
+	client.unwritten	= std::max(0.0, client.unwritten - elapsed * options_.min_client_rate);
+	client.unwritten_at	= now;
+	return client.unwritten < options_.send_buffer;
+}
+
+std::optional<WsFanout::Clock::time_point> WsFanout::resumeThrottled(Clock::time_point now) {
+	std::optional<Clock::time_point> next;
+	auto it = throttled_.begin();
+	while (it != throttled_.end()) {
+		Client& client = **it;
+		if (!client.closed && client.throttled_until > now) {
+			next = next ? std::min(*next, client.throttled_until) : client.throttled_until;
+			++it;
+			continue;
+		}
+		if (client.closed) {
+			client.scheduled = false;
+		} else {
+			ready_.push_back(*it);
+			clients_ready_.notify_one();
+		}
+		it = throttled_.erase(it);
+	}
+	return next;
+}
+
+bool WsFanout::sendsDelta(Client& client, const Pending& pending) {
+	const WsDelta& delta = pending.message->delta();
+	auto& last_seq				  = client.last_seq_by_action;
+	auto it						  = last_seq.find(delta.action_key);
+	// Only if the client got the exact message the delta is relative to, not an older one
+	bool known = it != last_seq.end() && delta.previous_seq != 0 && it->second == delta.previous_seq;
+	if (delta.final) {
+		if (it != last_seq.end())
+			last_seq.erase(it);
+	} else if (it != last_seq.end()) {
+		it->second = pending.seq;
+	} else {
+		if (last_seq.size() >= MAX_CLIENT_ACTIONS)
+			last_seq.clear();
+		last_seq.emplace(delta.action_key, pending.seq);
+	}
+	return known && static_cast<bool>(delta.encode);
+}
+
+void WsFanout::runSender() {
+	std::unique_lock<std::mutex> l(lock_);
+	while (running_) {
+		clients_ready_.wait(l, [this]() { return !running_ || !ready_.empty(); });
+		if (!running_)
+			break;
+		ClientPtr client = std::move(ready_.front());
+		ready_.pop_front();
+
+		// Drain the client until it has caught up or exceeds its send buffer, other clients are served by the
+		// other threads
+		bool throttled = false;
+		while (running_ && !client->closed && !client->queue.empty() && !throttled) {
+			std::deque<Pending> batch;
+			batch.swap(client->queue);
+			client->sending			= true;
+			client->in_flight_since = batch.front().published_at;
+			WsEncoding encoding		= client->encoding;
+			bool sequenced			= client->sequenced;
+			bool delta				= client->delta && encoding == WsEncoding::Json;
+			l.unlock();
+
+			bool failed	  = false;
+			size_t sent	  = 0;
+			size_t deltas = 0;
+			for (; sent < batch.size(); ++sent) {
+				const Pending& pending = batch[sent];
+				if (!hasSendRoom(*client, Clock::now())) {
+					throttled = true;
+					break;
+				}
+				try {
+					// Encoded by the first send thread that needs it, shared with the other clients
+					const std::string* frame = sequenced ? &pending.message->sequencedFrame(encoding, pending.seq)
+														 : &pending.message->frame(encoding);
+					if (delta && pending.message->delta().action_key != 0 && sendsDelta(*client, pending)) {
+						frame = &pending.message->deltaFrame(pending.seq);
+						++deltas;
+					}
+					client->send(*frame, isBinary(encoding));
+					client->unwritten += frame->size();
+				} catch (const std::exception& e) {
+					spdlog::error("Error sending to WebSocket client {}: {}", client->id, e.what());
+					failed = true;
+					break;
+				}
+				auto sent_at = Clock::now();
+				auto latency = sent_at - pending.published_at;
+				latency_.record(latency);
+				if (pending.trace.sampled())
+					Tracer::getInstance().record(pending.trace, "ws.fanout", pending.published_at, sent_at);
+			}
+			// Until the estimate has drained below the send buffer
+			auto retry_at = Clock::now();
+			if (throttled) {
+				double excess = client->unwritten - options_.send_buffer + 1;
+				retry_at += std::chrono::microseconds(static_cast<int64_t>(excess * 1e6 / options_.min_client_rate));
+			}
+
+			l.lock();
+			client->sending = false;
+			client->sent += sent;
+			deltas_ += deltas;
+			idle_.notify_all();
+			if (failed && !client->closed) {
+				evict(*client, "Send failed");
+			}
+			if (throttled && !client->closed) {
+				// The unsent messages go back in front of those queued meanwhile, the oldest are dropped if
+				// they do not fit
+				size_t unsent  = batch.size() - sent;
+				size_t room	   = options_.queue_limit - std::min(options_.queue_limit, client->queue.size());
+				size_t dropped = unsent > room ? unsent - room : 0;
+				client->queue.insert(client->queue.begin(), batch.begin() + sent + dropped, batch.end());
+				drop(*client, dropped);
+				client->throttled_until = retry_at;
+				throttled_.push_back(client);
+				++throttles_;
+				// The fan-out thread schedules it again
+				inbound_ready_.notify_one();
+			}
+		}
+		if (throttled && !client->closed)
+			continue;
+		client->scheduled  = false;
+		client->downgraded = false;
+	}
+}
+
+size_t WsFanout::clients() const {
+	std::lock_guard<std::mutex> l(lock_);
+	return clients_.size();
+}
+
+nlohmann::json WsFanout::stats() const {
+	std::lock_guard<std::mutex> l(lock_);
+	nlohmann::json j;
+	j["clients"]		= clients_.size();
+	j["inboundQueued"]	= inbound_.size();
+	j["inboundDropped"] = inbound_dropped_;
+	j["dropped"]		= dropped_;
+	j["evicted"]		= evicted_;
+	j["subscribed"]		= subscriptions_.filtered();
+	j["filteredOut"]	= filtered_out_;
+	j["resumed"]		= resumed_;
+	j["replaySeq"]		= replay_.lastSeq();
+	j["deltas"]			= deltas_;
+	j["throttled"]		= throttled_.size();
+	j["throttles"]		= throttles_;
+
+	size_t lagging = 0;
+	size_t encodings[WS_ENCODING_COUNT]{};
+	for (const auto& client : clients_) {
+		lagging += client.second->downgraded ? 1 : 0;
+		++encodings[static_cast<size_t>(client.second->encoding)];
+	}
+	j["lagging"]	  = lagging;
+	j["deltaClients"] = delta_clients_.load();
+	for (size_t i = 0; i < WS_ENCODING_COUNT; ++i) {
+		j["encodings"][toString(static_cast<WsEncoding>(i))] = encodings[i];
+	}
+	j["latency"] = latency_.snapshot().toJson();
+	return j;
+}
@@ -0,0 +1,226 @@
+#include "amqp_client.hpp"
+#include "denm_message.hpp"
+#include "event_bus.hpp"
+#include "interchange_service.hpp"
+#include "outgoing_denm.hpp"
+#include "support/loopback_broker.hpp"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <gtest/gtest.h>
+#include <memory>
+#include <proton/types.hpp>
+#include <stdexcept>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+class AmqpLoopbackTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		broker.route("del-test", "loc-test");
+		broker.start();
+
+		container.auto_stop(false);
+		container_thread = std::thread([this]() { container.run(); });
+	}
+
+	void TearDown() override {
+		// Stop the client container before the handlers it dispatches to go out of scope
+		container.stop();
+		if (container_thread.joinable()) {
+			container_thread.join();
+		}
+		snd.reset();
+		rcv.reset();
+		broker.stop();
+	}
+
+	void connect() {
+		snd = std::make_unique<sender>(container, broker.url(), "del-test");
+		rcv = std::make_unique<receiver>(container, broker.url(), "loc-test");
+	}
+
+	static proton::message textMessage(const std::string& text) {
+		proton::message m;
+		m.body(text);
+		return m;
+	}
+
+	LoopbackBroker broker;
+	proton::container container;
+	std::thread container_thread;
+	std::unique_ptr<sender> snd;
+	std::unique_ptr<receiver> rcv;
+};
+
+TEST_F(AmqpLoopbackTest, RoutesMessagesBetweenAddresses) {
+	connect();
+
+	snd->send(textMessage("hello"));
+	proton::message m = rcv->receive();
+
+	EXPECT_EQ(proton::get<std::string>(m.body()), "hello");
+	EXPECT_EQ(broker.received(), 1u);
+	EXPECT_EQ(broker.delivered(), 1u);
+}
+
+TEST_F(AmqpLoopbackTest, PreservesOrderWithinAddress) {
+	connect();
+
+	for (int i = 0; i < 50; ++i) {
+		snd->send(textMessage(std::to_string(i)));
+	}
+	for (int i = 0; i < 50; ++i) {
+		EXPECT_EQ(proton::get<std::string>(rcv->receive().body()), std::to_string(i));
+	}
+}
+
+TEST_F(AmqpLoopbackTest, CreditStarvationBlocksSender) {
+	// Producers get the initial window of two credits and nothing more
+	broker.setCreditWindow(2);
+	broker.starveCredit();
+
+	connect();
+
+	snd->send(textMessage("1"));
+	snd->send(textMessage("2"));
+	auto blocked = std::async(std::launch::async, [&]() { snd->send(textMessage("3")); });
+	EXPECT_EQ(blocked.wait_for(200ms), std::future_status::timeout);
+
+	broker.restoreCredit();
+	EXPECT_EQ(blocked.wait_for(5s), std::future_status::ready);
+
+	for (auto expected : {"1", "2", "3"}) {
+		EXPECT_EQ(proton::get<std::string>(rcv->receive().body()), expected);
+	}
+}
+
+TEST_F(AmqpLoopbackTest, SimulatedLatencyDelaysDelivery) {
+	broker.setLatency(100ms);
+	connect();
+
+	auto start = std::chrono::steady_clock::now();
+	snd->send(textMessage("late"));
+	rcv->receive();
+	EXPECT_GE(std::chrono::steady_clock::now() - start, 100ms);
+}
+
+TEST_F(AmqpLoopbackTest, ForcedDisconnectClosesClientsWithoutReconnect) {
+	connect();
+	snd->send(textMessage("before"));
+	EXPECT_EQ(proton::get<std::string>(rcv->receive().body()), "before");
+
+	// This container has no reconnect options, so the connections are lost for good. Callers get `closed`
+	// instead of the process exiting or the container thread dying with an exception
+	broker.disconnectAll();
+	auto received = std::async(std::launch::async, [&]() { rcv->receive(); });
+	ASSERT_EQ(received.wait_for(5s), std::future_status::ready);
+	EXPECT_THROW(received.get(), closed);
+
+	auto sent = std::async(std::launch::async, [&]() {
+		// Sends with credit left are only queued, the sender throws once it knows the connection is gone
+		for (;;) {
+			snd->send(textMessage("after"));
+		}
+	});
+	ASSERT_EQ(sent.wait_for(5s), std::future_status::ready);
+	EXPECT_THROW(sent.get(), closed);
+	EXPECT_THROW(snd->wait_credit(100ms), closed);
+}
+
+namespace {
+nlohmann::json testDenm() {
+	return {{"publisherId", "SE12345"},
+			{"publicationId", "SE12345:DENM-TEST"},
+			{"originatingCountry", "SE"},
+			{"protocolVersion", "DENM:1.3.1"},
+			{"messageType", "DENM"},
+			{"latitude", 57.772987},
+			{"longitude", 12.770160},
+			{"data",
+			 {{"header", {{"protocolVersion", 2}, {"messageId", 1}, {"stationId", 1234567}}},
+			  {"management",
+			   {{"actionId", 20},
+				{"stationType", 3},
+				{"eventPosition", {{"latitude", 57.772987}, {"longitude", 12.770160}, {"altitude", 190.0}}}}},
+			  {"situation", {{"informationQuality", 1}, {"causeCode", 2}, {"subCauseCode", 0}}}}}};
+}
+
+// Send with `publish` through an interchange connected to a loopback broker, and return the DENM that
+// comes back on denm.incoming
+nlohmann::json loopBack(const std::function<void()>& publish) {
+	LoopbackBroker broker;
+	broker.route("del-test", "loc-test");
+	broker.start();
+
+	std::promise<nlohmann::json> incoming;
+	auto& bus	 = EventBus::getInstance();
+	auto sub_id = bus.subscribe("denm.incoming", [&](const nlohmann::json& j) { incoming.set_value(j); });
+
+	InterchangeService interchange("loopback", broker.url(), "del-test", "loc-test", "");
+	interchange.start();
+	publish();
+
+	auto future = incoming.get_future();
+	bool ready	= future.wait_for(5s) == std::future_status::ready;
+	bus.unsubscribe("denm.incoming", sub_id);
+	if (!ready)
+		throw std::runtime_error("No DENM came back");
+	return future.get();
+}
+} // namespace
+
+TEST(InterchangeLoopbackTest, OutgoingDenmLoopsBackAsIncoming) {
+	auto received = loopBack([]() { EventBus::getInstance().publish("denm.outgoing", testDenm()); });
+	EXPECT_EQ(received["header"]["stationId"], 1234567);
+	EXPECT_EQ(received["situation"]["causeCode"], 2);
+}
+
+TEST(InterchangeLoopbackTest, UperDenmLoopsBackAsIncoming) {
+	auto uper		 = std::make_shared<OutgoingUperDenm>();
+	uper->properties = testDenm();
+	uper->uper		 = DenmMessage::fromJson(uper->properties["data"]).getUperEncoded();
+	uper->properties.erase("data");
+	// Routed by the event position decoded from the UPER body
+	uper->properties.erase("latitude");
+	uper->properties.erase("longitude");
+
+	auto received = loopBack(
+	  [&uper]() { EventBus::getInstance().publishShared<OutgoingUperDenm>("denm.outgoing.uper", uper); });
+	EXPECT_EQ(received["header"]["stationId"], 1234567);
+	EXPECT_EQ(received["management"]["actionId"], 20);
+}
+
+TEST(InterchangeLoopbackTest, ResumesAfterForcedDisconnect) {
+	LoopbackBroker broker;
+	broker.route("del-test", "loc-test");
+	broker.start();
+
+	std::atomic<int> incoming{0};
+	auto& bus	 = EventBus::getInstance();
+	auto sub_id = bus.subscribe("denm.incoming", [&](const nlohmann::json&) { ++incoming; });
+	// Publish a DENM every 100 ms until `count` came back, for at most `timeout`
+	auto loopBackUntil = [&](int count, std::chrono::milliseconds timeout) {
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (incoming < count && std::chrono::steady_clock::now() < deadline) {
+			EventBus::getInstance().publish("denm.outgoing", testDenm());
+			std::this_thread::sleep_for(100ms);
+		}
+		return incoming >= count;
+	};
+
+	{
+		InterchangeService interchange("loopback", broker.url(), "del-test", "loc-test", "");
+		interchange.start();
+		EXPECT_TRUE(loopBackUntil(1, 5s));
+
+		// The reconnect options of the interchange reattach both links, DENMs flow again
+		broker.disconnectAll();
+		int before = incoming;
+		EXPECT_TRUE(loopBackUntil(before + 1, 15s));
+		interchange.stop();
+	}
+	bus.unsubscribe("denm.incoming", sub_id);
+}
@@ -0,0 +1,57 @@
+#include "decode_cache.hpp"
+#include "hash_utils.hpp"
+#include <gtest/gtest.h>
+#include <string>
+
+namespace {
+std::shared_ptr<const IncomingDenm> makeDenm(const std::vector<unsigned char>& body) {
+	auto denm  = std::make_shared<IncomingDenm>();
+	denm->uper = body;
+	denm->hash = xxhash64(body);
+	return denm;
+}
+} // namespace
+
+TEST(HashUtilsTest, MatchesReferenceXxHash64) {
+	std::string abc = "abc";
+	EXPECT_EQ(xxhash64(nullptr, 0), 0xEF46DB3751D8E999ULL);
+	EXPECT_EQ(xxhash64(reinterpret_cast<const unsigned char*>(abc.data()), abc.size()), 0x44BC2CF5AD770999ULL);
+}
+
+TEST(DecodeCacheTest, HitReturnsSameDecodedMessage) {
+	DecodeCache cache(8);
+	std::vector<unsigned char> body = {0x02, 0x01, 0x00, 0x12, 0xd6, 0x87};
+	auto denm						= makeDenm(body);
+
+	EXPECT_EQ(cache.find(denm->hash, body), nullptr);
+	cache.insert(denm);
+	EXPECT_EQ(cache.find(denm->hash, body), denm);
+	EXPECT_EQ(cache.hits(), 1u);
+	EXPECT_EQ(cache.misses(), 1u);
+}
+
+TEST(DecodeCacheTest, HashCollisionIsAMiss) {
+	DecodeCache cache(8);
+	auto denm = makeDenm({0x01, 0x02});
+	cache.insert(denm);
+
+	std::vector<unsigned char> other = {0x03, 0x04};
+	EXPECT_EQ(cache.find(denm->hash, other), nullptr);
+}
+
+TEST(DecodeCacheTest, EvictsLeastRecentlyUsed) {
+	DecodeCache cache(2);
+	auto a = makeDenm({0x0a});
+	auto b = makeDenm({0x0b});
+	auto c = makeDenm({0x0c});
+
+	cache.insert(a);
+	cache.insert(b);
+	cache.find(a->hash, a->uper); // a becomes most recently used
+	cache.insert(c);
+
+	EXPECT_EQ(cache.size(), 2u);
+	EXPECT_EQ(cache.find(a->hash, a->uper), a);
+	EXPECT_EQ(cache.find(b->hash, b->uper), nullptr);
+	EXPECT_EQ(cache.find(c->hash, c->uper), c);
+}
@@ -0,0 +1,61 @@
+#include "delivery_status.hpp"
+#include <gtest/gtest.h>
+
+TEST(DeliveryStatusTest, TracksStateOfMessage) {
+	DeliveryStatusTable table;
+	std::string id = table.create(1000);
+	EXPECT_EQ((*table.lookup(id))["status"], "pending");
+
+	table.update(id, DeliveryState::Queued, "", 1010);
+	table.update(id, DeliveryState::Delivered, "", 1020);
+	auto status = table.lookup(id);
+	ASSERT_TRUE(status);
+	EXPECT_EQ((*status)["status"], "delivered");
+	EXPECT_EQ((*status)["createdAt"], 1000);
+	EXPECT_EQ((*status)["updatedAt"], 1020);
+
+	EXPECT_FALSE(table.lookup("unknown"));
+}
+
+TEST(DeliveryStatusTest, FinalStateWinsOverLateUpdate) {
+	DeliveryStatusTable table;
+	std::string id = table.create();
+	// The broker settled the message before the pipeline reported it as queued
+	table.update(id, DeliveryState::Delivered);
+	table.update(id, DeliveryState::Queued);
+	EXPECT_EQ((*table.lookup(id))["status"], "delivered");
+
+	std::string failed = table.create();
+	table.update(failed, DeliveryState::Failed, "Invalid causeCode");
+	EXPECT_EQ((*table.lookup(failed))["error"], "Invalid causeCode");
+	EXPECT_EQ(deliveryStateFromString("superseded"), DeliveryState::Superseded);
+}
+
+TEST(DeliveryStatusTest, FirstFinalStateWins) {
+	DeliveryStatusTable table;
+	std::string id = table.create();
+	table.update(id, DeliveryState::Queued);
+	table.update(id, DeliveryState::Delivered, "", 1000);
+	// Settlements of later repetitions, and a repetition conflated in the queue
+	table.update(id, DeliveryState::Released, "", 2000);
+	table.update(id, DeliveryState::Superseded, "", 3000);
+	table.update(id, DeliveryState::Failed, "Outbound queue is full", 4000);
+
+	auto status = table.lookup(id);
+	EXPECT_EQ((*status)["status"], "delivered");
+	EXPECT_EQ((*status)["updatedAt"], 1000);
+	EXPECT_FALSE(status->contains("error"));
+}
+
+TEST(DeliveryStatusTest, EvictsOldestWhenFull) {
+	DeliveryStatusTable table(2);
+	std::string first  = table.create();
+	std::string second = table.create();
+	std::string third  = table.create();
+
+	EXPECT_NE(first, second);
+	EXPECT_EQ(table.size(), 2u);
+	EXPECT_FALSE(table.lookup(first));
+	EXPECT_TRUE(table.lookup(second));
+	EXPECT_TRUE(table.lookup(third));
+}
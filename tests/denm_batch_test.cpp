@@ -0,0 +1,98 @@
+#include "denm_batch.hpp"
+#include "event_bus.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+std::vector<std::string> statuses(const nlohmann::json& results) {
+	std::vector<std::string> statuses;
+	for (const auto& result : results["results"]) {
+		statuses.push_back(result["status"]);
+	}
+	return statuses;
+}
+
+// Reports every item as sent but the second, like the interchange does for an item that failed to encode
+void sendAllButSecond(DenmBatch& batch) {
+	auto outgoing = batch.outgoing();
+	for (size_t i = 0; i < outgoing->errors.size(); ++i) {
+		outgoing->errors[i] = i == 1 ? "Missing field data" : "";
+	}
+	batch.report(*outgoing);
+}
+} // namespace
+
+TEST(DenmBatchTest, ParsesNdjson) {
+	DenmBatch batch(
+	  "{\"publisherId\": \"a\"}\n\n  \r\nnot json\n[1]\n{\"publisherId\": \"b\"}", DenmBatch::Format::Ndjson, 10);
+	ASSERT_EQ(batch.size(), 4u);
+	EXPECT_EQ(batch.pending(), 2u);
+
+	auto results = batch.results();
+	EXPECT_EQ(statuses(results), (std::vector<std::string>{"accepted", "rejected", "rejected", "accepted"}));
+	EXPECT_EQ(results["results"][1]["error"], "Invalid JSON");
+	EXPECT_EQ(results["results"][2]["error"], "Item is not a JSON object");
+}
+
+TEST(DenmBatchTest, ParsesArray) {
+	DenmBatch batch("[{\"publisherId\": \"a\"}, 42, {\"publisherId\": \"b\"}]", DenmBatch::Format::Array, 10);
+	ASSERT_EQ(batch.size(), 3u);
+	EXPECT_EQ(batch.outgoing()->items.size(), 2u);
+	EXPECT_EQ(batch.outgoing()->items[1]["publisherId"], "b");
+
+	EXPECT_THROW(DenmBatch("[{\"publisherId\": ", DenmBatch::Format::Array, 10), std::invalid_argument);
+}
+
+TEST(DenmBatchTest, StopsAfterMaxItems) {
+	DenmBatch batch("[{}, {}, {}, {}]", DenmBatch::Format::Array, 2);
+	EXPECT_TRUE(batch.tooLarge());
+	EXPECT_EQ(batch.size(), 3u);
+}
+
+TEST(DenmBatchTest, ReportsResultPerItem) {
+	DenmBatch batch("{\"publisherId\": \"a\"}\n[]\n{\"publisherId\": \"a\"}\n{\"publisherId\": \"a\"}",
+					DenmBatch::Format::Ndjson,
+					10);
+	sendAllButSecond(batch);
+
+	auto results = batch.results();
+	EXPECT_EQ(results["accepted"], 2);
+	EXPECT_EQ(results["rejected"], 2);
+	EXPECT_EQ(statuses(results), (std::vector<std::string>{"accepted", "rejected", "rejected", "accepted"}));
+	EXPECT_EQ(results["results"][2]["error"], "Missing field data");
+}
+
+TEST(DenmBatchTest, ChargesEveryItemToItsPublisher) {
+	RateLimiter limiter(RateLimit{1, 2});
+	DenmBatch batch(
+	  "[{\"publisherId\": \"a\"}, {\"publisherId\": \"a\"}, {\"publisherId\": \"b\"}, {\"publisherId\": \"a\"}, {}]",
+	  DenmBatch::Format::Array,
+	  10);
+	EXPECT_GT(batch.limit(limiter, ""), 0);
+	sendAllButSecond(batch);
+
+	auto results = batch.results();
+	EXPECT_EQ(statuses(results),
+			  (std::vector<std::string>{"accepted", "rejected", "accepted", "rejected", "rejected"}));
+	EXPECT_EQ(results["results"][3]["error"], "Rate limit exceeded");
+	EXPECT_EQ(results["results"][4]["error"], "Missing field publisherId");
+
+	// Publisher "a" has no tokens left, "b" has one
+	DenmBatch next("[{\"publisherId\": \"a\"}, {\"publisherId\": \"b\"}, {\"publisherId\": \"b\"}]",
+				   DenmBatch::Format::Array,
+				   10);
+	next.limit(limiter, "");
+	EXPECT_EQ(next.pending(), 1u);
+	EXPECT_EQ(next.outgoing()->items[0]["publisherId"], "b");
+}
+
+TEST(DenmBatchTest, ItemsNobodySentAreRejected) {
+	DenmBatch batch("[{\"publisherId\": \"a\"}, {\"publisherId\": \"b\"}]", DenmBatch::Format::Array, 10);
+	auto outgoing = batch.outgoing();
+	// Nothing subscribed to the batch event
+	EventBus::getInstance().publishShared<OutgoingDenmBatch>("denm.outgoing.batch", outgoing);
+	batch.report(*outgoing);
+
+	auto results = batch.results();
+	EXPECT_EQ(results["accepted"], 0);
+	EXPECT_EQ(results["results"][0]["status"], "rejected");
+}
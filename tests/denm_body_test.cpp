@@ -0,0 +1,141 @@
+#include "denm_body.hpp"
+#include <gtest/gtest.h>
+#include <map>
+
+namespace {
+const nlohmann::json DENM = {{"publisherId", "SE12345"},
+							 {"publicationId", "SE12345:DENM-TEST"},
+							 {"originatingCountry", "SE"},
+							 {"protocolVersion", "DENM:1.3.1"},
+							 {"latitude", 57.772987},
+							 {"longitude", 12.770160},
+							 {"data", {{"management", {{"actionId", 20}, {"stationType", 3}}}}}};
+
+std::string asString(const std::vector<uint8_t>& bytes) {
+	return std::string(bytes.begin(), bytes.end());
+}
+
+std::function<std::string(const char*)> headers(const std::map<std::string, std::string>& values) {
+	return [values](const char* name) {
+		auto it = values.find(name);
+		return it == values.end() ? std::string() : it->second;
+	};
+}
+
+const std::map<std::string, std::string> UPER_HEADERS = {{"X-Publisher-Id", "SE12345"},
+														 {"X-Publication-Id", "SE12345:DENM-TEST"},
+														 {"X-Originating-Country", "SE"},
+														 {"X-Protocol-Version", "DENM:1.3.1"}};
+} // namespace
+
+TEST(DenmBodyTest, FormatFollowsContentType) {
+	EXPECT_EQ(denmBodyFormat("application/json"), DenmBodyFormat::Json);
+	EXPECT_EQ(denmBodyFormat(""), DenmBodyFormat::Json);
+	EXPECT_EQ(denmBodyFormat("application/msgpack"), DenmBodyFormat::MessagePack);
+	EXPECT_EQ(denmBodyFormat("application/x-msgpack"), DenmBodyFormat::MessagePack);
+	EXPECT_EQ(denmBodyFormat("application/cbor"), DenmBodyFormat::Cbor);
+	EXPECT_EQ(denmBodyFormat("application/octet-stream"), DenmBodyFormat::Uper);
+}
+
+TEST(DenmBodyTest, BinaryFormatsCarryTheJsonDocument) {
+	EXPECT_EQ(parseDenmBody(DenmBodyFormat::Json, DENM.dump()), DENM);
+	EXPECT_EQ(parseDenmBody(DenmBodyFormat::MessagePack, asString(nlohmann::json::to_msgpack(DENM))), DENM);
+	EXPECT_EQ(parseDenmBody(DenmBodyFormat::Cbor, asString(nlohmann::json::to_cbor(DENM))), DENM);
+}
+
+TEST(DenmBodyTest, RejectsBodiesThatDoNotParse) {
+	std::string msgpack = asString(nlohmann::json::to_msgpack(DENM));
+	std::string cbor	= asString(nlohmann::json::to_cbor(DENM));
+	EXPECT_THROW(parseDenmBody(DenmBodyFormat::Json, "{\"publisherId\": "), std::invalid_argument);
+	EXPECT_THROW(parseDenmBody(DenmBodyFormat::MessagePack, msgpack.substr(0, msgpack.size() / 2)),
+				 std::invalid_argument);
+	EXPECT_THROW(parseDenmBody(DenmBodyFormat::Cbor, cbor.substr(0, cbor.size() / 2)), std::invalid_argument);
+	// A JSON body is not MessagePack
+	EXPECT_THROW(parseDenmBody(DenmBodyFormat::MessagePack, DENM.dump()), std::invalid_argument);
+}
+
+TEST(DenmBodyTest, UperPropertiesFromHeaders) {
+	auto values						   = UPER_HEADERS;
+	values["X-Latitude"]			   = "57.772987";
+	values["X-Shard-Id"]			   = "2";
+	values["X-Repetition-Interval-Ms"] = "1000";
+	values["X-Repetition-Duration-Ms"] = "60000";
+	std::string body("\x01\x02\x03", 3);
+
+	auto denm = uperDenmOf(headers(values), body);
+	EXPECT_EQ(denm->properties["messageType"], "DENM");
+	EXPECT_EQ(denm->properties["publisherId"], "SE12345");
+	EXPECT_DOUBLE_EQ(denm->properties["latitude"].get<double>(), 57.772987);
+	EXPECT_EQ(denm->properties["shardId"], 2);
+	EXPECT_EQ(denm->properties["repetition"], (nlohmann::json{{"intervalMs", 1000}, {"durationMs", 60000}}));
+	EXPECT_FALSE(denm->properties.contains("longitude"));
+	EXPECT_EQ(denm->uper, (std::vector<unsigned char>{1, 2, 3}));
+}
+
+TEST(DenmBodyTest, RejectsIncompleteUperRequests) {
+	auto missing = UPER_HEADERS;
+	missing.erase("X-Originating-Country");
+	EXPECT_THROW(uperDenmOf(headers(missing), "\x01"), std::invalid_argument);
+
+	auto invalid		   = UPER_HEADERS;
+	invalid["X-Longitude"] = "12.7east";
+	EXPECT_THROW(uperDenmOf(headers(invalid), "\x01"), std::invalid_argument);
+
+	EXPECT_THROW(uperDenmOf(headers(UPER_HEADERS), ""), std::invalid_argument);
+}
+
+namespace {
+// A binary WebSocket publish frame of `properties` and `uper`
+std::string publishFrame(const nlohmann::json& properties, const std::string& uper) {
+	std::string header = asString(nlohmann::json::to_msgpack(properties));
+	std::string frame;
+	frame.push_back(static_cast<char>(header.size() >> 8));
+	frame.push_back(static_cast<char>(header.size() & 0xff));
+	return frame + header + uper;
+}
+
+const nlohmann::json FRAME_PROPERTIES = {{"id", 7},
+										 {"publisherId", "SE12345"},
+										 {"publicationId", "SE12345:DENM-TEST"},
+										 {"originatingCountry", "SE"},
+										 {"protocolVersion", "DENM:1.3.1"},
+										 {"latitude", 57.772987}};
+} // namespace
+
+TEST(DenmBodyTest, UperDenmOfPublishFrame) {
+	nlohmann::json id;
+	auto denm = uperDenmOfFrame(publishFrame(FRAME_PROPERTIES, std::string("\x01\x02\x03", 3)), id);
+	EXPECT_EQ(id, 7);
+	EXPECT_FALSE(denm->properties.contains("id"));
+	EXPECT_EQ(denm->properties["messageType"], "DENM");
+	EXPECT_EQ(denm->properties["publisherId"], "SE12345");
+	EXPECT_EQ(denm->properties["latitude"], 57.772987);
+	EXPECT_EQ(denm->uper, (std::vector<unsigned char>{1, 2, 3}));
+	EXPECT_TRUE(denm->status_id.empty());
+
+	// A header of more than 255 bytes uses both length bytes
+	auto properties				= FRAME_PROPERTIES;
+	properties["publicationId"] = std::string(300, 'P');
+	denm						= uperDenmOfFrame(publishFrame(properties, "\x01"), id);
+	EXPECT_EQ(denm->properties["publicationId"], std::string(300, 'P'));
+	EXPECT_EQ(denm->uper, (std::vector<unsigned char>{1}));
+}
+
+TEST(DenmBodyTest, RejectsMalformedPublishFrames) {
+	nlohmann::json id;
+	EXPECT_THROW(uperDenmOfFrame("", id), std::invalid_argument);
+	EXPECT_THROW(uperDenmOfFrame(std::string("\x00\x00\x01", 3), id), std::invalid_argument);
+	// No UPER body after the header
+	EXPECT_THROW(uperDenmOfFrame(publishFrame(FRAME_PROPERTIES, ""), id), std::invalid_argument);
+	// A header length beyond the frame
+	std::string truncated = publishFrame(FRAME_PROPERTIES, "\x01");
+	truncated[0]		  = '\x7f';
+	EXPECT_THROW(uperDenmOfFrame(truncated, id), std::invalid_argument);
+	// Not a MessagePack map
+	EXPECT_THROW(uperDenmOfFrame(publishFrame(nlohmann::json::array({1, 2}), "\x01"), id), std::invalid_argument);
+	EXPECT_THROW(uperDenmOfFrame(std::string("\x00\x01\xc1\x01", 4), id), std::invalid_argument);
+
+	auto missing = FRAME_PROPERTIES;
+	missing.erase("protocolVersion");
+	EXPECT_THROW(uperDenmOfFrame(publishFrame(missing, "\x01"), id), std::invalid_argument);
+}
@@ -0,0 +1,177 @@
+#include "denm_lifecycle.hpp"
+#include "event_bus.hpp"
+#include "timer_wheel.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+TEST(TimerWheelTest, FiresAtDeadline) {
+	TimerWheel wheel(100);
+	std::vector<TimerWheel::TimerId> fired;
+	auto collect = [&fired](TimerWheel::TimerId id) { fired.push_back(id); };
+
+	wheel.schedule(1, 105);
+	wheel.advance(104, collect);
+	EXPECT_TRUE(fired.empty());
+	wheel.advance(105, collect);
+	EXPECT_EQ(fired, std::vector<TimerWheel::TimerId>{1});
+	EXPECT_EQ(wheel.size(), 0u);
+}
+
+TEST(TimerWheelTest, CancelAndReschedule) {
+	TimerWheel wheel;
+	std::vector<TimerWheel::TimerId> fired;
+	auto collect = [&fired](TimerWheel::TimerId id) { fired.push_back(id); };
+
+	wheel.schedule(1, 10);
+	wheel.schedule(2, 10);
+	EXPECT_TRUE(wheel.cancel(1));
+	EXPECT_FALSE(wheel.cancel(1));
+	wheel.schedule(2, 5000); // Moves the timer to a higher level
+	wheel.advance(4999, collect);
+	EXPECT_TRUE(fired.empty());
+	wheel.advance(5000, collect);
+	EXPECT_EQ(fired, std::vector<TimerWheel::TimerId>{2});
+}
+
+TEST(TimerWheelTest, RandomDeadlinesFireExactlyOnTime) {
+	// Deadlines spread over every level of the wheel, and beyond it
+	TimerWheel wheel(12345);
+	std::mt19937_64 rng(42);
+	std::vector<uint64_t> deadlines(2000);
+	for (size_t i = 0; i < deadlines.size(); ++i) {
+		deadlines[i] = 12346 + rng() % (1u << 25);
+		wheel.schedule(i, deadlines[i]);
+	}
+
+	size_t fired = 0;
+	uint64_t now = 12345;
+	while (wheel.size() > 0) {
+		now += 1 + rng() % 50000;
+		wheel.advance(now, [&](TimerWheel::TimerId id) {
+			EXPECT_LE(deadlines[id], now);
+			EXPECT_EQ(deadlines[id], wheel.now());
+			++fired;
+		});
+	}
+	EXPECT_EQ(fired, deadlines.size());
+}
+
+class DenmLifecycleTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		subscription = EventBus::getInstance().subscribe(
+		  "denm.lifecycle", [this](const nlohmann::json& event) { events.push_back(event["transition"]); });
+		now = DenmLifecycle::nowMs();
+	}
+
+	void TearDown() override {
+		EventBus::getInstance().unsubscribe("denm.lifecycle", subscription);
+	}
+
+	DenmActionInfo action(int64_t reference_time_ms) const {
+		DenmActionInfo info;
+		info.originating_station_id = 1234567;
+		info.sequence_number		= 20;
+		info.detection_time_ms		= now;
+		info.reference_time_ms		= reference_time_ms;
+		info.validity_duration_s	= 10;
+		return info;
+	}
+
+	DenmLifecycle lifecycle{std::chrono::milliseconds(100)};
+	EventBus::SubscriptionId subscription;
+	std::vector<std::string> events;
+	int64_t now;
+};
+
+TEST_F(DenmLifecycleTest, ClassifiesNewUpdateAndRepetition) {
+	EXPECT_EQ(lifecycle.apply(DenmDirection::Incoming, action(now), nullptr, now), DenmTransition::New);
+	EXPECT_EQ(lifecycle.apply(DenmDirection::Incoming, action(now), nullptr, now), DenmTransition::Repetition);
+	EXPECT_EQ(lifecycle.apply(DenmDirection::Incoming, action(now + 1000), nullptr, now), DenmTransition::Update);
+	EXPECT_EQ(lifecycle.apply(DenmDirection::Incoming, action(now), nullptr, now), DenmTransition::Stale);
+
+	// Directions are tracked separately
+	EXPECT_EQ(lifecycle.apply(DenmDirection::Outgoing, action(now), nullptr, now), DenmTransition::New);
+
+	EXPECT_EQ(events, (std::vector<std::string>{"new", "update", "new"}));
+	EXPECT_EQ(lifecycle.size(), 2u);
+}
+
+TEST_F(DenmLifecycleTest, TerminationRemovesEvent) {
+	lifecycle.apply(DenmDirection::Incoming, action(now), nullptr, now);
+
+	auto cancel		   = action(now + 1000);
+	cancel.termination = DenmActionInfo::Termination::Cancellation;
+	EXPECT_EQ(lifecycle.apply(DenmDirection::Incoming, cancel, nullptr, now), DenmTransition::Cancellation);
+	EXPECT_EQ(lifecycle.size(), 0u);
+	EXPECT_EQ(events, (std::vector<std::string>{"new", "cancellation"}));
+}
+
+TEST_F(DenmLifecycleTest, RepeatedOrUnknownTerminationIsStale) {
+	auto negation		 = action(now + 1000);
+	negation.termination = DenmActionInfo::Termination::Negation;
+	EXPECT_EQ(lifecycle.apply(DenmDirection::Incoming, negation, nullptr, now), DenmTransition::Stale);
+
+	lifecycle.apply(DenmDirection::Incoming, action(now), nullptr, now);
+	auto cancel		   = action(now + 1000);
+	cancel.termination = DenmActionInfo::Termination::Cancellation;
+	EXPECT_EQ(lifecycle.apply(DenmDirection::Incoming, cancel, nullptr, now), DenmTransition::Cancellation);
+	EXPECT_EQ(lifecycle.apply(DenmDirection::Incoming, cancel, nullptr, now), DenmTransition::Stale);
+	EXPECT_EQ(lifecycle.apply(DenmDirection::Incoming, negation, nullptr, now), DenmTransition::Stale);
+	EXPECT_EQ(events, (std::vector<std::string>{"new", "cancellation"}));
+}
+
+TEST_F(DenmLifecycleTest, ExpiresAfterValidityDuration) {
+	lifecycle.apply(DenmDirection::Incoming, action(now), nullptr, now);
+
+	lifecycle.expire(now + 9000);
+	EXPECT_EQ(lifecycle.size(), 1u);
+	lifecycle.expire(now + 10000);
+	EXPECT_EQ(lifecycle.size(), 0u);
+	EXPECT_EQ(events, (std::vector<std::string>{"new", "expiry"}));
+}
+
+TEST_F(DenmLifecycleTest, UpdateExtendsValidity) {
+	lifecycle.apply(DenmDirection::Incoming, action(now), nullptr, now);
+	auto update				 = action(now + 5000);
+	update.detection_time_ms = now + 5000;
+	lifecycle.apply(DenmDirection::Incoming, update, nullptr, now + 5000);
+
+	lifecycle.expire(now + 10000);
+	EXPECT_EQ(lifecycle.size(), 1u);
+	lifecycle.expire(now + 15000);
+	EXPECT_EQ(lifecycle.size(), 0u);
+}
+
+TEST_F(DenmLifecycleTest, TracksStateWithoutSubscribers) {
+	EventBus::getInstance().unsubscribe("denm.lifecycle", subscription);
+	EXPECT_FALSE(EventBus::getInstance().hasSubscribers("denm.lifecycle"));
+
+	// Classified and expired as usual, only no event is built
+	EXPECT_EQ(lifecycle.apply(DenmDirection::Incoming, action(now), nullptr, now), DenmTransition::New);
+	lifecycle.expire(now + 11000);
+	EXPECT_EQ(lifecycle.size(), 0u);
+	EXPECT_TRUE(events.empty());
+}
+
+TEST_F(DenmLifecycleTest, PublishesSharedEventsWithoutTheDenm) {
+	std::vector<DenmLifecycleEvent> shared;
+	auto id = EventBus::getInstance().subscribeShared<DenmLifecycleEvent>(
+	  "denm.lifecycle",
+	  [&shared](const std::shared_ptr<const DenmLifecycleEvent>& event) { shared.push_back(*event); });
+	EXPECT_TRUE(EventBus::getInstance().hasSharedSubscribers("denm.lifecycle"));
+
+	lifecycle.apply(DenmDirection::Incoming, action(now), nullptr, now);
+	lifecycle.apply(DenmDirection::Incoming, action(now), nullptr, now);
+	lifecycle.expire(now + 11000);
+	EventBus::getInstance().unsubscribe("denm.lifecycle", id);
+	EXPECT_FALSE(EventBus::getInstance().hasSharedSubscribers("denm.lifecycle"));
+
+	ASSERT_EQ(shared.size(), 2u);
+	EXPECT_EQ(shared[0].transition, DenmTransition::New);
+	EXPECT_EQ(shared[1].transition, DenmTransition::Expiry);
+	EXPECT_EQ(shared[1].direction, DenmDirection::Incoming);
+	EXPECT_EQ(shared[1].info.key(), action(now).key());
+	EXPECT_EQ(events, (std::vector<std::string>{"new", "expiry"}));
+}
@@ -0,0 +1,69 @@
+#include "denm_repeater.hpp"
+#include <gtest/gtest.h>
+#include <vector>
+
+class DenmRepeaterTest : public ::testing::Test {
+protected:
+	DenmRepeaterTest() :
+	  repeater([this](const std::vector<DenmRepeater::Repetition>& batch) { batches.push_back(batch); }) {}
+
+	void SetUp() override {
+		now = DenmRepeater::nowMs();
+	}
+
+	const std::chrono::milliseconds interval{100};
+	const std::chrono::milliseconds duration{10000};
+	std::vector<std::vector<DenmRepeater::Repetition>> batches;
+	DenmRepeater repeater;
+	int64_t now;
+};
+
+TEST_F(DenmRepeaterTest, RepeatsAtIntervalUntilDurationEnds) {
+	auto message = std::make_shared<const proton::message>();
+	repeater.add(1, message, interval, std::chrono::milliseconds(350), OutboundRoute(), now);
+
+	repeater.run(now + 50);
+	EXPECT_TRUE(batches.empty());
+	for (int i = 1; i <= 5; ++i) {
+		repeater.run(now + i * 100);
+	}
+
+	ASSERT_EQ(batches.size(), 3u);
+	EXPECT_EQ(batches[0].front().message, message);
+	EXPECT_EQ(repeater.size(), 0u);
+}
+
+TEST_F(DenmRepeaterTest, BatchesRepetitionsDueTogether) {
+	repeater.add(1, std::make_shared<const proton::message>(), interval, duration, OutboundRoute(), now);
+	repeater.add(2, std::make_shared<const proton::message>(), interval, duration, OutboundRoute(), now);
+
+	repeater.run(now + 100);
+	ASSERT_EQ(batches.size(), 1u);
+	EXPECT_EQ(batches[0].size(), 2u);
+}
+
+TEST_F(DenmRepeaterTest, ReplaceAndRemove) {
+	auto first	= std::make_shared<const proton::message>();
+	auto second = std::make_shared<const proton::message>();
+	repeater.add(1, first, interval, duration, OutboundRoute(), now);
+	repeater.add(1, second, interval, duration, OutboundRoute(), now);
+	EXPECT_EQ(repeater.size(), 1u);
+
+	repeater.run(now + 100);
+	ASSERT_EQ(batches.size(), 1u);
+	EXPECT_EQ(batches[0].front().message, second);
+
+	EXPECT_TRUE(repeater.remove(1));
+	repeater.run(now + 1000);
+	EXPECT_EQ(batches.size(), 1u);
+}
+
+TEST_F(DenmRepeaterTest, SkipsRepetitionsMissedWhileStalled) {
+	repeater.add(1, std::make_shared<const proton::message>(), interval, duration, OutboundRoute(), now);
+
+	repeater.run(now + 1000);
+	repeater.run(now + 1050);
+	repeater.run(now + 1100);
+	ASSERT_EQ(batches.size(), 2u);
+	EXPECT_EQ(batches[0].size(), 1u);
+}
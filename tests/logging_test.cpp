@@ -0,0 +1,57 @@
+#include "logging.hpp"
+#include <gtest/gtest.h>
+#include <spdlog/sinks/ostream_sink.h>
+#include <sstream>
+
+namespace {
+int evaluated = 0;
+
+int countEvaluation() {
+	return ++evaluated;
+}
+} // namespace
+
+class LoggingTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		previous_		= spdlog::default_logger();
+		previous_level_	= spdlog::get_level();
+		auto sink		= std::make_shared<spdlog::sinks::ostream_sink_mt>(out_);
+		spdlog::set_default_logger(std::make_shared<spdlog::logger>("test", sink));
+		evaluated = 0;
+	}
+	void TearDown() override {
+		spdlog::set_default_logger(previous_);
+		// The tests change the global level
+		spdlog::set_level(previous_level_);
+	}
+
+	std::ostringstream out_;
+	std::shared_ptr<spdlog::logger> previous_;
+	spdlog::level::level_enum previous_level_;
+};
+
+TEST_F(LoggingTest, DisabledLevelsDoNotEvaluateArguments) {
+	spdlog::set_level(spdlog::level::info);
+	LOG_DEBUG("value {}", countEvaluation());
+	EXPECT_EQ(evaluated, 0);
+	EXPECT_TRUE(out_.str().empty());
+	EXPECT_FALSE(logEnabled(spdlog::level::debug));
+
+	LOG_INFO("value {}", countEvaluation());
+	EXPECT_EQ(evaluated, 1);
+	EXPECT_NE(out_.str().find("value 1"), std::string::npos);
+}
+
+TEST_F(LoggingTest, EnabledLevelsAreLogged) {
+	spdlog::set_level(spdlog::level::debug);
+	LOG_DEBUG("value {}", countEvaluation());
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+	EXPECT_EQ(evaluated, 1);
+	EXPECT_NE(out_.str().find("value 1"), std::string::npos);
+#else
+	// Compiled out by AZ_V2X_LOG_LEVEL
+	EXPECT_EQ(evaluated, 0);
+#endif
+	spdlog::set_level(spdlog::level::info);
+}
@@ -0,0 +1,79 @@
+#include "metrics.hpp"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+TEST(MetricsTest, CounterSumsEveryThread) {
+	MetricCounter counter;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 32; ++t) {
+		threads.emplace_back([&counter]() {
+			for (int i = 0; i < 1000; ++i) {
+				counter.add();
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	EXPECT_EQ(counter.value(), 32000u);
+}
+
+TEST(MetricsTest, HistogramBucketsHoldTheirValues) {
+	for (uint64_t ns : {0ull, 1ull, 2ull, 3ull, 5ull, 6ull, 1000ull, 1536ull, 123456789ull}) {
+		size_t bucket = MetricHistogram::bucketOf(ns);
+		EXPECT_LT(ns, MetricHistogram::upperBoundNs(bucket)) << ns;
+		if (bucket > 0) {
+			EXPECT_GE(ns, MetricHistogram::upperBoundNs(bucket - 1)) << ns;
+		}
+	}
+	EXPECT_EQ(MetricHistogram::bucketOf(uint64_t(1) << 50), MetricHistogram::BUCKETS - 1);
+
+	MetricHistogram histogram;
+	histogram.record(std::chrono::microseconds(3));
+	histogram.record(std::chrono::milliseconds(2));
+	auto snapshot = histogram.snapshot();
+	EXPECT_EQ(snapshot.count, 2u);
+	EXPECT_EQ(snapshot.sum_ns, 2003000u);
+}
+
+TEST(MetricsTest, HistogramSummaryEstimatesPercentiles) {
+	MetricHistogram histogram;
+	EXPECT_EQ(histogram.snapshot().percentileNs(0.5), 0u);
+	for (int i = 0; i < 98; ++i) {
+		histogram.record(std::chrono::microseconds(10));
+	}
+	histogram.record(std::chrono::milliseconds(5));
+	histogram.record(std::chrono::milliseconds(5));
+
+	auto snapshot = histogram.snapshot();
+	// Upper bounds of the buckets, at most 50% above the recorded value
+	EXPECT_GT(snapshot.percentileNs(0.5), 10000u);
+	EXPECT_LE(snapshot.percentileNs(0.5), 15000u);
+	EXPECT_EQ(snapshot.percentileNs(0.9), snapshot.percentileNs(0.5));
+	EXPECT_GT(snapshot.percentileNs(0.99), 5000000u);
+	EXPECT_LE(snapshot.percentileNs(0.99), 7500000u);
+
+	auto j = snapshot.toJson();
+	EXPECT_EQ(j["count"], 100);
+	EXPECT_EQ(j["meanUs"], 110);
+	EXPECT_EQ(j["p50Us"], (snapshot.percentileNs(0.5) + 999) / 1000);
+}
+
+TEST(MetricsTest, RendersPrometheusText) {
+	auto& metrics = Metrics::getInstance();
+	metrics.counter("test_events_total", "Events").add(3);
+	metrics.gauge("test_depth", "Depth").set(7);
+	auto& histogram = metrics.histogram("test_latency_seconds", "Latency");
+	histogram.record(std::chrono::microseconds(3));
+	histogram.record(std::chrono::seconds(100));
+	EXPECT_EQ(&metrics.gauge("test_depth", "Depth"), &metrics.gauge("test_depth", "Depth"));
+	EXPECT_THROW(metrics.counter("test_depth", "Depth"), std::logic_error);
+
+	std::string text = metrics.render();
+	EXPECT_NE(text.find("# TYPE test_events_total counter\ntest_events_total 3\n"), std::string::npos);
+	EXPECT_NE(text.find("test_depth 7\n"), std::string::npos);
+	EXPECT_NE(text.find("test_latency_seconds_bucket{le=\"4.096e-06\"} 1\n"), std::string::npos);
+	EXPECT_NE(text.find("test_latency_seconds_bucket{le=\"+Inf\"} 2\n"), std::string::npos);
+	EXPECT_NE(text.find("test_latency_seconds_count 2\n"), std::string::npos);
+}
@@ -0,0 +1,175 @@
+#include "outbound_queue.hpp"
+#include "priority_classes.hpp"
+#include <algorithm>
+#include <gtest/gtest.h>
+
+namespace {
+const std::chrono::milliseconds no_wait(0);
+
+OutboundQueue::MessagePtr makeMessage() {
+	return std::make_shared<const proton::message>();
+}
+} // namespace
+
+TEST(OutboundQueueTest, ConflatesPendingUpdatesInPlace) {
+	OutboundQueue queue;
+	std::vector<OutboundQueue::MessagePtr> replaced;
+	queue.onConflated([&replaced](const OutboundQueue::MessagePtr& message) { replaced.push_back(message); });
+	auto first	= makeMessage();
+	auto other	= makeMessage();
+	auto latest = makeMessage();
+
+	queue.push(1, first);
+	queue.push(2, other);
+	queue.push(1, makeMessage());
+	queue.push(1, latest);
+
+	EXPECT_EQ(queue.size(), 2u);
+	EXPECT_EQ(queue.conflated(), 2u);
+	ASSERT_EQ(replaced.size(), 2u);
+	EXPECT_EQ(replaced[0], first);
+
+	auto batch = queue.pop(10, no_wait);
+	ASSERT_EQ(batch.size(), 2u);
+	EXPECT_EQ(batch[0], latest);
+	EXPECT_EQ(batch[1], other);
+}
+
+TEST(OutboundQueueTest, PopsAtMostCredit) {
+	OutboundQueue queue;
+	for (uint64_t key = 0; key < 5; ++key) {
+		queue.push(key, makeMessage());
+	}
+
+	EXPECT_EQ(queue.pop(3, no_wait).size(), 3u);
+	// Once sent, a key is no longer conflated
+	queue.push(0, makeMessage());
+	EXPECT_EQ(queue.conflated(), 0u);
+	EXPECT_EQ(queue.pop(10, no_wait).size(), 3u);
+}
+
+TEST(OutboundQueueTest, RejectsWhenFullOrClosed) {
+	OutboundQueue queue(2);
+	queue.push(1, makeMessage());
+	queue.push(2, makeMessage());
+	EXPECT_THROW(queue.push(3, makeMessage()), std::runtime_error);
+	// Updates of pending keys still fit
+	EXPECT_NO_THROW(queue.push(2, makeMessage()));
+
+	queue.close();
+	EXPECT_THROW(queue.push(4, makeMessage()), std::runtime_error);
+	EXPECT_TRUE(queue.pop(10, std::chrono::seconds(10)).empty());
+}
+
+TEST(OutboundQueueTest, PushesBatchUntilFull) {
+	OutboundQueue queue(2);
+	auto latest = makeMessage();
+	std::vector<OutboundQueue::Pending> batch = {
+	  {1, makeMessage(), OutboundRoute()},
+	  {2, makeMessage(), OutboundRoute()},
+	  {3, makeMessage(), OutboundRoute()},
+	  {1, latest, OutboundRoute()},
+	};
+
+	EXPECT_EQ(queue.push(batch), std::vector<bool>({true, true, false, true}));
+	EXPECT_EQ(queue.size(), 2u);
+	EXPECT_EQ(queue.conflated(), 1u);
+	EXPECT_EQ(queue.pop(10, no_wait).front(), latest);
+
+	queue.close();
+	EXPECT_THROW(queue.push(batch), std::runtime_error);
+}
+
+TEST(OutboundQueueTest, StrictSchedulingDrainsUrgentLaneFirst) {
+	OutboundQueue queue(100, {1, 1}, LaneScheduling::Strict);
+	auto urgent = makeMessage();
+	queue.push(1, makeMessage(), OutboundRoute{1});
+	queue.push(2, makeMessage(), OutboundRoute{1});
+	queue.push(3, urgent, OutboundRoute{0});
+
+	auto batch = queue.pop(1, no_wait);
+	ASSERT_EQ(batch.size(), 1u);
+	EXPECT_EQ(batch[0], urgent);
+	EXPECT_EQ(queue.size(1), 2u);
+	EXPECT_EQ(queue.latency(0).snapshot().count, 1u);
+}
+
+TEST(OutboundQueueTest, WeightedSchedulingSharesCredit) {
+	OutboundQueue queue(100, {3, 1}, LaneScheduling::Weighted);
+	std::vector<OutboundQueue::MessagePtr> urgent;
+	for (uint64_t key = 0; key < 20; ++key) {
+		auto message = makeMessage();
+		if (key % 2 == 0) {
+			urgent.push_back(message);
+		}
+		queue.push(key, message, OutboundRoute{key % 2 == 0 ? 0u : 1u});
+	}
+
+	// 3:1 while both lanes are backlogged, the low priority lane is not starved
+	auto batch = queue.pop(8, no_wait);
+	ASSERT_EQ(batch.size(), 8u);
+	size_t from_urgent = 0;
+	for (const auto& message : batch) {
+		from_urgent += std::find(urgent.begin(), urgent.end(), message) != urgent.end();
+	}
+	EXPECT_EQ(from_urgent, 6u);
+}
+
+TEST(OutboundQueueTest, UpdateMovesToNewLane) {
+	OutboundQueue queue(100, {1, 1}, LaneScheduling::Strict);
+	queue.push(1, makeMessage(), OutboundRoute{1});
+	queue.push(1, makeMessage(), OutboundRoute{0});
+	EXPECT_EQ(queue.size(), 1u);
+	EXPECT_EQ(queue.size(0), 1u);
+	EXPECT_EQ(queue.size(1), 0u);
+	EXPECT_EQ(queue.conflated(), 1u);
+}
+
+TEST(PriorityClassifierTest, MatchesMostSpecificRule) {
+	PriorityClassifier classifier("critical:9:8,high:5:4,normal:1:1", "97=critical,*/10=high,3/10=critical");
+	EXPECT_EQ(classifier.classify(97, 5), 0u);
+	EXPECT_EQ(classifier.classify(3, 10), 0u);
+	EXPECT_EQ(classifier.classify(1, 10), 1u);
+	EXPECT_EQ(classifier.classify(3, 5), 2u);
+	EXPECT_EQ(classifier.classes()[0].amqp_priority, 9);
+
+	EXPECT_THROW(PriorityClassifier("a:9:1", "97=b"), std::invalid_argument);
+	EXPECT_THROW(PriorityClassifier("a:10:1", ""), std::invalid_argument);
+	EXPECT_THROW(PriorityClassifier("a:x:1", ""), std::invalid_argument);
+}
+
+TEST(OutboundQueueTest, FairQueuingSharesLaneBetweenFlows) {
+	OutboundQueue queue(100, {1}, LaneScheduling::Strict, 100);
+	std::vector<OutboundQueue::MessagePtr> quiet;
+	for (uint64_t key = 0; key < 20; ++key) {
+		queue.push(key, makeMessage(), OutboundRoute{0, "flooder", 100});
+	}
+	for (uint64_t key = 100; key < 103; ++key) {
+		quiet.push_back(makeMessage());
+		queue.push(key, quiet.back(), OutboundRoute{0, "quiet", 100});
+	}
+
+	// The quiet publisher is not stuck behind the backlog of the flooder
+	auto batch = queue.pop(6, no_wait);
+	ASSERT_EQ(batch.size(), 6u);
+	size_t from_quiet = 0;
+	for (const auto& message : batch) {
+		from_quiet += std::find(quiet.begin(), quiet.end(), message) != quiet.end();
+	}
+	EXPECT_EQ(from_quiet, 3u);
+	EXPECT_EQ(queue.sentByFlow().at("flooder"), 3u);
+}
+
+TEST(OutboundQueueTest, FairQueuingAccountsForCost) {
+	OutboundQueue queue(100, {1}, LaneScheduling::Strict, 100);
+	for (uint64_t key = 0; key < 10; ++key) {
+		queue.push(key, makeMessage(), OutboundRoute{0, "large", 200});
+		queue.push(key + 100, makeMessage(), OutboundRoute{0, "small", 50});
+	}
+
+	queue.pop(12, no_wait);
+	auto sent = queue.sentByFlow();
+	// Equal bytes per round: four small messages for every large one
+	EXPECT_EQ(sent["small"], 10u);
+	EXPECT_EQ(sent["large"], 2u);
+}
@@ -0,0 +1,88 @@
+#include "publication_headers.hpp"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace {
+nlohmann::json request(const std::string& publication_id, const std::string& publisher_id = "NO00001") {
+	return {{"messageType", "DENM"},
+			{"protocolVersion", "DENM:1.2.2"},
+			{"publisherId", publisher_id},
+			{"publicationId", publication_id},
+			{"originatingCountry", "NO"}};
+}
+} // namespace
+
+TEST(PublicationHeadersTest, AppliesHeadersAndProperties) {
+	PublicationHeaderCache cache("user", "del-queue");
+	proton::message msg;
+	msg.properties().put("causeCode", 3);
+	cache.get(request("NO00001:1"))->applyTo(msg);
+
+	EXPECT_TRUE(msg.durable());
+	EXPECT_EQ(msg.ttl().milliseconds(), 3600000);
+	EXPECT_EQ(msg.user(), "user");
+	EXPECT_EQ(msg.to(), "del-queue");
+	EXPECT_EQ(proton::get<std::string>(msg.properties().get("publicationId")), "NO00001:1");
+	EXPECT_EQ(proton::get<std::string>(msg.properties().get("protocolVersion")), "DENM:1.2.2");
+	EXPECT_EQ(msg.properties().size(), 6u);
+}
+
+TEST(PublicationHeadersTest, BuiltOncePerPublication) {
+	PublicationHeaderCache cache("user", "del-queue");
+	auto first = cache.get(request("NO00001:1"));
+	EXPECT_EQ(cache.get(request("NO00001:1")), first);
+	EXPECT_NE(cache.get(request("NO00001:2")), first);
+	EXPECT_EQ(cache.size(), 2u);
+}
+
+TEST(PublicationHeadersTest, RebuiltWhenPropertiesChange) {
+	PublicationHeaderCache cache("user", "del-queue");
+	auto first	 = cache.get(request("NO00001:1"));
+	auto changed = cache.get(request("NO00001:1", "NO00002"));
+	EXPECT_NE(changed, first);
+	EXPECT_EQ(changed->values[2], "NO00002");
+	EXPECT_EQ(cache.get(request("NO00001:1", "NO00002")), changed);
+	EXPECT_EQ(cache.size(), 1u);
+}
+
+TEST(PublicationHeadersTest, MissingPropertyThrows) {
+	PublicationHeaderCache cache("user", "del-queue");
+	cache.get(request("NO00001:1"));
+	auto j = request("NO00001:1");
+	j.erase("originatingCountry");
+	EXPECT_THROW(cache.get(j), nlohmann::json::exception);
+	j["originatingCountry"] = 47;
+	EXPECT_THROW(cache.get(j), nlohmann::json::exception);
+	EXPECT_THROW(cache.get(nlohmann::json::object()), nlohmann::json::exception);
+}
+
+TEST(PublicationHeadersTest, ForgetsAllWhenFull) {
+	PublicationHeaderCache cache("user", "del-queue", 2);
+	cache.get(request("NO00001:1"));
+	cache.get(request("NO00001:2"));
+	cache.get(request("NO00001:2", "NO00002"));
+	EXPECT_EQ(cache.size(), 2u);
+	cache.get(request("NO00001:3"));
+	EXPECT_EQ(cache.size(), 1u);
+}
+
+TEST(PublicationHeadersTest, SharedByConcurrentSenders) {
+	PublicationHeaderCache cache("user", "del-queue");
+	auto headers = cache.get(request("NO00001:1"));
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; ++t) {
+		threads.emplace_back([&cache, headers]() {
+			for (int i = 0; i < 1000; ++i) {
+				proton::message msg;
+				auto applied = cache.get(request("NO00001:1"));
+				EXPECT_EQ(applied, headers);
+				applied->applyTo(msg);
+				EXPECT_EQ(proton::get<std::string>(msg.properties().get("publisherId")), "NO00001");
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
@@ -0,0 +1,29 @@
+#include "publish_window.hpp"
+#include <gtest/gtest.h>
+
+TEST(PublishWindowTest, RefusesDenmsBeyondTheWindow) {
+	PublishWindow window(2);
+	EXPECT_EQ(window.credit(), 2u);
+	EXPECT_TRUE(window.acquire());
+	EXPECT_TRUE(window.acquire());
+	EXPECT_EQ(window.inFlight(), 2u);
+	EXPECT_EQ(window.credit(), 0u);
+	EXPECT_FALSE(window.acquire());
+	EXPECT_EQ(window.inFlight(), 2u);
+}
+
+TEST(PublishWindowTest, AcknowledgementsReturnCredit) {
+	PublishWindow window(2);
+	window.acquire();
+	window.acquire();
+	window.release();
+	EXPECT_EQ(window.credit(), 1u);
+	EXPECT_TRUE(window.acquire());
+
+	window.release();
+	window.release();
+	// An acknowledgement too many never grants more than the window
+	window.release();
+	EXPECT_EQ(window.inFlight(), 0u);
+	EXPECT_EQ(window.credit(), 2u);
+}
@@ -0,0 +1,100 @@
+#include "rate_limiter.hpp"
+#include <gtest/gtest.h>
+
+TEST(RateLimiterTest, AllowsBurstThenRefills) {
+	RateLimiter limiter(RateLimit{10, 3});
+	auto now		   = RateLimiter::Clock::now();
+	double retry_after = 0;
+
+	for (int i = 0; i < 3; ++i) {
+		EXPECT_TRUE(limiter.allow("SE12345", "", retry_after, now));
+	}
+	EXPECT_FALSE(limiter.allow("SE12345", "", retry_after, now));
+	EXPECT_NEAR(retry_after, 0.1, 1e-9);
+	// Other publishers have their own bucket
+	EXPECT_TRUE(limiter.allow("NO54321", "", retry_after, now));
+
+	EXPECT_TRUE(limiter.allow("SE12345", "", retry_after, now + std::chrono::milliseconds(100)));
+
+	auto stats = limiter.stats();
+	EXPECT_EQ(stats["rejected"], 1);
+	EXPECT_EQ(stats["publishers"]["SE12345"]["accepted"], 4);
+}
+
+TEST(RateLimiterTest, RejectedRequestsTakeNoTokens) {
+	RateLimiter limiter(RateLimit{1, 1}, RateLimit{1, 2});
+	auto now		   = RateLimiter::Clock::now();
+	double retry_after = 0;
+
+	EXPECT_TRUE(limiter.allow("a", "10.0.0.1", retry_after, now));
+	// Publisher "a" is empty, the IP bucket keeps its last token for publisher "b"
+	EXPECT_FALSE(limiter.allow("a", "10.0.0.1", retry_after, now));
+	EXPECT_TRUE(limiter.allow("b", "10.0.0.1", retry_after, now));
+	EXPECT_FALSE(limiter.allow("c", "10.0.0.1", retry_after, now));
+	EXPECT_EQ(limiter.stats()["rejectedByIp"], 1);
+}
+
+TEST(RateLimiterTest, ConfiguresOverridesAtRuntime) {
+	RateLimiter limiter;
+	double retry_after = 0;
+	auto now		   = RateLimiter::Clock::now();
+	EXPECT_TRUE(limiter.allow("a", "", retry_after, now));
+	EXPECT_TRUE(limiter.allow("a", "", retry_after, now));
+
+	limiter.configure({{"publisher", {{"rate", 100}, {"burst", 100}}}, {"publishers", {{"a", {{"rate", 1}}}}}});
+	EXPECT_TRUE(limiter.allow("a", "", retry_after, now));
+	EXPECT_FALSE(limiter.allow("a", "", retry_after, now));
+	EXPECT_TRUE(limiter.allow("b", "", retry_after, now));
+	EXPECT_EQ(limiter.config()["publishers"]["a"]["rate"], 1.0);
+
+	EXPECT_THROW(limiter.configure({{"ip", {{"rate", -1}}}}), std::invalid_argument);
+}
+
+TEST(RateLimiterTest, EvictsLeastRecentlyUsedBucket) {
+	RateLimiter limiter(RateLimit{1, 1}, RateLimit(), 2);
+	auto now		   = RateLimiter::Clock::now();
+	double retry_after = 0;
+
+	EXPECT_TRUE(limiter.allow("a", "", retry_after, now));
+	EXPECT_TRUE(limiter.allow("b", "", retry_after, now));
+	EXPECT_FALSE(limiter.allow("a", "", retry_after, now));
+	// "b" was used longest ago and makes room for "c", "a" keeps its empty bucket
+	EXPECT_TRUE(limiter.allow("c", "", retry_after, now));
+	EXPECT_FALSE(limiter.allow("a", "", retry_after, now));
+	EXPECT_TRUE(limiter.allow("b", "", retry_after, now));
+}
+
+TEST(RateLimiterTest, AllowsAsManyAsBothBucketsHold) {
+	RateLimiter limiter(RateLimit{10, 5}, RateLimit{10, 3});
+	auto now		   = RateLimiter::Clock::now();
+	double retry_after = 0;
+
+	EXPECT_EQ(limiter.allowUpTo("a", "10.0.0.1", 4, retry_after, now), 3u);
+	EXPECT_NEAR(retry_after, 0.1, 1e-9);
+	EXPECT_EQ(limiter.allowUpTo("a", "10.0.0.2", 4, retry_after, now), 2u);
+	EXPECT_EQ(limiter.allowUpTo("a", "10.0.0.3", 4, retry_after, now), 0u);
+
+	auto stats = limiter.stats();
+	EXPECT_EQ(stats["accepted"], 5);
+	EXPECT_EQ(stats["rejected"], 7);
+	EXPECT_EQ(stats["rejectedByIp"], 1);
+}
+
+TEST(RateLimiterTest, ChargesIpBeforePublisher) {
+	RateLimiter limiter(RateLimit{1, 1}, RateLimit{10, 2});
+	auto now		   = RateLimiter::Clock::now();
+	double retry_after = 0;
+
+	EXPECT_TRUE(limiter.allowIp("10.0.0.1", retry_after, now));
+	EXPECT_TRUE(limiter.allow("a", "", retry_after, now));
+	// A request that never gets to its publisher still pays its IP token
+	EXPECT_TRUE(limiter.allowIp("10.0.0.1", retry_after, now));
+	EXPECT_FALSE(limiter.allowIp("10.0.0.1", retry_after, now));
+	EXPECT_NEAR(retry_after, 0.1, 1e-9);
+	EXPECT_TRUE(limiter.allowIp("10.0.0.2", retry_after, now));
+
+	auto stats = limiter.stats();
+	EXPECT_EQ(stats["accepted"], 1);
+	EXPECT_EQ(stats["rejected"], 1);
+	EXPECT_EQ(stats["rejectedByIp"], 1);
+}
@@ -0,0 +1,45 @@
+#include "replay_ring.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+std::shared_ptr<const WsMessage> makeMessage(const std::string& text) {
+	return std::make_shared<const WsMessage>(std::make_shared<const std::string>(text));
+}
+
+std::vector<uint64_t> seqs(const std::vector<ReplayRing::EntryPtr>& entries) {
+	std::vector<uint64_t> result;
+	for (const auto& entry : entries) {
+		result.push_back(entry->seq);
+	}
+	return result;
+}
+} // namespace
+
+TEST(ReplayRingTest, ReturnsEntriesAfterCursor) {
+	ReplayRing ring(4);
+	for (int i = 1; i <= 6; ++i) {
+		EXPECT_EQ(ring.append(makeMessage(std::to_string(i)), nullptr), static_cast<uint64_t>(i));
+	}
+	bool truncated = false;
+
+	EXPECT_EQ(seqs(ring.since(4, truncated)), std::vector<uint64_t>({5, 6}));
+	EXPECT_FALSE(truncated);
+	EXPECT_EQ(ring.since(5, truncated).front()->message->frame(WsEncoding::Json), "6");
+
+	// 1 and 2 were overwritten
+	EXPECT_EQ(seqs(ring.since(0, truncated)), std::vector<uint64_t>({3, 4, 5, 6}));
+	EXPECT_TRUE(truncated);
+	EXPECT_EQ(seqs(ring.since(2, truncated)), std::vector<uint64_t>({3, 4, 5, 6}));
+	EXPECT_FALSE(truncated);
+
+	// Only the newest when limited
+	EXPECT_EQ(seqs(ring.since(2, truncated, 2)), std::vector<uint64_t>({5, 6}));
+	EXPECT_TRUE(truncated);
+
+	EXPECT_TRUE(ring.since(6, truncated).empty());
+	EXPECT_FALSE(truncated);
+
+	// A cursor from before a restart
+	EXPECT_EQ(seqs(ring.since(100, truncated)), std::vector<uint64_t>({3, 4, 5, 6}));
+	EXPECT_TRUE(truncated);
+}
@@ -0,0 +1,60 @@
+#include "geo_utils.hpp"
+#include "shard_assigner.hpp"
+#include <gtest/gtest.h>
+#include <map>
+#include <random>
+
+namespace {
+std::vector<std::string> randomQuadKeys(size_t count) {
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<double> lat(-80, 80);
+	std::uniform_real_distribution<double> lon(-180, 180);
+	std::vector<std::string> keys;
+	for (size_t i = 0; i < count; ++i) {
+		keys.push_back(calculateQuadTree(lat(rng), lon(rng)));
+	}
+	return keys;
+}
+} // namespace
+
+TEST(ShardAssignerTest, SpreadsAreasEvenly) {
+	ShardAssigner assigner(4);
+	std::map<unsigned, size_t> counts;
+	for (const auto& key : randomQuadKeys(10000)) {
+		++counts[assigner.assign(key)];
+	}
+
+	ASSERT_EQ(counts.size(), 4u);
+	for (const auto& count : counts) {
+		EXPECT_GE(count.first, 1u);
+		EXPECT_LE(count.first, 4u);
+		EXPECT_NEAR(count.second, 2500, 500) << "shard " << count.first;
+	}
+}
+
+TEST(ShardAssignerTest, KeepsNearbyEventsTogetherAndMovesFewOnResize) {
+	ShardAssigner four(4);
+	ShardAssigner five(5);
+
+	// Same level 8 range
+	EXPECT_EQ(four.assign(calculateQuadTree(57.7729, 12.7701)), four.assign(calculateQuadTree(57.7730, 12.7705)));
+
+	auto keys	 = randomQuadKeys(10000);
+	size_t moved = 0;
+	for (const auto& key : keys) {
+		moved += four.assign(key) != five.assign(key);
+	}
+	// Ideally a fifth of the areas move to the new shard
+	EXPECT_LT(moved, keys.size() * 3 / 10);
+}
+
+TEST(ShardAssignerTest, PrefixTableTakesPrecedence) {
+	ShardAssigner assigner(3, "1202=3,12=2");
+	EXPECT_EQ(assigner.assign("120233301"), 3u);
+	EXPECT_EQ(assigner.assign("120133301"), 2u);
+	EXPECT_FALSE(ShardAssigner().enabled());
+
+	EXPECT_THROW(ShardAssigner(3, "14=1"), std::invalid_argument);
+	EXPECT_THROW(ShardAssigner(3, "12=4"), std::invalid_argument);
+	EXPECT_THROW(ShardAssigner(3, "12"), std::invalid_argument);
+}
@@ -0,0 +1,89 @@
+#include "geo_utils.hpp"
+#include "subscription_filter.hpp"
+#include <algorithm>
+#include <gtest/gtest.h>
+
+namespace {
+DenmAttributes denmAt(double latitude, double longitude, int cause_code = 1, int information_quality = 3) {
+	DenmAttributes denm;
+	denm.latitude			 = latitude;
+	denm.longitude			 = longitude;
+	denm.quadkey			 = calculateQuadTree(latitude, longitude);
+	denm.cause_code			 = cause_code;
+	denm.station_type		 = 5;
+	denm.information_quality = information_quality;
+	return denm;
+}
+
+std::vector<SubscriptionIndex::SubscriberId> matching(const SubscriptionIndex& index, const DenmAttributes& denm) {
+	std::vector<SubscriptionIndex::SubscriberId> ids;
+	index.match(denm, ids);
+	std::sort(ids.begin(), ids.end());
+	return ids;
+}
+} // namespace
+
+TEST(SubscriptionFilterTest, TileToQuadTreeMatchesCalculateQuadTree) {
+	uint32_t x, y;
+	latLonToTile(59.91, 10.75, 18, x, y);
+	EXPECT_EQ(tileToQuadTree(x, y, 18), calculateQuadTree(59.91, 10.75));
+}
+
+TEST(SubscriptionFilterTest, ParsesAndRejectsFilters) {
+	auto filter = SubscriptionFilter::fromJson(nlohmann::json::parse(
+	  R"({"boundingBox": {"minLatitude": 59, "minLongitude": 10, "maxLatitude": 60, "maxLongitude": 11},
+		  "causeCodes": [1, 2], "minInformationQuality": 2})"));
+	EXPECT_TRUE(filter.has_box);
+	EXPECT_EQ(filter.cause_codes, std::set<int>({1, 2}));
+	EXPECT_TRUE(filter.matches(denmAt(59.5, 10.5, 2, 2)));
+	EXPECT_FALSE(filter.matches(denmAt(61, 10.5, 2, 2)));
+	EXPECT_FALSE(filter.matches(denmAt(59.5, 10.5, 3, 2)));
+	EXPECT_FALSE(filter.matches(denmAt(59.5, 10.5, 2, 1)));
+	EXPECT_TRUE(SubscriptionFilter::fromJson(nlohmann::json::object()).empty());
+
+	EXPECT_THROW(SubscriptionFilter::fromJson(nlohmann::json::parse(R"({"quadkeys": ["0124"]})")),
+				 std::invalid_argument);
+	auto inverted = nlohmann::json::parse(
+	  R"({"boundingBox": {"minLatitude": 60, "minLongitude": 10, "maxLatitude": 59, "maxLongitude": 11}})");
+	EXPECT_THROW(SubscriptionFilter::fromJson(inverted), std::invalid_argument);
+	EXPECT_THROW(SubscriptionFilter::fromJson(nlohmann::json::parse(R"({"causeCodes": ["x"]})")),
+				 std::invalid_argument);
+}
+
+TEST(SubscriptionFilterTest, IndexMatchesLikeTheFilters) {
+	SubscriptionIndex index;
+	std::vector<SubscriptionFilter> filters(6);
+	filters[1].has_box		 = true;
+	filters[1].min_latitude	 = 59.8;
+	filters[1].min_longitude = 10.6;
+	filters[1].max_latitude	 = 60.0;
+	filters[1].max_longitude = 10.9;
+	filters[2].quadkeys		 = {calculateQuadTree(59.91, 10.75).substr(0, 6), calculateQuadTree(59.91, 10.75, 10)};
+	filters[3].cause_codes	 = {2};
+	filters[4].station_types = {5};
+	filters[5].has_box		 = true; // Too large to be indexed by tiles
+	filters[5].min_latitude	 = -80;
+	filters[5].min_longitude = -170;
+	filters[5].max_latitude	 = 80;
+	filters[5].max_longitude = 170;
+	filters[5].cause_codes	 = {1};
+	for (size_t i = 0; i < filters.size(); ++i) {
+		index.set(i, filters[i]);
+	}
+	EXPECT_EQ(index.filtered(), 5u);
+
+	for (const auto& denm :
+		 {denmAt(59.91, 10.75), denmAt(59.91, 10.75, 2), denmAt(63.4, 10.4), denmAt(-33.9, 18.4, 2)}) {
+		std::vector<SubscriptionIndex::SubscriberId> expected;
+		for (size_t i = 0; i < filters.size(); ++i) {
+			if (filters[i].matches(denm))
+				expected.push_back(i);
+		}
+		EXPECT_EQ(matching(index, denm), expected);
+	}
+
+	index.remove(1);
+	index.set(3, SubscriptionFilter());
+	EXPECT_EQ(matching(index, denmAt(59.91, 10.75)), std::vector<SubscriptionIndex::SubscriberId>({0, 2, 3, 4, 5}));
+	EXPECT_EQ(matching(index, denmAt(63.4, 10.4, 2)), std::vector<SubscriptionIndex::SubscriberId>({0, 3, 4}));
+}
@@ -0,0 +1,259 @@
+#include "loopback_broker.hpp"
+#include <algorithm>
+#include <proton/connection.hpp>
+#include <proton/delivery.hpp>
+#include <proton/error_condition.hpp>
+#include <proton/receiver_options.hpp>
+#include <proton/sender_options.hpp>
+#include <proton/source.hpp>
+#include <proton/source_options.hpp>
+#include <proton/target.hpp>
+#include <proton/target_options.hpp>
+#include <proton/transport.hpp>
+#include <proton/work_queue.hpp>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+LoopbackBroker::LoopbackBroker(const std::string& host, int port) :
+  host_(host),
+  port_(port),
+  container_(*this, "loopback-broker"),
+  listen_handler_(*this) {
+	// Keep running while no clients are connected, the broker is stopped explicitly
+	container_.auto_stop(false);
+}
+
+LoopbackBroker::~LoopbackBroker() {
+	stop();
+}
+
+void LoopbackBroker::start() {
+	if (container_thread_.joinable())
+		return;
+
+	container_thread_ = std::thread([this]() {
+		try {
+			container_.run();
+		} catch (const std::exception& e) {
+			spdlog::error("Loopback broker container error: {}", e.what());
+		}
+	});
+
+	std::unique_lock<std::mutex> l(lock_);
+	listening_.wait(l, [this]() { return listen_done_; });
+	if (!listen_error_.empty()) {
+		l.unlock();
+		stop();
+		throw std::runtime_error("Loopback broker failed to listen: " + listen_error_);
+	}
+	spdlog::debug("Loopback broker listening on {}", url());
+}
+
+void LoopbackBroker::stop() {
+	if (!container_thread_.joinable())
+		return;
+	container_.stop();
+	container_thread_.join();
+}
+
+void LoopbackBroker::route(const std::string& from, const std::string& to) {
+	std::lock_guard<std::mutex> l(lock_);
+	routes_[from] = to;
+}
+
+void LoopbackBroker::setObserver(Observer observer) {
+	std::lock_guard<std::mutex> l(lock_);
+	observer_ = std::move(observer);
+}
+
+void LoopbackBroker::setCreditWindow(int credit) {
+	credit_window_ = credit;
+}
+
+void LoopbackBroker::starveCredit() {
+	starved_ = true;
+}
+
+void LoopbackBroker::restoreCredit() {
+	starved_ = false;
+	forEachConnection([this](proton::work_queue* wq) { wq->add([this, wq]() { this->topUpCredit(wq); }); });
+}
+
+void LoopbackBroker::setLatency(std::chrono::milliseconds latency) {
+	latency_ms_ = latency.count();
+}
+
+void LoopbackBroker::disconnectAll() {
+	forEachConnection([this](proton::work_queue* wq) {
+		wq->add([this, wq]() {
+			auto it = connections_.find(wq);
+			if (it != connections_.end()) {
+				it->second.close(proton::error_condition("amqp:connection:forced", "loopback broker disconnect"));
+			}
+		});
+	});
+}
+
+void LoopbackBroker::forEachConnection(const std::function<void(proton::work_queue*)>& fn) {
+	std::lock_guard<std::mutex> l(lock_);
+	for (auto* wq : work_queues_) {
+		fn(wq);
+	}
+}
+
+void LoopbackBroker::ListenHandler::on_open(proton::listener& l) {
+	std::lock_guard<std::mutex> guard(broker_.lock_);
+	broker_.port_		 = l.port();
+	broker_.listen_done_ = true;
+	broker_.listening_.notify_all();
+}
+
+void LoopbackBroker::ListenHandler::on_error(proton::listener&, const std::string& what) {
+	std::lock_guard<std::mutex> guard(broker_.lock_);
+	broker_.listen_error_ = what.empty() ? "unknown error" : what;
+	broker_.listen_done_  = true;
+	broker_.listening_.notify_all();
+}
+
+void LoopbackBroker::on_container_start(proton::container& c) {
+	listener_ = c.listen(host_ + ":" + std::to_string(port_), listen_handler_);
+}
+
+void LoopbackBroker::on_connection_open(proton::connection& c) {
+	c.open();
+	proton::work_queue* wq = &c.work_queue();
+	connections_[wq]	   = c;
+
+	std::lock_guard<std::mutex> l(lock_);
+	work_queues_.push_back(wq);
+}
+
+void LoopbackBroker::on_sender_open(proton::sender& s) {
+	// A client receiver attached, deliver the queue named by its source address
+	std::string address = s.source().address();
+	s.open(proton::sender_options().source(proton::source_options().address(address)));
+	consumers_[address].push_back(s);
+	spdlog::debug("Loopback broker: consumer attached to {}", address);
+}
+
+void LoopbackBroker::on_receiver_open(proton::receiver& r) {
+	// A client sender attached. Credit is handed out manually so replenishment can be starved
+	std::string address = r.target().address();
+	r.open(proton::receiver_options().target(proton::target_options().address(address)).credit_window(0));
+	r.add_credit(credit_window_);
+	spdlog::debug("Loopback broker: producer attached to {}", address);
+}
+
+void LoopbackBroker::on_sendable(proton::sender& s) {
+	dispatch(s.source().address());
+}
+
+void LoopbackBroker::on_message(proton::delivery& d, proton::message& m) {
+	std::string address = d.receiver().target().address();
+	++received_;
+	if (!starved_) {
+		d.receiver().add_credit(1);
+	}
+
+	std::string to = address;
+	Observer observer;
+	{
+		std::lock_guard<std::mutex> l(lock_);
+		auto it = routes_.find(address);
+		if (it != routes_.end()) {
+			to = it->second;
+		}
+		observer = observer_;
+	}
+	if (observer) {
+		observer(address, m);
+	}
+
+	long long latency = latency_ms_;
+	if (latency > 0) {
+		container_.schedule(proton::duration(latency), [this, to, m]() { this->enqueue(to, m); });
+	} else {
+		enqueue(to, m);
+	}
+}
+
+void LoopbackBroker::on_sender_close(proton::sender& s) {
+	auto it = consumers_.find(s.source().address());
+	if (it == consumers_.end())
+		return;
+	auto& senders = it->second;
+	for (auto sit = senders.begin(); sit != senders.end(); ++sit) {
+		if (*sit == s) {
+			senders.erase(sit);
+			break;
+		}
+	}
+}
+
+void LoopbackBroker::on_transport_close(proton::transport& t) {
+	proton::connection c = t.connection();
+	for (auto& entry : consumers_) {
+		auto& senders = entry.second;
+		for (auto sit = senders.begin(); sit != senders.end();) {
+			sit = (sit->connection() == c) ? senders.erase(sit) : sit + 1;
+		}
+	}
+
+	for (auto it = connections_.begin(); it != connections_.end(); ++it) {
+		if (it->second == c) {
+			std::lock_guard<std::mutex> l(lock_);
+			auto wq = std::find(work_queues_.begin(), work_queues_.end(), it->first);
+			if (wq != work_queues_.end()) {
+				work_queues_.erase(wq);
+			}
+			connections_.erase(it);
+			break;
+		}
+	}
+}
+
+void LoopbackBroker::on_error(const proton::error_condition& e) {
+	// Clients disconnecting uncleanly is expected in fault injection tests
+	spdlog::debug("Loopback broker error: {}", e.what());
+}
+
+void LoopbackBroker::enqueue(const std::string& address, const proton::message& m) {
+	queues_[address].push_back(m);
+	dispatch(address);
+}
+
+void LoopbackBroker::dispatch(const std::string& address) {
+	auto queue	   = queues_.find(address);
+	auto consumers = consumers_.find(address);
+	if (queue == queues_.end() || consumers == consumers_.end())
+		return;
+
+	// Round-robin over the consumers of the address while any of them has credit
+	auto& messages = queue->second;
+	bool sent	   = true;
+	while (!messages.empty() && sent) {
+		sent = false;
+		for (auto& s : consumers->second) {
+			if (messages.empty())
+				break;
+			if (s.credit() > 0) {
+				s.send(messages.front());
+				messages.pop_front();
+				++delivered_;
+				sent = true;
+			}
+		}
+	}
+}
+
+void LoopbackBroker::topUpCredit(proton::work_queue* wq) {
+	auto it = connections_.find(wq);
+	if (it == connections_.end())
+		return;
+	for (proton::receiver r : it->second.receivers()) {
+		int missing = credit_window_ - r.credit();
+		if (missing > 0) {
+			r.add_credit(missing);
+		}
+	}
+}
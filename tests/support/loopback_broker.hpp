@@ -0,0 +1,130 @@
+#ifndef LOOPBACK_BROKER_HPP
+#define LOOPBACK_BROKER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <proton/container.hpp>
+#include <proton/listen_handler.hpp>
+#include <proton/listener.hpp>
+#include <proton/message.hpp>
+#include <proton/messaging_handler.hpp>
+#include <proton/receiver.hpp>
+#include <proton/sender.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Minimal in-process AMQP 1.0 broker used by tests, benchmarks and the load generator.
+//
+// Messages sent to an address are queued and delivered to receivers attached to that address, or to the
+// address configured with route() (e.g. the interchange "del-..." send address to the "loc-..." receive
+// address). All protocol handling runs on a single container thread; the public methods are thread-safe and
+// can be called from the test thread to inject faults while clients are connected.
+class LoopbackBroker : private proton::messaging_handler {
+public:
+	using Observer = std::function<void(const std::string& address, const proton::message& m)>;
+
+	// Port 0 lets the operating system pick a free port, see port()
+	explicit LoopbackBroker(const std::string& host = "127.0.0.1", int port = 0);
+	~LoopbackBroker();
+
+	// Start listening. Blocks until the listener is open and throws if it could not be opened
+	void start();
+	void stop();
+
+	int port() const {
+		return port_;
+	}
+	std::string url() const {
+		return "amqp://" + host_ + ":" + std::to_string(port_);
+	}
+
+	// Deliver messages sent to `from` to receivers of `to`
+	void route(const std::string& from, const std::string& to);
+
+	// Called on the broker thread for every message accepted from a producer, before any simulated latency
+	void setObserver(Observer observer);
+
+	// Credit granted to every producer link when it opens and by restoreCredit()
+	void setCreditWindow(int credit);
+	// Stop replenishing producer credit; producers block once their outstanding credit is used up
+	void starveCredit();
+	// Resume replenishing and top every producer link up to the credit window again
+	void restoreCredit();
+
+	// Delay every message by `latency` between reception and routing
+	void setLatency(std::chrono::milliseconds latency);
+
+	// Forcibly close every client connection with an amqp:connection:forced error
+	void disconnectAll();
+
+	size_t received() const {
+		return received_;
+	}
+	size_t delivered() const {
+		return delivered_;
+	}
+
+private:
+	class ListenHandler : public proton::listen_handler {
+	public:
+		explicit ListenHandler(LoopbackBroker& broker) :
+		  broker_(broker) {}
+		void on_open(proton::listener& l) override;
+		void on_error(proton::listener& l, const std::string& what) override;
+
+	private:
+		LoopbackBroker& broker_;
+	};
+
+	// Handler methods, all called on the container thread
+	void on_container_start(proton::container& c) override;
+	void on_connection_open(proton::connection& c) override;
+	void on_sender_open(proton::sender& s) override;
+	void on_receiver_open(proton::receiver& r) override;
+	void on_sendable(proton::sender& s) override;
+	void on_message(proton::delivery& d, proton::message& m) override;
+	void on_sender_close(proton::sender& s) override;
+	void on_transport_close(proton::transport& t) override;
+	void on_error(const proton::error_condition& e) override;
+
+	void enqueue(const std::string& address, const proton::message& m);
+	void dispatch(const std::string& address);
+	void topUpCredit(proton::work_queue* wq);
+	void forEachConnection(const std::function<void(proton::work_queue*)>& fn);
+
+	std::string host_;
+	int port_;
+
+	proton::container container_;
+	ListenHandler listen_handler_;
+	proton::listener listener_;
+	std::thread container_thread_;
+
+	// Protects the fields shared with the calling threads
+	mutable std::mutex lock_;
+	std::condition_variable listening_;
+	bool listen_done_ = false;
+	std::string listen_error_;
+	std::map<std::string, std::string> routes_;
+	std::vector<proton::work_queue*> work_queues_;
+	Observer observer_;
+
+	std::atomic<int> credit_window_{1000};
+	std::atomic<bool> starved_{false};
+	std::atomic<long long> latency_ms_{0};
+	std::atomic<size_t> received_{0};
+	std::atomic<size_t> delivered_{0};
+
+	// Container thread only
+	std::map<proton::work_queue*, proton::connection> connections_;
+	std::map<std::string, std::deque<proton::message>> queues_;
+	std::map<std::string, std::vector<proton::sender>> consumers_;
+};
+
+#endif // LOOPBACK_BROKER_HPP
@@ -0,0 +1,107 @@
+#include "trace.hpp"
+#include <gtest/gtest.h>
+#include <set>
+#include <thread>
+#include <vector>
+
+TEST(TraceTest, TraceparentRoundTrips) {
+	TraceContext trace{0x0123456789abcdefull, 0xfedcba9876543210ull, 0x1122334455667788ull};
+	EXPECT_EQ(trace.traceparent(), "00-0123456789abcdeffedcba9876543210-1122334455667788-01");
+
+	TraceContext parsed = TraceContext::fromTraceparent(trace.traceparent());
+	EXPECT_EQ(parsed.trace_hi, trace.trace_hi);
+	EXPECT_EQ(parsed.trace_lo, trace.trace_lo);
+	EXPECT_EQ(parsed.span_id, trace.span_id);
+
+	// Not sampled, wrong version and malformed
+	EXPECT_FALSE(TraceContext::fromTraceparent("00-0123456789abcdeffedcba9876543210-1122334455667788-00").sampled());
+	EXPECT_FALSE(TraceContext::fromTraceparent("01-0123456789abcdeffedcba9876543210-1122334455667788-01").sampled());
+	EXPECT_FALSE(TraceContext::fromTraceparent("00-0123456789ABCDEFfedcba9876543210-1122334455667788-01").sampled());
+	EXPECT_FALSE(TraceContext::fromTraceparent("").sampled());
+}
+
+TEST(TraceTest, ScopeSetsTheCurrentContext) {
+	EXPECT_FALSE(TraceContext::current().sampled());
+	{
+		TraceScope scope(TraceContext{0, 1, 2});
+		EXPECT_EQ(TraceContext::current().trace_lo, 1u);
+		{
+			TraceScope inner(TraceContext{0, 3, 4});
+			EXPECT_EQ(TraceContext::current().trace_lo, 3u);
+		}
+		EXPECT_EQ(TraceContext::current().trace_lo, 1u);
+	}
+	EXPECT_FALSE(TraceContext::current().sampled());
+}
+
+TEST(TraceTest, RingKeepsTheNewestSpans) {
+	SpanRing ring(8);
+	for (int i = 0; i < 20; ++i) {
+		ring.push(Span{"stage", 0, 1, i, i + 1, 1});
+	}
+	auto spans = ring.snapshot();
+	ASSERT_EQ(spans.size(), 8u);
+	EXPECT_EQ(spans.front().start_ns, 12);
+	EXPECT_EQ(spans.back().start_ns, 19);
+}
+
+TEST(TraceTest, RingTakesConcurrentWriters) {
+	SpanRing ring(1 << 16);
+	std::vector<std::thread> threads;
+	for (uint32_t t = 1; t <= 8; ++t) {
+		threads.emplace_back([&ring, t]() {
+			for (int i = 0; i < 1000; ++i) {
+				ring.push(Span{"stage", t, t, i, i, t});
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	auto spans = ring.snapshot();
+	EXPECT_EQ(spans.size() + ring.dropped(), 8000u);
+	for (const auto& span : spans) {
+		// Never a mix of two writers
+		EXPECT_EQ(span.trace_hi, span.thread);
+		EXPECT_EQ(span.trace_lo, span.thread);
+	}
+}
+
+TEST(TraceTest, SamplesAndExportsChromeTrace) {
+	auto& tracer = Tracer::getInstance();
+	tracer.configure(0.25, 1024);
+
+	std::set<uint64_t> traces;
+	for (int i = 0; i < 100; ++i) {
+		TraceContext trace = tracer.start();
+		if (trace.sampled()) {
+			traces.insert(trace.trace_lo);
+			TraceScope scope(trace);
+			ScopedSpan span("test.stage");
+		}
+	}
+	EXPECT_EQ(traces.size(), 25u);
+
+	// A sampled parent is continued with a new parent-id, but only at the local sample rate
+	TraceContext parent{0, 42, 7};
+	std::vector<TraceContext> children;
+	for (int i = 0; i < 8; ++i) {
+		TraceContext child = tracer.start(parent);
+		if (child.sampled())
+			children.push_back(child);
+	}
+	ASSERT_EQ(children.size(), 2u);
+	EXPECT_EQ(children[0].trace_lo, 42u);
+	EXPECT_NE(children[0].span_id, 7u);
+
+	auto trace	= tracer.exportChromeTrace();
+	auto events = trace["traceEvents"];
+	ASSERT_EQ(events.size(), 25u);
+	EXPECT_EQ(events[0]["name"], "test.stage");
+	EXPECT_EQ(events[0]["ph"], "X");
+	EXPECT_EQ(events[0]["args"]["traceId"].get<std::string>().size(), 32u);
+
+	tracer.configure(0);
+	EXPECT_FALSE(tracer.start().sampled());
+	EXPECT_FALSE(tracer.start(parent).sampled());
+}
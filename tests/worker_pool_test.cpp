@@ -0,0 +1,39 @@
+#include "worker_pool.hpp"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <set>
+#include <thread>
+#include <vector>
+
+TEST(WorkerPoolTest, RunsEveryPartOnce) {
+	WorkerPool pool(3);
+	std::vector<std::atomic<int>> calls(100);
+	pool.forEach(calls.size(), [&calls](size_t i) { ++calls[i]; });
+	for (const auto& count : calls) {
+		EXPECT_EQ(count, 1);
+	}
+}
+
+TEST(WorkerPoolTest, WithoutThreadsRunsOnCaller) {
+	WorkerPool pool(0);
+	std::set<std::thread::id> threads;
+	pool.forEach(10, [&threads](size_t) { threads.insert(std::this_thread::get_id()); });
+	EXPECT_EQ(threads, std::set<std::thread::id>{std::this_thread::get_id()});
+}
+
+TEST(WorkerPoolTest, SharedByConcurrentCallers) {
+	WorkerPool pool(2);
+	std::atomic<size_t> total{0};
+	std::vector<std::thread> callers;
+	for (int c = 0; c < 4; ++c) {
+		callers.emplace_back([&pool, &total]() {
+			for (int round = 0; round < 50; ++round) {
+				pool.forEach(8, [&total](size_t) { ++total; });
+			}
+		});
+	}
+	for (auto& caller : callers) {
+		caller.join();
+	}
+	EXPECT_EQ(total, 4u * 50 * 8);
+}
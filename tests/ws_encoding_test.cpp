@@ -0,0 +1,108 @@
+#include "ws_encoding.hpp"
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+namespace {
+IncomingDenm makeDenm() {
+	IncomingDenm denm;
+	// Bytes a text encoding would mangle: NUL, high bit set
+	denm.uper						   = {0x01, 0x00, 0xff, 0x80, 0x7f, 0x00, 0x42};
+	denm.json						   = {{"header", {{"stationId", 1234}}}, {"situation", {{"causeCode", 3}}}};
+	denm.serialized					   = denm.json.dump();
+	denm.action.originating_station_id = 1234;
+	denm.action.sequence_number		   = 7;
+	denm.action.reference_time_ms	   = 1700000000123;
+	denm.attributes.cause_code		   = 3;
+	denm.attributes.quadkey			   = "120203302133020303";
+	return denm;
+}
+
+// Inflate a raw deflate stream the way clients do, zlib with windowBits -15
+std::string inflateRaw(const std::string& data) {
+	z_stream stream{};
+	if (inflateInit2(&stream, -15) != Z_OK)
+		throw std::runtime_error("inflateInit2 failed");
+	std::string out;
+	char buffer[256];
+	stream.next_in	= reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+	stream.avail_in = static_cast<uInt>(data.size());
+	int result		= Z_OK;
+	while (result == Z_OK) {
+		stream.next_out	 = reinterpret_cast<Bytef*>(buffer);
+		stream.avail_out = sizeof(buffer);
+		result			 = inflate(&stream, Z_NO_FLUSH);
+		out.append(buffer, sizeof(buffer) - stream.avail_out);
+	}
+	inflateEnd(&stream);
+	if (result != Z_STREAM_END)
+		throw std::runtime_error("inflate failed");
+	return out;
+}
+} // namespace
+
+TEST(WsEncodingTest, UperFrameHasHeaderAndUnchangedBody) {
+	auto denm		  = makeDenm();
+	std::string frame = encodeIncomingDenm(denm, WsEncoding::Uper);
+
+	ASSERT_GE(frame.size(), 2u);
+	size_t header_size = (static_cast<unsigned char>(frame[0]) << 8) | static_cast<unsigned char>(frame[1]);
+	ASSERT_EQ(frame.size(), 2 + header_size + denm.uper.size());
+
+	auto header = nlohmann::json::from_msgpack(frame.begin() + 2, frame.begin() + 2 + header_size);
+	EXPECT_EQ(header,
+			  nlohmann::json({{"stationId", 1234},
+							  {"sequenceNumber", 7},
+							  {"referenceTime", 1700000000123},
+							  {"causeCode", 3},
+							  {"quadkey", "120203302133020303"}}));
+
+	std::vector<unsigned char> body(frame.begin() + 2 + header_size, frame.end());
+	EXPECT_EQ(body, denm.uper);
+}
+
+TEST(WsEncodingTest, MessagePackRoundTrip) {
+	auto denm		  = makeDenm();
+	std::string frame = encodeIncomingDenm(denm, WsEncoding::MessagePack);
+	EXPECT_EQ(nlohmann::json::from_msgpack(frame), denm.json);
+	EXPECT_EQ(encodeIncomingDenm(denm, WsEncoding::Json), denm.serialized);
+}
+
+TEST(WsEncodingTest, DeflateRawInflatesWithNegativeWindowBits) {
+	auto denm		  = makeDenm();
+	std::string frame = encodeIncomingDenm(denm, WsEncoding::JsonDeflate);
+	EXPECT_EQ(inflateRaw(frame), denm.serialized);
+
+	std::string repetitive(10000, 'a');
+	std::string deflated = deflateRaw(repetitive);
+	EXPECT_LT(deflated.size(), repetitive.size() / 10);
+	EXPECT_EQ(inflateRaw(deflated), repetitive);
+	EXPECT_EQ(inflateRaw(deflateRaw("")), "");
+}
+
+TEST(WsEncodingTest, SequencedFramesPrefixTheSequenceNumber) {
+	auto denm = std::make_shared<const IncomingDenm>(makeDenm());
+	WsMessage message(std::make_shared<const std::string>(denm->serialized),
+					  [denm](WsEncoding encoding) { return encodeIncomingDenm(*denm, encoding); });
+	uint64_t seq = 0x0102030405060708;
+
+	EXPECT_EQ(message.sequencedFrame(WsEncoding::Json, seq),
+			  "{\"seq\":" + std::to_string(seq) + ",\"denm\":" + denm->serialized + "}");
+	auto text = nlohmann::json::parse(message.sequencedFrame(WsEncoding::Json, seq));
+	EXPECT_EQ(text["seq"], seq);
+	EXPECT_EQ(text["denm"], denm->json);
+
+	const std::string& binary = message.sequencedFrame(WsEncoding::Uper, seq);
+	ASSERT_EQ(binary.size(), 8 + message.frame(WsEncoding::Uper).size());
+	EXPECT_EQ(binary.substr(0, 8), std::string("\x01\x02\x03\x04\x05\x06\x07\x08", 8));
+	EXPECT_EQ(binary.substr(8), message.frame(WsEncoding::Uper));
+
+	// A message keeps the sequence number it was first given
+	EXPECT_EQ(message.sequencedFrame(WsEncoding::Uper, seq + 1), binary);
+}
+
+TEST(WsEncodingTest, EncodingNames) {
+	for (auto encoding : {WsEncoding::Json, WsEncoding::Uper, WsEncoding::MessagePack, WsEncoding::JsonDeflate}) {
+		EXPECT_EQ(wsEncodingFromString(toString(encoding)), encoding);
+	}
+	EXPECT_THROW(wsEncodingFromString("xml"), std::invalid_argument);
+}
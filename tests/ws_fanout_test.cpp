@@ -0,0 +1,320 @@
+#include "ws_fanout.hpp"
+#include <algorithm>
+#include <gtest/gtest.h>
+
+namespace {
+// Wait up to a second for `condition`
+template <typename Condition>
+bool eventually(Condition condition) {
+	for (int i = 0; i < 1000 && !condition(); ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return condition();
+}
+
+WsFanout::Message makeMessage(const std::string& text) {
+	return std::make_shared<const WsMessage>(std::make_shared<const std::string>(text));
+}
+
+// Behaves like a Crow connection: a send appends the frame to a buffer without limit and returns at once, and
+// a close only marks the connection. The client reads nothing
+class BufferedConnection {
+public:
+	WsFanout::Send send() {
+		return [this](const std::string& frame, bool) {
+			std::lock_guard<std::mutex> l(lock_);
+			unread_ += frame.size();
+			++frames_;
+		};
+	}
+	WsFanout::Close close() {
+		return [this](const std::string&) { closed_ = true; };
+	}
+	size_t unread() {
+		std::lock_guard<std::mutex> l(lock_);
+		return unread_;
+	}
+	size_t frames() {
+		std::lock_guard<std::mutex> l(lock_);
+		return frames_;
+	}
+	bool closed() const {
+		return closed_;
+	}
+
+private:
+	std::mutex lock_;
+	size_t unread_ = 0;
+	size_t frames_ = 0;
+	std::atomic<bool> closed_{false};
+};
+} // namespace
+
+TEST(WsFanoutTest, DeliversToEveryClientInOrder) {
+	WsFanout fanout;
+	std::mutex lock;
+	std::vector<std::string> first, second;
+	fanout.add(
+	  [&](const std::string& m, bool) {
+		  std::lock_guard<std::mutex> l(lock);
+		  first.push_back(m);
+	  },
+	  [](const std::string&) {});
+	fanout.add(
+	  [&](const std::string& m, bool) {
+		  std::lock_guard<std::mutex> l(lock);
+		  second.push_back(m);
+	  },
+	  [](const std::string&) {});
+	fanout.start();
+
+	fanout.publish(makeMessage("a"));
+	fanout.publish(makeMessage("b"));
+
+	ASSERT_TRUE(eventually([&]() {
+		std::lock_guard<std::mutex> l(lock);
+		return first.size() == 2 && second.size() == 2;
+	}));
+	EXPECT_EQ(first, std::vector<std::string>({"a", "b"}));
+	EXPECT_EQ(second, first);
+}
+
+TEST(WsFanoutTest, StalledClientIsThrottledAndEvicted) {
+	WsFanoutOptions options;
+	options.queue_limit		= 4;
+	options.max_lag			= std::chrono::milliseconds(200);
+	options.send_buffer		= 1000;
+	options.min_client_rate = 1000;
+	WsFanout fanout(options);
+	BufferedConnection stalled;
+	fanout.add(stalled.send(), stalled.close());
+	fanout.start();
+
+	// Once it is assumed to hold a send buffer of unread frames, the client gets no more and its queue fills
+	const std::string frame(100, 'x');
+	for (int i = 0; i < 20; ++i) {
+		fanout.publish(makeMessage(frame));
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	ASSERT_TRUE(eventually([&]() { return fanout.stats()["throttled"] == 1; }));
+	EXPECT_LE(stalled.unread(), 1200u);
+	EXPECT_LT(stalled.frames(), 20u);
+	EXPECT_GT(fanout.stats()["dropped"].get<uint64_t>(), 0u);
+
+	// Once its oldest withheld message is older than max_lag, it is disconnected
+	std::this_thread::sleep_for(std::chrono::milliseconds(250));
+	fanout.publish(makeMessage(frame));
+	EXPECT_TRUE(eventually([&]() { return stalled.closed(); }));
+	EXPECT_EQ(fanout.stats()["evicted"], 1);
+	fanout.stop();
+}
+
+TEST(WsFanoutTest, ClientsWithinMinClientRateAreNotThrottled) {
+	WsFanoutOptions options;
+	options.queue_limit		= 4;
+	options.send_buffer		= 1000;
+	options.min_client_rate = 1000000;
+	WsFanout fanout(options);
+	BufferedConnection client;
+	fanout.add(client.send(), client.close());
+	fanout.start();
+
+	for (int i = 0; i < 20; ++i) {
+		fanout.publish(makeMessage(std::string(100, 'x')));
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	ASSERT_TRUE(eventually([&]() { return client.frames() == 20; }));
+	EXPECT_EQ(fanout.stats()["throttles"], 0);
+	EXPECT_EQ(fanout.stats()["dropped"], 0);
+}
+
+TEST(WsFanoutTest, MessagesBeingSentCountTowardsLag) {
+	WsFanoutOptions options;
+	options.max_lag			= std::chrono::milliseconds(100);
+	options.min_client_rate = 0;
+	WsFanout fanout(options);
+	std::atomic<bool> release{false};
+	std::atomic<bool> closed{false};
+	// A transport whose send blocks, the message stays with the send thread
+	fanout.add(
+	  [&](const std::string&, bool) {
+		  for (int i = 0; i < 2000 && !release; ++i)
+			  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	  },
+	  [&](const std::string&) { closed = true; });
+	std::atomic<int> other_received{0};
+	fanout.add([&](const std::string&, bool) { ++other_received; }, [](const std::string&) {});
+	fanout.start();
+
+	fanout.publish(makeMessage("first"));
+	std::this_thread::sleep_for(std::chrono::milliseconds(150));
+	fanout.publish(makeMessage("late"));
+	// The other client is served by the other send thread meanwhile
+	EXPECT_TRUE(eventually([&]() { return other_received == 2; }));
+	EXPECT_TRUE(eventually([&]() { return closed.load(); }));
+	EXPECT_EQ(fanout.stats()["evicted"], 1);
+
+	release = true;
+	fanout.stop();
+}
+
+TEST(WsFanoutTest, RecordsOneSpanPerSampledMessage) {
+	auto& tracer = Tracer::getInstance();
+	tracer.configure(1, 1024);
+	WsFanout fanout;
+	std::atomic<int> received{0};
+	for (int i = 0; i < 3; ++i) {
+		fanout.add([&](const std::string&, bool) { ++received; }, [](const std::string&) {});
+	}
+	fanout.start();
+	{
+		TraceScope scope(tracer.start());
+		fanout.publish(makeMessage("a"));
+	}
+	ASSERT_TRUE(eventually([&]() { return received == 3; }));
+	// The span is recorded after the send
+	fanout.stop();
+
+	auto spans = tracer.spans();
+	EXPECT_EQ(std::count_if(spans.begin(),
+							spans.end(),
+							[](const Span& span) { return std::string(span.name) == "ws.fanout"; }),
+			  1);
+	tracer.configure(0);
+}
+
+TEST(WsFanoutTest, EncodesOncePerEncoding) {
+	WsFanout fanout;
+	std::atomic<int> encoded{0};
+	std::mutex lock;
+	std::vector<std::pair<std::string, bool>> frames;
+	auto send = [&](const std::string& frame, bool binary) {
+		std::lock_guard<std::mutex> l(lock);
+		frames.emplace_back(frame, binary);
+	};
+	for (int i = 0; i < 3; ++i) {
+		auto id = fanout.add(send, [](const std::string&) {});
+		fanout.setEncoding(id, i == 0 ? WsEncoding::Json : WsEncoding::MessagePack);
+	}
+	fanout.start();
+
+	fanout.publish(std::make_shared<const WsMessage>(std::make_shared<const std::string>("{}"), [&](WsEncoding) {
+		++encoded;
+		return std::string("\x80", 1);
+	}));
+
+	ASSERT_TRUE(eventually([&]() {
+		std::lock_guard<std::mutex> l(lock);
+		return frames.size() == 3;
+	}));
+	EXPECT_EQ(encoded, 1);
+	EXPECT_EQ(std::count(frames.begin(), frames.end(), std::make_pair(std::string("\x80", 1), true)), 2);
+	EXPECT_EQ(std::count(frames.begin(), frames.end(), std::make_pair(std::string("{}"), false)), 1);
+}
+
+TEST(WsFanoutTest, ResumedClientGetsMissedMessagesOnce) {
+	WsFanout fanout;
+	fanout.start();
+	fanout.publish(makeMessage("\"a\""));
+	fanout.publish(makeMessage("\"b\""));
+
+	std::mutex lock;
+	std::vector<std::string> frames;
+	fanout.add(
+	  [&](const std::string& m, bool) {
+		  std::lock_guard<std::mutex> l(lock);
+		  frames.push_back(m);
+	  },
+	  [](const std::string&) {},
+	  1);
+	fanout.publish(makeMessage("\"c\""));
+
+	ASSERT_TRUE(eventually([&]() {
+		std::lock_guard<std::mutex> l(lock);
+		return frames.size() >= 2;
+	}));
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	std::lock_guard<std::mutex> l(lock);
+	EXPECT_EQ(frames, std::vector<std::string>({R"({"seq":2,"denm":"b"})", R"({"seq":3,"denm":"c"})"}));
+}
+
+TEST(WsFanoutTest, DeltaClientsGetDeltasOnlyForMessagesTheyReceived) {
+	WsFanout fanout;
+	std::mutex lock;
+	std::vector<std::string> early, late, plain;
+	auto collect = [&](std::vector<std::string>& into) {
+		return [&lock, &into](const std::string& m, bool) {
+			std::lock_guard<std::mutex> l(lock);
+			into.push_back(m);
+		};
+	};
+	auto received = [&](const std::vector<std::string>& from, size_t count) {
+		return eventually([&]() {
+			std::lock_guard<std::mutex> l(lock);
+			return from.size() == count;
+		});
+	};
+	fanout.setDelta(fanout.add(collect(early), [](const std::string&) {}), true);
+	fanout.add(collect(plain), [](const std::string&) {});
+	fanout.start();
+
+	// Three versions of one action, each relative to the previous one
+	uint64_t previous_seq = 0;
+
+	auto publishVersion = [&](const std::string& text, bool final) {
+		WsDelta delta;
+		delta.action_key   = 42;
+		delta.previous_seq = previous_seq;
+		delta.final		   = final;
+		delta.encode	   = [text](uint64_t seq) { return "delta " + text + " " + std::to_string(seq); };
+		auto message =
+		  std::make_shared<const WsMessage>(std::make_shared<const std::string>(text), nullptr, std::move(delta));
+		previous_seq = fanout.publish(message);
+	};
+	publishVersion("v1", false);
+	ASSERT_TRUE(received(early, 1));
+	fanout.setDelta(fanout.add(collect(late), [](const std::string&) {}), true);
+	publishVersion("v2", false);
+	ASSERT_TRUE(received(late, 1));
+	publishVersion("v3", true);
+
+	ASSERT_TRUE(received(early, 3));
+	ASSERT_TRUE(received(late, 2));
+	ASSERT_TRUE(received(plain, 3));
+	EXPECT_EQ(early, std::vector<std::string>({"v1", "delta v2 2", "delta v3 3"}));
+	// It never received v1, so v2 is sent in full
+	EXPECT_EQ(late, std::vector<std::string>({"v2", "delta v3 3"}));
+	EXPECT_EQ(plain, std::vector<std::string>({"v1", "v2", "v3"}));
+	EXPECT_EQ(fanout.stats()["deltas"], 3);
+	EXPECT_EQ(fanout.stats()["deltaClients"], 2);
+}
+
+TEST(WsFanoutTest, CountsDeltaClients) {
+	WsFanout fanout;
+	auto first	= fanout.add([](const std::string&, bool) {}, [](const std::string&) {});
+	auto second = fanout.add([](const std::string&, bool) {}, [](const std::string&) {});
+	EXPECT_EQ(fanout.deltaClients(), 0u);
+
+	fanout.setDelta(first, true);
+	fanout.setDelta(first, true);
+	fanout.setDelta(second, true);
+	EXPECT_EQ(fanout.deltaClients(), 2u);
+	fanout.setDelta(second, false);
+	EXPECT_EQ(fanout.deltaClients(), 1u);
+	fanout.remove(first);
+	EXPECT_EQ(fanout.deltaClients(), 0u);
+	EXPECT_EQ(fanout.stats()["deltaClients"], 0);
+}
+
+TEST(WsFanoutTest, MergePatchOfDenmVersions) {
+	auto from  = nlohmann::json::parse(R"({"a": 1, "b": {"c": 2, "d": 3}, "e": [1, 2], "f": "x"})");
+	auto to	   = nlohmann::json::parse(R"({"a": 1, "b": {"c": 2, "d": 4}, "e": [1], "g": true})");
+	auto patch = mergePatchOf(from, to);
+	EXPECT_EQ(patch, nlohmann::json::parse(R"({"b": {"d": 4}, "e": [1], "f": null, "g": true})"));
+
+	// Applying the patch gives the new version
+	auto patched = from;
+	patched.merge_patch(patch);
+	EXPECT_EQ(patched, to);
+	EXPECT_TRUE(mergePatchOf(to, to).empty());
+}
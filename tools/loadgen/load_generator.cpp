@@ -0,0 +1,412 @@
+#include "load_generator.hpp"
+#include <algorithm>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/websocket.hpp>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <sys/socket.h>
+
+namespace beast		= boost::beast;
+namespace http		= beast::http;
+namespace websocket = beast::websocket;
+using tcp			= boost::asio::ip::tcp;
+
+namespace {
+const char* const HOP_NAMES[] = {"http", "wsAck", "broker", "webSocket"};
+
+// Cause codes of common road hazards with their largest subcause used here
+const std::pair<int, int> CAUSES[] = {{1, 4}, {2, 3}, {3, 6}, {9, 5}, {12, 2}, {17, 3}, {94, 2}, {97, 1}};
+const int STATION_TYPES[]		   = {3, 5, 6, 10, 15};
+
+// Probe DENMs use the station just below the load, and are not recorded
+constexpr uint32_t PROBE_STATION = LoadGenerator::FIRST_STATION - 1;
+// DENM indexes beyond this do not fit the stationIDs they are identified by
+constexpr double MAX_DENMS = 1e12;
+
+std::string postDenm(beast::tcp_stream& stream,
+					 beast::flat_buffer& buffer,
+					 const std::string& host,
+					 const std::string& body,
+					 http::status& status) {
+	http::request<http::string_body> req{http::verb::post, "/denm", 11};
+	req.set(http::field::host, host);
+	req.set(http::field::content_type, "application/json");
+	req.keep_alive(true);
+	req.body() = body;
+	req.prepare_payload();
+	http::write(stream, req);
+
+	http::response<http::string_body> res;
+	http::read(stream, buffer, res);
+	status = res.result();
+	return res.body();
+}
+} // namespace
+
+const char* toString(Hop hop) {
+	return HOP_NAMES[static_cast<size_t>(hop)];
+}
+
+void LatencyLog::record(std::chrono::nanoseconds latency) {
+	std::lock_guard<std::mutex> l(lock_);
+	latencies_ns_.push_back(latency.count());
+}
+
+LatencyLog::Summary LatencyLog::summarize() const {
+	std::vector<int64_t> sorted;
+	{
+		std::lock_guard<std::mutex> l(lock_);
+		sorted = latencies_ns_;
+	}
+	Summary summary;
+	summary.count = sorted.size();
+	if (sorted.empty())
+		return summary;
+
+	std::sort(sorted.begin(), sorted.end());
+	auto at = [&sorted](double quantile) {
+		size_t rank = static_cast<size_t>(std::ceil(quantile * sorted.size()));
+		return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1] / 1e6;
+	};
+	summary.p50_ms	= at(0.50);
+	summary.p99_ms	= at(0.99);
+	summary.p999_ms = at(0.999);
+	summary.max_ms	= sorted.back() / 1e6;
+	return summary;
+}
+
+LoadGenerator::LoadGenerator(const LoadOptions& options) :
+  options_(options) {
+	// Checked before the count is converted, a negative or NaN rate would not fit
+	if (!(options_.rate > 0) || options_.duration.count() <= 0)
+		throw std::invalid_argument("The rate and duration must be positive");
+	double total = options_.rate * options_.duration.count();
+	if (total > MAX_DENMS)
+		throw std::invalid_argument("Too many DENMs, reduce the rate or duration");
+	total_				 = static_cast<uint64_t>(total);
+	options_.connections = std::max<size_t>(options_.connections, 1);
+	options_.ws_window	 = std::max<size_t>(options_.ws_window, 1);
+}
+
+nlohmann::json LoadGenerator::makeDenm(uint64_t i) const {
+	std::mt19937_64 random(i);
+	auto uniform = [&random](double min, double max) {
+		return std::uniform_real_distribution<double>(min, max)(random);
+	};
+	auto pick = [&random](size_t count) { return std::uniform_int_distribution<size_t>(0, count - 1)(random); };
+
+	uint32_t station	= FIRST_STATION + static_cast<uint32_t>(i >> 16);
+	double latitude		= uniform(options_.min_latitude, options_.max_latitude);
+	double longitude	= uniform(options_.min_longitude, options_.max_longitude);
+	const auto& cause	= CAUSES[pick(std::size(CAUSES))];
+	std::string country = "NO";
+	// A few publishers and publications, as from a handful of road operators
+	std::string publisher = country + "0000" + std::to_string(i % 8);
+
+	nlohmann::json data;
+	data["header"]	   = {{"protocolVersion", 2}, {"messageId", 1}, {"stationId", station}};
+	data["management"] = {{"actionId", station},
+						  {"sequenceNumber", i & 0xffff},
+						  {"stationType", STATION_TYPES[pick(std::size(STATION_TYPES))]},
+						  {"validityDuration", 60 + pick(12) * 50},
+						  {"eventPosition", {{"latitude", latitude}, {"longitude", longitude}, {"altitude", 100.0}}}};
+	data["situation"] = {{"informationQuality", 1 + pick(7)},
+						 {"causeCode", cause.first},
+						 {"subCauseCode", pick(cause.second + 1)}};
+	// Moving hazards also report speed and heading
+	if (pick(4) == 0) {
+		data["location"] = {{"eventSpeed", uniform(0, 30)},
+							{"speedConfidence", 1},
+							{"eventHeading", uniform(0, 359)},
+							{"headingConfidence", 1}};
+	}
+
+	return {{"publisherId", publisher},
+			{"publicationId", publisher + ":LOADGEN"},
+			{"originatingCountry", country},
+			{"protocolVersion", "DENM:1.2.2"},
+			{"messageType", "DENM"},
+			{"latitude", latitude},
+			{"longitude", longitude},
+			{"data", std::move(data)}};
+}
+
+LoadGenerator::Clock::time_point LoadGenerator::scheduledAt(uint64_t i) const {
+	return start_ + std::chrono::nanoseconds(static_cast<int64_t>(std::llround(i * 1e9 / options_.rate)));
+}
+
+void LoadGenerator::seen(Hop hop, uint32_t station_id, uint16_t sequence_number) {
+	auto now = Clock::now();
+	if (station_id == PROBE_STATION) {
+		probe_seen_ = true;
+		return;
+	}
+	if (station_id < FIRST_STATION || !running_)
+		return;
+	uint64_t i = (static_cast<uint64_t>(station_id - FIRST_STATION) << 16) | sequence_number;
+	if (i < total_) {
+		logs_[static_cast<size_t>(hop)].record(now - scheduledAt(i));
+	}
+}
+
+void LoadGenerator::connect(std::chrono::seconds timeout) {
+	for (size_t client = 0; client < options_.ws_clients; ++client) {
+		ws_threads_.emplace_back([this, client]() { this->runWsClient(client); });
+	}
+
+	// The service and both AMQP links are up once a DENM makes it all the way back
+	auto deadline = Clock::now() + timeout;
+	for (uint16_t probe = 0; !probe_seen_; ++probe) {
+		if (Clock::now() > deadline)
+			throw std::runtime_error("No DENM came back over the WebSocket, is the service connected to the broker?");
+		try {
+			boost::asio::io_context io;
+			beast::tcp_stream stream(io);
+			tcp::resolver resolver(io);
+			stream.connect(resolver.resolve(options_.host, std::to_string(options_.http_port)));
+			beast::flat_buffer buffer;
+			nlohmann::json denm								= makeDenm(0);
+			denm["data"]["header"]["stationId"]				= PROBE_STATION;
+			denm["data"]["management"]["actionId"]			= PROBE_STATION;
+			denm["data"]["management"]["sequenceNumber"]	= probe;
+			http::status status;
+			postDenm(stream, buffer, options_.host, denm.dump(), status);
+		} catch (const std::exception& e) {
+			spdlog::debug("Probe failed: {}", e.what());
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	}
+}
+
+void LoadGenerator::run() {
+	start_	 = Clock::now() + std::chrono::milliseconds(100);
+	running_ = true;
+	std::vector<std::thread> connections;
+	for (size_t i = 0; i < options_.connections; ++i) {
+		if (options_.mode == PublishMode::WebSocket) {
+			connections.emplace_back([this]() { this->runWsPublisher(); });
+		} else {
+			connections.emplace_back([this]() { this->runHttpConnection(); });
+		}
+	}
+	for (auto& connection : connections) {
+		connection.join();
+	}
+	end_ = Clock::now();
+
+	std::this_thread::sleep_for(options_.drain);
+	running_ = false;
+	{
+		std::lock_guard<std::mutex> l(ws_sockets_lock_);
+		for (int socket : ws_sockets_) {
+			::shutdown(socket, SHUT_RDWR);
+		}
+	}
+	for (auto& thread : ws_threads_) {
+		thread.join();
+	}
+}
+
+void LoadGenerator::runHttpConnection() {
+	boost::asio::io_context io;
+	tcp::resolver resolver(io);
+	std::unique_ptr<beast::tcp_stream> stream;
+	beast::flat_buffer buffer;
+
+	for (uint64_t i = next_++; i < total_; i = next_++) {
+		std::this_thread::sleep_until(scheduledAt(i));
+		std::string body = makeDenm(i).dump();
+		try {
+			if (!stream) {
+				stream = std::make_unique<beast::tcp_stream>(io);
+				stream->connect(resolver.resolve(options_.host, std::to_string(options_.http_port)));
+			}
+			http::status status;
+			std::string response = postDenm(*stream, buffer, options_.host, body, status);
+			logs_[static_cast<size_t>(Hop::Http)].record(Clock::now() - scheduledAt(i));
+			++sent_;
+			if (status != http::status::ok) {
+				++http_errors_;
+				spdlog::warn("POST /denm failed with {}: {}", static_cast<int>(status), response);
+			}
+		} catch (const std::exception& e) {
+			++http_errors_;
+			spdlog::warn("POST /denm failed: {}", e.what());
+			stream.reset();
+			buffer.clear();
+		}
+	}
+}
+
+void LoadGenerator::runWsPublisher() {
+	// One thread drives the connection with asynchronous operations, so acknowledgements are read while
+	// DENMs are written
+	boost::asio::io_context io;
+	websocket::stream<tcp::socket> ws(io);
+	boost::asio::steady_timer timer(io);
+	beast::flat_buffer buffer;
+	std::string frame;			// Being written
+	uint64_t next	   = 0;		// Index of the DENM to send next
+	size_t outstanding = 0;		// Sent and not acknowledged
+	bool sending	   = false; // Waiting for the schedule or writing
+	bool finished	   = false; // Every DENM of the connection was sent
+	bool closing	   = false;
+
+	auto close = [&]() {
+		if (closing)
+			return;
+		closing = true;
+		timer.cancel();
+		ws.async_close(websocket::close_code::normal, [](beast::error_code) {});
+	};
+	// DENMs still unacknowledged after the drain time are given up
+	auto finish = [&]() {
+		finished = true;
+		if (outstanding == 0) {
+			close();
+			return;
+		}
+		timer.expires_after(options_.drain);
+		timer.async_wait([&](beast::error_code ec) {
+			if (!ec)
+				close();
+		});
+	};
+
+	std::function<void()> sendNext = [&]() {
+		if (sending || finished || closing || outstanding >= options_.ws_window)
+			return;
+		next = next_++;
+		if (next >= total_) {
+			finish();
+			return;
+		}
+		sending = true;
+		timer.expires_at(scheduledAt(next));
+		timer.async_wait([&](beast::error_code ec) {
+			if (ec)
+				return;
+			frame = nlohmann::json{{"type", "publish"}, {"id", next}, {"denm", makeDenm(next)}}.dump();
+			++outstanding;
+			ws.async_write(boost::asio::buffer(frame), [&](beast::error_code ec, size_t) {
+				sending = false;
+				if (ec) {
+					++ws_errors_;
+					spdlog::warn("WebSocket publish failed: {}", ec.message());
+					return;
+				}
+				++sent_;
+				sendNext();
+			});
+		});
+	};
+
+	std::function<void()> readAck = [&]() {
+		ws.async_read(buffer, [&](beast::error_code ec, size_t) {
+			if (ec)
+				return;
+			auto ack = nlohmann::json::parse(beast::buffers_to_string(buffer.data()), nullptr, false);
+			buffer.consume(buffer.size());
+			if (ack.is_object() && ack.value("type", "") == "ack" && ack["id"].is_number_unsigned()) {
+				uint64_t i = ack["id"].get<uint64_t>();
+				if (ack.value("status", "") == "failed") {
+					++ws_errors_;
+					spdlog::warn("WebSocket publish of DENM {} failed: {}", i, ack.value("error", ""));
+				} else if (i < total_) {
+					logs_[static_cast<size_t>(Hop::WsAck)].record(Clock::now() - scheduledAt(i));
+				}
+				outstanding -= outstanding > 0 ? 1 : 0;
+				if (finished && outstanding == 0) {
+					close();
+				} else {
+					sendNext();
+				}
+			}
+			readAck();
+		});
+	};
+
+	try {
+		tcp::resolver resolver(io);
+		boost::asio::connect(ws.next_layer(), resolver.resolve(options_.host, std::to_string(options_.ws_port)));
+		ws.handshake(options_.host, "/denm");
+		ws.text(true);
+		readAck();
+		sendNext();
+		io.run();
+	} catch (const std::exception& e) {
+		++ws_errors_;
+		spdlog::error("WebSocket publisher failed: {}", e.what());
+	}
+}
+
+void LoadGenerator::runWsClient(size_t client) {
+	try {
+		boost::asio::io_context io;
+		websocket::stream<tcp::socket> ws(io);
+		tcp::resolver resolver(io);
+		boost::asio::connect(ws.next_layer(), resolver.resolve(options_.host, std::to_string(options_.ws_port)));
+		ws.handshake(options_.host, "/denm");
+		{
+			std::lock_guard<std::mutex> l(ws_sockets_lock_);
+			ws_sockets_.push_back(ws.next_layer().native_handle());
+		}
+
+		beast::flat_buffer buffer;
+		while (true) {
+			ws.read(buffer);
+			auto denm = nlohmann::json::parse(beast::buffers_to_string(buffer.data()), nullptr, false);
+			buffer.consume(buffer.size());
+			const auto* management = denm.is_object() && denm.contains("management") ? &denm["management"] : nullptr;
+			if (management && management->contains("actionId") && management->contains("sequenceNumber")) {
+				seen(Hop::WebSocket,
+					 (*management)["actionId"].get<uint32_t>(),
+					 (*management)["sequenceNumber"].get<uint16_t>());
+			}
+		}
+	} catch (const std::exception& e) {
+		// Shut down at the end of the run, or the service went away
+		if (running_)
+			spdlog::error("WebSocket client {} failed: {}", client, e.what());
+	}
+}
+
+nlohmann::json LoadGenerator::report() const {
+	double elapsed_s = std::chrono::duration<double>(end_ - start_).count();
+	nlohmann::json j;
+	j["scheduled"]	= total_;
+	j["sent"]		= sent_.load();
+	j["httpErrors"] = http_errors_.load();
+	j["wsErrors"]	= ws_errors_.load();
+	j["rate"]		= options_.rate;
+	j["seconds"]	= elapsed_s;
+	for (size_t i = 0; i < HOP_COUNT; ++i) {
+		// Only the hop of the publish mode in use
+		Hop publish_hop = options_.mode == PublishMode::WebSocket ? Hop::Http : Hop::WsAck;
+		if (static_cast<Hop>(i) == publish_hop)
+			continue;
+		auto summary = logs_[i].summarize();
+		auto& hop	 = j["hops"][HOP_NAMES[i]];
+		hop["count"] = summary.count;
+		// Arrivals per second over the sending period, the WebSocket hop counts every client
+		hop["throughput"] = elapsed_s > 0 ? summary.count / elapsed_s : 0;
+		hop["p50Ms"]	  = summary.p50_ms;
+		hop["p99Ms"]	  = summary.p99_ms;
+		hop["p999Ms"]	  = summary.p999_ms;
+		hop["maxMs"]	  = summary.max_ms;
+	}
+	uint64_t expected_ws = total_ * options_.ws_clients;
+	j["hops"]["broker"]["missing"] =
+	  total_ - std::min<uint64_t>(total_, j["hops"]["broker"]["count"].get<uint64_t>());
+	j["hops"]["webSocket"]["missing"] =
+	  expected_ws - std::min<uint64_t>(expected_ws, j["hops"]["webSocket"]["count"].get<uint64_t>());
+	return j;
+}
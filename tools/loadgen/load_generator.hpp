@@ -0,0 +1,120 @@
+#ifndef LOAD_GENERATOR_HPP
+#define LOAD_GENERATOR_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How the load generator publishes DENMs
+enum class PublishMode {
+	Http,	   // POST /denm, one request per DENM on keep-alive connections
+	WebSocket, // {"type": "publish"} messages on WebSocket connections, acknowledged asynchronously
+};
+
+struct LoadOptions {
+	std::string host = "127.0.0.1";
+	int http_port	 = 8080;
+	int ws_port		 = 8080;
+	double rate		 = 1000; // DENMs per second, sent on schedule whether or not earlier requests completed
+	std::chrono::seconds duration{10};
+	PublishMode mode   = PublishMode::Http;
+	size_t connections = 8;	 // Connections sending the DENMs
+	size_t ws_clients  = 4;	 // WebSocket clients receiving every DENM
+	size_t ws_window   = 64; // Unacknowledged DENMs per WebSocket connection, the service's --ws-publish-window
+	// Area the event positions are drawn from
+	double min_latitude	 = 59.80;
+	double min_longitude = 10.60;
+	double max_latitude	 = 60.00;
+	double max_longitude = 10.90;
+	// How long to wait for DENMs still on their way after the last one was sent
+	std::chrono::milliseconds drain{2000};
+};
+
+// Hops a DENM is timed at, all measured from the time it was scheduled to be sent
+enum class Hop {
+	Http,	   // POST /denm response received
+	WsAck,	   // Acknowledgement of a DENM published over a WebSocket received
+	Broker,	   // Accepted by the AMQP broker from the service
+	WebSocket, // Received back by a WebSocket client, once per client
+};
+constexpr size_t HOP_COUNT = 4;
+const char* toString(Hop hop);
+
+// Latencies of one hop, kept in full so percentiles are exact
+class LatencyLog {
+public:
+	void record(std::chrono::nanoseconds latency);
+
+	struct Summary {
+		size_t count   = 0;
+		double p50_ms  = 0;
+		double p99_ms  = 0;
+		double p999_ms = 0;
+		double max_ms  = 0;
+	};
+	Summary summarize() const;
+
+private:
+	mutable std::mutex lock_;
+	std::vector<int64_t> latencies_ns_;
+};
+
+// Open-loop load against POST /denm or WebSocket publishing, with the DENMs looped back to WebSocket clients.
+//
+// DENM i is scheduled at start + i / rate. Every latency is measured from that scheduled time rather than from
+// when a connection actually got to send it, so a stalled service shows up as latency of every DENM that
+// should have been sent meanwhile instead of as fewer samples (no coordinated omission). DENM i carries
+// actionID (FIRST_STATION + i / 65536, i % 65536), which identifies it again at the broker and in the
+// WebSocket frames without any lookup table. A WebSocket connection keeps at most ws_window DENMs
+// unacknowledged, a DENM waiting for the window is late like one waiting for an HTTP connection.
+class LoadGenerator {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr uint32_t FIRST_STATION = 1000000;
+
+	// Throws std::invalid_argument if the rate or duration is not positive or too many DENMs are scheduled
+	explicit LoadGenerator(const LoadOptions& options);
+
+	// The randomized DENM with index i, the same for the same i
+	nlohmann::json makeDenm(uint64_t i) const;
+
+	// Connect the WebSocket clients and send probe DENMs until one comes back, throws after `timeout`
+	void connect(std::chrono::seconds timeout);
+	// Send rate * duration DENMs and wait for the drain time
+	void run();
+
+	// For the broker observer: record a DENM seen at `hop` now
+	void seen(Hop hop, uint32_t station_id, uint16_t sequence_number);
+
+	// Throughput, errors and latency percentiles of every hop
+	nlohmann::json report() const;
+
+private:
+	Clock::time_point scheduledAt(uint64_t i) const;
+	void runHttpConnection();
+	void runWsPublisher();
+	void runWsClient(size_t client);
+
+	LoadOptions options_;
+	uint64_t total_ = 0;
+	Clock::time_point start_;
+	Clock::time_point end_;
+	std::atomic<uint64_t> next_{0};
+	std::atomic<bool> running_{false};
+	std::atomic<bool> probe_seen_{false};
+	std::atomic<uint64_t> http_errors_{0};
+	std::atomic<uint64_t> ws_errors_{0}; // Failed acknowledgements and WebSocket publishers that failed
+	std::atomic<uint64_t> sent_{0};
+	std::vector<std::thread> ws_threads_;
+	std::vector<int> ws_sockets_; // Native handles, shut down to end the blocking reads
+	std::mutex ws_sockets_lock_;
+	LatencyLog logs_[HOP_COUNT];
+};
+
+#endif // LOAD_GENERATOR_HPP
@@ -0,0 +1,172 @@
+#include "denm_message.hpp"
+#include "denm_service.hpp"
+#include "interchange_service.hpp"
+#include "load_generator.hpp"
+#include "support/loopback_broker.hpp"
+#include <boost/program_options.hpp>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <spdlog/spdlog.h>
+
+namespace {
+const char* const SEND_ADDRESS	  = "del-loadgen";
+const char* const RECEIVE_ADDRESS = "loc-loadgen";
+
+void parseArea(const std::string& area, LoadOptions& options) {
+	char comma;
+	std::istringstream in(area);
+	in >> options.min_latitude >> comma >> options.min_longitude >> comma >> options.max_latitude >> comma >>
+	  options.max_longitude;
+	if (!in || options.min_latitude >= options.max_latitude || options.min_longitude >= options.max_longitude)
+		throw std::invalid_argument("Invalid area: " + area);
+}
+
+PublishMode parseMode(const std::string& mode) {
+	if (mode == "http")
+		return PublishMode::Http;
+	if (mode == "ws")
+		return PublishMode::WebSocket;
+	throw std::invalid_argument("Invalid publish mode: " + mode);
+}
+
+void printReport(const nlohmann::json& report) {
+	std::printf("%llu DENMs scheduled at %.0f/s, %llu sent in %.1f s, %llu HTTP errors, %llu WebSocket errors\n",
+				report["scheduled"].get<unsigned long long>(),
+				report["rate"].get<double>(),
+				report["sent"].get<unsigned long long>(),
+				report["seconds"].get<double>(),
+				report["httpErrors"].get<unsigned long long>(),
+				report["wsErrors"].get<unsigned long long>());
+	std::printf("%-10s %10s %10s %10s %10s %10s %10s %10s\n",
+				"hop",
+				"count",
+				"missing",
+				"per s",
+				"p50 ms",
+				"p99 ms",
+				"p999 ms",
+				"max ms");
+	for (const auto& hop : report["hops"].items()) {
+		const auto& h = hop.value();
+		std::printf("%-10s %10llu %10s %10.0f %10.2f %10.2f %10.2f %10.2f\n",
+					hop.key().c_str(),
+					h["count"].get<unsigned long long>(),
+					h.contains("missing") ? std::to_string(h["missing"].get<unsigned long long>()).c_str() : "-",
+					h["throughput"].get<double>(),
+					h["p50Ms"].get<double>(),
+					h["p99Ms"].get<double>(),
+					h["p999Ms"].get<double>(),
+					h["maxMs"].get<double>());
+	}
+}
+} // namespace
+
+int main(int argc, char** argv) {
+	try {
+		namespace po = boost::program_options;
+
+		po::options_description desc("Allowed options");
+		desc.add_options()("help,h", "produce help message")(
+		  "rate,r", po::value<double>()->default_value(1000), "DENMs per second, sent on schedule (open loop)")(
+		  "duration,d", po::value<long>()->default_value(10), "seconds to send DENMs for")(
+		  "publish",
+		  po::value<std::string>()->default_value("http"),
+		  "publish with POST /denm (http) or {\"type\": \"publish\"} WebSocket messages (ws)")(
+		  "connections", po::value<size_t>()->default_value(8), "keep-alive HTTP or publishing WebSocket connections")(
+		  "ws-window",
+		  po::value<size_t>()->default_value(64),
+		  "unacknowledged DENMs per publishing WebSocket connection, at most the service's --ws-publish-window")(
+		  "ws-clients", po::value<size_t>()->default_value(4), "WebSocket clients receiving every DENM")(
+		  "area",
+		  po::value<std::string>()->default_value("59.80,10.60,60.00,10.90"),
+		  "event positions as minLatitude,minLongitude,maxLatitude,maxLongitude")(
+		  "host", po::value<std::string>()->default_value("127.0.0.1"), "service host")(
+		  "http-port", po::value<int>()->default_value(18080), "service HTTP port")(
+		  "ws-port", po::value<int>()->default_value(0), "service WebSocket port (default: the HTTP port)")(
+		  "external",
+		  po::bool_switch(),
+		  "drive a running service instead of starting one; it must use the broker of the load generator")(
+		  "broker-port", po::value<int>()->default_value(5672), "port of the loopback AMQP broker")(
+		  "drain-ms", po::value<long>()->default_value(2000), "wait for DENMs in flight after the last one")(
+		  "json", po::bool_switch(), "print the report as JSON")(
+		  "log-level,l", po::value<std::string>()->default_value("warn"), "logging level (debug, info, warn, error)");
+
+		po::variables_map vm;
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+
+		if (vm.count("help")) {
+			std::cout << desc << "\n";
+			return 0;
+		}
+		spdlog::set_level(spdlog::level::from_str(vm["log-level"].as<std::string>()));
+
+		LoadOptions options;
+		options.host		= vm["host"].as<std::string>();
+		options.http_port	= vm["http-port"].as<int>();
+		options.ws_port		= vm["ws-port"].as<int>() > 0 ? vm["ws-port"].as<int>() : options.http_port;
+		options.rate		= vm["rate"].as<double>();
+		options.duration	= std::chrono::seconds(vm["duration"].as<long>());
+		options.mode		= parseMode(vm["publish"].as<std::string>());
+		options.connections = vm["connections"].as<size_t>();
+		options.ws_window	= vm["ws-window"].as<size_t>();
+		options.ws_clients	= vm["ws-clients"].as<size_t>();
+		options.drain		= std::chrono::milliseconds(vm["drain-ms"].as<long>());
+		parseArea(vm["area"].as<std::string>(), options);
+		LoadGenerator generator(options);
+
+		// Stand-in for the interchange: what the service sends comes back on its receive address
+		LoopbackBroker broker("127.0.0.1", vm["broker-port"].as<int>());
+		broker.route(SEND_ADDRESS, RECEIVE_ADDRESS);
+		broker.setObserver([&generator](const std::string&, const proton::message& m) {
+			if (m.body().type() != proton::BINARY)
+				return;
+			try {
+				DenmMessage denm;
+				denm.fromUper(proton::get<proton::binary>(m.body()));
+				auto action = denm.actionInfo();
+				generator.seen(Hop::Broker, action.originating_station_id, action.sequence_number);
+			} catch (const std::exception& e) {
+				spdlog::warn("Broker received an undecodable DENM: {}", e.what());
+			}
+		});
+		broker.start();
+
+		std::unique_ptr<InterchangeService> interchange;
+		std::unique_ptr<DenmService> service;
+		if (vm["external"].as<bool>()) {
+			std::fprintf(stderr,
+						 "Waiting for the service, start it with --amqp-url %s --amqp-send %s --amqp-receive %s\n",
+						 broker.url().c_str(),
+						 SEND_ADDRESS,
+						 RECEIVE_ADDRESS);
+		} else {
+			interchange =
+			  std::make_unique<InterchangeService>("loadgen", broker.url(), SEND_ADDRESS, RECEIVE_ADDRESS, "");
+			DenmServiceOptions service_options;
+			service = std::make_unique<DenmService>(options.host, options.http_port, options.ws_port, service_options);
+			interchange->start();
+			service->start();
+		}
+
+		generator.connect(std::chrono::seconds(vm["external"].as<bool>() ? 300 : 30));
+		generator.run();
+		auto report = generator.report();
+		if (vm["json"].as<bool>()) {
+			std::cout << report.dump(2) << "\n";
+		} else {
+			printReport(report);
+		}
+
+		if (service)
+			service->stop();
+		if (interchange)
+			interchange->stop();
+		broker.stop();
+		return 0;
+	} catch (const std::exception& e) {
+		spdlog::error("Error: {}", e.what());
+		return 1;
+	}
+}